@@ -11,6 +11,7 @@ namespace DJAutoMixApp.Services
     {
         private System.Timers.Timer? positionTimer;
         private readonly int deckId;
+        private uint lastEndCount;
 
         public string DeckName { get; private set; }
         public string? CurrentTrackPath { get; private set; }
@@ -103,12 +104,10 @@ namespace DJAutoMixApp.Services
             Tempo = 1.0;
             Pitch = 0.0;
 
-            // Timer for position updates (UI feedback)
+            // Timer for position updates (UI feedback), read from the engine
+            // status block rather than one query per value
             positionTimer = new System.Timers.Timer(50);
-            positionTimer.Elapsed += (s, e) =>
-            {
-                PositionChanged?.Invoke(this, CurrentPosition);
-            };
+            positionTimer.Elapsed += (s, e) => PollStatus();
         }
 
         public void LoadTrack(string filePath, double bpm = 0, double beatOffset = 0)
@@ -163,6 +162,22 @@ namespace DJAutoMixApp.Services
             }
         }
 
+        private void PollStatus()
+        {
+            if (AudioEngineInterop.engine_read_status(out var status) != 0 || deckId >= status.DeckCount)
+                return;
+
+            var deck = status.Decks[deckId];
+            PositionChanged?.Invoke(this, TimeSpan.FromSeconds(deck.PositionSeconds));
+
+            if (deck.EndCount != lastEndCount)
+            {
+                lastEndCount = deck.EndCount;
+                positionTimer?.Stop();
+                TrackEnded?.Invoke(this, EventArgs.Empty);
+            }
+        }
+
         public void EnableSync(AudioDeck master)
         {
             if (master == this) return;
@@ -208,6 +223,10 @@ namespace DJAutoMixApp.Services
                     AudioEngineInterop.deck_play(deckId);
                 }
                 
+                // Only ends from here on count
+                if (AudioEngineInterop.engine_read_status(out var status) == 0 && deckId < status.DeckCount)
+                    lastEndCount = status.Decks[deckId].EndCount;
+
                 positionTimer?.Start();
                 PlaybackStarted?.Invoke(this, EventArgs.Empty);
             }
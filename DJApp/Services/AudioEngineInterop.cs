@@ -3,6 +3,202 @@ using System.Runtime.InteropServices;
 
 namespace DJAutoMixApp.Services
 {
+    /// <summary>
+    /// One waveform_bin_t of the engine's waveform pyramid
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential, Pack = 1)]
+    public struct WaveformBin
+    {
+        public sbyte Min;
+        public sbyte Max;
+        public byte Rms;
+        public byte Low;
+        public byte Mid;
+        public byte High;
+        public ushort Reserved;
+    }
+
+    /// <summary>
+    /// audio_host_api_info_t, from engine_get_host_api_info
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Ansi)]
+    public struct AudioHostApiInfo
+    {
+        public const int DirectSound = 1;
+        public const int Mme = 2;
+        public const int Asio = 3;
+        public const int WdmKs = 11;
+        public const int Wasapi = 13;
+
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 64)]
+        public string Name;
+        public int Type;
+        public int DeviceCount;
+        public int DefaultOutputDevice;
+    }
+
+    /// <summary>
+    /// audio_device_info_t, from engine_get_device_info
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Ansi)]
+    public struct AudioDeviceInfo
+    {
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 128)]
+        public string Name;
+        public int HostApi;
+        public int HostApiType;
+        public int MaxOutputChannels;
+        public double DefaultSampleRate;
+        public double DefaultLowLatencySeconds;
+        public double DefaultHighLatencySeconds;
+        public int IsDefault;
+    }
+
+    /// <summary>
+    /// audio_output_config_t, for engine_start_device and engine_probe_latency
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct AudioOutputConfig
+    {
+        public const int AutomaticDevice = -1;
+        public const int Exclusive = 1;   // WASAPI exclusive mode
+        public const int Cue = 2;         // Four channels: master on 1/2, cue on 3/4
+
+        public int Device;
+        public int BufferFrames;          // 0 = engine_init's buffer size
+        public double SuggestedLatencySeconds;  // 0 = the device's low latency
+        public int Flags;
+        public int AsioFirstChannel;      // 0 = from output 1
+    }
+
+    /// <summary>
+    /// audio_latency_probe_t, filled by engine_probe_latency
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct AudioLatencyProbe
+    {
+        public int BufferFrames;
+        public double OutputLatencySeconds;
+        public double ReportedLatencySeconds;
+        public int SizesTried;
+    }
+
+    /// <summary>
+    /// One deck_status_t of the engine status block
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct DeckStatus
+    {
+        public double PositionSeconds;
+        public double DurationSeconds;
+        public double Phase;
+        public double Tempo;
+        public double Bpm;
+        public float PeakLeft;
+        public float PeakRight;
+        public int Playing;
+        public uint EndCount;
+        public double LoopStartSeconds;
+        public double LoopEndSeconds;
+        public int Looping;
+        public int Rolling;
+        public float AutoGainDb;          // Applied pre-fader, 0 when off
+    }
+
+    /// <summary>
+    /// engine_status_t, copied out by engine_read_status
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct EngineStatus
+    {
+        public const int MaxDecks = 8;
+
+        public ulong Blocks;
+        public float MasterPeakLeft;
+        public float MasterPeakRight;
+        public int DeckCount;
+        public float Crossfader;   // 0.0 = A, 1.0 = B; follows automation
+        public float CpuLoad;      // Device's estimate, 0.0 - 1.0
+        public float CallbackLoad; // Last callback's time over its buffer's duration
+        public uint Xruns;
+        public uint DeadlineMisses;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = MaxDecks)]
+        public DeckStatus[] Decks;
+    }
+
+    /// <summary>
+    /// perf_timing_t: per block, in microseconds
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct PerfTiming
+    {
+        public double MeanUs;
+        public double MaxUs;
+    }
+
+    /// <summary>
+    /// engine_perf_t, copied out by engine_get_perf
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct EnginePerf
+    {
+        public const int HistogramBuckets = 16;  // Eighths of the deadline
+        public const int StageCount = 5;         // Deck render, stretch, EQ, mix, sync
+
+        public ulong Callbacks;
+        public ulong Blocks;
+        public ulong InputUnderflows;
+        public ulong InputOverflows;
+        public ulong OutputUnderflows;
+        public ulong OutputOverflows;
+        public ulong DeadlineMisses;
+        public double DeadlineUs;
+        public double LastCallbackUs;
+        public double MeanCallbackUs;
+        public double MaxCallbackUs;
+        public double MaxLatenessUs;
+        public double CpuLoad;
+        public double OutputLatencyUs;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = HistogramBuckets)]
+        public ulong[] Histogram;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = StageCount)]
+        public PerfTiming[] Stages;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = EngineStatus.MaxDecks)]
+        public PerfTiming[] Decks;
+
+        public ulong DroppedCommands;
+    }
+
+    /// <summary>
+    /// analysis_features_t, filled by audio_analyze_features and analysis_get_features
+    /// </summary>
+    [StructLayout(LayoutKind.Sequential)]
+    public struct AnalysisFeatures
+    {
+        public const int ChromaBins = 12;
+        public const int Bands = 3;       // Split at 250 Hz and 2.5 kHz
+
+        public double Bpm;
+        public double FirstBeatSeconds;
+        public double LoudnessDb;
+        public int Key;                   // 0 - 11 C to B major, 12 - 23 minor, -1 none
+        public float KeyStrength;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = ChromaBins)]
+        public float[] Chroma;
+
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = Bands)]
+        public float[] BandEnergy;
+
+        public int HasLoudness;           // EBU R128 figures below are valid
+        public double IntegratedLufs;
+        public double TruePeakDb;
+    }
+
     /// <summary>
     /// P/Invoke wrapper for the C++ audio engine
     /// </summary>
@@ -14,6 +210,9 @@ namespace DJAutoMixApp.Services
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern int engine_init(int sampleRate, int bufferSize);
 
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_init_decks(int sampleRate, int bufferSize, int deckCount); // 1 - 8 decks
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void engine_shutdown();
 
@@ -23,10 +222,80 @@ namespace DJAutoMixApp.Services
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void engine_stop();
 
+        // Output devices (indexed as PortAudio lists them) and the latency probe
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_get_host_api_count();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_get_host_api_info(int hostApi, out AudioHostApiInfo info);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_get_device_count();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_get_device_info(int device, out AudioDeviceInfo info);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_start_device(ref AudioOutputConfig config);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_probe_latency(ref AudioOutputConfig config, double secondsPerSize,
+                                                      out AudioLatencyProbe result);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_get_deck_count();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_set_render_threads(int count); // 0 = serial; only while stopped
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_set_render_ahead(int blocks); // Buffers rendered ahead, 0 - 8; only while stopped
+
+        // Track loading (mode: 0 = full decode, 1 = progressive)
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void engine_set_load_mode(int mode, double prerollSeconds);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void engine_set_storage_format(int format); // 0 = float32, 1 = int16, 2 = half-float
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void engine_set_streaming_threshold(double seconds);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern void engine_set_pcm_cache([MarshalAs(UnmanagedType.LPStr)] string directory, double maxMegabytes); // null/0 disables
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void engine_set_track_cache(double maxMegabytes); // In-memory preloads (default 512, 0 disables)
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int engine_set_analysis_database([MarshalAs(UnmanagedType.LPStr)] string path); // null disables
+
+        // Diagnostics
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void engine_set_log_level(int level); // 0 = debug ... 3 = error, 4 = off
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern void engine_set_log_file([MarshalAs(UnmanagedType.LPStr)] string path);
+
         // Deck operations
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         public static extern int deck_load_track(int deckId, [MarshalAs(UnmanagedType.LPStr)] string filePath);
 
+        // Loads an encoded MP3/WAV/FLAC from memory (format from its magic bytes, else
+        // formatHint). With a release callback data is decoded in place - keep it pinned
+        // and the delegate alive until release runs, exactly once; without one it's copied.
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        public delegate void BufferReleaseCallback(IntPtr userData); // Maybe on an engine thread
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int deck_load_track_memory(int deckId, IntPtr data, UIntPtr size,
+            [MarshalAs(UnmanagedType.LPStr)] string? formatHint, BufferReleaseCallback? release, IntPtr userData);
+
+        // Decodes and analyzes a track in the background for a later deck_load_track.
+        // Returns an analysis job handle to release, 0 if already cached, -1 on error.
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int deck_preload([MarshalAs(UnmanagedType.LPStr)] string filePath);
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void deck_unload_track(int deckId);
 
@@ -51,19 +320,95 @@ namespace DJAutoMixApp.Services
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern double deck_get_duration(int deckId);
 
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern double deck_get_decoded_duration(int deckId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern double deck_get_load_progress(int deckId);
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern int deck_is_playing(int deckId);
 
+        // Scheduled transport: at a stream frame, or with atFrame < 0 on the
+        // quantize deck's next multiple of quantizeBeats (1 = beat, 4 = bar)
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern long engine_get_stream_frame();
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int deck_schedule_play(int deckId, long atFrame, int quantizeDeck, int quantizeBeats);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int deck_schedule_pause(int deckId, long atFrame, int quantizeDeck, int quantizeBeats);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int deck_schedule_set_position(int deckId, double positionSeconds, long atFrame,
+                                                            int quantizeDeck, int quantizeBeats);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void engine_cancel_scheduled(int deckId);
+
+        // Hot cues: jumps play from the next frame, from a stretcher primed in the background
+        public const int HotCueCount = 8;
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_set_hot_cue(int deckId, int index, double positionSeconds);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_clear_hot_cue(int deckId, int index);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern double deck_get_hot_cue(int deckId, int index);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_hot_cue(int deckId, int index);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int deck_schedule_hot_cue(int deckId, int index, long atFrame, int quantizeDeck,
+                                                       int quantizeBeats);
+
+        // Loops: sample-accurate, crossfaded wraps; a roll releases with beats <= 0
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_loop_in(int deckId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_loop_out(int deckId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_set_loop(int deckId, double startSeconds, double endSeconds);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_loop_beats(int deckId, double beats);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_loop_exit(int deckId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_loop_roll(int deckId, double beats);
+
+        // Renders the scripted mix to a float WAV, faster than real time; stream must be stopped
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int engine_render_offline(string wavPath, double seconds);
+
         // Deck parameters
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void deck_set_volume(int deckId, float volume);
 
+        // Pre-fader gain to targetLufs (e.g. -14); a track still being measured waits for a pause
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_set_auto_gain(int deckId, int enabled, double targetLufs);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int deck_get_loudness(int deckId, out double integratedLufs, out double truePeakDb);
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void deck_set_tempo(int deckId, double tempo);
 
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void deck_set_pitch(int deckId, double semitones);
 
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void deck_set_stretch_mode(int deckId, int mode);
+
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void deck_set_bpm(int deckId, double bpm);
 
@@ -73,6 +418,30 @@ namespace DJAutoMixApp.Services
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void deck_set_beat_offset(int deckId, double offsetSeconds);
 
+        // Beat grid: beats points at count doubles (seconds) until the handle is released
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr deck_acquire_beat_grid(int deckId, out IntPtr beats, out int count);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void beat_grid_release(IntPtr grid);
+
+        // Waveform pyramid: levels 0 - 3 of 64, 256, 1024 and 4096 frames per
+        // bin; bins points at binCount WaveformBin until the handle is released
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr deck_acquire_waveform(int deckId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern IntPtr waveform_get_level(IntPtr waveform, int level, out long binCount, out int framesPerBin);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void waveform_release(IntPtr waveform);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern double deck_get_nearest_beat(int deckId, double positionSeconds);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern double deck_get_beat_phase(int deckId);
+
         // EQ
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void deck_set_eq_low(int deckId, float gain);
@@ -87,6 +456,19 @@ namespace DJAutoMixApp.Services
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void mixer_set_crossfader(float position);
 
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void mixer_set_crossfader_assign(int deckId, int side); // 0 = A, 1 = B, 2 = thru
+
+        // Cue bus (headphones), on a stream opened with AudioOutputConfig.Cue
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void mixer_set_pfl(int deckId, int enabled);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void mixer_set_cue_mix(float mix); // 0.0 = cue only, 1.0 = master only
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void mixer_set_cue_volume(float volume);
+
         // Sync
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void sync_enable(int slaveDeckId, int masterDeckId);
@@ -97,7 +479,38 @@ namespace DJAutoMixApp.Services
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern void sync_align_now(int slaveDeckId, int masterDeckId);
 
-        // Callbacks
+        // Automation, interpolated by the audio thread. startFrame < 0 starts now.
+        public const int AutomationCrossfader = 0;
+        public const int AutomationVolume = 1;
+        public const int AutomationEqLow = 2;
+        public const int AutomationEqMid = 3;
+        public const int AutomationEqHigh = 4;
+        public const int AutomationTempo = 5;
+
+        public const int ShapeLinear = 0;
+        public const int ShapeSCurve = 1;
+        public const int ShapeEaseIn = 2;
+        public const int ShapeEaseOut = 3;
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void automation_ramp(int target, int deckId, double value, long startFrame,
+                                                  double durationSeconds, int shape);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void automation_cancel(int target, int deckId);
+
+        // Status block, rewritten by the audio thread every block; never blocks it
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_read_status(out EngineStatus status);
+
+        // Performance counters: callback timing, xruns and per-stage times
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_get_perf(out EnginePerf perf);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void engine_reset_perf();
+
+        // Callbacks (run on an engine notifier thread, never the audio thread)
         [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
         public delegate void PositionCallback(int deckId, double position);
 
@@ -116,5 +529,50 @@ namespace DJAutoMixApp.Services
 
         [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
         public static extern double audio_analyze_beat_offset(int deckId, double bpm);
+
+        // FFT behind every analysis: 0 = double-precision reference (default), 1 = SIMD float
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int engine_set_analysis_fft(int backend);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int audio_analyze_features(int deckId, out AnalysisFeatures features);
+
+        // Background analysis (flags: 1 = background priority, 2 = preview first;
+        // status: 0 queued, 1 running, 2 done, 3 failed, 4 cancelled, 5 preview
+        // ready, -1 unknown handle)
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        public delegate void AnalysisCallback(int jobId, int status); // On an analysis thread
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int analysis_submit_deck(int deckId, int flags);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int analysis_submit_file([MarshalAs(UnmanagedType.LPStr)] string filePath, int flags);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern int analysis_submit_files(
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPStr)] string[] filePaths,
+            int count, int flags, [Out] int[] jobIds);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int analysis_get_status(int jobId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern double analysis_get_progress(int jobId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int analysis_get_result(int jobId, out double bpm, out double firstBeatSeconds);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern int analysis_get_features(int jobId, out AnalysisFeatures features);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void analysis_cancel(int jobId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void analysis_release(int jobId);
+
+        [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+        public static extern void set_analysis_callback(AnalysisCallback callback);
     }
 }
@@ -19,6 +19,7 @@ namespace DJAutoMixApp.Services
         private bool isMixing = false;
         private bool isAutoMixEnabled = false;
         private int mixDurationSeconds = 10; // Duration of crossfade in seconds
+        private const int PreloadTrackCount = 2; // Playlist entries decoded ahead of the one loaded
         
         public event EventHandler<double>? CrossfaderPositionChanged;
         public event EventHandler<string>? StatusChanged;
@@ -100,6 +101,11 @@ namespace DJAutoMixApp.Services
         public void StopAutoMix()
         {
             mixTimer?.Stop();
+            if (isMixing)
+            {
+                // Leave the fader where the fade had got to
+                AudioEngineInterop.automation_cancel(AudioEngineInterop.AutomationCrossfader, -1);
+            }
             isMixing = false;
             StatusChanged?.Invoke(this, "Auto-mix disabled");
         }
@@ -215,27 +221,25 @@ namespace DJAutoMixApp.Services
             DJAutoMixApp.App.Log($"StartMix: About to play nextDeck, IsSyncEnabled={nextDeck?.IsSyncEnabled}");
             nextDeck?.Play();
 
-            // Start crossfade
-            var mixSteps = mixDurationSeconds * 10; // Update 10 times per second
-            var currentStep = 0;
+            // The engine runs the crossfade itself, sample-smooth; the timer
+            // only mirrors the fader for the UI and finishes the transition
+            double target = activeDeck == deckA ? 1.0 : 0.0;
+            AudioEngineInterop.automation_ramp(AudioEngineInterop.AutomationCrossfader, -1, target, -1,
+                                               mixDurationSeconds, AudioEngineInterop.ShapeLinear);
+            var mixEnd = DateTime.UtcNow.AddSeconds(mixDurationSeconds);
 
             mixTimer = new System.Timers.Timer(100); // 100ms interval
             mixTimer.Elapsed += (s, e) =>
             {
-                currentStep++;
-                var progress = (double)currentStep / mixSteps;
-
-                // Update crossfader position - smooth transition from one side to the other
-                if (activeDeck == deckA)
-                {
-                    CrossfaderPosition = progress * 100; // Move from 0 to 100
-                }
-                else
+                if (AudioEngineInterop.engine_read_status(out var status) == 0)
                 {
-                    CrossfaderPosition = (1 - progress) * 100; // Move from 100 to 0
+                    // Not through the setter, which would take the fader back
+                    // from the automation
+                    crossfaderPosition = status.Crossfader * 100.0;
+                    CrossfaderPositionChanged?.Invoke(this, crossfaderPosition);
                 }
 
-                if (currentStep >= mixSteps)
+                if (DateTime.UtcNow >= mixEnd)
                 {
                     CompleteMixTransition();
                 }
@@ -324,6 +328,7 @@ namespace DJAutoMixApp.Services
                 // Pass beat offset for accurate phase sync
                 deck.LoadTrack(track.FilePath, track.BPM, track.BeatOffset);
                 StatusChanged?.Invoke(this, $"Loaded: {track.Title} ({track.BPM:F1} BPM)");
+                PreloadTracksAfter(track);
             }
             catch (Exception ex)
             {
@@ -331,6 +336,18 @@ namespace DJAutoMixApp.Services
             }
         }
 
+        private void PreloadTracksAfter(Models.PlaylistItem track)
+        {
+            // The engine decodes and analyzes these in the background, so the
+            // next loads attach at once; nothing here waits on the jobs
+            foreach (var upcoming in playlistManager.TracksAfter(track, PreloadTrackCount))
+            {
+                int jobId = AudioEngineInterop.deck_preload(upcoming.FilePath);
+                if (jobId > 0)
+                    AudioEngineInterop.analysis_release(jobId);
+            }
+        }
+
         private void UpdateDeckVolumes()
         {
             // Update C++ engine's mixer crossfader directly
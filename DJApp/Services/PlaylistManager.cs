@@ -25,6 +25,15 @@ namespace DJAutoMixApp.Services
             : null;
 
         public bool HasNext => currentIndex + 1 < playlist.Count;
+
+        /// <summary>
+        /// Up to count entries following item, in playlist order
+        /// </summary>
+        public IEnumerable<PlaylistItem> TracksAfter(PlaylistItem item, int count)
+        {
+            var index = playlist.IndexOf(item);
+            return index < 0 ? Enumerable.Empty<PlaylistItem>() : playlist.Skip(index + 1).Take(count);
+        }
         public bool HasPrevious => currentIndex > 0;
 
         public event EventHandler? PlaylistChanged;
@@ -0,0 +1,404 @@
+// Headless render benchmark. Drives the engine graph block by block through
+// renderEngineBlock(), with no output device, over a matrix of scenarios:
+// deck count, block size, stretch engine, EQ and sync. Prints one JSON
+// object per line - a "meta" record, then one "render" record per
+// scenario with the cost per frame, the worst block against the real-time
+// deadline and the engine's own stage timings - so runs can be diffed
+// across versions. Ahead of those, "fft" records time the analysis FFT
+// backends and check the fast one against the double-precision reference
+// at every size the analysis plans, failing the run past a tolerance, and
+// "analysis" records time a whole analysis of each track per backend.
+//
+//   djengine_bench [--track file]... [--seconds s] [--threads n] [--quick]
+//
+// Without --track it renders a synthetic track written to the temp folder.
+// Decks sync on each track's analyzed BPM (the synthetic one's is known).
+
+#include "dj_audio_engine.h"
+#include "dj_audio_internal.h"
+#include "dr_wav.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const int SAMPLE_RATE = 44100;
+
+// Renders before timing starts, so stretchers and EQ glides have settled
+const double WARMUP_SECONDS = 0.5;
+
+// Synthetic fixture: a minute of kick, hats and a pad at 120 BPM
+const double SYNTHETIC_SECONDS = 60.0;
+const double SYNTHETIC_BPM = 120.0;
+
+// Tempo offsets of stretched decks, one per deck so no two stretch alike
+const double STRETCH_TEMPO_STEP = 0.015;
+
+// Analysis FFT sizes - the onset frames at full rate and at the preview
+// tier's decimations, and the key frames - and transforms timed per
+// backend and size
+const int FFT_SIZES[] = { 128, 256, 512, 1024, 4096 };
+const int FFT_TRANSFORMS = 20000;
+const int FFT_TRANSFORMS_QUICK = 2000;
+
+// Worst fast-backend bin error, relative to the reference's largest bin,
+// before the run fails: a few float roundings per radix-4 stage
+const double FFT_MAX_REL_ERROR = 1e-5;
+
+const char* const FFT_BACKEND_NAMES[] = { "reference", "fast" };
+const char* const STRETCH_NAMES[] = { "bypass", "vinyl", "soundtouch" };
+const char* const STAGE_NAMES[DJ_PERF_STAGE_COUNT] = { "deck_render", "stretch", "eq", "mix", "sync" };
+const int STRETCH_BYPASS = 0;
+
+struct Options {
+    std::vector<std::string> tracks;
+    double seconds = 2.0;
+    int threads = -1;  // Engine default
+    bool quick = false;
+};
+
+struct Scenario {
+    int decks;
+    int block;
+    int stretch;  // STRETCH_NAMES index
+    bool eq;
+    bool sync;
+};
+
+struct Result {
+    int64_t frames = 0;
+    double total_ns = 0.0;
+    double p99_ns = 0.0;
+    double worst_ns = 0.0;
+    engine_perf_t perf = {};  // The engine's own per-stage timings
+};
+
+bool writeSyntheticTrack(const std::string& path) {
+    const int64_t frames = static_cast<int64_t>(SYNTHETIC_SECONDS * SAMPLE_RATE);
+    const double beat_frames = 60.0 / SYNTHETIC_BPM * SAMPLE_RATE;
+    const double two_pi = 6.283185307179586;
+    
+    std::vector<float> samples(static_cast<size_t>(frames) * 2);
+    uint32_t noise = 22222;
+    for (int64_t i = 0; i < frames; i++) {
+        double t = static_cast<double>(i) / SAMPLE_RATE;
+        double since_beat = std::fmod(static_cast<double>(i), beat_frames) / SAMPLE_RATE;
+        double since_hat = std::fmod(i + beat_frames / 2.0, beat_frames) / SAMPLE_RATE;
+        
+        noise = noise * 1664525u + 1013904223u;
+        double white = static_cast<int32_t>(noise) / 2147483648.0;
+        
+        double kick = std::sin(two_pi * (50.0 + 80.0 * std::exp(-since_beat * 30.0)) * since_beat) * std::exp(-since_beat * 8.0);
+        double hat = white * std::exp(-since_hat * 60.0) * 0.2;
+        double pad = 0.08 * (std::sin(two_pi * 220.0 * t) + std::sin(two_pi * 277.18 * t) + std::sin(two_pi * 329.63 * t));
+        
+        samples[i * 2] = static_cast<float>(0.5 * kick + hat + pad);
+        samples[i * 2 + 1] = static_cast<float>(0.5 * kick - hat + pad);
+    }
+    
+    drwav_data_format format;
+    format.container = drwav_container_riff;
+    format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+    format.channels = 2;
+    format.sampleRate = SAMPLE_RATE;
+    format.bitsPerSample = 32;
+    
+    drwav wav;
+    if (!drwav_init_file_write(&wav, path.c_str(), &format, nullptr)) return false;
+    bool ok = drwav_write_pcm_frames(&wav, static_cast<drwav_uint64>(frames), samples.data()) == static_cast<drwav_uint64>(frames);
+    drwav_uninit(&wav);
+    return ok;
+}
+
+bool parseOptions(int argc, char** argv, Options* options) {
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--track") && has_value) {
+            options->tracks.push_back(argv[++i]);
+        } else if (!strcmp(argv[i], "--seconds") && has_value) {
+            options->seconds = std::max(0.1, atof(argv[++i]));
+        } else if (!strcmp(argv[i], "--threads") && has_value) {
+            options->threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--quick")) {
+            options->quick = true;
+        } else {
+            fprintf(stderr, "usage: djengine_bench [--track file]... [--seconds s] [--threads n] [--quick]\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// The scenario's deck setup, applied in place since no stream runs
+void setUpDecks(const Scenario& scenario) {
+    engine_cancel_scheduled(-1);
+    for (int i = 0; i < scenario.decks; i++) {
+        deck_set_stretch_mode(i, scenario.stretch == 1 ? 0 : 1);
+        deck_set_tempo(i, scenario.stretch == STRETCH_BYPASS ? 1.0 : 1.0 + STRETCH_TEMPO_STEP * (i + 1));
+        deck_set_eq_low(i, scenario.eq ? 0.5f : 1.0f);
+        deck_set_eq_mid(i, 1.0f);
+        deck_set_eq_high(i, scenario.eq ? 1.5f : 1.0f);
+        deck_set_volume(i, 1.0f / scenario.decks);
+        
+        if (scenario.sync && i > 0) {
+            sync_enable(i, 0);
+        } else {
+            sync_disable(i);
+        }
+        
+        // Spread out, clear of the intro
+        deck_set_position(i, 5.0 + 3.0 * i);
+        deck_play(i);
+    }
+}
+
+Result runScenario(const Scenario& scenario, double seconds, std::vector<float>& output,
+                   std::vector<double>& block_ns) {
+    setUpDecks(scenario);
+    dj::EngineState* engine = dj::g_engine;
+    
+    int64_t warmup = static_cast<int64_t>(WARMUP_SECONDS * SAMPLE_RATE);
+    for (int64_t done = 0; done < warmup; done += scenario.block) {
+        dj::renderEngineBlock(engine, output.data(), scenario.block);
+    }
+    
+    Result result;
+    engine_reset_perf();
+    int64_t frames = static_cast<int64_t>(seconds * SAMPLE_RATE);
+    block_ns.clear();
+    for (int64_t done = 0; done < frames; done += scenario.block) {
+        auto start = std::chrono::steady_clock::now();
+        dj::renderEngineBlock(engine, output.data(), scenario.block);
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        
+        block_ns.push_back(ns);
+        result.total_ns += ns;
+        result.worst_ns = std::max(result.worst_ns, ns);
+        result.frames += scenario.block;
+    }
+    
+    if (!block_ns.empty()) {
+        size_t p99 = std::min(block_ns.size() - 1, block_ns.size() * 99 / 100);
+        std::nth_element(block_ns.begin(), block_ns.begin() + p99, block_ns.end());
+        result.p99_ns = block_ns[p99];
+    }
+    engine_get_perf(&result.perf);
+    return result;
+}
+
+void printResult(const Scenario& scenario, const Result& result, int threads) {
+    double deadline_ns = 1e9 * scenario.block / SAMPLE_RATE;
+    double blocks = static_cast<double>(result.frames) / scenario.block;
+    printf("{\"bench\":\"render\",\"decks\":%d,\"block\":%d,\"stretch\":\"%s\",\"eq\":%s,\"sync\":%s,"
+           "\"threads\":%d,\"frames\":%lld,\"ns_per_frame\":%.2f,\"mean_block_us\":%.2f,"
+           "\"p99_block_us\":%.2f,\"worst_block_us\":%.2f,\"deadline_us\":%.2f,\"worst_load\":%.4f,",
+           scenario.decks, scenario.block, STRETCH_NAMES[scenario.stretch],
+           scenario.eq ? "true" : "false", scenario.sync ? "true" : "false", threads,
+           static_cast<long long>(result.frames), result.total_ns / result.frames,
+           result.total_ns / blocks / 1000.0, result.p99_ns / 1000.0, result.worst_ns / 1000.0,
+           deadline_ns / 1000.0, result.worst_ns / deadline_ns);
+    
+    // Mean and worst per block, summed over the decks
+    printf("\"stages_us\":{");
+    for (int i = 0; i < DJ_PERF_STAGE_COUNT; i++) {
+        printf("%s\"%s\":[%.2f,%.2f]", i ? "," : "", STAGE_NAMES[i],
+               result.perf.stages[i].mean_us, result.perf.stages[i].max_us);
+    }
+    printf("}}\n");
+    fflush(stdout);
+}
+
+std::string jsonString(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// Nanoseconds per forward transform over transforms calls
+double timeFFT(dj::AnalysisFFT& fft, std::vector<float>& input, int transforms) {
+    std::vector<float> reals(static_cast<size_t>(fft.size()) / 2 + 1);
+    std::vector<float> imags(reals.size());
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < transforms; i++) {
+        input[i % input.size()] += 1e-6f;  // Not the same transform every time
+        fft.forward(input.data(), reals.data(), imags.data());
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / transforms;
+}
+
+// False if the fast backend strays from the reference at any size
+bool benchFFT(bool quick) {
+    int transforms = quick ? FFT_TRANSFORMS_QUICK : FFT_TRANSFORMS;
+    bool accurate = true;
+    for (int size : FFT_SIZES) {
+        std::vector<float> input(static_cast<size_t>(size));
+        uint32_t noise = 12345;
+        for (float& sample : input) {
+            noise = noise * 1664525u + 1013904223u;
+            sample = static_cast<int32_t>(noise) / 2147483648.0f;
+        }
+        
+        auto reference = dj::makeAnalysisFFT(dj::FFTBackend::Reference, size);
+        auto fast = dj::makeAnalysisFFT(dj::FFTBackend::Fast, size);
+        std::vector<float> ref_re(static_cast<size_t>(size) / 2 + 1), ref_im(ref_re.size());
+        std::vector<float> fast_re(ref_re.size()), fast_im(ref_re.size());
+        reference->forward(input.data(), ref_re.data(), ref_im.data());
+        fast->forward(input.data(), fast_re.data(), fast_im.data());
+        
+        // Worst bin error against the reference's largest bin
+        double peak = 0.0;
+        double error = 0.0;
+        for (size_t k = 0; k < ref_re.size(); k++) {
+            peak = std::max(peak, std::hypot(static_cast<double>(ref_re[k]), ref_im[k]));
+            error = std::max(error, std::hypot(static_cast<double>(fast_re[k]) - ref_re[k],
+                                               static_cast<double>(fast_im[k]) - ref_im[k]));
+        }
+        
+        double relative = peak > 0.0 ? error / peak : 0.0;
+        bool pass = fast->getBackend() == dj::FFTBackend::Fast && relative <= FFT_MAX_REL_ERROR;
+        accurate = accurate && pass;
+        
+        double reference_ns = timeFFT(*reference, input, transforms);
+        double fast_ns = timeFFT(*fast, input, transforms);
+        printf("{\"bench\":\"fft\",\"size\":%d,\"transforms\":%d,\"reference_ns\":%.1f,\"fast_ns\":%.1f,"
+               "\"speedup\":%.2f,\"max_rel_error\":%.3g,\"pass\":%s}\n",
+               size, transforms, reference_ns, fast_ns, reference_ns / fast_ns, relative, pass ? "true" : "false");
+        fflush(stdout);
+    }
+    return accurate;
+}
+
+// One full analysis of the track per backend, decoded once up front. The
+// BPM found (0 if none) is what the decks sync on later.
+bool benchAnalysis(const std::string& path, double* bpm) {
+    dj::LoadOptions options;
+    options.build_waveform = false;
+    dj::AudioFile track;
+    if (!track.load(path.c_str(), options)) return false;
+    double duration = static_cast<double>(track.getTotalSamples()) / std::max(1, track.getSampleRate());
+    
+    *bpm = 0.0;
+    dj::FFTBackend selected = dj::getAnalysisFFTBackend();
+    for (int backend = 0; backend < 2; backend++) {
+        dj::setAnalysisFFTBackend(static_cast<dj::FFTBackend>(backend));
+        auto start = std::chrono::steady_clock::now();
+        auto result = dj::analyzeTrack(track);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        printf("{\"bench\":\"analysis\",\"track\":%s,\"backend\":\"%s\",\"track_seconds\":%.2f,"
+               "\"seconds\":%.4f,\"x_realtime\":%.1f,\"bpm\":%.3f}\n",
+               jsonString(path).c_str(), FFT_BACKEND_NAMES[backend], duration, seconds,
+               seconds > 0.0 ? duration / seconds : 0.0, result ? result->bpm : 0.0);
+        fflush(stdout);
+        if (result && result->bpm > 0.0 && backend == static_cast<int>(selected)) *bpm = result->bpm;
+    }
+    dj::setAnalysisFFTBackend(selected);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, &options)) return 2;
+    
+    std::string synthetic;
+    if (options.tracks.empty()) {
+        synthetic = (std::filesystem::temp_directory_path() / "djengine_bench_synthetic.wav").string();
+        if (!writeSyntheticTrack(synthetic)) {
+            fprintf(stderr, "djengine_bench: could not write %s\n", synthetic.c_str());
+            return 1;
+        }
+        options.tracks.push_back(synthetic);
+    }
+    
+    std::vector<int> deck_counts = options.quick ? std::vector<int>{ 1, 4 } : std::vector<int>{ 1, 2, 4, 8 };
+    std::vector<int> blocks = options.quick ? std::vector<int>{ 64, 512 }
+                                            : std::vector<int>{ 32, 64, 128, 256, 512, 1024, 2048 };
+    
+    printf("{\"bench\":\"meta\",\"sample_rate\":%d,\"hardware_threads\":%u,\"seconds\":%.2f,\"tracks\":[",
+           SAMPLE_RATE, std::thread::hardware_concurrency(), options.seconds);
+    for (size_t i = 0; i < options.tracks.size(); i++) {
+        printf("%s%s", i ? "," : "", jsonString(options.tracks[i]).c_str());
+    }
+    printf("]}\n");
+    
+    engine_set_log_level(static_cast<int>(dj::LogLevel::Off));
+    bool fft_accurate = benchFFT(options.quick);
+    if (!fft_accurate) fprintf(stderr, "djengine_bench: fast FFT strays from the reference\n");
+    std::vector<double> track_bpms;
+    for (const std::string& track : options.tracks) {
+        double bpm = 0.0;
+        if (!benchAnalysis(track, &bpm)) {
+            fprintf(stderr, "djengine_bench: could not load %s\n", track.c_str());
+            return 1;
+        }
+        
+        // The synthetic track's tempo is known exactly; a user's track goes
+        // by its analysis, and without a BPM its deck simply isn't synced
+        track_bpms.push_back(track == synthetic ? SYNTHETIC_BPM : bpm);
+    }
+    
+    std::vector<float> output(static_cast<size_t>(blocks.back()) * 2);
+    std::vector<double> block_ns;
+    block_ns.reserve(static_cast<size_t>(options.seconds * SAMPLE_RATE / blocks.front()) + 1);
+    
+    int status = fft_accurate ? 0 : 1;
+    for (int decks : deck_counts) {
+        // Tracks load once per deck count; every scenario after reuses them
+        if (engine_init_decks(SAMPLE_RATE, blocks.back(), decks) != 0) {
+            fprintf(stderr, "djengine_bench: engine_init_decks(%d) failed\n", decks);
+            return 1;
+        }
+        engine_set_log_level(static_cast<int>(dj::LogLevel::Off));
+        if (options.threads >= 0) engine_set_render_threads(options.threads);
+        int threads = dj::g_engine->render_pool ? dj::g_engine->render_pool->getWorkerCount() : 0;
+        
+        bool loaded = true;
+        for (int i = 0; i < decks; i++) {
+            size_t index = i % options.tracks.size();
+            const std::string& track = options.tracks[index];
+            if (deck_load_track(i, track.c_str()) != 0) {
+                fprintf(stderr, "djengine_bench: could not load %s\n", track.c_str());
+                loaded = false;
+                break;
+            }
+            if (track_bpms[index] > 0.0) deck_set_bpm(i, track_bpms[index]);
+        }
+        
+        for (int block : blocks) {
+            for (int stretch = 0; loaded && stretch < 3; stretch++) {
+                for (int eq = 0; eq < 2; eq++) {
+                    for (int sync = 0; sync < (decks > 1 ? 2 : 1); sync++) {
+                        Scenario scenario = { decks, block, stretch, eq != 0, sync != 0 };
+                        printResult(scenario, runScenario(scenario, options.seconds, output, block_ns), threads);
+                    }
+                }
+            }
+        }
+        
+        engine_shutdown();
+        if (!loaded) {
+            status = 1;
+            break;
+        }
+    }
+    
+    if (!synthetic.empty()) {
+        std::error_code ignored;
+        std::filesystem::remove(synthetic, ignored);
+    }
+    return status;
+}
@@ -1,6 +1,8 @@
 #ifndef DJ_AUDIO_ENGINE_H
 #define DJ_AUDIO_ENGINE_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -12,31 +14,222 @@ extern "C" {
 #endif
 
 // Engine lifecycle
-DJ_API int engine_init(int sample_rate, int buffer_size);
+DJ_API int engine_init(int sample_rate, int buffer_size);  // Two decks
+DJ_API int engine_init_decks(int sample_rate, int buffer_size, int deck_count);  // 1 - 8 decks
 DJ_API void engine_shutdown();
 DJ_API int engine_start();
 DJ_API void engine_stop();
+DJ_API int engine_get_deck_count();
+DJ_API int engine_set_render_threads(int count);  // Deck render workers (0 = serial); while stopped
+
+// Pipeline mode: a render thread of its own (MMCSS Pro Audio on Windows)
+// keeps blocks buffers of every deck ready ahead of the device, whose
+// callback then only mixes them. Adds that many buffers of latency against
+// dropouts when a block renders slowly: to the output, and to every control
+// but the crossfader, deck volumes and cue mix, which the callback applies
+// in its next buffer. Callback times in engine_perf_t then cover that mix;
+// stage times, and the status block's meters, still the render.
+// 0 = render in the callback (default), up to 8; while stopped.
+DJ_API int engine_set_render_ahead(int blocks);
+
+// Output devices, indexed as PortAudio lists them (inputs included - check
+// max_output_channels). engine_start() opens the first ASIO device, or the
+// default output; engine_start_device() opens a chosen one. Exclusive mode
+// applies to WASAPI devices, asio_first_channel to ASIO ones.
+#define DJ_HOST_API_DIRECTSOUND 1
+#define DJ_HOST_API_MME 2
+#define DJ_HOST_API_ASIO 3
+#define DJ_HOST_API_WDMKS 11
+#define DJ_HOST_API_WASAPI 13
+
+#define DJ_DEVICE_AUTOMATIC -1
+#define DJ_OUTPUT_EXCLUSIVE 1  // WASAPI exclusive mode
+#define DJ_OUTPUT_CUE 2        // Four channels: master on 1/2, cue bus (headphones) on 3/4
+
+typedef struct audio_host_api_info_t {
+    char name[64];
+    int type;                   // DJ_HOST_API_*, or PortAudio's id for others
+    int device_count;
+    int default_output_device;  // -1 if none
+} audio_host_api_info_t;
+
+typedef struct audio_device_info_t {
+    char name[128];             // UTF-8
+    int host_api;               // Index for engine_get_host_api_info
+    int host_api_type;
+    int max_output_channels;
+    double default_sample_rate;
+    double default_low_latency_seconds;
+    double default_high_latency_seconds;
+    int is_default;             // Its host API's default output
+} audio_device_info_t;
+
+typedef struct audio_output_config_t {
+    int device;                 // DJ_DEVICE_AUTOMATIC, or an index
+    int buffer_frames;          // 0 = engine_init's buffer size
+    double suggested_latency_seconds;  // 0 = the device's low latency
+    int flags;                  // DJ_OUTPUT_*
+    int asio_first_channel;     // 0 = from output 1
+} audio_output_config_t;
+
+DJ_API int engine_get_host_api_count();
+DJ_API int engine_get_host_api_info(int host_api, audio_host_api_info_t* info);
+DJ_API int engine_get_device_count();
+DJ_API int engine_get_device_info(int device, audio_device_info_t* info);
+DJ_API int engine_start_device(const audio_output_config_t* config);  // Null = as engine_start()
+
+// Latency probe, while stopped: runs config's device at buffer_frames (or
+// 2048), halving until a size glitches - an xrun, or a callback slower than
+// its buffer - and reports the smallest that ran clean for seconds_per_size.
+// The mix renders as usual throughout, so probe under a realistic load.
+// Leaves the stream stopped; returns -1 if no size ran clean.
+typedef struct audio_latency_probe_t {
+    int buffer_frames;                // For audio_output_config_t, 0 if none ran clean
+    double output_latency_seconds;    // Measured at that size: buffer to DAC, 0 if the host doesn't say
+    double reported_latency_seconds;  // The stream's own figure
+    int sizes_tried;
+} audio_latency_probe_t;
+
+DJ_API int engine_probe_latency(const audio_output_config_t* config, double seconds_per_size,
+                                audio_latency_probe_t* result);
 
-// Deck operations (deck_id: 0 = Deck A, 1 = Deck B)
-DJ_API int deck_load_track(int deck_id, const char* file_path);
+// Track loading (mode: 0 = full decode, 1 = progressive - playable after preroll_seconds)
+DJ_API void engine_set_load_mode(int mode, double preroll_seconds);
+DJ_API void engine_set_storage_format(int format);  // 0 = float32, 1 = int16, 2 = half-float
+DJ_API void engine_set_streaming_threshold(double seconds);  // Longer tracks stream from disk (0 = never)
+DJ_API void engine_set_pcm_cache(const char* directory, double max_megabytes);  // Decoded PCM cache (null/0 = off)
+DJ_API void engine_set_track_cache(double max_megabytes);  // In-memory preloads, LRU (default 512, 0 = off)
+DJ_API int engine_set_analysis_database(const char* path);  // Persistent analyses by file content (null = off)
+
+// Diagnostics (level: 0 = debug, 1 = info, 2 = warning, 3 = error, 4 = off)
+DJ_API void engine_set_log_level(int level);
+DJ_API void engine_set_log_file(const char* path);  // Default: cpp_debug.log in the temp folder
+
+// Deck operations (deck_id: 0 .. engine_get_deck_count() - 1)
+DJ_API int deck_load_track(int deck_id, const char* file_path);  // Takes a preloaded track without decoding
+
+// The same from an encoded MP3, WAV or FLAC file in memory, told apart by
+// its magic bytes, or by format_hint ("mp3", ".flac", a file name) when
+// those don't say. With a release callback the engine decodes from data in
+// place and calls release(user_data) exactly once, when it stops reading
+// it: before returning for a full decode or a failure, later and from an
+// engine thread for progressive and streamed loads. Without one the bytes
+// are copied and may be freed on return.
+typedef void (*buffer_release_callback_t)(void* user_data);
+DJ_API int deck_load_track_memory(int deck_id, const void* data, size_t size, const char* format_hint,
+                                  buffer_release_callback_t release, void* user_data);
+
+// Decodes and analyzes a track any deck may load next, as a background
+// analysis job, into the track cache. Returns the job's handle (release it
+// as any other), 0 if the track is cached already, or -1 (also with the
+// cache disabled). A preload holds the track whole even past the streaming
+// threshold if it fits the cache's budget; one that doesn't fails its job.
+DJ_API int deck_preload(const char* file_path);
 DJ_API void deck_unload_track(int deck_id);
 DJ_API void deck_play(int deck_id);
-DJ_API void deck_play_synced(int deck_id, int master_deck_id);  // Atomically align and play
+DJ_API void deck_play_synced(int deck_id, int master_deck_id);  // Cue at the first kick, start on the master's next beat
 DJ_API void deck_pause(int deck_id);
 DJ_API void deck_stop(int deck_id);
 DJ_API void deck_set_position(int deck_id, double position_seconds);
 DJ_API double deck_get_position(int deck_id);
 DJ_API double deck_get_duration(int deck_id);
+DJ_API double deck_get_decoded_duration(int deck_id);  // Playable so far (progressive loads)
+DJ_API double deck_get_load_progress(int deck_id);     // 0.0 - 1.0
 DJ_API int deck_is_playing(int deck_id);
 
+// Scheduled transport, applied on the exact frame inside the audio block:
+// at stream frame at_frame (see engine_get_stream_frame), or with at_frame
+// < 0 when quantize_deck next reaches a multiple of quantize_beats on its
+// beat grid (1 = next beat, 4 = next bar). Quantizing to a stopped deck
+// applies at once. The deck_schedule_ calls return 0, or -1 for a bad
+// deck or when the command can't be held (256 are pending already).
+DJ_API long long engine_get_stream_frame();  // Frames rendered since engine_init
+DJ_API int deck_schedule_play(int deck_id, long long at_frame, int quantize_deck, int quantize_beats);
+DJ_API int deck_schedule_pause(int deck_id, long long at_frame, int quantize_deck, int quantize_beats);
+DJ_API int deck_schedule_set_position(int deck_id, double position_seconds, long long at_frame,
+                                      int quantize_deck, int quantize_beats);
+DJ_API void engine_cancel_scheduled(int deck_id);  // -1 for every deck
+
+// Hot cues (index 0 .. DJ_HOT_CUE_COUNT - 1), cleared by loading a track.
+// deck_hot_cue jumps to the cue and plays. On a stretching deck a
+// background thread keeps every cue's stretcher primed for the current
+// tempo, pitch and stretch mode, so the jump plays from the next frame
+// with no refill; right after a change it falls back to a normal seek.
+#define DJ_HOT_CUE_COUNT 8
+DJ_API void deck_set_hot_cue(int deck_id, int index, double position_seconds);  // < 0 = current position
+DJ_API void deck_clear_hot_cue(int deck_id, int index);
+DJ_API double deck_get_hot_cue(int deck_id, int index);  // Seconds, or -1 if unset
+DJ_API void deck_hot_cue(int deck_id, int index);
+DJ_API int deck_schedule_hot_cue(int deck_id, int index, long long at_frame, int quantize_deck, int quantize_beats);
+
+// Loops, cleared by loading a track. The wrap is sample-accurate and
+// crossfaded over a few milliseconds; a stretching deck is fed straight
+// across it, so tempo changes never break the loop. Setting a loop behind
+// the play position jumps into it where it would be had it looped all
+// along. deck_loop_beats starts on the beat (or fraction of one) being
+// played. A loop roll plays a beat loop until released with beats <= 0,
+// then carries on where playback would have been without it.
+DJ_API void deck_loop_in(int deck_id);
+DJ_API void deck_loop_out(int deck_id);   // Loops from the last loop in to here
+DJ_API void deck_set_loop(int deck_id, double start_seconds, double end_seconds);
+DJ_API void deck_loop_beats(int deck_id, double beats);  // 0.25, 0.5, 1, 2, 4, ...
+DJ_API void deck_loop_exit(int deck_id);  // Also releases a roll
+DJ_API void deck_loop_roll(int deck_id, double beats);
+
+// Offline render: runs the whole graph without a device, as fast as the
+// CPU allows, into a 32-bit float WAV (FLAC can't be written). Only while
+// the stream is stopped; blocks until done, and other engine calls wait
+// for it. Scheduled commands and automation run on the same stream clock,
+// so script the mix first, then render. Streaming tracks refill in real
+// time and may drop out - set the streaming threshold to 0 before loading.
+DJ_API int engine_render_offline(const char* wav_path, double seconds);
+
 // Deck parameters
 DJ_API void deck_set_volume(int deck_id, float volume);  // 0.0 - 1.0
+// Auto-gain: a pre-fader gain taking each track to target_lufs (EBU R128
+// integrated loudness, e.g. -14), measured while the track decodes. A
+// track that starts playing before its measurement is done stays at unity
+// until the deck is paused.
+DJ_API void deck_set_auto_gain(int deck_id, int enabled, double target_lufs);
+DJ_API int deck_get_loudness(int deck_id, double* integrated_lufs, double* true_peak_db);  // 0 once measured
 DJ_API void deck_set_tempo(int deck_id, double tempo);   // 0.5 - 2.0
 DJ_API void deck_set_pitch(int deck_id, double semitones); // -12 to +12
+// 0 = vinyl (pitch follows tempo, cheapest), 1 = key lock (SoundTouch,
+// the default), 2 = custom engine if one was registered. Vinyl decks
+// ignore deck_set_pitch.
+DJ_API void deck_set_stretch_mode(int deck_id, int mode);
 DJ_API void deck_set_bpm(int deck_id, double bpm);
 DJ_API double deck_get_bpm(int deck_id);
 DJ_API void deck_set_beat_offset(int deck_id, double offset_seconds);
 
+// Beat grid of the loaded track, once analyzed (null before). beats gets
+// count beat times in seconds, valid until the handle is released.
+DJ_API const void* deck_acquire_beat_grid(int deck_id, const double** beats, int* count);
+DJ_API void beat_grid_release(const void* grid);
+DJ_API double deck_get_nearest_beat(int deck_id, double position_seconds);  // Unchanged without a grid
+DJ_API double deck_get_beat_phase(int deck_id);  // 0.0 - 1.0
+
+// Waveform of the loaded track as a pyramid of levels, 64 << (2 * level)
+// frames per bin, for drawing without copies (null for streamed tracks).
+// Bins stay valid until the handle is released; bin_count grows while a
+// progressive load is still decoding.
+typedef struct {
+    signed char min;     // -127 - 127
+    signed char max;
+    unsigned char rms;   // 0 - 255
+    unsigned char low;   // Band RMS: < 250 Hz, 250 Hz - 2.5 kHz, > 2.5 kHz
+    unsigned char mid;
+    unsigned char high;
+    unsigned char reserved[2];
+} waveform_bin_t;
+
+#define WAVEFORM_LEVEL_COUNT 4
+
+DJ_API const void* deck_acquire_waveform(int deck_id);
+DJ_API const waveform_bin_t* waveform_get_level(const void* waveform, int level, long long* bin_count,
+                                                int* frames_per_bin);
+DJ_API void waveform_release(const void* waveform);
+
 // EQ
 DJ_API void deck_set_eq_low(int deck_id, float gain);   // 0.0 - 2.0
 DJ_API void deck_set_eq_mid(int deck_id, float gain);
@@ -44,17 +237,161 @@ DJ_API void deck_set_eq_high(int deck_id, float gain);
 
 // Mixer
 DJ_API void mixer_set_crossfader(float position);  // 0.0 = A, 1.0 = B
+DJ_API void mixer_set_crossfader_assign(int deck_id, int side);  // 0 = A, 1 = B, 2 = thru (default: even A, odd B)
+
+// Cue bus, on a stream opened with DJ_OUTPUT_CUE: the decks with PFL on,
+// after EQ and before volume and crossfader, blended with the master by the
+// cue mix (0.0 = cue only, the default; 1.0 = master only), then the
+// headphone volume. Mixed from the same deck buffers as the master.
+DJ_API void mixer_set_pfl(int deck_id, int enabled);
+DJ_API void mixer_set_cue_mix(float mix);
+DJ_API void mixer_set_cue_volume(float volume);  // Default 1.0
 
 // Sync
 DJ_API void sync_enable(int slave_deck_id, int master_deck_id);
 DJ_API void sync_disable(int deck_id);
 DJ_API void sync_align_now(int slave_deck_id, int master_deck_id);  // Immediate one-time alignment
 
+// Automation, run by the audio thread: the parameter moves from wherever it
+// is when the ramp starts to value over duration_seconds. start_frame is a
+// stream frame (engine_get_stream_frame), or < 0 for now. A new ramp
+// replaces the parameter's old one; setting the parameter directly cancels
+// its ramp. Tempo ramps fight the phase lock on a synced slave.
+// target: 0 = crossfader (deck_id ignored), 1 = volume, 2 = EQ low,
+//         3 = EQ mid, 4 = EQ high, 5 = tempo
+// shape:  0 = linear, 1 = S-curve, 2 = ease in, 3 = ease out
+DJ_API void automation_ramp(int target, int deck_id, double value, long long start_frame, double duration_seconds,
+                            int shape);
+DJ_API void automation_cancel(int target, int deck_id);  // target -1 = all of the deck's
+
 // BPM Analysis (using MiniBPM library)
 DJ_API double audio_analyze_bpm(int deck_id);           // Analyze loaded track for BPM
 DJ_API double audio_analyze_beat_offset(int deck_id, double bpm);  // Find first beat position
 
-// Callbacks (for UI updates)
+// FFT behind every analysis: 0 = double-precision reference (kissfft,
+// default), 1 = single-precision SIMD. Applies to analyses started after.
+DJ_API int engine_set_analysis_fft(int backend);
+
+// Track features, all from the same analysis pass as the BPM.
+// key: 0 - 11 = C to B major, 12 - 23 = C to B minor, -1 = none found.
+// Bands split at 250 Hz and 2.5 kHz.
+#define DJ_ANALYSIS_CHROMA_BINS 12
+#define DJ_ANALYSIS_BANDS 3
+
+typedef struct analysis_features_t {
+    double bpm;                                 // 0 if the track couldn't be analyzed
+    double first_beat_seconds;
+    double loudness_db;                         // Gated RMS level in dBFS
+    int key;
+    float key_strength;                         // Profile correlation, -1 - 1
+    float chroma[DJ_ANALYSIS_CHROMA_BINS];      // Pitch classes from C, peak 1
+    float band_energy[DJ_ANALYSIS_BANDS];       // Low, mid, high shares, summing to 1
+    int has_loudness;                           // R128 figures below are valid
+    double integrated_lufs;
+    double true_peak_db;
+} analysis_features_t;
+
+DJ_API int audio_analyze_features(int deck_id, analysis_features_t* features);  // Analyzes on first use
+
+// Background analysis. flags: 1 = background priority (library scans run
+// behind deck jobs), 2 = preview first: a BPM and tentative grid from a
+// decimated window within tens of milliseconds (status 5, and the deck's
+// grid for a deck job), replaced by the full analysis once it's done.
+// Handles are > 0, or -1 if the job couldn't be queued.
+// Status: 0 = queued, 1 = running, 2 = done, 3 = failed, 4 = cancelled,
+// 5 = preview ready, -1 = unknown handle. The callback runs on an analysis
+// thread, for the preview as well.
+typedef void (*analysis_callback_t)(int job_id, int status);
+DJ_API int analysis_submit_deck(int deck_id, int flags);       // Cancelled when the deck is reloaded
+DJ_API int analysis_submit_file(const char* file_path, int flags);
+DJ_API int analysis_submit_files(const char** file_paths, int count, int flags, int* job_ids);  // Returns jobs queued
+DJ_API int analysis_get_status(int job_id);
+DJ_API double analysis_get_progress(int job_id);               // 0.0 - 1.0
+DJ_API int analysis_get_result(int job_id, double* bpm, double* first_beat_seconds);  // 0 once done or previewed
+DJ_API int analysis_get_features(int job_id, analysis_features_t* features);          // Previews: beat fields only
+DJ_API void analysis_cancel(int job_id);
+DJ_API void analysis_release(int job_id);                      // Frees the handle
+DJ_API void set_analysis_callback(analysis_callback_t callback);
+
+// Engine status, rewritten by the audio thread after every block. Reading
+// it never blocks the audio thread; one engine_read_status() per UI frame
+// replaces polling the deck getters.
+#define DJ_STATUS_MAX_DECKS 8
+
+typedef struct deck_status_t {
+    double position_seconds;
+    double duration_seconds;
+    double phase;             // 0.0 - 1.0 within the beat
+    double tempo;
+    double bpm;
+    float peak_left;          // Post EQ and auto-gain, pre volume; falls back at 20 dB/s
+    float peak_right;
+    int playing;
+    unsigned int end_count;   // Bumped each time playback runs off the end of the track
+    double loop_start_seconds;
+    double loop_end_seconds;
+    int looping;
+    int rolling;
+    float auto_gain_db;       // Applied pre-fader, 0 when off
+} deck_status_t;
+
+typedef struct engine_status_t {
+    unsigned long long blocks;  // Audio callbacks so far
+    float master_peak_left;
+    float master_peak_right;
+    int deck_count;
+    float crossfader;           // 0.0 = A, 1.0 = B; follows automation
+    float cpu_load;             // Device's estimate, 0.0 - 1.0 (see engine_perf_t)
+    float callback_load;        // Last callback's time over its buffer's duration
+    unsigned int xruns;         // Device underflows and overflows
+    unsigned int deadline_misses;  // Callbacks slower than their buffer
+    deck_status_t decks[DJ_STATUS_MAX_DECKS];
+} engine_status_t;
+
+DJ_API int engine_read_status(engine_status_t* status);  // -1 before engine_init
+
+// Performance counters, kept by the audio thread without locks, since
+// engine_init or the last engine_reset_perf. The deadline is a buffer's
+// duration; histogram[i] counts callbacks that took i/8 to (i+1)/8 of
+// theirs, the last bucket everything slower. Lateness is how far a
+// callback started behind the one before plus its buffer. Stage and deck
+// times are per block and in CPU time: stretch and EQ are part of deck
+// render, and with render workers the decks add up past the callback.
+#define DJ_PERF_HISTOGRAM_BUCKETS 16
+#define DJ_PERF_STAGE_COUNT 5  // 0 = deck render, 1 = stretch, 2 = EQ, 3 = mix, 4 = sync
+
+typedef struct perf_timing_t {
+    double mean_us;
+    double max_us;
+} perf_timing_t;
+
+typedef struct engine_perf_t {
+    unsigned long long callbacks;
+    unsigned long long blocks;             // Rendered, here or offline
+    unsigned long long input_underflows;   // Device flags, as PortAudio reports them
+    unsigned long long input_overflows;
+    unsigned long long output_underflows;  // The device ran dry: an audible dropout
+    unsigned long long output_overflows;
+    unsigned long long deadline_misses;
+    double deadline_us;                    // Of the last callback
+    double last_callback_us;
+    double mean_callback_us;
+    double max_callback_us;
+    double max_lateness_us;
+    double cpu_load;                       // Pa_GetStreamCpuLoad, 0.0 - 1.0
+    double output_latency_us;              // Last buffer's lead on the DAC, 0 if the host doesn't say
+    unsigned long long histogram[DJ_PERF_HISTOGRAM_BUCKETS];
+    perf_timing_t stages[DJ_PERF_STAGE_COUNT];
+    perf_timing_t decks[DJ_STATUS_MAX_DECKS];  // Deck render, per deck
+    unsigned long long dropped_commands;   // Timed out on a full command queue: the change was lost
+} engine_perf_t;
+
+DJ_API int engine_get_perf(engine_perf_t* perf);  // -1 before engine_init
+DJ_API void engine_reset_perf();                  // From the next block
+
+// Callbacks (for UI updates). They run on an engine notifier thread, never
+// the audio thread: positions about every 100 ms while audio is running,
+// track ends within a few ms of the end_count change.
 typedef void (*position_callback_t)(int deck_id, double position);
 typedef void (*track_ended_callback_t)(int deck_id);
 DJ_API void set_position_callback(position_callback_t callback);
@@ -0,0 +1,273 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace dj {
+
+// Database layout: AnalysisDbHeader, then records of AnalysisRecordHeader
+// plus payload. The payload is AnalysisRecordFixed, beat_count uint32 beat
+// positions in frames at sample_rate, then peak_count uint8 peaks.
+static const uint32_t ANALYSIS_DB_MAGIC = 0x4E41444A;      // "DJAN"
+static const uint32_t ANALYSIS_DB_VERSION = 3;      // 2: key, chroma and bands; 3: R128
+static const uint32_t ANALYSIS_RECORD_MAGIC = 0x4345524A;  // "JREC"
+
+// hashContent() reads this much from the start, middle and end
+static const size_t CONTENT_HASH_WINDOW_BYTES = 64 * 1024;
+
+struct AnalysisDbHeader {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct AnalysisRecordHeader {
+    uint32_t magic;
+    uint32_t payload_bytes;
+    uint64_t key;
+    uint64_t checksum;  // hashBytes of the payload
+};
+
+struct AnalysisRecordFixed {
+    double bpm;
+    double loudness_db;
+    uint32_t sample_rate;
+    uint32_t beat_count;
+    uint32_t peak_frames;
+    uint32_t peak_count;
+    int32_t key;
+    float key_strength;
+    float chroma[CHROMA_BINS];
+    float band_energy[ANALYSIS_BANDS];
+    uint32_t has_loudness;
+    double integrated_lufs;
+    double true_peak_db;
+};
+
+// A database holding only the file header
+static bool createDatabase(const char* filepath) {
+    FILE* file = fopen(filepath, "wb");
+    if (!file) return false;
+    AnalysisDbHeader header = { ANALYSIS_DB_MAGIC, ANALYSIS_DB_VERSION };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    return (fclose(file) == 0) && ok;
+}
+
+uint64_t hashFileContent(const char* filepath) {
+    MappedFile file;
+    if (!filepath || !file.open(filepath)) return 0;
+    return hashContent(file.data(), file.size());
+}
+
+uint64_t hashContent(const uint8_t* data, size_t size) {
+    if (!data || size == 0) return 0;
+
+    // Tags are usually rewritten at the start or the end of a file, but
+    // edits there are rare next to renames and moves, which this survives
+    uint64_t length = size;
+    uint64_t hash = hashBytes(&length, sizeof(length));
+
+    size_t window = std::min(CONTENT_HASH_WINDOW_BYTES, size);
+    const size_t starts[3] = { 0, (size - window) / 2, size - window };
+    for (size_t start : starts) {
+        hash = hashBytes(data + start, window, hash);
+    }
+    return hash != 0 ? hash : 1;
+}
+
+AnalysisDatabase::AnalysisDatabase() {
+}
+
+bool AnalysisDatabase::open(const char* filepath) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_.clear();
+    index_.clear();
+    if (!filepath || !*filepath) return false;
+
+    std::error_code ec;
+    fs::path parent = fs::path(filepath).parent_path();
+    if (!parent.empty()) fs::create_directories(parent, ec);
+
+    if (!fs::exists(filepath, ec) || fs::file_size(filepath, ec) == 0) {
+        if (!createDatabase(filepath)) return false;
+    }
+
+    path_ = filepath;
+    if (!readIndex()) {
+        DJ_LOG_WARN("Analysis database %s is not usable", filepath);
+        path_.clear();
+        index_.clear();
+        return false;
+    }
+
+    DJ_LOG_INFO("Analysis database %s: %zu tracks", filepath, index_.size());
+    return true;
+}
+
+void AnalysisDatabase::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_.clear();
+    index_.clear();
+}
+
+bool AnalysisDatabase::isOpen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !path_.empty();
+}
+
+size_t AnalysisDatabase::getTrackCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+}
+
+bool AnalysisDatabase::readIndex() {
+    FILE* file = fopen(path_.c_str(), "rb");
+    if (!file) return false;
+
+    AnalysisDbHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != ANALYSIS_DB_MAGIC) {
+        fclose(file);
+        return false;
+    }
+    if (header.version != ANALYSIS_DB_VERSION) {
+        // Records without the newer features; re-analyzing beats serving them
+        fclose(file);
+        DJ_LOG_INFO("Analysis database: format %u is out of date, starting over", header.version);
+        return createDatabase(path_.c_str());
+    }
+
+    std::error_code ec;
+    uint64_t file_size = fs::file_size(path_, ec);
+    uint64_t offset = sizeof(header);
+
+    // Only the headers are read here; payloads are checked on lookup
+    AnalysisRecordHeader record;
+    while (offset + sizeof(record) <= file_size) {
+        if (fseek(file, static_cast<long>(offset), SEEK_SET) != 0 ||
+            fread(&record, sizeof(record), 1, file) != 1 ||
+            record.magic != ANALYSIS_RECORD_MAGIC ||
+            offset + sizeof(record) + record.payload_bytes > file_size) {
+            break;
+        }
+        index_[record.key] = { offset + sizeof(record), record.payload_bytes, record.checksum };
+        offset += sizeof(record) + record.payload_bytes;
+    }
+    fclose(file);
+
+    // A record cut short by a crash would hide everything appended after it
+    if (offset < file_size) {
+        DJ_LOG_WARN("Analysis database: dropping %llu bytes of torn records",
+                    static_cast<unsigned long long>(file_size - offset));
+        fs::resize_file(path_, offset, ec);
+        if (ec) return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const AnalysisResult> AnalysisDatabase::lookup(uint64_t key) const {
+    std::vector<uint8_t> payload;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key);
+        if (path_.empty() || it == index_.end()) return nullptr;
+
+        FILE* file = fopen(path_.c_str(), "rb");
+        if (!file) return nullptr;
+        payload.resize(it->second.bytes);
+        bool ok = fseek(file, static_cast<long>(it->second.offset), SEEK_SET) == 0 &&
+                  fread(payload.data(), 1, payload.size(), file) == payload.size();
+        fclose(file);
+        if (!ok || hashBytes(payload.data(), payload.size()) != it->second.checksum) return nullptr;
+    }
+
+    AnalysisRecordFixed fixed;
+    if (payload.size() < sizeof(fixed)) return nullptr;
+    memcpy(&fixed, payload.data(), sizeof(fixed));
+    size_t expected = sizeof(fixed) + fixed.beat_count * sizeof(uint32_t) + fixed.peak_count;
+    if (payload.size() != expected || fixed.sample_rate == 0) return nullptr;
+
+    auto result = std::make_shared<AnalysisResult>();
+    result->sample_rate = static_cast<int>(fixed.sample_rate);
+    result->bpm = fixed.bpm;
+    result->loudness_db = fixed.loudness_db;
+    result->peak_frames = static_cast<int>(fixed.peak_frames);
+    result->key = fixed.key;
+    result->key_strength = fixed.key_strength;
+    std::copy(fixed.chroma, fixed.chroma + CHROMA_BINS, result->chroma);
+    std::copy(fixed.band_energy, fixed.band_energy + ANALYSIS_BANDS, result->band_energy);
+    result->has_loudness = fixed.has_loudness != 0;
+    result->loudness.integrated_lufs = fixed.integrated_lufs;
+    result->loudness.true_peak_db = fixed.true_peak_db;
+
+    const uint8_t* cursor = payload.data() + sizeof(fixed);
+    result->beats.resize(fixed.beat_count);
+    for (uint32_t i = 0; i < fixed.beat_count; i++) {
+        uint32_t frame;
+        memcpy(&frame, cursor + i * sizeof(frame), sizeof(frame));
+        result->beats[i] = static_cast<double>(frame) / fixed.sample_rate;
+    }
+    cursor += fixed.beat_count * sizeof(uint32_t);
+    result->peaks.assign(cursor, cursor + fixed.peak_count);
+    return result;
+}
+
+void AnalysisDatabase::store(uint64_t key, const AnalysisResult& result) {
+    if (key == 0 || result.sample_rate <= 0) return;
+
+    // Beats go in as frame numbers, which is what the tracker produced
+    AnalysisRecordFixed fixed = {};
+    fixed.bpm = result.bpm;
+    fixed.loudness_db = result.loudness_db;
+    fixed.sample_rate = static_cast<uint32_t>(result.sample_rate);
+    fixed.beat_count = static_cast<uint32_t>(result.beats.size());
+    fixed.peak_frames = static_cast<uint32_t>(result.peak_frames);
+    fixed.peak_count = static_cast<uint32_t>(result.peaks.size());
+    fixed.key = result.key;
+    fixed.key_strength = result.key_strength;
+    std::copy(result.chroma, result.chroma + CHROMA_BINS, fixed.chroma);
+    std::copy(result.band_energy, result.band_energy + ANALYSIS_BANDS, fixed.band_energy);
+    fixed.has_loudness = result.has_loudness ? 1 : 0;
+    fixed.integrated_lufs = result.loudness.integrated_lufs;
+    fixed.true_peak_db = result.loudness.true_peak_db;
+
+    std::vector<uint8_t> payload(sizeof(fixed) + fixed.beat_count * sizeof(uint32_t) + fixed.peak_count);
+    memcpy(payload.data(), &fixed, sizeof(fixed));
+    uint8_t* cursor = payload.data() + sizeof(fixed);
+    for (double beat : result.beats) {
+        uint32_t frame = static_cast<uint32_t>(std::llround(std::max(0.0, beat) * result.sample_rate));
+        memcpy(cursor, &frame, sizeof(frame));
+        cursor += sizeof(frame);
+    }
+    if (!result.peaks.empty()) memcpy(cursor, result.peaks.data(), result.peaks.size());
+
+    AnalysisRecordHeader record;
+    record.magic = ANALYSIS_RECORD_MAGIC;
+    record.payload_bytes = static_cast<uint32_t>(payload.size());
+    record.key = key;
+    record.checksum = hashBytes(payload.data(), payload.size());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (path_.empty()) return;
+
+    std::error_code ec;
+    uint64_t offset = fs::file_size(path_, ec);
+    if (ec) return;
+
+    FILE* file = fopen(path_.c_str(), "ab");
+    if (!file) return;
+    bool ok = fwrite(&record, sizeof(record), 1, file) == 1 &&
+              fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+    ok = (fclose(file) == 0) && ok;
+
+    if (ok) {
+        index_[key] = { offset + sizeof(record), record.payload_bytes, record.checksum };
+    } else {
+        fs::resize_file(path_, offset, ec);  // Don't leave a torn record behind
+    }
+}
+
+} // namespace dj
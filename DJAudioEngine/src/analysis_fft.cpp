@@ -0,0 +1,293 @@
+#include "dj_audio_engine.h"
+#include "dj_audio_internal.h"
+#include "simd.h"
+#include "dsp/transforms/FFT.h"
+#include <algorithm>
+#include <cmath>
+
+namespace dj {
+
+// Smallest size the fast backend plans: its first stage runs four radix-4
+// butterflies side by side, so the half-size complex transform needs 16
+static const int FAST_FFT_MIN_SIZE = 32;
+
+// Reference until the caller opts in: the fast backend's results differ
+// from it by float rounding, checked by djengine_bench's "fft" records
+static std::atomic<FFTBackend> g_fft_backend{ FFTBackend::Reference };
+
+// qm-dsp's FFTReal on kissfft, built with kiss_fft_scalar=double. Fills all
+// n bins, so the spectrum goes through scratch buffers.
+class ReferenceFFT : public AnalysisFFT {
+public:
+    explicit ReferenceFFT(int size)
+        : size_(size)
+        , fft_(size)
+        , input_(static_cast<size_t>(size))
+        , reals_(static_cast<size_t>(size))
+        , imags_(static_cast<size_t>(size))
+    {
+    }
+
+    FFTBackend getBackend() const override { return FFTBackend::Reference; }
+    int size() const override { return size_; }
+
+    void forward(const float* input, float* reals, float* imags) override {
+        std::copy(input, input + size_, input_.begin());
+        fft_.forward(input_.data(), reals_.data(), imags_.data());
+        for (int k = 0; k <= size_ / 2; k++) {
+            reals[k] = static_cast<float>(reals_[k]);
+            imags[k] = static_cast<float>(imags_[k]);
+        }
+    }
+
+private:
+    int size_;
+    FFTReal fft_;
+    std::vector<double> input_;
+    std::vector<double> reals_;
+    std::vector<double> imags_;
+};
+
+// The n real inputs as n / 2 complex ones (even samples real, odd
+// imaginary), through a Stockham radix-4 transform that needs no bit
+// reversal, then split into the real spectrum. Split real and imaginary
+// arrays throughout, so every butterfly works on four values per vector.
+class FastFFT : public AnalysisFFT {
+public:
+    explicit FastFFT(int size)
+        : size_(size)
+        , half_(size / 2)
+    {
+        const double pi = 3.14159265358979323846;
+        for (auto* buffer : { &xr_, &xi_, &yr_, &yi_ }) buffer->assign(static_cast<size_t>(half_), 0.0f);
+
+        // Per radix-4 stage, w^p, w^2p and w^3p for p < n / 4, as planar
+        // real and imaginary rows
+        for (int n = half_; n >= 4; n /= 4) {
+            int m = n / 4;
+            size_t base = twiddles_.size();
+            twiddles_.resize(base + 6 * static_cast<size_t>(m));
+            for (int p = 0; p < m; p++) {
+                for (int k = 1; k <= 3; k++) {
+                    double angle = -2.0 * pi * k * p / n;
+                    twiddles_[base + (2 * k - 2) * m + p] = static_cast<float>(std::cos(angle));
+                    twiddles_[base + (2 * k - 1) * m + p] = static_cast<float>(std::sin(angle));
+                }
+            }
+        }
+
+        split_re_.resize(static_cast<size_t>(half_) + 1);
+        split_im_.resize(static_cast<size_t>(half_) + 1);
+        for (int k = 0; k <= half_; k++) {
+            double angle = -2.0 * pi * k / size_;
+            split_re_[k] = static_cast<float>(std::cos(angle));
+            split_im_[k] = static_cast<float>(std::sin(angle));
+        }
+    }
+
+    FFTBackend getBackend() const override { return FFTBackend::Fast; }
+    int size() const override { return size_; }
+
+    void forward(const float* input, float* reals, float* imags) override {
+        for (int i = 0; i < half_; i += 4) {
+            vec4 even, odd;
+            vdeinterleave(vload(input + 2 * i), vload(input + 2 * i + 4), &even, &odd);
+            vstore(xr_.data() + i, even);
+            vstore(xi_.data() + i, odd);
+        }
+
+        const float* zr;
+        const float* zi;
+        transform(&zr, &zi);
+        splitSpectrum(zr, zi, reals, imags);
+    }
+
+private:
+    // Complex transform of xr_ / xi_, ending in whichever pair the last
+    // stage wrote
+    void transform(const float** out_re, const float** out_im) {
+        float* xr = xr_.data();
+        float* xi = xi_.data();
+        float* yr = yr_.data();
+        float* yi = yi_.data();
+        const float* twiddles = twiddles_.data();
+
+        int n = half_;
+        int s = 1;
+        for (; n >= 4; n /= 4, s *= 4) {
+            int m = n / 4;
+            if (s == 1) {
+                firstStage(m, twiddles, xr, xi, yr, yi);
+            } else {
+                for (int p = 0; p < m; p++) {
+                    vec4 w1r = vset1(twiddles[p]), w1i = vset1(twiddles[m + p]);
+                    vec4 w2r = vset1(twiddles[2 * m + p]), w2i = vset1(twiddles[3 * m + p]);
+                    vec4 w3r = vset1(twiddles[4 * m + p]), w3i = vset1(twiddles[5 * m + p]);
+                    for (int q = 0; q < s; q += 4) {
+                        int in = q + s * p;
+                        int out = q + s * 4 * p;
+                        butterfly(xr + in, xi + in, s * m, yr + out, yi + out, s, w1r, w1i, w2r, w2i, w3r, w3i);
+                    }
+                }
+            }
+            twiddles += 6 * m;
+            std::swap(xr, yr);
+            std::swap(xi, yi);
+        }
+
+        if (n == 2) {
+            for (int q = 0; q < s; q += 4) {
+                vec4 ar = vload(xr + q), ai = vload(xi + q);
+                vec4 br = vload(xr + q + s), bi = vload(xi + q + s);
+                vstore(yr + q, vadd(ar, br));
+                vstore(yi + q, vadd(ai, bi));
+                vstore(yr + q + s, vsub(ar, br));
+                vstore(yi + q + s, vsub(ai, bi));
+            }
+            std::swap(xr, yr);
+            std::swap(xi, yi);
+        }
+        *out_re = xr;
+        *out_im = xi;
+    }
+
+    // One radix-4 butterfly on four lanes. Inputs stride apart from x,
+    // outputs stride apart from y.
+    static void butterfly(const float* xr, const float* xi, int in_stride, float* yr, float* yi, int out_stride,
+                          vec4 w1r, vec4 w1i, vec4 w2r, vec4 w2i, vec4 w3r, vec4 w3i) {
+        vec4 r[4], i[4];
+        radix4(xr, xi, in_stride, w1r, w1i, w2r, w2i, w3r, w3i, r, i);
+        for (int k = 0; k < 4; k++) {
+            vstore(yr + k * out_stride, r[k]);
+            vstore(yi + k * out_stride, i[k]);
+        }
+    }
+
+    static void radix4(const float* xr, const float* xi, int stride, vec4 w1r, vec4 w1i, vec4 w2r, vec4 w2i,
+                       vec4 w3r, vec4 w3i, vec4* r, vec4* i) {
+        vec4 ar = vload(xr), ai = vload(xi);
+        vec4 br = vload(xr + stride), bi = vload(xi + stride);
+        vec4 cr = vload(xr + 2 * stride), ci = vload(xi + 2 * stride);
+        vec4 dr = vload(xr + 3 * stride), di = vload(xi + 3 * stride);
+
+        vec4 apc_r = vadd(ar, cr), apc_i = vadd(ai, ci);
+        vec4 amc_r = vsub(ar, cr), amc_i = vsub(ai, ci);
+        vec4 bpd_r = vadd(br, dr), bpd_i = vadd(bi, di);
+        vec4 bmd_r = vsub(br, dr), bmd_i = vsub(bi, di);
+
+        // amc -/+ j(b - d)
+        vec4 t1r = vadd(amc_r, bmd_i), t1i = vsub(amc_i, bmd_r);
+        vec4 t2r = vsub(apc_r, bpd_r), t2i = vsub(apc_i, bpd_i);
+        vec4 t3r = vsub(amc_r, bmd_i), t3i = vadd(amc_i, bmd_r);
+
+        r[0] = vadd(apc_r, bpd_r);
+        i[0] = vadd(apc_i, bpd_i);
+        r[1] = vsub(vmul(w1r, t1r), vmul(w1i, t1i));
+        i[1] = vadd(vmul(w1r, t1i), vmul(w1i, t1r));
+        r[2] = vsub(vmul(w2r, t2r), vmul(w2i, t2i));
+        i[2] = vadd(vmul(w2r, t2i), vmul(w2i, t2r));
+        r[3] = vsub(vmul(w3r, t3r), vmul(w3i, t3i));
+        i[3] = vadd(vmul(w3r, t3i), vmul(w3i, t3r));
+    }
+
+    // Stride 1: four consecutive butterflies per vector, whose outputs sit
+    // four apart, so each group transposes on the way out
+    static void firstStage(int m, const float* twiddles, const float* xr, const float* xi, float* yr, float* yi) {
+        for (int p = 0; p < m; p += 4) {
+            vec4 r[4], i[4];
+            radix4(xr + p, xi + p, m,
+                   vload(twiddles + p), vload(twiddles + m + p),
+                   vload(twiddles + 2 * m + p), vload(twiddles + 3 * m + p),
+                   vload(twiddles + 4 * m + p), vload(twiddles + 5 * m + p), r, i);
+            vtranspose4(r[0], r[1], r[2], r[3]);
+            vtranspose4(i[0], i[1], i[2], i[3]);
+            for (int k = 0; k < 4; k++) {
+                vstore(yr + 4 * (p + k), r[k]);
+                vstore(yi + 4 * (p + k), i[k]);
+            }
+        }
+    }
+
+    // X[k] = E[k] + W^k O[k], with the even and odd samples' spectra
+    // E[k] = (Z[k] + conj Z[M - k]) / 2 and O[k] = (Z[k] - conj Z[M - k]) / 2j
+    void splitSpectrum(const float* zr, const float* zi, float* reals, float* imags) const {
+        const int half = half_;
+        auto scalarBin = [&](int k) {
+            int mirror = (half - k) % half;
+            float a = zr[k % half], b = zi[k % half];
+            float c = zr[mirror], d = zi[mirror];
+            float even_r = 0.5f * (a + c), even_i = 0.5f * (b - d);
+            float odd_r = 0.5f * (b + d), odd_i = 0.5f * (c - a);
+            reals[k] = even_r + split_re_[k] * odd_r - split_im_[k] * odd_i;
+            imags[k] = even_i + split_re_[k] * odd_i + split_im_[k] * odd_r;
+        };
+
+        scalarBin(0);
+        const vec4 one_half = vset1(0.5f);
+        int k = 1;
+        for (; k + 3 < half; k += 4) {
+            vec4 a = vload(zr + k), b = vload(zi + k);
+            vec4 c = vreverse(vload(zr + half - k - 3)), d = vreverse(vload(zi + half - k - 3));
+            vec4 even_r = vmul(one_half, vadd(a, c)), even_i = vmul(one_half, vsub(b, d));
+            vec4 odd_r = vmul(one_half, vadd(b, d)), odd_i = vmul(one_half, vsub(c, a));
+            vec4 wr = vload(split_re_.data() + k), wi = vload(split_im_.data() + k);
+            vstore(reals + k, vadd(even_r, vsub(vmul(wr, odd_r), vmul(wi, odd_i))));
+            vstore(imags + k, vadd(even_i, vadd(vmul(wr, odd_i), vmul(wi, odd_r))));
+        }
+        for (; k <= half; k++) scalarBin(k);
+    }
+
+    int size_;
+    int half_;
+    std::vector<float> xr_, xi_, yr_, yi_;  // Ping-pong between stages
+    std::vector<float> twiddles_;
+    std::vector<float> split_re_, split_im_;  // W^k for k <= n / 2
+};
+
+std::unique_ptr<AnalysisFFT> makeAnalysisFFT(FFTBackend backend, int size) {
+    bool power_of_two = size > 0 && (size & (size - 1)) == 0;
+    if (backend == FFTBackend::Fast && power_of_two && size >= FAST_FFT_MIN_SIZE) {
+        return std::make_unique<FastFFT>(size);
+    }
+    return std::make_unique<ReferenceFFT>(size);
+}
+
+AnalysisFFT& getThreadFFT(FFTBackend backend, int size) {
+    // A handful per thread at most, so a list will do. Keyed by the backend
+    // asked for, so the Reference plan standing in for a size Fast can't
+    // plan is found again.
+    struct Plan {
+        FFTBackend backend;
+        std::unique_ptr<AnalysisFFT> fft;
+    };
+    thread_local std::vector<Plan> plans;
+
+    for (Plan& plan : plans) {
+        if (plan.backend == backend && plan.fft->size() == size) return *plan.fft;
+    }
+    plans.push_back({ backend, makeAnalysisFFT(backend, size) });
+    return *plans.back().fft;
+}
+
+void setAnalysisFFTBackend(FFTBackend backend) {
+    g_fft_backend.store(backend);
+}
+
+FFTBackend getAnalysisFFTBackend() {
+    return g_fft_backend.load();
+}
+
+} // namespace dj
+
+// C API for the analysis FFT
+extern "C" {
+
+DJ_API int engine_set_analysis_fft(int backend) {
+    if (backend != static_cast<int>(dj::FFTBackend::Reference) && backend != static_cast<int>(dj::FFTBackend::Fast)) {
+        return -1;
+    }
+    dj::setAnalysisFFTBackend(static_cast<dj::FFTBackend>(backend));
+    return 0;
+}
+
+} // extern "C"
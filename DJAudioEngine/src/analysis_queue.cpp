@@ -0,0 +1,404 @@
+#include "dj_audio_engine.h"
+#include "dj_audio_internal.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+namespace dj {
+
+struct AnalysisQueue::Job {
+    int id = 0;
+    int deck_id = -1;                  // -1 for file jobs
+    Deck* deck = nullptr;              // Outlives the queue
+    AnalysisPriority priority = AnalysisPriority::Background;
+    AnalysisTier tier = AnalysisTier::Full;  // Preview: publish one before the full result
+
+    std::shared_ptr<AudioFile> track;  // Deck jobs
+    TrackCache* cache = nullptr;       // Preloads: where the decoded track goes
+    std::string path;                  // File jobs
+    LoadOptions options;
+
+    AnalysisControl control;
+    std::atomic<AnalysisStatus> status{ AnalysisStatus::Queued };
+    std::shared_ptr<const AnalysisResult> result;  // Set with the status, under the queue's lock
+};
+
+// Analysis only burns CPU the audio and render threads may need
+static void demoteAnalysisThread() {
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+}
+
+AnalysisQueue::AnalysisQueue(int workers)
+    : next_id_(1)
+    , running_(true)
+    , callback_(nullptr)
+{
+    for (int i = 0; i < std::max(1, workers); i++) {
+        threads_.emplace_back(&AnalysisQueue::workerMain, this);
+    }
+}
+
+AnalysisQueue::~AnalysisQueue() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        for (auto& entry : jobs_) {
+            entry.second->control.cancelled = true;
+        }
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+int AnalysisQueue::submitTrack(std::shared_ptr<AudioFile> track, Deck* deck, int deck_id, AnalysisPriority priority,
+                               AnalysisTier tier) {
+    if (!track) return -1;
+
+    auto job = std::make_shared<Job>();
+    job->deck_id = deck_id;
+    job->deck = deck;
+    job->priority = priority;
+    job->tier = tier;
+    job->track = std::move(track);
+    return enqueue(std::move(job));
+}
+
+int AnalysisQueue::submitFile(const char* filepath, const LoadOptions& options, AnalysisPriority priority,
+                              AnalysisTier tier) {
+    if (!filepath) return -1;
+
+    auto job = std::make_shared<Job>();
+    job->priority = priority;
+    job->tier = tier;
+    job->path = filepath;
+    job->options = options;
+    return enqueue(std::move(job));
+}
+
+int AnalysisQueue::submitPreload(const char* filepath, const LoadOptions& options, TrackCache* cache) {
+    if (!filepath || !cache) return -1;
+
+    auto job = std::make_shared<Job>();
+    job->priority = AnalysisPriority::Background;
+    job->path = filepath;
+    job->options = options;
+    job->cache = cache;
+    return enqueue(std::move(job));
+}
+
+int AnalysisQueue::enqueue(std::shared_ptr<Job> job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return -1;
+
+    job->id = next_id_++;
+    if (next_id_ <= 0) next_id_ = 1;  // Handles stay positive after wrapping
+
+    jobs_[job->id] = job;
+    pending_[static_cast<int>(job->priority)].push_back(job);
+    wake_.notify_one();
+    return job->id;
+}
+
+bool AnalysisQueue::getStatus(int job_id, AnalysisStatus* status, double* progress) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(job_id);
+    if (it == jobs_.end()) return false;
+
+    const Job& job = *it->second;
+    AnalysisStatus current = job.status.load();
+    if (status) *status = current;
+    if (progress) *progress = (current == AnalysisStatus::Done) ? 1.0 : job.control.progress.load();
+    return true;
+}
+
+std::shared_ptr<const AnalysisResult> AnalysisQueue::getResult(int job_id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = jobs_.find(job_id);
+    if (it == jobs_.end()) return nullptr;
+
+    AnalysisStatus status = it->second->status.load();
+    return (status == AnalysisStatus::Done || status == AnalysisStatus::Preview) ? it->second->result : nullptr;
+}
+
+bool AnalysisQueue::cancelLocked(Job& job) {
+    job.control.cancelled = true;
+    if (job.status.load() != AnalysisStatus::Queued) return false;
+
+    // Never started, so it ends here; running jobs notice the flag themselves
+    auto& queue = pending_[static_cast<int>(job.priority)];
+    auto it = std::find_if(queue.begin(), queue.end(),
+                           [&job](const std::shared_ptr<Job>& queued) { return queued.get() == &job; });
+    if (it == queue.end()) return false;
+
+    queue.erase(it);
+    job.status = AnalysisStatus::Cancelled;
+    job.track.reset();
+    return true;
+}
+
+void AnalysisQueue::notifyCancelled(const std::vector<int>& job_ids) {
+    // Outside the lock, so the callback may poll the queue
+    Callback callback = callback_.load();
+    if (!callback) return;
+    for (int id : job_ids) {
+        callback(id, static_cast<int>(AnalysisStatus::Cancelled));
+    }
+}
+
+void AnalysisQueue::cancel(int job_id) {
+    std::vector<int> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(job_id);
+        if (it != jobs_.end() && cancelLocked(*it->second)) cancelled.push_back(job_id);
+    }
+    notifyCancelled(cancelled);
+}
+
+void AnalysisQueue::cancelDeck(int deck_id) {
+    std::vector<int> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : jobs_) {
+            if (entry.second->deck_id == deck_id && cancelLocked(*entry.second)) {
+                cancelled.push_back(entry.first);
+            }
+        }
+    }
+    notifyCancelled(cancelled);
+}
+
+void AnalysisQueue::release(int job_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.erase(job_id);
+}
+
+void AnalysisQueue::workerMain() {
+    demoteAnalysisThread();
+
+    for (;;) {
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] {
+                return !running_ || !pending_[0].empty() || !pending_[1].empty();
+            });
+            if (!running_) break;
+
+            for (auto& queue : pending_) {
+                if (!queue.empty()) {
+                    job = std::move(queue.front());
+                    queue.pop_front();
+                    break;
+                }
+            }
+            job->status = AnalysisStatus::Running;
+        }
+
+        runJob(*job);
+    }
+}
+
+void AnalysisQueue::runJob(Job& job) {
+    std::shared_ptr<AudioFile> track = std::move(job.track);
+
+    // Preloaded already, perhaps by a job queued ahead of this one
+    if (!track && job.cache) track = job.cache->find(job.path.c_str(), job.options);
+
+    if (!track) {
+        // Analyzed before: nothing to decode, unless the decode is the point
+        AnalysisDatabase* db = job.options.analysis_db;
+        if (!job.cache && db && db->isOpen()) {
+            std::shared_ptr<const AnalysisResult> stored = db->lookup(hashFileContent(job.path.c_str()));
+            if (stored) {
+                finish(job, AnalysisStatus::Done, std::move(stored));
+                return;
+            }
+        }
+        
+        // Loaded just for this job, fully in memory whatever the deck
+        // settings say. Kept out of the PCM cache, which a library scan
+        // would otherwise flush of the tracks actually being played, and
+        // never drawn, so no waveform either. A preload is for a deck, so
+        // it loads as one would, only all of it on this thread - and held
+        // in memory as long as it fits the cache, since a streamed track
+        // can't be shared. Longer ones still stream, and fail below.
+        LoadOptions options = job.options;
+        options.mode = LoadMode::Full;
+        if (!job.cache) {
+            options.streaming_threshold_seconds = 0.0;
+            options.pcm_cache = nullptr;
+            options.build_waveform = false;
+        } else {
+            double frame_bytes = 2.0 * bytesPerSample(options.storage_format);
+            int rate = std::max(1, options.target_sample_rate);
+            options.streaming_threshold_seconds = std::max(1.0, job.cache->getBudget() / frame_bytes / rate);
+        }
+
+        track = std::make_shared<AudioFile>();
+        if (job.control.cancelled.load()) {
+            finish(job, AnalysisStatus::Cancelled);
+            return;
+        }
+        if (!track->load(job.path.c_str(), options)) {
+            DJ_LOG_WARN("Analysis job %d: could not load %s", job.id, job.path.c_str());
+            finish(job, AnalysisStatus::Failed);
+            return;
+        }
+        if (job.cache) {
+            if (track->isStreaming()) {
+                DJ_LOG_WARN("Analysis job %d: %s is larger than the track cache, not preloaded", job.id, job.path.c_str());
+                finish(job, AnalysisStatus::Failed);
+                return;
+            }
+            job.cache->insert(job.path.c_str(), job.options, track);
+        }
+    }
+
+    // A quick grid to play against while the full analysis runs, unless
+    // the track already has the full one
+    if (job.tier == AnalysisTier::Preview && !track->peekAnalysis()) {
+        std::shared_ptr<const AnalysisResult> preview = analyzePreview(*track, &job.control);
+        if (!preview || job.control.cancelled.load()) {
+            finish(job, AnalysisStatus::Cancelled);
+            return;
+        }
+        if (preview->bpm > 0.0) {
+            if (job.deck) job.deck->setBeatGrid(BeatGrid::fromAnalysis(*preview), track.get());
+            finish(job, AnalysisStatus::Preview, std::move(preview));
+        }
+    }
+
+    std::shared_ptr<const AnalysisResult> result = track->getAnalysis(&job.control);
+    if (!result || job.control.cancelled.load()) {
+        finish(job, AnalysisStatus::Cancelled);
+        return;
+    }
+
+    if (job.deck) {
+        job.deck->setBeatGrid(BeatGrid::fromAnalysis(*result), track.get());
+    }
+
+    AnalysisStatus status = result->bpm > 0.0 ? AnalysisStatus::Done : AnalysisStatus::Failed;
+    finish(job, status, std::move(result));
+}
+
+void AnalysisQueue::finish(Job& job, AnalysisStatus status, std::shared_ptr<const AnalysisResult> result) {
+    // Also how a preview goes out, which readers may still hold when the
+    // full result replaces it - so both change together under the lock
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (result) job.result = std::move(result);
+        job.status.store(status);
+    }
+
+    DJ_LOG_DEBUG("Analysis job %d finished with status %d", job.id, static_cast<int>(status));
+
+    Callback callback = callback_.load();
+    if (callback) callback(job.id, static_cast<int>(status));
+}
+
+} // namespace dj
+
+// C API for background analysis
+extern "C" {
+
+static dj::AnalysisPriority priorityFromFlags(int flags) {
+    return (flags & 1) ? dj::AnalysisPriority::Background : dj::AnalysisPriority::Deck;
+}
+
+static dj::AnalysisTier tierFromFlags(int flags) {
+    return (flags & 2) ? dj::AnalysisTier::Preview : dj::AnalysisTier::Full;
+}
+
+static dj::AnalysisQueue* analysisQueue() {
+    return dj::g_engine ? dj::g_engine->analysis_queue.get() : nullptr;
+}
+
+DJ_API int analysis_submit_deck(int deck_id, int flags) {
+    if (!dj::isValidDeck(deck_id)) return -1;
+
+    dj::Deck* deck = dj::g_engine->decks[deck_id].get();
+    auto track = deck->getAudioFile();
+    if (!track) return -1;
+
+    dj::AnalysisQueue* queue = analysisQueue();
+    return queue ? queue->submitTrack(std::move(track), deck, deck_id, priorityFromFlags(flags), tierFromFlags(flags)) : -1;
+}
+
+DJ_API int analysis_submit_file(const char* file_path, int flags) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    if (!queue || !file_path) return -1;
+    return queue->submitFile(file_path, dj::g_engine->load_options, priorityFromFlags(flags), tierFromFlags(flags));
+}
+
+DJ_API int analysis_submit_files(const char** file_paths, int count, int flags, int* job_ids) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    if (!queue || !file_paths) return 0;
+
+    int queued = 0;
+    for (int i = 0; i < count; i++) {
+        int id = file_paths[i] ? queue->submitFile(file_paths[i], dj::g_engine->load_options, priorityFromFlags(flags),
+                                                   tierFromFlags(flags)) : -1;
+        if (job_ids) job_ids[i] = id;
+        if (id > 0) queued++;
+    }
+    return queued;
+}
+
+DJ_API int analysis_get_status(int job_id) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    dj::AnalysisStatus status;
+    if (!queue || !queue->getStatus(job_id, &status, nullptr)) return -1;
+    return static_cast<int>(status);
+}
+
+DJ_API double analysis_get_progress(int job_id) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    double progress = 0.0;
+    if (!queue || !queue->getStatus(job_id, nullptr, &progress)) return 0.0;
+    return progress;
+}
+
+DJ_API int analysis_get_result(int job_id, double* bpm, double* first_beat_seconds) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    auto result = queue ? queue->getResult(job_id) : nullptr;
+    if (!result) return -1;
+
+    if (bpm) *bpm = result->bpm;
+    if (first_beat_seconds) *first_beat_seconds = result->beats.empty() ? 0.0 : result->beats[0];
+    return 0;
+}
+
+DJ_API int analysis_get_features(int job_id, analysis_features_t* features) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    auto result = queue && features ? queue->getResult(job_id) : nullptr;
+    if (!result) return -1;
+
+    dj::copyAnalysisFeatures(*result, features);
+    return 0;
+}
+
+DJ_API void analysis_cancel(int job_id) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    if (queue) queue->cancel(job_id);
+}
+
+DJ_API void analysis_release(int job_id) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    if (queue) queue->release(job_id);
+}
+
+DJ_API void set_analysis_callback(analysis_callback_t callback) {
+    dj::AnalysisQueue* queue = analysisQueue();
+    if (queue) queue->setCallback(callback);
+}
+
+} // extern "C"
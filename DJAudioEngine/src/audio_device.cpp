@@ -0,0 +1,351 @@
+#include "dj_audio_engine.h"
+#include "dj_audio_internal.h"
+#include <portaudio.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+// Host-specific stream settings, where this PortAudio build has the host
+#if defined(_WIN32) && __has_include(<pa_win_wasapi.h>)
+#include <pa_win_wasapi.h>
+#define DJ_HAVE_PA_WASAPI 1
+#endif
+#if defined(_WIN32) && __has_include(<pa_asio.h>)
+#include <pa_asio.h>
+#define DJ_HAVE_PA_ASIO 1
+#endif
+
+static_assert(DJ_HOST_API_DIRECTSOUND == paDirectSound, "host API types must match PortAudio's");
+static_assert(DJ_HOST_API_MME == paMME, "host API types must match PortAudio's");
+static_assert(DJ_HOST_API_ASIO == paASIO, "host API types must match PortAudio's");
+static_assert(DJ_HOST_API_WDMKS == paWDMKS, "host API types must match PortAudio's");
+static_assert(DJ_HOST_API_WASAPI == paWASAPI, "host API types must match PortAudio's");
+
+namespace dj {
+
+// Buffer sizes the latency probe steps down through, halving each time
+static const int PROBE_MAX_BUFFER_FRAMES = 2048;
+static const int PROBE_MIN_BUFFER_FRAMES = 32;
+
+// Time after each start the probe doesn't count: many hosts glitch while
+// a stream spins up
+static const int PROBE_WARMUP_MS = 250;
+
+bool initializeAudioDevice() {
+    return Pa_Initialize() == paNoError;
+}
+
+void terminateAudioDevice() {
+    Pa_Terminate();
+}
+
+// PortAudio callback
+static int audioCallback(
+    const void* inputBuffer,
+    void* outputBuffer,
+    unsigned long framesPerBuffer,
+    const PaStreamCallbackTimeInfo* timeInfo,
+    PaStreamCallbackFlags statusFlags,
+    void* userData)
+{
+    EngineState* engine = static_cast<EngineState*>(userData);
+    int64_t start = nowNanoseconds();
+    
+    // In pipeline mode the decks are already rendered; running dry is as
+    // audible as the device doing so
+    bool underflow = false;
+    if (engine->render_ahead) {
+        underflow = !engine->render_ahead->pull(static_cast<float*>(outputBuffer), static_cast<int>(framesPerBuffer));
+    } else {
+        renderDeviceBlock(engine, static_cast<float*>(outputBuffer), static_cast<int>(framesPerBuffer));
+    }
+    int64_t elapsed = nowNanoseconds() - start;
+    
+    // Hosts that can't tell report zero times
+    double latency = 0.0;
+    if (timeInfo && timeInfo->outputBufferDacTime > 0.0 && timeInfo->currentTime > 0.0) {
+        latency = std::max(0.0, timeInfo->outputBufferDacTime - timeInfo->currentTime);
+    }
+    
+    unsigned flags = 0;
+    if (statusFlags & paInputUnderflow) flags |= PERF_INPUT_UNDERFLOW;
+    if (statusFlags & paInputOverflow) flags |= PERF_INPUT_OVERFLOW;
+    if ((statusFlags & paOutputUnderflow) || underflow) flags |= PERF_OUTPUT_UNDERFLOW;
+    if (statusFlags & paOutputOverflow) flags |= PERF_OUTPUT_OVERFLOW;
+    
+    // Pa_GetStreamCpuLoad may be called from the callback
+    engine->perf->endCallback(static_cast<int>(framesPerBuffer), start, elapsed, flags,
+                              Pa_GetStreamCpuLoad(engine->stream), latency);
+    return paContinue;
+}
+
+static void copyName(char* out, size_t size, const char* name) {
+    snprintf(out, size, "%s", name ? name : "");
+}
+
+// What engine_start() opens: the first ASIO device, else the default output
+static audio_output_config_t automaticOutput() {
+    audio_output_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.device = DJ_DEVICE_AUTOMATIC;
+    return config;
+}
+
+static PaDeviceIndex findAutomaticDevice() {
+    int device_count = Pa_GetDeviceCount();
+    for (int i = 0; i < device_count; i++) {
+        const PaDeviceInfo* device_info = Pa_GetDeviceInfo(i);
+        const PaHostApiInfo* host_api_info = Pa_GetHostApiInfo(device_info->hostApi);
+        if (host_api_info->type == paASIO && device_info->maxOutputChannels >= 2) {
+            return i;
+        }
+    }
+    return Pa_GetDefaultOutputDevice();
+}
+
+static uint64_t xrunCount(const engine_perf_t& perf) {
+    return perf.input_underflows + perf.input_overflows + perf.output_underflows + perf.output_overflows;
+}
+
+// Opens config's device and starts the stream. command_mutex held and no
+// stream open. reported_latency, if set, gets the stream's own figure.
+static bool openStream(EngineState* engine, const audio_output_config_t& config, int buffer_frames,
+                       double* reported_latency) {
+    PaDeviceIndex device = config.device >= 0 ? config.device : findAutomaticDevice();
+    if (device == paNoDevice || device >= Pa_GetDeviceCount()) {
+        return false;
+    }
+    
+    // The cue bus goes out on channels 3 and 4 of the same stream, so it
+    // can't drift from the master
+    int channels = (config.flags & DJ_OUTPUT_CUE) ? 4 : 2;
+    const PaDeviceInfo* device_info = Pa_GetDeviceInfo(device);
+    if (!device_info || device_info->maxOutputChannels < channels) {
+        return false;
+    }
+    PaHostApiTypeId host = Pa_GetHostApiInfo(device_info->hostApi)->type;
+    
+    PaStreamParameters outputParams;
+    outputParams.device = device;
+    outputParams.channelCount = channels;
+    outputParams.sampleFormat = paFloat32;
+    outputParams.suggestedLatency = config.suggested_latency_seconds > 0.0
+        ? config.suggested_latency_seconds : device_info->defaultLowOutputLatency;
+    outputParams.hostApiSpecificStreamInfo = nullptr;
+    
+#ifdef DJ_HAVE_PA_WASAPI
+    // The callback thread at Pro Audio priority; exclusive mode skips the
+    // shared-mode mixer and the period it adds
+    PaWasapiStreamInfo wasapi;
+    memset(&wasapi, 0, sizeof(wasapi));
+    if (host == paWASAPI) {
+        wasapi.size = sizeof(wasapi);
+        wasapi.hostApiType = paWASAPI;
+        wasapi.version = 1;
+        wasapi.flags = paWinWasapiThreadPriority;
+        wasapi.threadPriority = eThreadPriorityProAudio;
+        if (config.flags & DJ_OUTPUT_EXCLUSIVE) wasapi.flags |= paWinWasapiExclusive;
+        outputParams.hostApiSpecificStreamInfo = &wasapi;
+    }
+#endif
+    
+#ifdef DJ_HAVE_PA_ASIO
+    // Outputs past the first pair, for interfaces with several
+    PaAsioStreamInfo asio;
+    memset(&asio, 0, sizeof(asio));
+    int selectors[4];
+    for (int i = 0; i < 4; i++) {
+        selectors[i] = config.asio_first_channel + i;
+    }
+    if (host == paASIO && config.asio_first_channel > 0) {
+        if (config.asio_first_channel + channels > device_info->maxOutputChannels) {
+            return false;
+        }
+        asio.size = sizeof(asio);
+        asio.hostApiType = paASIO;
+        asio.version = 1;
+        asio.flags = paAsioUseChannelSelectors;
+        asio.channelSelectors = selectors;
+        outputParams.hostApiSpecificStreamInfo = &asio;
+    }
+#endif
+    (void)host;
+    
+    // Rendering at the size the stream is opened with, so hosts that vary
+    // their callbacks' sizes still get whole blocks
+    engine->output_channels = channels;
+    if (engine->render_ahead_blocks > 0) {
+        engine->render_ahead = std::make_unique<RenderAhead>(engine, buffer_frames, engine->render_ahead_blocks);
+    }
+    
+    PaError err = Pa_OpenStream(
+        &engine->stream,
+        nullptr,  // No input
+        &outputParams,
+        engine->sample_rate,
+        buffer_frames,
+        paClipOff,
+        audioCallback,
+        engine
+    );
+    
+    if (err != paNoError) {
+        DJ_LOG_WARN("Could not open %s at %d frames: %s", device_info->name, buffer_frames, Pa_GetErrorText(err));
+        engine->stream = nullptr;
+        engine->render_ahead.reset();
+        return false;
+    }
+    
+    // Start stream; the first callback has no predecessor to be late on
+    engine->perf->restartClock();
+    err = Pa_StartStream(engine->stream);
+    if (err != paNoError) {
+        DJ_LOG_WARN("Could not start %s: %s", device_info->name, Pa_GetErrorText(err));
+        Pa_CloseStream(engine->stream);
+        engine->stream = nullptr;
+        engine->render_ahead.reset();
+        return false;
+    }
+    
+    const PaStreamInfo* stream_info = Pa_GetStreamInfo(engine->stream);
+    double latency = stream_info ? stream_info->outputLatency : 0.0;
+    if (engine->render_ahead) latency += static_cast<double>(engine->render_ahead->getLatencyFrames()) / engine->sample_rate;
+    if (reported_latency) *reported_latency = latency;
+    DJ_LOG_INFO("Output: %s, %d channels, %d frames, %.2f ms reported latency", device_info->name, channels,
+                buffer_frames, latency * 1000.0);
+    return true;
+}
+
+// command_mutex held
+static void closeStream(EngineState* engine) {
+    if (!engine->stream) return;
+    
+    Pa_StopStream(engine->stream);
+    Pa_CloseStream(engine->stream);
+    engine->render_ahead.reset();
+    engine->stream = nullptr;
+    
+    // The callback has stopped; apply whatever it didn't get to
+    drainCommands(engine);
+}
+
+} // namespace dj
+
+// C API for the output stream
+extern "C" {
+
+DJ_API int engine_get_host_api_count() {
+    if (!dj::g_engine) return -1;
+    return std::max(0, static_cast<int>(Pa_GetHostApiCount()));
+}
+
+DJ_API int engine_get_host_api_info(int host_api, audio_host_api_info_t* info) {
+    if (!dj::g_engine || !info || host_api < 0 || host_api >= Pa_GetHostApiCount()) return -1;
+    const PaHostApiInfo* api = Pa_GetHostApiInfo(host_api);
+    if (!api) return -1;
+    
+    memset(info, 0, sizeof(*info));
+    dj::copyName(info->name, sizeof(info->name), api->name);
+    info->type = static_cast<int>(api->type);
+    info->device_count = api->deviceCount;
+    info->default_output_device = api->defaultOutputDevice;
+    return 0;
+}
+
+DJ_API int engine_get_device_count() {
+    if (!dj::g_engine) return -1;
+    return std::max(0, static_cast<int>(Pa_GetDeviceCount()));
+}
+
+DJ_API int engine_get_device_info(int device, audio_device_info_t* info) {
+    if (!dj::g_engine || !info || device < 0 || device >= Pa_GetDeviceCount()) return -1;
+    const PaDeviceInfo* device_info = Pa_GetDeviceInfo(device);
+    const PaHostApiInfo* api = device_info ? Pa_GetHostApiInfo(device_info->hostApi) : nullptr;
+    if (!api) return -1;
+    
+    memset(info, 0, sizeof(*info));
+    dj::copyName(info->name, sizeof(info->name), device_info->name);
+    info->host_api = device_info->hostApi;
+    info->host_api_type = static_cast<int>(api->type);
+    info->max_output_channels = device_info->maxOutputChannels;
+    info->default_sample_rate = device_info->defaultSampleRate;
+    info->default_low_latency_seconds = device_info->defaultLowOutputLatency;
+    info->default_high_latency_seconds = device_info->defaultHighOutputLatency;
+    info->is_default = (device == api->defaultOutputDevice) ? 1 : 0;
+    return 0;
+}
+
+DJ_API int engine_start() {
+    return engine_start_device(nullptr);
+}
+
+DJ_API int engine_start_device(const audio_output_config_t* config) {
+    if (!dj::g_engine) return -1;
+    audio_output_config_t settings = config ? *config : dj::automaticOutput();
+    
+    // Producers switch from applying in place to queueing once stream is set
+    std::lock_guard<std::mutex> lock(dj::g_engine->command_mutex);
+    if (dj::g_engine->stream) {
+        return -1;
+    }
+    
+    int frames = settings.buffer_frames > 0 ? settings.buffer_frames : dj::g_engine->buffer_size;
+    return dj::openStream(dj::g_engine, settings, frames, nullptr) ? 0 : -1;
+}
+
+DJ_API void engine_stop() {
+    if (!dj::g_engine) return;
+    
+    std::lock_guard<std::mutex> lock(dj::g_engine->command_mutex);
+    dj::closeStream(dj::g_engine);
+}
+
+DJ_API int engine_probe_latency(const audio_output_config_t* config, double seconds_per_size,
+                                audio_latency_probe_t* result) {
+    if (!dj::g_engine || !result) return -1;
+    audio_output_config_t settings = config ? *config : dj::automaticOutput();
+    memset(result, 0, sizeof(*result));
+    
+    auto period = std::chrono::duration<double>(std::max(0.1, seconds_per_size));
+    int largest = settings.buffer_frames > 0 ? settings.buffer_frames : dj::PROBE_MAX_BUFFER_FRAMES;
+    
+    for (int frames = largest; frames >= dj::PROBE_MIN_BUFFER_FRAMES; frames /= 2) {
+        double reported = 0.0;
+        {
+            // Only while stopped; the lock is dropped while the size runs,
+            // so the API stays usable
+            std::lock_guard<std::mutex> lock(dj::g_engine->command_mutex);
+            if (dj::g_engine->stream || !dj::openStream(dj::g_engine, settings, frames, &reported)) break;
+        }
+        
+        engine_perf_t before;
+        engine_perf_t after;
+        std::this_thread::sleep_for(std::chrono::milliseconds(dj::PROBE_WARMUP_MS));
+        dj::g_engine->perf->read(&before);
+        std::this_thread::sleep_for(period);
+        dj::g_engine->perf->read(&after);
+        
+        {
+            std::lock_guard<std::mutex> lock(dj::g_engine->command_mutex);
+            dj::closeStream(dj::g_engine);
+        }
+        result->sizes_tried++;
+        
+        // Hosts that never flag an underflow still show slow callbacks
+        uint64_t glitches = dj::xrunCount(after) - dj::xrunCount(before) + after.deadline_misses - before.deadline_misses;
+        DJ_LOG_INFO("Latency probe: %d frames, %llu glitches, %.2f ms to the DAC", frames,
+                    static_cast<unsigned long long>(glitches), after.output_latency_us / 1000.0);
+        if (glitches > 0 || after.callbacks == before.callbacks) break;
+        
+        result->buffer_frames = frames;
+        result->output_latency_seconds = after.output_latency_us / 1e6;
+        result->reported_latency_seconds = reported;
+    }
+    
+    return result->buffer_frames > 0 ? 0 : -1;
+}
+
+} // extern "C"
@@ -0,0 +1,52 @@
+#include "dj_audio_engine.h"
+#include "dj_audio_internal.h"
+
+// No output device: the engine only renders through engine_render_offline.
+// Linked instead of audio_device.cpp where PortAudio isn't wanted.
+
+namespace dj {
+
+bool initializeAudioDevice() {
+    return true;
+}
+
+void terminateAudioDevice() {
+}
+
+} // namespace dj
+
+extern "C" {
+
+DJ_API int engine_get_host_api_count() {
+    return 0;
+}
+
+DJ_API int engine_get_host_api_info(int /*host_api*/, audio_host_api_info_t* /*info*/) {
+    return -1;
+}
+
+DJ_API int engine_get_device_count() {
+    return 0;
+}
+
+DJ_API int engine_get_device_info(int /*device*/, audio_device_info_t* /*info*/) {
+    return -1;
+}
+
+DJ_API int engine_start() {
+    return -1;
+}
+
+DJ_API int engine_start_device(const audio_output_config_t* /*config*/) {
+    return -1;
+}
+
+DJ_API void engine_stop() {
+}
+
+DJ_API int engine_probe_latency(const audio_output_config_t* /*config*/, double /*seconds_per_size*/,
+                                audio_latency_probe_t* /*result*/) {
+    return -1;
+}
+
+} // extern "C"
@@ -1,51 +1,403 @@
 #include "dj_audio_engine.h"
 #include "dj_audio_internal.h"
-#include <portaudio.h>
+#include "simd.h"
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <vector>
 
+static_assert(DJ_HOT_CUE_COUNT == dj::HOT_CUE_COUNT, "hot cue counts must match");
+
 namespace dj {
 
 // Global engine state
 EngineState* g_engine = nullptr;
 
-// PortAudio callback
-static int audioCallback(
-    const void* inputBuffer,
-    void* outputBuffer,
-    unsigned long framesPerBuffer,
-    const PaStreamCallbackTimeInfo* timeInfo,
-    PaStreamCallbackFlags statusFlags,
-    void* userData)
-{
-    EngineState* engine = static_cast<EngineState*>(userData);
-    float* output = static_cast<float*>(outputBuffer);
+// Pending parameter changes; far more than the UI can issue per callback
+static const size_t COMMAND_QUEUE_CAPACITY = 1024;
+
+// Commands waiting for their frame or beat; far more than a set needs
+static const size_t SCHEDULER_CAPACITY = 256;
+
+// Ramps running or waiting to start: one per parameter of 8 decks and more
+static const size_t AUTOMATION_CAPACITY = 64;
+
+// How long a producer waits for the callback to make room before dropping
+static const int COMMAND_PUSH_TIMEOUT_MS = 50;
+
+// Render scratch covers at least this many frames per block, whatever
+// buffer_size was asked for - hosts may deliver larger blocks than requested
+static const int MIN_RENDER_BLOCK_FRAMES = 4096;
+
+// Stereo scratch buffers the render graph takes per block beyond one per deck
+static const int RENDER_SCRATCH_SPARE_BUFFERS = 2;
+
+// Render workers the pool starts with at most; the callback thread is the
+// one more that takes deck jobs
+static const int MAX_RENDER_WORKERS = 3;
+
+// Background analysis threads. Each analysis spreads its detection function
+// over every core, but decoding is one thread per file, so library scans
+// want a few files in flight.
+static const int MIN_ANALYSIS_WORKERS = 2;
+static const int MAX_ANALYSIS_WORKERS = 4;
+
+// Decoded tracks kept for decks to take, until engine_set_track_cache says
+// otherwise: two preloaded ten-minute tracks as float at 48 kHz
+static const double TRACK_CACHE_DEFAULT_MEGABYTES = 512.0;
+
+static uint64_t megabytesToBytes(double megabytes) {
+    return static_cast<uint64_t>(std::max(0.0, megabytes) * 1024.0 * 1024.0);
+}
+
+static Command makeCommand(Command::Type type, int deck, double value = 0.0,
+                           int64_t position = 0, int other = -1) {
+    Command command;
+    command.type = type;
+    command.deck = deck;
+    command.other = other;
+    command.value = value;
+    command.position = position;
+    command.due_frame = -1;
+    command.quantize_deck = -1;
+    command.quantize_beats = 1;
+    command.ramp_seconds = 0.0;
+    command.ramp_shape = 0;
+    return command;
+}
+
+// Applied at stream frame at_frame, or when quantize_deck reaches its next
+// multiple of quantize_beats beats (at_frame < 0)
+static Command scheduleCommand(Command command, long long at_frame, int quantize_deck, int quantize_beats) {
+    if (at_frame >= 0) {
+        command.due_frame = at_frame;
+    } else {
+        command.quantize_deck = quantize_deck;
+        command.quantize_beats = std::max(1, quantize_beats);
+    }
+    return command;
+}
+
+// Render thread, or any thread while the stream is stopped
+static void applyCommand(EngineState* engine, const Command& command) {
+    int deck_count = static_cast<int>(engine->decks.size());
+    Deck* deck = (command.deck >= 0 && command.deck < deck_count) ? engine->decks[command.deck].get() : nullptr;
+    Deck* other = (command.other >= 0 && command.other < deck_count) ? engine->decks[command.other].get() : nullptr;
+    
+    if (command.isScheduled()) {
+        int quantize = command.quantize_deck;
+        const Deck* reference = (quantize >= 0 && quantize < deck_count) ? engine->decks[quantize].get() : nullptr;
+        if (!engine->scheduler->add(command, reference)) {
+            DJ_LOG_WARN("Scheduler full, dropped command %d for deck %d", static_cast<int>(command.type), command.deck);
+        }
+        return;
+    }
+    
+    switch (command.type) {
+        case Command::Type::DeckPlay:
+            if (deck) deck->play(command.position);
+            break;
+        case Command::Type::DeckPlaySynced:
+            if (deck && other) {
+                // Cued now, then let go on the master's next beat at that
+                // exact frame
+                int64_t cue = engine->sync_manager->cueSynced(deck, other, engine->sample_rate);
+                Command play = scheduleCommand(makeCommand(Command::Type::DeckPlay, command.deck, 0.0, cue),
+                                               -1, command.other, 1);
+                bool scheduled = cue >= 0 && engine->scheduler->reserve() && engine->scheduler->add(play, other);
+                if (!scheduled) deck->play(cue);
+            }
+            break;
+        case Command::Type::DeckPause:
+            if (deck) deck->pause();
+            break;
+        case Command::Type::DeckStop:
+            if (deck) deck->stop();
+            break;
+        case Command::Type::DeckSetPosition:
+            if (deck) deck->setPosition(command.value);
+            break;
+        case Command::Type::DeckHotCue:
+            if (deck) deck->triggerHotCue(command.other);
+            break;
+        case Command::Type::DeckLoopIn:
+            if (deck) deck->loopIn();
+            break;
+        case Command::Type::DeckLoopOut:
+            if (deck) deck->loopOut();
+            break;
+        case Command::Type::DeckSetLoop:
+            if (deck) deck->setLoop(static_cast<int64_t>(command.value), command.position);
+            break;
+        case Command::Type::DeckLoopBeats:
+            if (deck) deck->setBeatLoop(command.value);
+            break;
+        case Command::Type::DeckLoopExit:
+            if (deck) deck->exitLoop();
+            break;
+        case Command::Type::DeckLoopRoll:
+            if (!deck) break;
+            if (command.value > 0.0) {
+                deck->startLoopRoll(command.value);
+            } else {
+                deck->endLoopRoll();
+            }
+            break;
+        case Command::Type::DeckSetAutoGain:
+            if (deck) deck->setAutoGain(command.other != 0, command.value);
+            break;
+        case Command::Type::DeckSetVolume:
+            // Setting a parameter takes it from its automation
+            engine->automation->cancel(static_cast<int>(AutomationTarget::DeckVolume), command.deck);
+            if (!deck) break;
+            deck->setVolume(static_cast<float>(command.value));
+            engine->applied_controls.volume[command.deck] = static_cast<uint32_t>(command.other);
+            break;
+        case Command::Type::DeckSetTempo:
+            engine->automation->cancel(static_cast<int>(AutomationTarget::DeckTempo), command.deck);
+            if (deck) deck->setTempo(command.value);
+            break;
+        case Command::Type::DeckSetPitch:
+            if (deck) deck->setPitch(command.value);
+            break;
+        case Command::Type::DeckSetStretchMode:
+            if (deck) deck->setStretchMode(static_cast<StretchMode>(static_cast<int>(command.value)));
+            break;
+        case Command::Type::DeckSetEQLow:
+            engine->automation->cancel(static_cast<int>(AutomationTarget::DeckEQLow), command.deck);
+            if (deck) deck->setEQLow(static_cast<float>(command.value));
+            break;
+        case Command::Type::DeckSetEQMid:
+            engine->automation->cancel(static_cast<int>(AutomationTarget::DeckEQMid), command.deck);
+            if (deck) deck->setEQMid(static_cast<float>(command.value));
+            break;
+        case Command::Type::DeckSetEQHigh:
+            engine->automation->cancel(static_cast<int>(AutomationTarget::DeckEQHigh), command.deck);
+            if (deck) deck->setEQHigh(static_cast<float>(command.value));
+            break;
+        case Command::Type::MixerSetCrossfader:
+            engine->automation->cancel(static_cast<int>(AutomationTarget::Crossfader), -1);
+            engine->mixer->setCrossfader(static_cast<float>(command.value));
+            engine->applied_controls.crossfader = static_cast<uint32_t>(command.other);
+            break;
+        case Command::Type::MixerSetAssign:
+            engine->mixer->setAssign(command.deck, static_cast<CrossfaderSide>(static_cast<int>(command.value)));
+            break;
+        case Command::Type::MixerSetPFL:
+            engine->mixer->setPFL(command.deck, command.value != 0.0);
+            break;
+        case Command::Type::MixerSetCueMix:
+            engine->mixer->setCueMix(static_cast<float>(command.value));
+            engine->applied_controls.cue_mix = static_cast<uint32_t>(command.other);
+            break;
+        case Command::Type::MixerSetCueVolume:
+            engine->mixer->setCueVolume(static_cast<float>(command.value));
+            break;
+        case Command::Type::SyncEnable:
+            engine->sync_manager->enable(command.deck, command.other);
+            break;
+        case Command::Type::SyncDisable:
+            engine->sync_manager->disable(command.deck);
+            break;
+        case Command::Type::SyncAlignNow:
+            if (deck && other) engine->sync_manager->alignNow(deck, other);
+            break;
+        case Command::Type::ScheduleCancel:
+            engine->scheduler->cancel(command.deck);
+            break;
+        case Command::Type::AutomationRamp: {
+            // Until the stream runs again, "now" is where it stopped
+            int64_t start = command.position >= 0 ? command.position : engine->stream_frame.load();
+            engine->automation->add(static_cast<AutomationTarget>(command.other), command.deck, command.value,
+                                    start, command.ramp_seconds, static_cast<AutomationShape>(command.ramp_shape));
+            break;
+        }
+        case Command::Type::AutomationCancel:
+            engine->automation->cancel(command.other, command.deck);
+            break;
+        case Command::Type::PerfReset:
+            engine->perf->reset();
+            break;
+    }
+}
+
+void drainCommands(EngineState* engine) {
+    Command command;
+    while (engine->commands->pop(&command)) {
+        applyCommand(engine, command);
+    }
+}
+
+// API threads. With no stream running nothing renders, so the change is
+// applied in place; otherwise it waits for the start of the next callback.
+// False when it was dropped. A master-stage control's command also leaves
+// its value in control, numbered in its other, for RenderAhead::pull.
+static bool submitCommand(const Command& command, LiveControl* control = nullptr) {
+    EngineState* engine = g_engine;
+    std::lock_guard<std::mutex> lock(engine->command_mutex);
+    
+    // Numbered under the lock, so changes reach the queue in their order
+    Command numbered = command;
+    float previous = 0.0f;
+    if (control) {
+        uint32_t change = control->change.load(std::memory_order_relaxed) + 1;
+        previous = control->value.load(std::memory_order_relaxed);
+        numbered.other = static_cast<int>(change);
+        control->value.store(static_cast<float>(command.value), std::memory_order_relaxed);
+        control->change.store(change, std::memory_order_release);
+    }
+    
+    if (!engine->stream) {
+        applyCommand(engine, numbered);
+        return true;
+    }
+    
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(COMMAND_PUSH_TIMEOUT_MS);
+    while (!engine->commands->push(numbered)) {
+        // Only if the callback has stalled - never block the caller for good
+        if (std::chrono::steady_clock::now() > deadline) {
+            if (control) {
+                // Taken back, or pull() would hold it over the render thread's for good
+                control->change.store(control->change.load(std::memory_order_relaxed) - 1, std::memory_order_release);
+                control->value.store(previous, std::memory_order_relaxed);
+            }
+            engine->perf->addDroppedCommand();
+            DJ_LOG_WARN("Command queue full for %d ms, dropped command %d for deck %d",
+                        COMMAND_PUSH_TIMEOUT_MS, static_cast<int>(command.type), command.deck);
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+// API threads: a scheduled command, with its place in the scheduler taken
+// first; -1 when the scheduler is full or the command was dropped
+static int submitScheduled(const Command& command) {
+    EventScheduler& scheduler = *g_engine->scheduler;
+    if (!scheduler.reserve()) {
+        DJ_LOG_WARN("Scheduler full, refused command %d for deck %d", static_cast<int>(command.type), command.deck);
+        return -1;
+    }
+    if (!submitCommand(command)) {
+        scheduler.release();
+        return -1;
+    }
+    return 0;
+}
+
+// Stems from offset frames in, or null without them
+static float* const* offsetStems(float* const* stems, int count, int offset, float** offset_stems) {
+    if (!stems) return nullptr;
+    for (int i = 0; i < count; i++) {
+        offset_stems[i] = stems[i] + offset * 2;
+    }
+    return offset_stems;
+}
+
+// Mixes all decks into output, in pieces if the span outgrew the scratch
+static void mixSpan(EngineState* engine, Deck* const* decks, int deck_count, float* output, float* cue_output,
+                    float* const* stems, int frames) {
+    float* piece_stems[MAX_DECKS];
+    for (int offset = 0; offset < frames; offset += engine->max_block_frames) {
+        int block = std::min(engine->max_block_frames, frames - offset);
+        engine->arena.reset();
+        engine->mixer->mix(
+            decks,
+            deck_count,
+            output + offset * 2,
+            cue_output ? cue_output + offset * 2 : nullptr,
+            block,
+            engine->arena,
+            engine->render_pool.get(),
+            offsetStems(stems, deck_count, offset, piece_stems)
+        );
+    }
+}
+
+void renderEngineBlock(EngineState* engine, float* output, int frames, float* cue_output, float* const* stems) {
+    // Nothing below may allocate; DJ_DEBUG_RT_ALLOC builds assert on it
+    RealtimeScope realtime;
+    enableFlushToZero();
+    
+    // Parameter changes land on a block boundary; scheduled ones join the
+    // scheduler
+    drainCommands(engine);
+    
+    Deck* decks[MAX_DECKS];
+    int deck_count = static_cast<int>(engine->decks.size());
+    for (int i = 0; i < deck_count; i++) {
+        decks[i] = engine->decks[i].get();
+    }
     
     // Update sync before mixing
-    Deck* deck_array[2] = { engine->decks[0].get(), engine->decks[1].get() };
-    engine->sync_manager->update(deck_array);
-    
-    // Mix both decks
-    engine->mixer->mix(
-        engine->decks[0].get(),
-        engine->decks[1].get(),
-        output,
-        framesPerBuffer
-    );
-    
-    // Throttle position callbacks (update every ~10 callbacks = ~100ms at 512 samples)
-    engine->callback_counter++;
-    if (engine->callback_counter >= 10) {
-        engine->callback_counter = 0;
-        
-        if (engine->position_callback) {
-            auto callback = reinterpret_cast<position_callback_t>(engine->position_callback);
-            callback(0, engine->decks[0]->getPosition());
-            callback(1, engine->decks[1]->getPosition());
+    int64_t sync_start = nowNanoseconds();
+    engine->sync_manager->update(decks, deck_count, static_cast<double>(frames) / engine->sample_rate);
+    engine->perf->addStage(PerfStage::Sync, nowNanoseconds() - sync_start);
+    
+    // Mix all decks in spans that end where a scheduled command is due, so
+    // each is applied on its exact frame
+    int64_t stream_frame = engine->stream_frame.load(std::memory_order_relaxed);
+    float* span_stems[MAX_DECKS];
+    for (int done = 0; done < frames;) {
+        Command command;
+        while (engine->scheduler->popDue(decks, deck_count, stream_frame + done, &command)) {
+            applyCommand(engine, command);
         }
+        
+        // Automated parameters reach their values for the end of the span;
+        // the mixer ramps to them across it
+        int span = engine->scheduler->framesUntilNext(decks, deck_count, stream_frame + done, frames - done);
+        span = std::min(span, engine->automation->framesUntilNext(stream_frame + done, span));
+        engine->automation->apply(decks, deck_count, engine->mixer.get(), stream_frame + done, stream_frame + done + span);
+        mixSpan(engine, decks, deck_count, output + done * 2, cue_output ? cue_output + done * 2 : nullptr,
+                offsetStems(stems, deck_count, done, span_stems), span);
+        done += span;
     }
+    engine->stream_frame.store(stream_frame + frames, std::memory_order_relaxed);
     
-    return paContinue;
+    // The render pool has joined, so the decks' timings are safe to take
+    engine->perf->addStage(PerfStage::Mix, engine->mixer->takeMixTime());
+    for (int i = 0; i < deck_count; i++) {
+        engine->perf->addDeck(i, decks[i]->takeTimings());
+    }
+    engine->perf->endBlock();
+    
+    // The UI and the notifier thread read the rest from here
+    engine->status->publish(decks, deck_count, engine->mixer->getCrossfader(), *engine->perf, output, frames);
+}
+
+void renderDeviceBlock(EngineState* engine, float* output, int frames) {
+    if (engine->output_channels != 4) {
+        renderEngineBlock(engine, output, frames);
+        return;
+    }
+    
+    // Both buses from the one pass over the decks, then side by side
+    float* master = engine->device_master.data();
+    float* cue = engine->device_cue.data();
+    for (int offset = 0; offset < frames; offset += engine->max_block_frames) {
+        int block = std::min(engine->max_block_frames, frames - offset);
+        renderEngineBlock(engine, master, block, cue);
+        
+        float* out = output + offset * 4;
+        for (int i = 0; i < block; i++) {
+            out[i * 4] = master[i * 2];
+            out[i * 4 + 1] = master[i * 2 + 1];
+            out[i * 4 + 2] = cue[i * 2];
+            out[i * 4 + 3] = cue[i * 2 + 1];
+        }
+    }
+}
+
+static int defaultRenderWorkers(int deck_count) {
+    int cores = static_cast<int>(std::thread::hardware_concurrency());
+    return std::max(0, std::min({ deck_count - 1, cores - 1, MAX_RENDER_WORKERS }));
+}
+
+static int defaultAnalysisWorkers() {
+    int cores = static_cast<int>(std::thread::hardware_concurrency());
+    return std::max(MIN_ANALYSIS_WORKERS, std::min(cores / 2, MAX_ANALYSIS_WORKERS));
 }
 
 } // namespace dj
@@ -54,13 +406,20 @@ static int audioCallback(
 extern "C" {
 
 DJ_API int engine_init(int sample_rate, int buffer_size) {
+    return engine_init_decks(sample_rate, buffer_size, 2);
+}
+
+DJ_API int engine_init_decks(int sample_rate, int buffer_size, int deck_count) {
     if (dj::g_engine) {
         return -1;  // Already initialized
     }
+    if (deck_count < 1 || deck_count > dj::MAX_DECKS) {
+        return -1;
+    }
     
-    // Initialize PortAudio
-    PaError err = Pa_Initialize();
-    if (err != paNoError) {
+    dj::Logger::instance().start(nullptr);
+    
+    if (!dj::initializeAudioDevice()) {
         return -1;
     }
     
@@ -69,13 +428,41 @@ DJ_API int engine_init(int sample_rate, int buffer_size) {
     dj::g_engine->sample_rate = sample_rate;
     dj::g_engine->buffer_size = buffer_size;
     dj::g_engine->stream = nullptr;
-    dj::g_engine->position_callback = nullptr;
-    dj::g_engine->track_ended_callback = nullptr;
-    dj::g_engine->callback_counter = 0;
+    dj::g_engine->render_ahead_blocks = 0;
+    dj::g_engine->output_channels = 2;
+    dj::g_engine->commands = std::make_unique<dj::CommandQueue>(dj::COMMAND_QUEUE_CAPACITY);
+    dj::g_engine->scheduler = std::make_unique<dj::EventScheduler>(dj::SCHEDULER_CAPACITY, sample_rate);
+    dj::g_engine->automation = std::make_unique<dj::Automation>(dj::AUTOMATION_CAPACITY, sample_rate);
+    dj::g_engine->stream_frame = 0;
+    
+    // All render scratch is reserved here; the callback never allocates
+    dj::g_engine->max_block_frames = std::max(buffer_size, dj::MIN_RENDER_BLOCK_FRAMES);
+    dj::g_engine->arena.reserve(static_cast<size_t>(dj::g_engine->max_block_frames) * 2 * sizeof(float)
+                                * (deck_count + dj::RENDER_SCRATCH_SPARE_BUFFERS));
+    dj::g_engine->device_master.assign(static_cast<size_t>(dj::g_engine->max_block_frames) * 2, 0.0f);
+    dj::g_engine->device_cue.assign(static_cast<size_t>(dj::g_engine->max_block_frames) * 2, 0.0f);
+    
+    // Disabled until engine_set_pcm_cache gives it a directory
+    dj::g_engine->pcm_cache = std::make_unique<dj::PcmCache>();
+    dj::g_engine->load_options.pcm_cache = dj::g_engine->pcm_cache.get();
+    
+    // Likewise until engine_set_analysis_database opens a file
+    dj::g_engine->analysis_db = std::make_unique<dj::AnalysisDatabase>();
+    dj::g_engine->load_options.analysis_db = dj::g_engine->analysis_db.get();
+    
+    dj::g_engine->track_cache = std::make_unique<dj::TrackCache>(dj::megabytesToBytes(dj::TRACK_CACHE_DEFAULT_MEGABYTES));
+    dj::g_engine->load_options.track_cache = dj::g_engine->track_cache.get();
     
     // Create decks
-    dj::g_engine->decks[0] = std::make_unique<dj::Deck>(sample_rate);
-    dj::g_engine->decks[1] = std::make_unique<dj::Deck>(sample_rate);
+    for (int i = 0; i < deck_count; i++) {
+        dj::g_engine->decks.push_back(std::make_unique<dj::Deck>(sample_rate));
+    }
+    dj::g_engine->render_pool = std::make_unique<dj::RenderPool>(dj::defaultRenderWorkers(deck_count));
+    dj::g_engine->analysis_queue = std::make_unique<dj::AnalysisQueue>(dj::defaultAnalysisWorkers());
+    dj::g_engine->cue_primer = std::make_unique<dj::CuePrimer>(dj::g_engine->decks);
+    dj::g_engine->status = std::make_unique<dj::StatusBlock>(sample_rate);
+    dj::g_engine->status_notifier = std::make_unique<dj::StatusNotifier>(*dj::g_engine->status);
+    dj::g_engine->perf = std::make_unique<dj::PerfCounters>(sample_rate);
     
     // Create mixer and sync manager
     dj::g_engine->mixer = std::make_unique<dj::Mixer>();
@@ -89,312 +476,502 @@ DJ_API void engine_shutdown() {
     
     engine_stop();
     
+    // Before anything a callback could still reach is torn down
+    dj::g_engine->status_notifier.reset();
+    
     delete dj::g_engine;
     dj::g_engine = nullptr;
     
-    Pa_Terminate();
+    dj::terminateAudioDevice();
+    
+    // Flushes whatever is still queued
+    dj::Logger::instance().stop();
 }
 
-DJ_API int engine_start() {
-    if (!dj::g_engine || dj::g_engine->stream) {
-        return -1;
-    }
+DJ_API int engine_get_deck_count() {
+    if (!dj::g_engine) return 0;
+    return static_cast<int>(dj::g_engine->decks.size());
+}
+
+DJ_API int engine_set_render_threads(int count) {
+    if (!dj::g_engine || count < 0) return -1;
     
-    // Open default output device with ASIO if available
-    PaStreamParameters outputParams;
-    outputParams.device = Pa_GetDefaultOutputDevice();
+    // Workers are only replaced while nothing renders
+    std::lock_guard<std::mutex> lock(dj::g_engine->command_mutex);
+    if (dj::g_engine->stream) return -1;
     
-    // Try to find ASIO device
-    int deviceCount = Pa_GetDeviceCount();
-    for (int i = 0; i < deviceCount; i++) {
-        const PaDeviceInfo* deviceInfo = Pa_GetDeviceInfo(i);
-        const PaHostApiInfo* hostApiInfo = Pa_GetHostApiInfo(deviceInfo->hostApi);
-        
-        if (hostApiInfo->type == paASIO) {
-            outputParams.device = i;
-            break;
-        }
-    }
+    dj::g_engine->render_pool = count > 0 ? std::make_unique<dj::RenderPool>(count) : nullptr;
+    return 0;
+}
+
+DJ_API int engine_set_render_ahead(int blocks) {
+    if (!dj::g_engine || blocks < 0 || blocks > dj::MAX_RENDER_AHEAD_BLOCKS) return -1;
+    
+    // Takes effect when the next stream opens
+    std::lock_guard<std::mutex> lock(dj::g_engine->command_mutex);
+    if (dj::g_engine->stream) return -1;
     
-    if (outputParams.device == paNoDevice) {
+    dj::g_engine->render_ahead_blocks = blocks;
+    return 0;
+}
+
+// Deck operations
+DJ_API int deck_load_track(int deck_id, const char* file_path) {
+    if (!dj::isValidDeck(deck_id) || !file_path) {
         return -1;
     }
     
-    const PaDeviceInfo* deviceInfo = Pa_GetDeviceInfo(outputParams.device);
-    outputParams.channelCount = 2;
-    outputParams.sampleFormat = paFloat32;
-    outputParams.suggestedLatency = deviceInfo->defaultLowOutputLatency;
-    outputParams.hostApiSpecificStreamInfo = nullptr;
-    
-    // Open stream
-    PaError err = Pa_OpenStream(
-        &dj::g_engine->stream,
-        nullptr,  // No input
-        &outputParams,
-        dj::g_engine->sample_rate,
-        dj::g_engine->buffer_size,
-        paClipOff,
-        dj::audioCallback,
-        dj::g_engine
-    );
-    
-    if (err != paNoError) {
-        return -1;
+    // Whatever was analyzing the outgoing track is no longer wanted
+    dj::g_engine->analysis_queue->cancelDeck(deck_id);
+    
+    return dj::g_engine->decks[deck_id]->loadTrack(file_path, dj::g_engine->load_options) ? 0 : -1;
+}
+
+DJ_API int deck_load_track_memory(int deck_id, const void* data, size_t size, const char* format_hint,
+                                  buffer_release_callback_t release, void* user_data) {
+    // Owns the release from here, so it runs exactly once whatever happens.
+    // Without one the bytes are only the caller's until this returns.
+    std::shared_ptr<const dj::EncodedBuffer> buffer;
+    if (release) {
+        buffer = std::make_shared<dj::EncodedBuffer>(data, size, release, user_data);
+    } else if (data && size > 0) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        buffer = std::make_shared<dj::EncodedBuffer>(std::vector<uint8_t>(bytes, bytes + size));
     }
     
-    // Start stream
-    err = Pa_StartStream(dj::g_engine->stream);
-    if (err != paNoError) {
-        Pa_CloseStream(dj::g_engine->stream);
-        dj::g_engine->stream = nullptr;
+    if (!dj::isValidDeck(deck_id) || !buffer || buffer->size() == 0) {
         return -1;
     }
     
-    return 0;
+    dj::g_engine->analysis_queue->cancelDeck(deck_id);
+    return dj::g_engine->decks[deck_id]->loadTrackMemory(std::move(buffer), format_hint,
+                                                         dj::g_engine->load_options) ? 0 : -1;
 }
 
-DJ_API void engine_stop() {
-    if (!dj::g_engine || !dj::g_engine->stream) return;
+DJ_API int deck_preload(const char* file_path) {
+    if (!dj::g_engine || !file_path) return -1;
     
-    Pa_StopStream(dj::g_engine->stream);
-    Pa_CloseStream(dj::g_engine->stream);
-    dj::g_engine->stream = nullptr;
+    // The options a deck will look the track up with
+    dj::LoadOptions options = dj::g_engine->load_options;
+    options.target_sample_rate = dj::g_engine->sample_rate;
+    if (dj::g_engine->track_cache->contains(file_path, options)) return 0;
+    if (dj::g_engine->track_cache->getBudget() == 0) return -1;  // Nowhere to keep it
+    
+    return dj::g_engine->analysis_queue->submitPreload(file_path, options, dj::g_engine->track_cache.get());
 }
 
-// Deck operations
-DJ_API int deck_load_track(int deck_id, const char* file_path) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1 || !file_path) {
-        return -1;
+DJ_API void engine_set_load_mode(int mode, double preroll_seconds) {
+    if (!dj::g_engine) return;
+    dj::g_engine->load_options.mode = (mode == 1) ? dj::LoadMode::Progressive : dj::LoadMode::Full;
+    if (preroll_seconds > 0.0) {
+        dj::g_engine->load_options.preroll_seconds = preroll_seconds;
     }
-    
-    return dj::g_engine->decks[deck_id]->loadTrack(file_path) ? 0 : -1;
+}
+
+DJ_API void engine_set_storage_format(int format) {
+    if (!dj::g_engine) return;
+    switch (format) {
+        case 1:  dj::g_engine->load_options.storage_format = dj::SampleFormat::Int16; break;
+        case 2:  dj::g_engine->load_options.storage_format = dj::SampleFormat::Float16; break;
+        default: dj::g_engine->load_options.storage_format = dj::SampleFormat::Float32; break;
+    }
+}
+
+DJ_API void engine_set_streaming_threshold(double seconds) {
+    if (!dj::g_engine) return;
+    dj::g_engine->load_options.streaming_threshold_seconds = std::max(0.0, seconds);
+}
+
+DJ_API void engine_set_pcm_cache(const char* directory, double max_megabytes) {
+    if (!dj::g_engine) return;
+    dj::g_engine->pcm_cache->configure(directory, dj::megabytesToBytes(max_megabytes));
+}
+
+DJ_API void engine_set_track_cache(double max_megabytes) {
+    if (!dj::g_engine) return;
+    dj::g_engine->track_cache->setBudget(dj::megabytesToBytes(max_megabytes));
+}
+
+DJ_API int engine_set_analysis_database(const char* path) {
+    if (!dj::g_engine) return -1;
+    if (!path || !*path) {
+        dj::g_engine->analysis_db->close();
+        return 0;
+    }
+    return dj::g_engine->analysis_db->open(path) ? 0 : -1;
+}
+
+DJ_API void engine_set_log_level(int level) {
+    level = std::max(0, std::min(level, static_cast<int>(dj::LogLevel::Off)));
+    dj::Logger::instance().setLevel(static_cast<dj::LogLevel>(level));
+}
+
+DJ_API void engine_set_log_file(const char* path) {
+    // Restart the writer on the new file. Stopping drains what is queued to
+    // the old one, so only records after this call go to the new file.
+    dj::Logger::instance().stop();
+    dj::Logger::instance().start(path);
 }
 
 DJ_API void deck_unload_track(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::g_engine->analysis_queue->cancelDeck(deck_id);
     dj::g_engine->decks[deck_id]->unloadTrack();
 }
 
 DJ_API void deck_play(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->play();
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckPlay, deck_id, 0.0, -1));
 }
 
 DJ_API void deck_play_synced(int deck_id, int master_deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1 || master_deck_id < 0 || master_deck_id > 1) return;
-    
-    FILE* logFile = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-    
-    dj::Deck* master = dj::g_engine->decks[master_deck_id].get();
-    dj::Deck* slave = dj::g_engine->decks[deck_id].get();
-    
-    double master_bpm = master->getBPM();
-    double slave_bpm = slave->getBPM();
-    
-    if (logFile) {
-        fprintf(logFile, "=== DJ-STYLE SYNC (FIXED) ===\n");
-        fprintf(logFile, "master_bpm=%.1f, slave_bpm=%.1f\n", master_bpm, slave_bpm);
-    }
-    
-    if (master_bpm <= 0 || slave_bpm <= 0) {
-        if (logFile) {
-            fprintf(logFile, "No BPM, just playing\n");
-            fclose(logFile);
-        }
-        slave->play();
-        return;
-    }
-    
-    // Step 1: Match tempo
-    double tempo_ratio = master_bpm / slave_bpm;
-    slave->setTempo(tempo_ratio);
-    
-    // Same tempo - alignNow handles it
-    if (std::abs(tempo_ratio - 1.0) < 0.01) {
-        if (logFile) {
-            fprintf(logFile, "Same tempo, using alignNow\n");
-            fclose(logFile);
-        }
-        slave->play();
-        return;
-    }
-    
-    int sample_rate = 44100;
-    
-    // Step 2: Get beat offsets - the ACTUAL position of the first kick in each track
-    double master_first_kick = master->getBeatOffset();  // e.g., 0.058 sec
-    double slave_first_kick = slave->getBeatOffset();    // e.g., 0.449 sec
-    
-    // Step 3: Calculate beat intervals
-    double master_spb = 60.0 / master_bpm;  // Seconds per beat in master (real-time)
-    double slave_spb = 60.0 / slave_bpm;    // Seconds per beat in slave (source time)
-    
-    // Step 4: Find where master is in its beat cycle
-    // Master's beat grid starts at master_first_kick and repeats every master_spb
-    double master_pos = master->getPosition();
-    double master_time_since_first_kick = master_pos - master_first_kick;
-    
-    // How far into the current beat cycle? (phase)
-    double master_phase = fmod(master_time_since_first_kick, master_spb);
-    if (master_phase < 0) master_phase += master_spb;
-    
-    // Time until master's next kick
-    double time_to_master_kick = master_spb - master_phase;
-    
-    if (logFile) {
-        fprintf(logFile, "Master: pos=%.3f, first_kick=%.3f, phase=%.3fms, time_to_kick=%.1fms\n",
-                master_pos, master_first_kick, master_phase * 1000, time_to_master_kick * 1000);
-    }
-    
-    // Step 5: DJ-STYLE CUE AND START
-    // A DJ cues the incoming track at its first kick (slave_first_kick)
-    // Then presses play when the master hits a kick
-    // 
-    // Since we can't truly "wait", we start the slave NOW at a position
-    // that will bring it to its first kick exactly when master hits its kick
-    //
-    // Slave plays at tempo_ratio speed. In time_to_master_kick real-time seconds,
-    // slave will advance by: time_to_master_kick * tempo_ratio source-seconds
-    
-    double slave_advance = time_to_master_kick * tempo_ratio;
-    
-    // Start slave at: first_kick - advance
-    // So when it advances, it reaches first_kick exactly when master hits its kick
-    double slave_start_pos = slave_first_kick - slave_advance;
-    
-    // If start position is negative (before track start), add one beat period
-    while (slave_start_pos < 0) {
-        slave_start_pos += slave_spb;
-    }
-    
-    int64_t slave_start_samples = static_cast<int64_t>(slave_start_pos * sample_rate);
-    
-    if (logFile) {
-        fprintf(logFile, "Slave: first_kick=%.3f, will_advance=%.3f in %.1fms\n",
-                slave_first_kick, slave_advance, time_to_master_kick * 1000);
-        fprintf(logFile, "Starting slave at %.3f sec (sample %lld)\n",
-                slave_start_pos, (long long)slave_start_samples);
-        fprintf(logFile, "When master hits kick at %.1fms, slave will be at its first kick (%.3f sec)\n",
-                time_to_master_kick * 1000, slave_first_kick);
-        fclose(logFile);
-    }
-    
-    slave->play(slave_start_samples);
+    if (!dj::isValidDeck(deck_id) || !dj::isValidDeck(master_deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckPlaySynced, deck_id, 0.0, 0, master_deck_id));
+}
+
+DJ_API long long engine_get_stream_frame() {
+    if (!dj::g_engine) return 0;
+    return dj::g_engine->stream_frame.load();
+}
+
+DJ_API int deck_schedule_play(int deck_id, long long at_frame, int quantize_deck, int quantize_beats) {
+    if (!dj::isValidDeck(deck_id) || (at_frame < 0 && !dj::isValidDeck(quantize_deck))) return -1;
+    dj::Command play = dj::makeCommand(dj::Command::Type::DeckPlay, deck_id, 0.0, -1);
+    return dj::submitScheduled(dj::scheduleCommand(play, at_frame, quantize_deck, quantize_beats));
+}
+
+DJ_API int deck_schedule_pause(int deck_id, long long at_frame, int quantize_deck, int quantize_beats) {
+    if (!dj::isValidDeck(deck_id) || (at_frame < 0 && !dj::isValidDeck(quantize_deck))) return -1;
+    dj::Command pause = dj::makeCommand(dj::Command::Type::DeckPause, deck_id);
+    return dj::submitScheduled(dj::scheduleCommand(pause, at_frame, quantize_deck, quantize_beats));
+}
+
+DJ_API int deck_schedule_set_position(int deck_id, double position_seconds, long long at_frame,
+                                      int quantize_deck, int quantize_beats) {
+    if (!dj::isValidDeck(deck_id) || (at_frame < 0 && !dj::isValidDeck(quantize_deck))) return -1;
+    dj::Command seek = dj::makeCommand(dj::Command::Type::DeckSetPosition, deck_id, position_seconds);
+    return dj::submitScheduled(dj::scheduleCommand(seek, at_frame, quantize_deck, quantize_beats));
+}
+
+DJ_API void engine_cancel_scheduled(int deck_id) {
+    if (!dj::g_engine) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::ScheduleCancel, deck_id));
+}
+
+// Hot cues. Points are atomics on the deck, like the beat grid values;
+// jumps go through the command queue.
+DJ_API void deck_set_hot_cue(int deck_id, int index, double position_seconds) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::Deck* deck = dj::g_engine->decks[deck_id].get();
+    double seconds = position_seconds < 0.0 ? deck->getPosition() : position_seconds;
+    deck->setHotCue(index, static_cast<int64_t>(std::llround(seconds * dj::g_engine->sample_rate)));
+    dj::g_engine->cue_primer->wake();
+}
+
+DJ_API void deck_clear_hot_cue(int deck_id, int index) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::g_engine->decks[deck_id]->setHotCue(index, -1);
+}
+
+DJ_API double deck_get_hot_cue(int deck_id, int index) {
+    if (!dj::isValidDeck(deck_id)) return -1.0;
+    int64_t frame = dj::g_engine->decks[deck_id]->getHotCue(index);
+    return frame < 0 ? -1.0 : static_cast<double>(frame) / dj::g_engine->sample_rate;
+}
+
+DJ_API void deck_hot_cue(int deck_id, int index) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckHotCue, deck_id, 0.0, 0, index));
+}
+
+DJ_API int deck_schedule_hot_cue(int deck_id, int index, long long at_frame, int quantize_deck, int quantize_beats) {
+    if (!dj::isValidDeck(deck_id) || (at_frame < 0 && !dj::isValidDeck(quantize_deck))) return -1;
+    dj::Command jump = dj::makeCommand(dj::Command::Type::DeckHotCue, deck_id, 0.0, 0, index);
+    return dj::submitScheduled(dj::scheduleCommand(jump, at_frame, quantize_deck, quantize_beats));
+}
+
+// Loops, applied by the audio thread at the next block
+DJ_API void deck_loop_in(int deck_id) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckLoopIn, deck_id));
+}
+
+DJ_API void deck_loop_out(int deck_id) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckLoopOut, deck_id));
+}
+
+DJ_API void deck_set_loop(int deck_id, double start_seconds, double end_seconds) {
+    if (!dj::isValidDeck(deck_id)) return;
+    int64_t start = static_cast<int64_t>(std::llround(start_seconds * dj::g_engine->sample_rate));
+    int64_t end = static_cast<int64_t>(std::llround(end_seconds * dj::g_engine->sample_rate));
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetLoop, deck_id, static_cast<double>(start), end));
+}
+
+DJ_API void deck_loop_beats(int deck_id, double beats) {
+    if (!dj::isValidDeck(deck_id) || beats <= 0.0) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckLoopBeats, deck_id, beats));
+}
+
+DJ_API void deck_loop_exit(int deck_id) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckLoopExit, deck_id));
+}
+
+DJ_API void deck_loop_roll(int deck_id, double beats) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckLoopRoll, deck_id, beats));
 }
 
 DJ_API void deck_pause(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->pause();
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckPause, deck_id));
 }
 
 DJ_API void deck_stop(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->stop();
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckStop, deck_id));
 }
 
 DJ_API void deck_set_position(int deck_id, double position_seconds) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->setPosition(position_seconds);
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetPosition, deck_id, position_seconds));
 }
 
 DJ_API double deck_get_position(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return 0.0;
+    if (!dj::isValidDeck(deck_id)) return 0.0;
     return dj::g_engine->decks[deck_id]->getPosition();
 }
 
 DJ_API double deck_get_duration(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return 0.0;
+    if (!dj::isValidDeck(deck_id)) return 0.0;
     return dj::g_engine->decks[deck_id]->getDuration();
 }
 
+DJ_API double deck_get_decoded_duration(int deck_id) {
+    if (!dj::isValidDeck(deck_id)) return 0.0;
+    return dj::g_engine->decks[deck_id]->getDecodedDuration();
+}
+
+DJ_API double deck_get_load_progress(int deck_id) {
+    if (!dj::isValidDeck(deck_id)) return 0.0;
+    return dj::g_engine->decks[deck_id]->getLoadProgress();
+}
+
 DJ_API int deck_is_playing(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return 0;
+    if (!dj::isValidDeck(deck_id)) return 0;
     return dj::g_engine->decks[deck_id]->isPlaying() ? 1 : 0;
 }
 
 // Deck parameters
 DJ_API void deck_set_volume(int deck_id, float volume) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->setVolume(volume);
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetVolume, deck_id, volume),
+                      &dj::g_engine->live_controls.volume[deck_id]);
+}
+
+DJ_API void deck_set_auto_gain(int deck_id, int enabled, double target_lufs) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetAutoGain, deck_id, target_lufs, 0, enabled ? 1 : 0));
+}
+
+DJ_API int deck_get_loudness(int deck_id, double* integrated_lufs, double* true_peak_db) {
+    if (!dj::isValidDeck(deck_id)) return -1;
+    
+    auto track = dj::g_engine->decks[deck_id]->getAudioFile();
+    dj::TrackLoudness loudness;
+    if (!track || !track->getLoudness(&loudness)) return -1;
+    if (integrated_lufs) *integrated_lufs = loudness.integrated_lufs;
+    if (true_peak_db) *true_peak_db = loudness.true_peak_db;
+    return 0;
 }
 
 DJ_API void deck_set_tempo(int deck_id, double tempo) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->setTempo(tempo);
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetTempo, deck_id, tempo));
 }
 
 DJ_API void deck_set_pitch(int deck_id, double semitones) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->setPitch(semitones);
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetPitch, deck_id, semitones));
+}
+
+DJ_API void deck_set_stretch_mode(int deck_id, int mode) {
+    if (!dj::isValidDeck(deck_id) || mode < 0 || mode >= dj::STRETCH_MODE_COUNT) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetStretchMode, deck_id, mode));
 }
 
 DJ_API void deck_set_bpm(int deck_id, double bpm) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
+    if (!dj::isValidDeck(deck_id)) return;
     dj::g_engine->decks[deck_id]->setBPM(bpm);
 }
 
 DJ_API double deck_get_bpm(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return 0.0;
+    if (!dj::isValidDeck(deck_id)) return 0.0;
     return dj::g_engine->decks[deck_id]->getBPM();
 }
 
 DJ_API void deck_set_beat_offset(int deck_id, double offset_seconds) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
+    if (!dj::isValidDeck(deck_id)) return;
     dj::g_engine->decks[deck_id]->setBeatOffset(offset_seconds);
 }
 
+DJ_API const void* deck_acquire_beat_grid(int deck_id, const double** beats, int* count) {
+    if (beats) *beats = nullptr;
+    if (count) *count = 0;
+    if (!dj::isValidDeck(deck_id)) return nullptr;
+    
+    auto grid = dj::g_engine->decks[deck_id]->acquireBeatGrid();
+    if (!grid) return nullptr;
+    
+    // The handle is a reference of the caller's own, so the array stays put
+    // through reloads until it is released
+    if (beats) *beats = grid->getBeats();
+    if (count) *count = grid->getBeatCount();
+    return new std::shared_ptr<const dj::BeatGrid>(std::move(grid));
+}
+
+DJ_API void beat_grid_release(const void* grid) {
+    delete static_cast<const std::shared_ptr<const dj::BeatGrid>*>(grid);
+}
+
+DJ_API const void* deck_acquire_waveform(int deck_id) {
+    if (!dj::isValidDeck(deck_id)) return nullptr;
+    
+    auto track = dj::g_engine->decks[deck_id]->getAudioFile();
+    auto waveform = track ? track->getWaveform() : nullptr;
+    if (!waveform) return nullptr;
+    return new std::shared_ptr<const dj::WaveformPyramid>(std::move(waveform));
+}
+
+DJ_API const waveform_bin_t* waveform_get_level(const void* waveform, int level, long long* bin_count,
+                                                int* frames_per_bin) {
+    if (bin_count) *bin_count = 0;
+    if (frames_per_bin) *frames_per_bin = 0;
+    if (!waveform || level < 0 || level >= dj::WaveformPyramid::LEVEL_COUNT) return nullptr;
+    
+    const dj::WaveformPyramid& pyramid = **static_cast<const std::shared_ptr<const dj::WaveformPyramid>*>(waveform);
+    if (bin_count) *bin_count = pyramid.getBinCount(level);
+    if (frames_per_bin) *frames_per_bin = dj::WaveformPyramid::getFramesPerBin(level);
+    return reinterpret_cast<const waveform_bin_t*>(pyramid.getBins(level));
+}
+
+DJ_API void waveform_release(const void* waveform) {
+    delete static_cast<const std::shared_ptr<const dj::WaveformPyramid>*>(waveform);
+}
+
+DJ_API double deck_get_nearest_beat(int deck_id, double position_seconds) {
+    if (!dj::isValidDeck(deck_id)) return position_seconds;
+    
+    auto grid = dj::g_engine->decks[deck_id]->acquireBeatGrid();
+    return grid ? grid->getNearestBeat(position_seconds) : position_seconds;
+}
+
+DJ_API double deck_get_beat_phase(int deck_id) {
+    if (!dj::isValidDeck(deck_id)) return 0.0;
+    
+    dj::Deck* deck = dj::g_engine->decks[deck_id].get();
+    auto grid = deck->acquireBeatGrid();
+    return deck->getPhase(grid.get());
+}
+
 // EQ
 DJ_API void deck_set_eq_low(int deck_id, float gain) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->setEQLow(gain);
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetEQLow, deck_id, gain));
 }
 
 DJ_API void deck_set_eq_mid(int deck_id, float gain) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->setEQMid(gain);
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetEQMid, deck_id, gain));
 }
 
 DJ_API void deck_set_eq_high(int deck_id, float gain) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return;
-    dj::g_engine->decks[deck_id]->setEQHigh(gain);
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::DeckSetEQHigh, deck_id, gain));
 }
 
 // Mixer
 DJ_API void mixer_set_crossfader(float position) {
     if (!dj::g_engine) return;
-    dj::g_engine->mixer->setCrossfader(position);
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::MixerSetCrossfader, -1, position),
+                      &dj::g_engine->live_controls.crossfader);
+}
+
+DJ_API void mixer_set_crossfader_assign(int deck_id, int side) {
+    if (!dj::isValidDeck(deck_id) || side < 0 || side > 2) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::MixerSetAssign, deck_id, side));
+}
+
+DJ_API void mixer_set_pfl(int deck_id, int enabled) {
+    if (!dj::isValidDeck(deck_id)) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::MixerSetPFL, deck_id, enabled ? 1.0 : 0.0));
+}
+
+DJ_API void mixer_set_cue_mix(float mix) {
+    if (!dj::g_engine) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::MixerSetCueMix, -1, mix),
+                      &dj::g_engine->live_controls.cue_mix);
+}
+
+DJ_API void mixer_set_cue_volume(float volume) {
+    if (!dj::g_engine) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::MixerSetCueVolume, -1, volume));
 }
 
 // Sync
 DJ_API void sync_enable(int slave_deck_id, int master_deck_id) {
     if (!dj::g_engine) return;
-    dj::g_engine->sync_manager->enable(slave_deck_id, master_deck_id);
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::SyncEnable, slave_deck_id, 0.0, 0, master_deck_id));
 }
 
 DJ_API void sync_disable(int deck_id) {
     if (!dj::g_engine) return;
-    dj::g_engine->sync_manager->disable(deck_id);
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::SyncDisable, deck_id));
 }
 
 DJ_API void sync_align_now(int slave_deck_id, int master_deck_id) {
-    if (!dj::g_engine || slave_deck_id < 0 || slave_deck_id > 1 || 
-        master_deck_id < 0 || master_deck_id > 1) return;
+    if (!dj::isValidDeck(slave_deck_id) || !dj::isValidDeck(master_deck_id)) return;
     
-    dj::g_engine->sync_manager->alignNow(
-        dj::g_engine->decks[slave_deck_id].get(),
-        dj::g_engine->decks[master_deck_id].get()
-    );
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::SyncAlignNow, slave_deck_id, 0.0, 0, master_deck_id));
+}
+
+// Automation
+DJ_API void automation_ramp(int target, int deck_id, double value, long long start_frame, double duration_seconds,
+                            int shape) {
+    if (!dj::g_engine || target < 0 || target >= dj::AUTOMATION_TARGET_COUNT) return;
+    if (target != static_cast<int>(dj::AutomationTarget::Crossfader) && !dj::isValidDeck(deck_id)) return;
+    if (target == static_cast<int>(dj::AutomationTarget::Crossfader)) deck_id = -1;
+    if (shape < 0 || shape >= dj::AUTOMATION_SHAPE_COUNT) shape = 0;
+    
+    dj::Command command = dj::makeCommand(dj::Command::Type::AutomationRamp, deck_id, value,
+                                          start_frame < 0 ? -1 : start_frame, target);
+    command.ramp_seconds = std::max(0.0, duration_seconds);
+    command.ramp_shape = static_cast<uint8_t>(shape);
+    dj::submitCommand(command);
+}
+
+DJ_API void automation_cancel(int target, int deck_id) {
+    if (!dj::g_engine) return;
+    if (target == static_cast<int>(dj::AutomationTarget::Crossfader)) deck_id = -1;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::AutomationCancel, deck_id, 0.0, 0, target));
+}
+
+// Performance counters; engine_get_perf is in perf_counters.cpp
+DJ_API void engine_reset_perf() {
+    if (!dj::g_engine) return;
+    dj::submitCommand(dj::makeCommand(dj::Command::Type::PerfReset, -1));
 }
 
-// Callbacks
+// Callbacks, run by the status notifier thread
 DJ_API void set_position_callback(position_callback_t callback) {
     if (!dj::g_engine) return;
-    dj::g_engine->position_callback = callback;
+    dj::g_engine->status_notifier->setPositionCallback(callback);
 }
 
 DJ_API void set_track_ended_callback(track_ended_callback_t callback) {
     if (!dj::g_engine) return;
-    dj::g_engine->track_ended_callback = callback;
+    dj::g_engine->status_notifier->setTrackEndedCallback(callback);
 }
 
 } // extern "C"
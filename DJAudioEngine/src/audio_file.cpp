@@ -11,26 +11,234 @@
 #include <cstring>
 #include <cctype>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+
+// Hardware half-float conversion when the target has it (AVX2 implies F16C)
+#if defined(__F16C__) || defined(__AVX2__)
+#define DJ_HAVE_F16C 1
+#include <immintrin.h>
+#else
+#define DJ_HAVE_F16C 0
+#endif
 
 namespace dj {
 
-AudioFile::AudioFile() 
-    : total_samples_(0)
+// Frames decoded per step, both for the foreground decode and for each
+// chunk published by the progressive decoder thread
+static const int64_t DECODE_CHUNK_FRAMES = 65536;
+
+// Streaming refills in smaller steps so seeks are picked up quickly
+static const int64_t STREAM_CHUNK_FRAMES = 4096;
+
+// MP3 seek table density for streamed files
+static const drmp3_uint32 MP3_SEEK_POINTS = 4096;
+
+// How often a cancellable wait for the decoder checks its cancel flag
+static const int ANALYSIS_CANCEL_POLL_MS = 20;
+
+// ----------------------------------------------------------------------------
+// Sample format conversion
+// ----------------------------------------------------------------------------
+
+#if !DJ_HAVE_F16C
+// IEEE 754 binary16 <-> binary32, round-to-nearest-even
+static uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t abs_bits = bits & 0x7FFFFFFFu;
+    
+    if (abs_bits >= 0x47800000u) {
+        // Overflow, Inf or NaN
+        return static_cast<uint16_t>(sign | (abs_bits > 0x7F800000u ? 0x7E00u : 0x7C00u));
+    }
+    if (abs_bits < 0x38800000u) {
+        // Subnormal half (or zero)
+        if (abs_bits < 0x33000000u) return static_cast<uint16_t>(sign);
+        uint32_t mantissa = (abs_bits & 0x007FFFFFu) | 0x00800000u;
+        int shift = 126 - static_cast<int>(abs_bits >> 23);
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) half++;
+        return static_cast<uint16_t>(sign | half);
+    }
+    
+    uint32_t half = (abs_bits - 0x38000000u) >> 13;
+    uint32_t rest = abs_bits & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1))) half++;
+    return static_cast<uint16_t>(sign | half);
+}
+
+static float halfToFloat(uint16_t value) {
+    uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    uint32_t exponent = (value >> 10) & 0x1Fu;
+    uint32_t mantissa = value & 0x3FFu;
+    
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Normalise the subnormal
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400u) == 0) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+        }
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+#endif
+
+// Convert interleaved float samples into the storage format
+static void encodeSamples(const float* input, uint8_t* output, size_t count, SampleFormat format) {
+    switch (format) {
+        case SampleFormat::Float32:
+            memcpy(output, input, count * sizeof(float));
+            break;
+        case SampleFormat::Int16: {
+            int16_t* out = reinterpret_cast<int16_t*>(output);
+            for (size_t i = 0; i < count; i++) {
+                float v = std::lrintf(input[i] * 32768.0f);
+                out[i] = static_cast<int16_t>(std::max(-32768.0f, std::min(v, 32767.0f)));
+            }
+            break;
+        }
+        case SampleFormat::Float16: {
+            uint16_t* out = reinterpret_cast<uint16_t*>(output);
+            size_t i = 0;
+#if DJ_HAVE_F16C
+            for (; i + 8 <= count; i += 8) {
+                __m256 v = _mm256_loadu_ps(input + i);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+            }
+            for (; i < count; i++) {
+                out[i] = _cvtss_sh(input[i], _MM_FROUND_TO_NEAREST_INT);
+            }
+#else
+            for (; i < count; i++) {
+                out[i] = floatToHalf(input[i]);
+            }
+#endif
+            break;
+        }
+    }
+}
+
+// Convert stored samples back to float - this runs on the audio thread
+static void decodeSamples(const uint8_t* input, float* output, size_t count, SampleFormat format) {
+    switch (format) {
+        case SampleFormat::Float32:
+            memcpy(output, input, count * sizeof(float));
+            break;
+        case SampleFormat::Int16: {
+            // Simple enough for the compiler to vectorise
+            const int16_t* in = reinterpret_cast<const int16_t*>(input);
+            const float scale = 1.0f / 32768.0f;
+            for (size_t i = 0; i < count; i++) {
+                output[i] = in[i] * scale;
+            }
+            break;
+        }
+        case SampleFormat::Float16: {
+            const uint16_t* in = reinterpret_cast<const uint16_t*>(input);
+            size_t i = 0;
+#if DJ_HAVE_F16C
+            for (; i + 8 <= count; i += 8) {
+                __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+                _mm256_storeu_ps(output + i, _mm256_cvtph_ps(h));
+            }
+            for (; i < count; i++) {
+                output[i] = _cvtsh_ss(in[i]);
+            }
+#else
+            for (; i < count; i++) {
+                output[i] = halfToFloat(in[i]);
+            }
+#endif
+            break;
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// EncodedBuffer
+// ----------------------------------------------------------------------------
+
+EncodedBuffer::EncodedBuffer(const void* data, size_t size, ReleaseCallback release, void* user_data)
+    : data_(static_cast<const uint8_t*>(data))
+    , size_(data ? size : 0)
+    , release_(release)
+    , user_data_(user_data)
+{
+}
+
+EncodedBuffer::EncodedBuffer(std::vector<uint8_t> bytes)
+    : owned_(std::move(bytes))
+    , data_(owned_.data())
+    , size_(owned_.size())
+    , release_(nullptr)
+    , user_data_(nullptr)
+{
+}
+
+EncodedBuffer::~EncodedBuffer() {
+    if (release_) release_(user_data_);
+}
+
+// ----------------------------------------------------------------------------
+// AudioDecoder
+// ----------------------------------------------------------------------------
+
+AudioDecoder::AudioDecoder()
+    : format_(Format::None)
+    , handle_(nullptr)
+    , total_frames_(0)
     , sample_rate_(0)
-    , channels_(0)
+    , source_channels_(0)
 {
 }
 
-AudioFile::~AudioFile() {
-    unload();
+AudioDecoder::~AudioDecoder() {
+    close();
 }
 
-bool AudioFile::load(const char* filepath) {
-    unload();
+bool AudioDecoder::open(const char* filepath) {
+    close();
+    return filepath && openAs(formatFromName(filepath), filepath);
+}
+
+bool AudioDecoder::openMemory(std::shared_ptr<const EncodedBuffer> buffer, const char* format_hint) {
+    close();
+    if (!buffer || buffer->size() == 0) return false;
     
-    // Determine file type by extension
-    const char* ext = strrchr(filepath, '.');
-    if (!ext) return false;
+    Format format = formatFromBytes(buffer->data(), buffer->size());
+    if (format == Format::None && format_hint) format = formatFromName(format_hint);
+    
+    memory_ = std::move(buffer);
+    if (!openAs(format, nullptr)) {
+        memory_.reset();
+        return false;
+    }
+    return true;
+}
+
+AudioDecoder::Format AudioDecoder::formatFromName(const char* name) {
+    // The extension, or a hint that is nothing but one
+    const char* ext = strrchr(name, '.');
+    ext = ext ? ext + 1 : name;
     
     // Convert to lowercase for comparison
     char ext_lower[10] = {0};
@@ -38,73 +246,903 @@ bool AudioFile::load(const char* filepath) {
         ext_lower[i] = tolower(ext[i]);
     }
     
-    drwav_uint64 frames = 0;
-    unsigned int channels = 0;
-    unsigned int sample_rate = 0;
-    float* data = nullptr;
+    if (strcmp(ext_lower, "mp3") == 0) return Format::Mp3;
+    if (strcmp(ext_lower, "wav") == 0) return Format::Wav;
+    if (strcmp(ext_lower, "flac") == 0) return Format::Flac;
+    return Format::None;
+}
+
+AudioDecoder::Format AudioDecoder::formatFromBytes(const uint8_t* data, size_t size) {
+    if (size >= 12 && (memcmp(data, "RIFF", 4) == 0 || memcmp(data, "RF64", 4) == 0) &&
+        memcmp(data + 8, "WAVE", 4) == 0) {
+        return Format::Wav;
+    }
+    if (size >= 4 && memcmp(data, "riff", 4) == 0) return Format::Wav;  // Wave64
+    
+    // An ID3v2 tag can front MP3 and, rarely, FLAC; what follows it decides.
+    // Its size is syncsafe: seven bits per byte.
+    size_t pos = 0;
+    if (size >= 10 && memcmp(data, "ID3", 3) == 0) {
+        size_t tag = (static_cast<size_t>(data[6] & 0x7F) << 21) | (static_cast<size_t>(data[7] & 0x7F) << 14) |
+                     (static_cast<size_t>(data[8] & 0x7F) << 7) | static_cast<size_t>(data[9] & 0x7F);
+        pos = 10 + tag + ((data[5] & 0x10) ? 10 : 0);  // Footer
+        if (pos >= size) return Format::Mp3;
+    }
     
-    if (strcmp(ext_lower, ".mp3") == 0) {
-        // Load MP3
-        drmp3_config config;
-        data = drmp3_open_file_and_read_pcm_frames_f32(filepath, &config, &frames, nullptr);
-        if (!data) return false;
-        channels = config.channels;
-        sample_rate = config.sampleRate;
+    // Native or Ogg-encapsulated FLAC, which dr_flac reads either way
+    if (size - pos >= 4 && (memcmp(data + pos, "fLaC", 4) == 0 || memcmp(data + pos, "OggS", 4) == 0)) {
+        return Format::Flac;
+    }
+    
+    // MPEG audio frame sync, with a layer set - ADTS AAC has it clear
+    if (size - pos >= 2 && data[pos] == 0xFF && (data[pos + 1] & 0xE0) == 0xE0 && (data[pos + 1] & 0x06) != 0) {
+        return Format::Mp3;
+    }
+    return pos > 0 ? Format::Mp3 : Format::None;
+}
+
+bool AudioDecoder::openAs(Format format, const char* filepath) {
+    const void* data = memory_ ? memory_->data() : nullptr;
+    size_t size = memory_ ? memory_->size() : 0;
+    
+    if (format == Format::Mp3) {
+        drmp3* mp3 = new drmp3;
+        bool ok = filepath ? drmp3_init_file(mp3, filepath, nullptr) : drmp3_init_memory(mp3, data, size, nullptr);
+        if (!ok) {
+            delete mp3;
+            return false;
+        }
+        format_ = Format::Mp3;
+        handle_ = mp3;
+        source_channels_ = mp3->channels;
+        sample_rate_ = mp3->sampleRate;
+        // MP3 has no length header; this scans frame headers without decoding
+        total_frames_ = static_cast<int64_t>(drmp3_get_pcm_frame_count(mp3));
     }
-    else if (strcmp(ext_lower, ".wav") == 0) {
-        // Load WAV
-        data = drwav_open_file_and_read_pcm_frames_f32(filepath, &channels, &sample_rate, &frames, nullptr);
-        if (!data) return false;
+    else if (format == Format::Wav) {
+        drwav* wav = new drwav;
+        bool ok = filepath ? drwav_init_file(wav, filepath, nullptr) : drwav_init_memory(wav, data, size, nullptr);
+        if (!ok) {
+            delete wav;
+            return false;
+        }
+        format_ = Format::Wav;
+        handle_ = wav;
+        source_channels_ = wav->channels;
+        sample_rate_ = wav->sampleRate;
+        total_frames_ = static_cast<int64_t>(wav->totalPCMFrameCount);
     }
-    else if (strcmp(ext_lower, ".flac") == 0) {
-        // Load FLAC
-        data = drflac_open_file_and_read_pcm_frames_f32(filepath, &channels, &sample_rate, &frames, nullptr);
-        if (!data) return false;
+    else if (format == Format::Flac) {
+        drflac* flac = filepath ? drflac_open_file(filepath, nullptr) : drflac_open_memory(data, size, nullptr);
+        if (!flac) return false;
+        format_ = Format::Flac;
+        handle_ = flac;
+        source_channels_ = flac->channels;
+        sample_rate_ = flac->sampleRate;
+        total_frames_ = static_cast<int64_t>(flac->totalPCMFrameCount);
     }
     else {
         return false;
     }
     
-    // Convert to stereo if mono
-    if (channels == 1) {
-        // Allocate stereo buffer
-        audio_data_.resize(frames * 2);
-        for (drwav_uint64 i = 0; i < frames; i++) {
-            audio_data_[i * 2] = data[i];      // Left
-            audio_data_[i * 2 + 1] = data[i];  // Right
+    // Unsupported channel count
+    if (source_channels_ != 1 && source_channels_ != 2) {
+        close();
+        return false;
+    }
+    
+    return true;
+}
+
+void AudioDecoder::close() {
+    switch (format_) {
+        case Format::Mp3:
+            drmp3_uninit(static_cast<drmp3*>(handle_));
+            delete static_cast<drmp3*>(handle_);
+            break;
+        case Format::Wav:
+            drwav_uninit(static_cast<drwav*>(handle_));
+            delete static_cast<drwav*>(handle_);
+            break;
+        case Format::Flac:
+            drflac_close(static_cast<drflac*>(handle_));
+            break;
+        case Format::None:
+            break;
+    }
+    
+    format_ = Format::None;
+    handle_ = nullptr;
+    memory_.reset();
+    total_frames_ = 0;
+    sample_rate_ = 0;
+    source_channels_ = 0;
+}
+
+int64_t AudioDecoder::read(float* output, int64_t frames) {
+    if (!handle_ || frames <= 0) return 0;
+    
+    // Mono decodes into scratch and is then duplicated into both channels
+    float* target = output;
+    if (source_channels_ == 1) {
+        if (mono_scratch_.size() < static_cast<size_t>(frames)) {
+            mono_scratch_.resize(frames);
         }
-        channels_ = 2;
+        target = mono_scratch_.data();
+    }
+    
+    drmp3_uint64 got = 0;
+    switch (format_) {
+        case Format::Mp3:
+            got = drmp3_read_pcm_frames_f32(static_cast<drmp3*>(handle_), frames, target);
+            break;
+        case Format::Wav:
+            got = drwav_read_pcm_frames_f32(static_cast<drwav*>(handle_), frames, target);
+            break;
+        case Format::Flac:
+            got = drflac_read_pcm_frames_f32(static_cast<drflac*>(handle_), frames, target);
+            break;
+        case Format::None:
+            break;
     }
-    else if (channels == 2) {
-        // Already stereo
-        audio_data_.assign(data, data + frames * 2);
-        channels_ = 2;
+    
+    if (source_channels_ == 1) {
+        for (drmp3_uint64 i = 0; i < got; i++) {
+            output[i * 2] = target[i];      // Left
+            output[i * 2 + 1] = target[i];  // Right
+        }
     }
-    else {
-        // Unsupported channel count
-        drwav_free(data, nullptr);
+    
+    return static_cast<int64_t>(got);
+}
+
+bool AudioDecoder::seek(int64_t frame) {
+    if (!handle_ || frame < 0) return false;
+    
+    switch (format_) {
+        case Format::Mp3:
+            return drmp3_seek_to_pcm_frame(static_cast<drmp3*>(handle_), frame) != 0;
+        case Format::Wav:
+            return drwav_seek_to_pcm_frame(static_cast<drwav*>(handle_), frame) != 0;
+        case Format::Flac:
+            return drflac_seek_to_pcm_frame(static_cast<drflac*>(handle_), frame) != 0;
+        case Format::None:
+            break;
+    }
+    return false;
+}
+
+void AudioDecoder::buildSeekTable() {
+    if (format_ != Format::Mp3) return;  // WAV and FLAC seek natively
+    
+    drmp3* mp3 = static_cast<drmp3*>(handle_);
+    drmp3_uint32 count = MP3_SEEK_POINTS;
+    seek_table_.resize(count * sizeof(drmp3_seek_point));
+    
+    auto* points = reinterpret_cast<drmp3_seek_point*>(seek_table_.data());
+    if (!drmp3_calculate_seek_points(mp3, &count, points) ||
+        !drmp3_bind_seek_table(mp3, count, points)) {
+        seek_table_.clear();
+    }
+}
+
+// ----------------------------------------------------------------------------
+// AudioFile
+// ----------------------------------------------------------------------------
+
+AudioFile::AudioFile() 
+    : pcm_data_(nullptr)
+    , source_offset_(0)
+    , source_pending_(0)
+    , source_eof_(false)
+    , source_sample_rate_(0)
+    , target_sample_rate_(0)
+    , pcm_cache_(nullptr)
+    , total_samples_(0)
+    , decoded_samples_(0)
+    , sample_rate_(0)
+    , channels_(0)
+    , storage_format_(SampleFormat::Float32)
+    , streaming_(false)
+    , ring_frames_(0)
+    , stream_start_(0)
+    , stream_end_(0)
+    , stream_read_(0)
+    , seek_target_(0)
+    , seek_serial_(0)
+    , seek_ack_(0)
+    , decode_complete_(true)
+    , cancel_decode_(false)
+    , analysis_db_(nullptr)
+    , content_key_(0)
+    , has_loudness_(false)
+    , build_waveform_(false)
+{
+}
+
+AudioFile::~AudioFile() {
+    unload();
+}
+
+bool AudioFile::load(const char* filepath, const LoadOptions& options) {
+    unload();
+    
+    source_path_ = filepath;
+    pcm_cache_ = options.pcm_cache;
+    target_sample_rate_ = options.target_sample_rate;
+    build_waveform_ = options.build_waveform;
+    
+    if (options.analysis_db && options.analysis_db->isOpen()) {
+        attachStoredAnalysis(hashFileContent(filepath), options.analysis_db);
+    }
+    
+    if (pcm_cache_ && loadFromCache(filepath, options)) {
+        return true;
+    }
+    
+    if (!decoder_.open(filepath)) {
+        return false;
+    }
+    return loadOpened(options);
+}
+
+bool AudioFile::loadMemory(std::shared_ptr<const EncodedBuffer> buffer, const char* format_hint,
+                           const LoadOptions& options) {
+    unload();
+    if (!buffer) return false;
+    
+    // Stands in for the path in logs, and its extension carries the hint to
+    // decoders that reopen the buffer
+    source_path_ = std::string("(memory).") + (format_hint ? format_hint : "");
+    pcm_cache_ = nullptr;  // Keyed by path and modification time, which memory has neither of
+    target_sample_rate_ = options.target_sample_rate;
+    build_waveform_ = options.build_waveform;
+    
+    // The key a file of these bytes would have, so its analysis is shared
+    if (options.analysis_db && options.analysis_db->isOpen()) {
+        attachStoredAnalysis(hashContent(buffer->data(), buffer->size()), options.analysis_db);
+    }
+    
+    source_memory_ = buffer;
+    if (!decoder_.openMemory(std::move(buffer), source_path_.c_str())) {
+        unload();
+        return false;
+    }
+    return loadOpened(options);
+}
+
+void AudioFile::attachStoredAnalysis(uint64_t content_key, AnalysisDatabase* db) {
+    // A track analyzed before, on any deck or by a library scan, arrives
+    // with its analysis
+    content_key_ = content_key;
+    if (content_key_ == 0) return;
+    
+    analysis_db_ = db;
+    analysis_ = analysis_db_->lookup(content_key_);
+    if (analysis_ && analysis_->has_loudness) setLoudness(analysis_->loudness);
+}
+
+bool AudioFile::loadOpened(const LoadOptions& options) {
+    source_sample_rate_ = decoder_.getSampleRate();
+    sample_rate_ = source_sample_rate_;
+    channels_ = 2;
+    if (!has_loudness_.load()) meter_ = std::make_unique<LoudnessMeter>(source_sample_rate_);
+    
+    // Everything past this point counts in output (engine-rate) frames
+    if (target_sample_rate_ > 0 && target_sample_rate_ != source_sample_rate_) {
+        if (!resampler_.open(source_sample_rate_, target_sample_rate_)) {
+            unload();
+            return false;
+        }
+        sample_rate_ = target_sample_rate_;
+        source_buffer_.resize(STREAM_CHUNK_FRAMES * 2);
+    }
+    
+    int64_t source_total = decoder_.getTotalFrames();
+    int64_t total = Resampler::convertedLength(source_total, source_sample_rate_, sample_rate_);
+    
+    // Very long files (recorded sets, radio shows) are streamed from disk
+    // instead of being held in memory
+    if (options.streaming_threshold_seconds > 0.0 &&
+        total > static_cast<int64_t>(options.streaming_threshold_seconds * sample_rate_)) {
+        if (startStreaming(options)) {
+            return true;
+        }
+        unload();
         return false;
     }
     
-    total_samples_ = frames;
-    sample_rate_ = sample_rate;
+    storage_format_ = options.storage_format;
+    const size_t frame_bytes = 2 * bytesPerSample(storage_format_);
+    decode_buffer_.resize(DECODE_CHUNK_FRAMES * 2);
+    
+    // Progressive decoding needs the length up front so the buffer never
+    // moves while the audio thread reads it
+    if (options.mode == LoadMode::Progressive && total > 0) {
+        pcm_.assign(static_cast<size_t>(total) * frame_bytes, 0);
+        pcm_data_ = pcm_.data();
+        total_samples_.store(total, std::memory_order_release);
+        if (build_waveform_) {
+            waveform_ = std::make_shared<WaveformPyramid>(sample_rate_, total);
+        }
+        
+        int64_t preroll = static_cast<int64_t>(options.preroll_seconds * sample_rate_);
+        preroll = std::max<int64_t>(0, std::min(preroll, total));
+        
+        if (decodeRange(preroll) && decoded_samples_.load() < total) {
+            decode_complete_.store(false, std::memory_order_release);
+            decode_thread_ = std::thread(&AudioFile::decodeThreadMain, this);
+            return true;
+        }
+        
+        finishDecode();
+        if (getTotalSamples() == 0) {
+            unload();
+            return false;
+        }
+        return true;
+    }
+    
+    int64_t decoded = resampler_.isActive() ? decodeResampled(source_total) : decodeNative(total);
+    decoder_.close();
+    source_memory_.reset();
+    resampler_.close();
+    source_buffer_.clear();
+    source_buffer_.shrink_to_fit();
+    decode_buffer_.clear();
+    decode_buffer_.shrink_to_fit();
     
-    // Free the original data
-    drwav_free(data, nullptr);
+    if (decoded == 0) {
+        unload();
+        return false;
+    }
     
+    pcm_data_ = pcm_.data();
+    total_samples_.store(decoded, std::memory_order_release);
+    decoded_samples_.store(decoded, std::memory_order_release);
+    decode_complete_.store(true, std::memory_order_release);
+    
+    finishLoudness();
+    buildWaveform();
+    storeInCache();
     return true;
 }
 
+int64_t AudioFile::decodeNative(int64_t total) {
+    // Length may be unknown (some FLAC streams), so grow as needed
+    const size_t frame_bytes = 2 * bytesPerSample(storage_format_);
+    pcm_.reserve(total > 0 ? static_cast<size_t>(total) * frame_bytes : 0);
+    int64_t decoded = 0;
+    for (;;) {
+        int64_t got = readSource(decode_buffer_.data(), DECODE_CHUNK_FRAMES);
+        pcm_.resize(static_cast<size_t>(decoded + got) * frame_bytes);
+        encodeSamples(decode_buffer_.data(), pcm_.data() + decoded * frame_bytes, got * 2, storage_format_);
+        decoded += got;
+        if (got < DECODE_CHUNK_FRAMES) break;
+    }
+    return decoded;
+}
+
+int64_t AudioFile::decodeResampled(int64_t source_total) {
+    // Decoding is inherently serial, so it goes first at the source rate;
+    // conversion then runs on every core, straight into pcm_
+    std::vector<float> source;
+    source.reserve(source_total > 0 ? static_cast<size_t>(source_total) * 2 : 0);
+    int64_t source_frames = 0;
+    for (;;) {
+        source.resize(static_cast<size_t>(source_frames + DECODE_CHUNK_FRAMES) * 2);
+        int64_t got = readSource(source.data() + source_frames * 2, DECODE_CHUNK_FRAMES);
+        source_frames += got;
+        if (got < DECODE_CHUNK_FRAMES) break;
+    }
+    
+    int64_t total = Resampler::convertedLength(source_frames, source_sample_rate_, sample_rate_);
+    const size_t frame_bytes = 2 * bytesPerSample(storage_format_);
+    pcm_.assign(static_cast<size_t>(total) * frame_bytes, 0);
+    
+    Resampler::convertParallel(source.data(), source_frames, source_sample_rate_, sample_rate_,
+        [this, frame_bytes](int64_t pos, const float* frames, int64_t count) {
+            encodeSamples(frames, pcm_.data() + pos * frame_bytes, count * 2, storage_format_);
+        });
+    
+    return total;
+}
+
+int64_t AudioFile::readSource(float* output, int64_t frames) {
+    int64_t got = decoder_.read(output, frames);
+    
+    // Still in cache from the decode, so loudness costs no extra pass
+    if (meter_ && !streaming_) meter_->process(output, got);
+    return got;
+}
+
+int64_t AudioFile::readConverted(float* output, int64_t frames) {
+    if (!resampler_.isActive()) {
+        return readSource(output, frames);
+    }
+    
+    int64_t written = 0;
+    bool refill = source_pending_ == 0;
+    while (written < frames) {
+        if (refill && !source_eof_ && source_pending_ < STREAM_CHUNK_FRAMES) {
+            // Keep whatever the converter hasn't taken yet at the front
+            memmove(source_buffer_.data(), source_buffer_.data() + source_offset_ * 2,
+                    source_pending_ * 2 * sizeof(float));
+            source_offset_ = 0;
+            int64_t room = STREAM_CHUNK_FRAMES - source_pending_;
+            int64_t got = readSource(source_buffer_.data() + source_pending_ * 2, room);
+            source_pending_ += got;
+            source_eof_ = got < room;
+        }
+        
+        int64_t used = 0;
+        int64_t got = resampler_.process(source_buffer_.data() + source_offset_ * 2, source_pending_,
+                                         output + written * 2, frames - written, source_eof_, &used);
+        source_offset_ += used;
+        source_pending_ -= used;
+        written += got;
+        
+        if (got == 0 && used == 0) {
+            if (refill || source_eof_) break;  // Source ended and the filter is drained
+            refill = true;  // Converter wants more context than is buffered
+            continue;
+        }
+        refill = source_pending_ == 0;
+    }
+    
+    return written;
+}
+
+bool AudioFile::loadFromCache(const char* filepath, const LoadOptions& options) {
+    PcmCacheInfo info;
+    const uint8_t* pcm = nullptr;
+    auto mapping = pcm_cache_->open(filepath, options.storage_format, options.target_sample_rate, &info, &pcm);
+    if (!mapping) return false;
+    
+    // Long files still stream from disk; the cache only replaces full decodes
+    if (options.streaming_threshold_seconds > 0.0 &&
+        info.frames > static_cast<int64_t>(options.streaming_threshold_seconds * info.sample_rate)) {
+        return false;
+    }
+    
+    pcm_mapping_ = std::move(mapping);
+    pcm_data_ = pcm;
+    storage_format_ = info.format;
+    sample_rate_ = info.sample_rate;
+    source_sample_rate_ = info.sample_rate;  // The source isn't opened on a hit
+    channels_ = 2;
+    
+    total_samples_.store(info.frames, std::memory_order_release);
+    decoded_samples_.store(info.frames, std::memory_order_release);
+    decode_complete_.store(true, std::memory_order_release);
+    if (info.has_loudness && !has_loudness_.load()) setLoudness(info.loudness);
+    
+    buildWaveform();
+    return true;
+}
+
+void AudioFile::buildWaveform() {
+    if (!build_waveform_) return;
+    
+    // The whole track is in memory, so this runs on every core
+    int64_t total = getTotalSamples();
+    waveform_ = std::make_shared<WaveformPyramid>(sample_rate_, total);
+    waveform_->update(*this, total, true);
+}
+
+void AudioFile::storeInCache() {
+    if (!pcm_cache_ || streaming_ || pcm_mapping_) return;
+    
+    PcmCacheInfo info;
+    info.format = storage_format_;
+    info.sample_rate = sample_rate_;
+    info.frames = getTotalSamples();
+    info.has_loudness = getLoudness(&info.loudness);
+    
+    size_t bytes = static_cast<size_t>(info.frames) * 2 * bytesPerSample(storage_format_);
+    pcm_cache_->store(source_path_.c_str(), target_sample_rate_, info, pcm_data_, bytes);
+}
+
+bool AudioFile::decodeRange(int64_t frames) {
+    int64_t total = getTotalSamples();
+    int64_t decoded = decoded_samples_.load(std::memory_order_relaxed);
+    int64_t end = std::min(total, decoded + frames);
+    
+    while (decoded < end) {
+        if (cancel_decode_.load(std::memory_order_relaxed)) return false;
+        
+        int64_t to_read = std::min(DECODE_CHUNK_FRAMES, end - decoded);
+        int64_t got = readConverted(decode_buffer_.data(), to_read);
+        encodeSamples(decode_buffer_.data(), pcm_.data() + decoded * 2 * bytesPerSample(storage_format_),
+                      got * 2, storage_format_);
+        decoded += got;
+        
+        // Publish the chunk - readers may now play up to this frame
+        decoded_samples_.store(decoded, std::memory_order_release);
+        decode_cv_.notify_all();
+        if (waveform_) waveform_->update(*this, decoded, false);
+        
+        if (got < to_read) return false;  // Stream ended early or decode error
+    }
+    
+    return true;
+}
+
+void AudioFile::decodeThreadMain() {
+    while (decodeRange(DECODE_CHUNK_FRAMES) && decoded_samples_.load() < getTotalSamples()) {
+    }
+    finishDecode();
+}
+
+void AudioFile::finishDecode() {
+    decoder_.close();
+    source_memory_.reset();
+    resampler_.close();
+    source_buffer_.clear();
+    source_buffer_.shrink_to_fit();
+    decode_buffer_.clear();
+    decode_buffer_.shrink_to_fit();
+    
+    // Frame counts from headers can overshoot what actually decodes
+    total_samples_.store(decoded_samples_.load(), std::memory_order_release);
+    
+    // A cancelled decode is partial - never let it into the cache
+    if (!cancel_decode_.load() && getTotalSamples() > 0) {
+        finishLoudness();
+        if (waveform_) waveform_->update(*this, getTotalSamples(), true);
+        storeInCache();
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(decode_mutex_);
+        decode_complete_.store(true, std::memory_order_release);
+    }
+    decode_cv_.notify_all();
+}
+
+bool AudioFile::startStreaming(const LoadOptions& options) {
+    decoder_.buildSeekTable();
+    
+    streaming_ = true;
+    ring_frames_ = std::max<int64_t>(STREAM_CHUNK_FRAMES * 8,
+        static_cast<int64_t>(options.streaming_buffer_seconds * sample_rate_));
+    ring_.assign(static_cast<size_t>(ring_frames_) * 2, 0.0f);
+    
+    // The whole track counts as playable; the ring refills on demand
+    int64_t total = Resampler::convertedLength(decoder_.getTotalFrames(), source_sample_rate_, sample_rate_);
+    total_samples_.store(total, std::memory_order_release);
+    decoded_samples_.store(total, std::memory_order_release);
+    
+    // Prime the first half of the ring so playback can start immediately
+    int64_t primed = 0;
+    int64_t prime_frames = ring_frames_ / 2;
+    while (primed < prime_frames) {
+        int64_t to_read = std::min(STREAM_CHUNK_FRAMES, prime_frames - primed);
+        int64_t got = readConverted(ring_.data() + primed * 2, to_read);
+        primed += got;
+        if (got < to_read) break;
+    }
+    if (primed == 0) {
+        return false;
+    }
+    stream_end_.store(primed);
+    
+    if (meter_) {
+        bool opened = source_memory_ ? meter_decoder_.openMemory(source_memory_, source_path_.c_str())
+                                     : meter_decoder_.open(source_path_.c_str());
+        if (opened) {
+            meter_buffer_.resize(STREAM_CHUNK_FRAMES * 2);
+        } else {
+            meter_.reset();
+        }
+    }
+    
+    decode_thread_ = std::thread(&AudioFile::streamThreadMain, this);
+    return true;
+}
+
+void AudioFile::streamThreadMain() {
+    uint32_t handled_serial = 0;
+    bool eof = false;
+    
+    while (!cancel_decode_.load(std::memory_order_relaxed)) {
+        // Serial first, then target - pairs with requestSeek's store order
+        uint32_t serial = seek_serial_.load();
+        if (serial != handled_serial) {
+            int64_t target = seek_target_.load();
+            eof = !seekConverted(target);
+            stream_start_.store(target);
+            stream_end_.store(target);
+            handled_serial = serial;
+            seek_ack_.store(serial);
+            continue;
+        }
+        
+        // Keep one chunk of slack behind the reader - see readStreamFrames
+        int64_t end = stream_end_.load();
+        int64_t space = stream_read_.load() + ring_frames_ - STREAM_CHUNK_FRAMES - end;
+        if (eof || space < STREAM_CHUNK_FRAMES) {
+            if (!meterStreamChunk()) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        
+        // Write up to the wrap point; the next pass continues from slot 0
+        int64_t slot = end % ring_frames_;
+        int64_t to_read = std::min(STREAM_CHUNK_FRAMES, ring_frames_ - slot);
+        int64_t got = readConverted(ring_.data() + slot * 2, to_read);
+        
+        if (got < to_read) {
+            eof = true;
+            // Header frame counts can overshoot what actually decodes
+            if (end + got < getTotalSamples()) {
+                total_samples_.store(end + got, std::memory_order_release);
+            }
+        }
+        
+        // A seek that arrived mid-read makes this chunk stale
+        if (seek_serial_.load() != handled_serial) continue;
+        
+        stream_end_.store(end + got);
+    }
+}
+
+bool AudioFile::meterStreamChunk() {
+    if (!meter_) return false;
+    
+    // One chunk per idle pass, so a seek never waits on more than that
+    int64_t got = meter_decoder_.read(meter_buffer_.data(), STREAM_CHUNK_FRAMES);
+    meter_->process(meter_buffer_.data(), got);
+    if (got < STREAM_CHUNK_FRAMES) {
+        finishLoudness();
+        meter_decoder_.close();
+        meter_buffer_.clear();
+        meter_buffer_.shrink_to_fit();
+    }
+    return true;
+}
+
+bool AudioFile::seekConverted(int64_t pos) {
+    // The resampler restarts from silence, so the first few frames after a
+    // seek ramp in slightly - this only runs on a discontinuity anyway
+    source_offset_ = 0;
+    source_pending_ = 0;
+    source_eof_ = false;
+    resampler_.reset();
+    
+    int64_t source_pos = (sample_rate_ == source_sample_rate_) ? pos
+        : (pos * source_sample_rate_ + sample_rate_ / 2) / sample_rate_;
+    return decoder_.seek(source_pos);
+}
+
+void AudioFile::requestSeek(int64_t pos) {
+    seek_target_.store(pos);
+    stream_read_.store(pos);
+    seek_serial_.fetch_add(1);
+}
+
+int64_t AudioFile::readStreamFrames(int64_t pos, float* output, int64_t frames) {
+    if (seek_ack_.load() != seek_serial_.load()) {
+        // Still refilling after a seek; a newer jump replaces the pending one
+        if (pos != seek_target_.load()) {
+            requestSeek(pos);
+        }
+        return 0;
+    }
+    
+    // Publish our position before looking at the window so the decoder
+    // can't start overwriting what we are about to copy
+    stream_read_.store(pos);
+    
+    int64_t end = stream_end_.load();
+    
+    // The chunk in flight may be clobbering the oldest STREAM_CHUNK_FRAMES
+    int64_t start = std::max(stream_start_.load(), end - ring_frames_ + STREAM_CHUNK_FRAMES);
+    
+    if (pos < start || pos > end + ring_frames_ / 4) {
+        // Outside the window - served by the decoder's seek, not by the ring
+        requestSeek(pos);
+        return 0;
+    }
+    
+    int64_t count = std::min(frames, end - pos);
+    if (count <= 0) return 0;  // Decoder hasn't reached pos yet
+    
+    int64_t slot = pos % ring_frames_;
+    int64_t first = std::min(count, ring_frames_ - slot);
+    memcpy(output, ring_.data() + slot * 2, first * 2 * sizeof(float));
+    if (count > first) {
+        memcpy(output + first * 2, ring_.data(), (count - first) * 2 * sizeof(float));
+    }
+    
+    stream_read_.store(pos + count);
+    return count;
+}
+
+int64_t AudioFile::readFrames(int64_t pos, float* output, int64_t frames) {
+    if (pos < 0 || frames <= 0) return 0;
+    
+    if (streaming_) {
+        if (pos >= getTotalSamples()) return 0;
+        return readStreamFrames(pos, output, std::min(frames, getTotalSamples() - pos));
+    }
+    
+    return copyFrames(pos, output, frames);
+}
+
+int64_t AudioFile::copyFrames(int64_t pos, float* output, int64_t frames) const {
+    if (streaming_ || pos < 0) return 0;
+    
+    int64_t count = std::min(frames, getDecodedSamples() - pos);
+    if (count <= 0) return 0;
+    
+    decodeSamples(pcm_data_ + pos * 2 * bytesPerSample(storage_format_), output, count * 2, storage_format_);
+    return count;
+}
+
+const float* AudioFile::peekFrames(int64_t pos, int64_t frames, int64_t* available) const {
+    *available = 0;
+    if (streaming_ || storage_format_ != SampleFormat::Float32 || pos < 0) return nullptr;
+    
+    int64_t count = std::min(frames, getDecodedSamples() - pos);
+    if (count <= 0) return nullptr;
+    
+    *available = count;
+    return reinterpret_cast<const float*>(pcm_data_) + pos * 2;
+}
+
+bool AudioFile::isEndOfTrack(int64_t pos) const {
+    // Completion flag first so a finished decode is never mistaken for a
+    // stale watermark
+    bool complete = isFullyDecoded();
+    return complete && pos >= getTotalSamples();
+}
+
+void AudioFile::waitUntilDecoded() const {
+    std::unique_lock<std::mutex> lock(decode_mutex_);
+    decode_cv_.wait(lock, [this] { return decode_complete_.load(); });
+}
+
+bool AudioFile::waitUntilDecoded(const std::atomic<bool>& cancel) const {
+    // The decoder doesn't know about the canceller, so poll for it
+    std::unique_lock<std::mutex> lock(decode_mutex_);
+    while (!decode_complete_.load()) {
+        if (cancel.load()) return false;
+        decode_cv_.wait_for(lock, std::chrono::milliseconds(ANALYSIS_CANCEL_POLL_MS));
+    }
+    return true;
+}
+
+bool AudioFile::waitUntilDecoded(int64_t frames, const std::atomic<bool>& cancel) const {
+    // Chunks are notified without the lock, so a wakeup can be missed; the
+    // poll covers it
+    std::unique_lock<std::mutex> lock(decode_mutex_);
+    while (!decode_complete_.load() && getDecodedSamples() < frames) {
+        if (cancel.load()) return false;
+        decode_cv_.wait_for(lock, std::chrono::milliseconds(ANALYSIS_CANCEL_POLL_MS));
+    }
+    return true;
+}
+
+bool AudioFile::getLoudness(TrackLoudness* loudness) const {
+    if (!has_loudness_.load(std::memory_order_acquire)) return false;
+    *loudness = loudness_;
+    return true;
+}
+
+void AudioFile::setLoudness(const TrackLoudness& loudness) {
+    loudness_ = loudness;
+    has_loudness_.store(true, std::memory_order_release);
+}
+
+void AudioFile::finishLoudness() {
+    if (!meter_) return;
+    setLoudness(meter_->getLoudness());
+    meter_.reset();
+    
+    DJ_LOG_DEBUG("Loudness of %s: %.1f LUFS, %.1f dBTP", source_path_.c_str(),
+                 loudness_.integrated_lufs, loudness_.true_peak_db);
+}
+
+std::shared_ptr<const AnalysisResult> AudioFile::peekAnalysis() const {
+    // Held through a whole analysis run, which this must not wait out
+    std::unique_lock<std::mutex> lock(analysis_mutex_, std::try_to_lock);
+    return lock.owns_lock() ? analysis_ : nullptr;
+}
+
+std::shared_ptr<const AnalysisResult> AudioFile::getAnalysis(AnalysisControl* control) const {
+    std::lock_guard<std::mutex> lock(analysis_mutex_);
+    if (analysis_) return analysis_;
+    
+    if (streaming_) {
+        // Never entirely in memory, so there is nothing to analyze
+        analysis_ = std::make_shared<AnalysisResult>();
+        return analysis_;
+    }
+    
+    if (control) {
+        if (!waitUntilDecoded(control->cancelled)) return nullptr;
+    } else {
+        waitUntilDecoded();
+    }
+    
+    // A cancelled run leaves the cache empty for the next caller
+    analysis_ = analyzeTrack(*this, control);
+    if (analysis_ && analysis_->bpm > 0.0 && analysis_db_) {
+        analysis_db_->store(content_key_, *analysis_);
+    }
+    return analysis_;
+}
+
 void AudioFile::unload() {
-    audio_data_.clear();
+    cancel_decode_ = true;
+    if (decode_thread_.joinable()) {
+        decode_thread_.join();
+    }
+    cancel_decode_ = false;
+    
+    decoder_.close();
+    resampler_.close();
+    meter_.reset();
+    meter_decoder_.close();
+    source_memory_.reset();  // After the decoders, which may hold it too
+    meter_buffer_.clear();
+    meter_buffer_.shrink_to_fit();
+    has_loudness_ = false;
+    source_buffer_.clear();
+    source_buffer_.shrink_to_fit();
+    source_offset_ = 0;
+    source_pending_ = 0;
+    source_eof_ = false;
+    source_sample_rate_ = 0;
+    pcm_data_ = nullptr;
+    pcm_mapping_.reset();
+    pcm_.clear();
+    pcm_.shrink_to_fit();
+    decode_buffer_.clear();
+    decode_buffer_.shrink_to_fit();
+    ring_.clear();
+    ring_.shrink_to_fit();
+    streaming_ = false;
+    ring_frames_ = 0;
+    stream_start_ = 0;
+    stream_end_ = 0;
+    stream_read_ = 0;
+    seek_target_ = 0;
+    seek_serial_ = 0;
+    seek_ack_ = 0;
     total_samples_ = 0;
+    decoded_samples_ = 0;
+    decode_complete_ = true;
     sample_rate_ = 0;
     channels_ = 0;
+    build_waveform_ = false;
+    waveform_.reset();  // Handles the UI holds keep their copy alive
+    
+    std::lock_guard<std::mutex> lock(analysis_mutex_);
+    analysis_.reset();
+    analysis_db_ = nullptr;
+    content_key_ = 0;
 }
 
 double AudioFile::getDurationSeconds() const {
     if (sample_rate_ == 0) return 0.0;
-    return static_cast<double>(total_samples_) / sample_rate_;
+    return static_cast<double>(getTotalSamples()) / sample_rate_;
+}
+
+uint64_t AudioFile::getMemoryBytes() const {
+    if (streaming_) return static_cast<uint64_t>(ring_.size()) * sizeof(float);
+    return static_cast<uint64_t>(getTotalSamples()) * 2 * bytesPerSample(storage_format_);
+}
+
+double AudioFile::getDecodedSeconds() const {
+    if (sample_rate_ == 0) return 0.0;
+    return static_cast<double>(getDecodedSamples()) / sample_rate_;
+}
+
+double AudioFile::getDecodeProgress() const {
+    int64_t total = getTotalSamples();
+    if (total <= 0) return isFullyDecoded() ? 1.0 : 0.0;
+    return static_cast<double>(getDecodedSamples()) / total;
 }
 
 } // namespace dj
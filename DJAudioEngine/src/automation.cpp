@@ -0,0 +1,112 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cmath>
+
+namespace dj {
+
+// Longest span the callback mixes while a ramp runs: the length of one
+// straight piece of the curve (about 3 ms at 44.1 kHz)
+static const int AUTOMATION_SEGMENT_FRAMES = 128;
+
+static double shapeRamp(AutomationShape shape, double t) {
+    switch (shape) {
+        case AutomationShape::SCurve:  return t * t * (3.0 - 2.0 * t);
+        case AutomationShape::EaseIn:  return t * t;
+        case AutomationShape::EaseOut: return 1.0 - (1.0 - t) * (1.0 - t);
+        case AutomationShape::Linear:  break;
+    }
+    return t;
+}
+
+static double readTarget(AutomationTarget target, const Deck* deck, const Mixer* mixer) {
+    switch (target) {
+        case AutomationTarget::Crossfader: return mixer->getCrossfader();
+        case AutomationTarget::DeckVolume: return deck->getVolume();
+        case AutomationTarget::DeckEQLow:  return deck->getEQLow();
+        case AutomationTarget::DeckEQMid:  return deck->getEQMid();
+        case AutomationTarget::DeckEQHigh: return deck->getEQHigh();
+        case AutomationTarget::DeckTempo:  return deck->getTempo();
+    }
+    return 0.0;
+}
+
+static void writeTarget(AutomationTarget target, Deck* deck, Mixer* mixer, double value) {
+    switch (target) {
+        case AutomationTarget::Crossfader: mixer->setCrossfader(static_cast<float>(value)); break;
+        case AutomationTarget::DeckVolume: deck->setVolume(static_cast<float>(value)); break;
+        case AutomationTarget::DeckEQLow:  deck->setEQLow(static_cast<float>(value)); break;
+        case AutomationTarget::DeckEQMid:  deck->setEQMid(static_cast<float>(value)); break;
+        case AutomationTarget::DeckEQHigh: deck->setEQHigh(static_cast<float>(value)); break;
+        case AutomationTarget::DeckTempo:  deck->setTempo(value); break;
+    }
+}
+
+Automation::Automation(size_t capacity, int sample_rate)
+    : capacity_(capacity)
+    , sample_rate_(sample_rate)
+{
+    ramps_.reserve(capacity_);
+}
+
+bool Automation::add(AutomationTarget target, int deck, double value, int64_t start_frame, double seconds,
+                     AutomationShape shape) {
+    if (target == AutomationTarget::Crossfader) deck = -1;
+    cancel(static_cast<int>(target), deck);
+    if (ramps_.size() >= capacity_) return false;
+    
+    Ramp ramp;
+    ramp.target = target;
+    ramp.shape = shape;
+    ramp.started = false;
+    ramp.deck = deck;
+    ramp.from = 0.0;
+    ramp.to = value;
+    ramp.start_frame = start_frame;
+    ramp.duration_frames = std::max<int64_t>(0, std::llround(seconds * sample_rate_));
+    ramps_.push_back(ramp);
+    return true;
+}
+
+void Automation::cancel(int target, int deck) {
+    ramps_.erase(std::remove_if(ramps_.begin(), ramps_.end(), [target, deck](const Ramp& ramp) {
+        return ramp.deck == deck && (target < 0 || static_cast<int>(ramp.target) == target);
+    }), ramps_.end());
+}
+
+int Automation::framesUntilNext(int64_t stream_frame, int frames) const {
+    int64_t next = frames;
+    for (const Ramp& ramp : ramps_) {
+        // A ramp yet to start ends the span on its first frame
+        int64_t until = ramp.start_frame - stream_frame;
+        next = std::min<int64_t>(next, until > 0 ? until : AUTOMATION_SEGMENT_FRAMES);
+    }
+    return static_cast<int>(std::max<int64_t>(1, next));
+}
+
+void Automation::apply(Deck* const* decks, int count, Mixer* mixer, int64_t span_start, int64_t span_end) {
+    for (size_t i = 0; i < ramps_.size();) {
+        Ramp& ramp = ramps_[i];
+        Deck* deck = (ramp.deck >= 0 && ramp.deck < count) ? decks[ramp.deck] : nullptr;
+        if (span_start < ramp.start_frame || (!deck && ramp.target != AutomationTarget::Crossfader)) {
+            i++;
+            continue;
+        }
+        
+        if (!ramp.started) {
+            ramp.started = true;
+            ramp.from = readTarget(ramp.target, deck, mixer);
+        }
+        
+        double t = ramp.duration_frames > 0
+                 ? std::min(1.0, static_cast<double>(span_end - ramp.start_frame) / ramp.duration_frames) : 1.0;
+        writeTarget(ramp.target, deck, mixer, ramp.from + (ramp.to - ramp.from) * shapeRamp(ramp.shape, t));
+        
+        if (t >= 1.0) {
+            ramps_.erase(ramps_.begin() + i);
+        } else {
+            i++;
+        }
+    }
+}
+
+} // namespace dj
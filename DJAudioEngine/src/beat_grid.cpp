@@ -0,0 +1,78 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cmath>
+
+namespace dj {
+
+// Beats either side of a position that getLocalBPM() averages over
+static const int LOCAL_BPM_HALF_WINDOW = 4;
+
+BeatGrid::BeatGrid(std::vector<double> beats)
+    : beats_(std::move(beats))
+{
+}
+
+std::shared_ptr<const BeatGrid> BeatGrid::fromAnalysis(const AnalysisResult& result) {
+    if (result.beats.size() < 2) return nullptr;
+
+    // The tracker emits ascending beats; drop any repeats so every interval
+    // is positive
+    std::vector<double> beats;
+    beats.reserve(result.beats.size());
+    for (double beat : result.beats) {
+        if (beats.empty() || beat > beats.back()) beats.push_back(beat);
+    }
+    if (beats.size() < 2) return nullptr;
+
+    return std::make_shared<BeatGrid>(std::move(beats));
+}
+
+double BeatGrid::getBeatNumber(double seconds) const {
+    size_t count = beats_.size();
+    if (seconds < beats_.front()) {
+        return (seconds - beats_[0]) / (beats_[1] - beats_[0]);
+    }
+    if (seconds >= beats_.back()) {
+        return (count - 1) + (seconds - beats_[count - 1]) / (beats_[count - 1] - beats_[count - 2]);
+    }
+
+    // Last beat at or before seconds
+    size_t i = std::upper_bound(beats_.begin(), beats_.end(), seconds) - beats_.begin() - 1;
+    return i + (seconds - beats_[i]) / (beats_[i + 1] - beats_[i]);
+}
+
+double BeatGrid::getBeatTime(double beat_number) const {
+    int count = getBeatCount();
+    if (beat_number < 0.0) {
+        return beats_[0] + beat_number * (beats_[1] - beats_[0]);
+    }
+    if (beat_number >= count - 1) {
+        return beats_[count - 1] + (beat_number - (count - 1)) * (beats_[count - 1] - beats_[count - 2]);
+    }
+
+    int i = static_cast<int>(beat_number);
+    return beats_[i] + (beat_number - i) * (beats_[i + 1] - beats_[i]);
+}
+
+double BeatGrid::getPhase(double seconds) const {
+    double beat = getBeatNumber(seconds);
+    return beat - std::floor(beat);
+}
+
+double BeatGrid::getNearestBeat(double seconds) const {
+    return getBeatTime(std::round(getBeatNumber(seconds)));
+}
+
+double BeatGrid::getLocalBPM(double seconds) const {
+    int count = getBeatCount();
+    int center = static_cast<int>(std::floor(getBeatNumber(seconds)));
+    int first = std::max(0, std::min(center - LOCAL_BPM_HALF_WINDOW, count - 2));
+    int last = std::min(count - 1, std::max(center + LOCAL_BPM_HALF_WINDOW, first + 1));
+    return 60.0 * (last - first) / (beats_[last] - beats_[first]);
+}
+
+double BeatGrid::getAverageBPM() const {
+    return 60.0 * (beats_.size() - 1) / (beats_.back() - beats_.front());
+}
+
+} // namespace dj
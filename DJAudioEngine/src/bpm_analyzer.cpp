@@ -3,6 +3,7 @@
 
 #include "dj_audio_engine.h"
 #include "dj_audio_internal.h"
+#include "simd.h"
 
 // QM DSP includes
 #include "dsp/tempotracking/TempoTrackV2.h"
@@ -14,125 +15,483 @@
 #include <cstdio>
 #include <numeric>
 
+static_assert(DJ_ANALYSIS_CHROMA_BINS == dj::CHROMA_BINS, "chroma sizes must match");
+static_assert(DJ_ANALYSIS_BANDS == dj::ANALYSIS_BANDS, "band counts must match");
+
 namespace dj {
 
-// Analyze audio data for BPM using QM DSP TempoTrackV2
-// This is the same algorithm used by Mixxx for accurate tempo detection
-double analyzeBPM(const float* samples, int64_t sampleCount, int sampleRate) {
-    FILE* logFile = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-    
-    // Early logging to diagnose crash
-    if (logFile) {
-        fprintf(logFile, "\n=== BPM ANALYSIS START ===\n");
-        fprintf(logFile, "samples=%p, count=%lld, rate=%d\n", 
-                (void*)samples, (long long)sampleCount, sampleRate);
-        fflush(logFile);
+// QM DSP detection function parameters, which every spectral feature
+// shares: one windowed FFT per hop
+static const int ANALYSIS_STEP_FRAMES = 512;
+static const int ANALYSIS_FRAME_LENGTH = 1024;
+
+// Detection function frames per parallel chunk (~6 s of audio at 44.1 kHz)
+static const int64_t DF_CHUNK_FRAMES = 512;
+
+// Frames a chunk runs ahead of its first output. The complex spectral
+// difference only remembers the last magnitudes and two frames of phase,
+// so after this the detector's state matches the serial pass exactly.
+static const int64_t DF_WARMUP_FRAMES = 4;
+
+// Share of an analysis' progress reported for the shared pass; the tempo
+// tracker's two passes fill the rest
+static const float DF_PROGRESS_SHARE = 0.7f;
+static const float BEAT_PERIOD_PROGRESS = 0.9f;
+
+// Frames per waveform overview peak (~93 ms at 44.1 kHz). A chunk's frames
+// hold whole overview blocks, so each chunk fills its own. Each block is
+// also one frame of the key detector's FFT: a 1024-point frame can't tell
+// the semitones of anything below ~725 Hz apart.
+static const int OVERVIEW_PEAK_FRAMES = 4096;
+static_assert((DF_CHUNK_FRAMES * ANALYSIS_STEP_FRAMES) % OVERVIEW_PEAK_FRAMES == 0,
+              "chunks must hold whole overview blocks");
+
+// Loudness gating, as in EBU R128 but over the overview blocks and without
+// K-weighting: blocks below the absolute gate are silence, and blocks more
+// than the relative gate under the mean of the rest are ignored
+static const double LOUDNESS_ABSOLUTE_GATE_DB = -70.0;
+static const double LOUDNESS_RELATIVE_GATE_DB = -10.0;
+
+// Band splits, as the waveform's
+static const double BAND_LOW_SPLIT_HZ = 250.0;
+static const double BAND_HIGH_SPLIT_HZ = 2500.0;
+
+// Chroma comes from the bins no wider than a semitone (above ~180 Hz at
+// 44.1 kHz), up to where cymbals and noise take over
+static const double CHROMA_MAX_HZ = 5000.0;
+static const double CHROMA_TUNING_HZ = 440.0;
+
+// Krumhansl-Kessler probe tone profiles, from the tonic
+static const double KEY_MAJOR_PROFILE[CHROMA_BINS] = {
+    6.35, 2.23, 3.48, 2.33, 4.38, 4.09, 2.52, 5.19, 2.39, 3.66, 2.29, 2.88
+};
+static const double KEY_MINOR_PROFILE[CHROMA_BINS] = {
+    6.33, 2.68, 3.52, 5.38, 2.60, 3.53, 2.54, 4.75, 3.98, 2.69, 3.34, 3.17
+};
+
+// Preview tier: the rate it analyzes at and the window it takes. The
+// decimation is a power of two, so frame lengths stay powers of two; 44.1
+// and 48 kHz come down by four.
+static const int PREVIEW_SAMPLE_RATE = 11025;
+static const double PREVIEW_WINDOW_SECONDS = 30.0;
+
+// Candidate window centres, as fractions of the track. The loudest one
+// decoded is analyzed, which keeps breakdowns out; the first is the one a
+// progressive decode is waited for.
+static const double PREVIEW_WINDOW_CENTRES[] = { 0.25, 0.5, 0.75 };
+
+// Anti-alias filter length per unit of decimation, and its cutoff as a
+// share of the decimated Nyquist
+static const int PREVIEW_FILTER_TAPS_PER_FACTOR = 8;
+static const double PREVIEW_FILTER_CUTOFF = 0.9;
+
+// Frames read at a time while choosing and downmixing the window
+static const int64_t PREVIEW_READ_FRAMES = 65536;
+
+// Beats the preview needs to fit a tentative grid to
+static const size_t PREVIEW_MIN_GRID_BEATS = 8;
+
+static DFConfig makeDFConfig(int stepSize, int frameLength) {
+    // Complex Spectral Difference - best for beats
+    DFConfig dfConfig;
+    dfConfig.stepSize = stepSize;
+    dfConfig.frameLength = frameLength;
+    dfConfig.DFType = DF_COMPLEXSD;
+    dfConfig.dbRise = 3.0;
+    dfConfig.adaptiveWhitening = false;
+    dfConfig.whiteningRelaxCoeff = -1;
+    dfConfig.whiteningFloor = -1;
+    return dfConfig;
+}
+
+// qm-dsp's Hanning window, 0.5 - 0.5 cos(2 pi i / n), so frames match the
+// ones DetectionFunction windows itself
+static std::vector<float> makeHannWindow(int length) {
+    const double pi = 3.14159265358979323846;
+    std::vector<float> window(static_cast<size_t>(length));
+    for (int i = 0; i < length; i++) {
+        window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * pi * i / length));
     }
-    
-    if (!samples || sampleCount == 0 || sampleRate == 0) {
-        if (logFile) {
-            fprintf(logFile, "ERROR: Invalid input parameters\n");
-            fclose(logFile);
+    return window;
+}
+
+// The complex spectral difference DetectionFunction computes for the
+// config above, in single precision and with no trigonometry per bin. Each
+// bin adds |M' - M e^(j dev)| for the last magnitude M', where dev is the
+// phase's second difference, and that distance only needs
+// cos(dev) = Re(u conj(u')^2 u'') of the unit phasors - atan2 and
+// exp(j dev) cancel out.
+class SpectralDifference {
+public:
+    explicit SpectralDifference(int bins)
+        : bins_(bins)
+        , magnitude_(static_cast<size_t>(bins), 0.0f)
+        , newest_(0)
+    {
+        // Zero phases, as DetectionFunction's history starts
+        for (int i = 0; i < 2; i++) {
+            phasor_re_[i].assign(static_cast<size_t>(bins), 1.0f);
+            phasor_im_[i].assign(static_cast<size_t>(bins), 0.0f);
         }
-        return 0.0;
     }
     
-    try {
-        if (logFile) {
-            fprintf(logFile, "Input: %lld samples at %d Hz (%.1f seconds)\n", 
-                    (long long)sampleCount, sampleRate, (double)sampleCount / sampleRate);
-            fflush(logFile);
-        }
+    double process(const float* reals, const float* imags) {
+        float* lastMagnitude = magnitude_.data();
+        const float* lastRe = phasor_re_[newest_].data();
+        const float* lastIm = phasor_im_[newest_].data();
+        float* olderRe = phasor_re_[1 - newest_].data();  // Overwritten with this frame's
+        float* olderIm = phasor_im_[1 - newest_].data();
         
-        // QM DSP detection function parameters
-        const int stepSize = 512;           // Hop size
-        const int frameLength = 1024;       // Frame size
-        
-        if (logFile) {
-            fprintf(logFile, "Creating DFConfig...\n");
-            fflush(logFile);
+        int k = 0;
+        vec4 sum = vset1(0.0f);
+        for (; k + 4 <= bins_; k += 4) {
+            sum = vadd(sum, bins(reals + k, imags + k, lastMagnitude + k, lastRe + k, lastIm + k,
+                                 olderRe + k, olderIm + k));
         }
+        float lanes[4];
+        vstore(lanes, sum);
+        double total = static_cast<double>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
         
-        // Configure detection function (Complex Spectral Difference - best for beats)
-        DFConfig dfConfig;
-        dfConfig.stepSize = stepSize;
-        dfConfig.frameLength = frameLength;
-        dfConfig.DFType = DF_COMPLEXSD;     // Complex spectral difference
-        dfConfig.dbRise = 3.0;
-        dfConfig.adaptiveWhitening = false;
-        dfConfig.whiteningRelaxCoeff = -1;
-        dfConfig.whiteningFloor = -1;
-        
-        if (logFile) {
-            fprintf(logFile, "Creating DetectionFunction...\n");
-            fflush(logFile);
+        // The odd bin out (n / 2 + 1 never divides by four), a lane at a time
+        for (; k < bins_; k++) {
+            float re[4] = { reals[k] }, im[4] = { imags[k] }, magnitude[4] = { lastMagnitude[k] };
+            float ur[4] = { lastRe[k] }, ui[4] = { lastIm[k] }, vr[4] = { olderRe[k] }, vi[4] = { olderIm[k] };
+            vstore(lanes, bins(re, im, magnitude, ur, ui, vr, vi));
+            lastMagnitude[k] = magnitude[0];
+            olderRe[k] = vr[0];
+            olderIm[k] = vi[0];
+            total += lanes[0];
         }
         
-        DetectionFunction df(dfConfig);
+        newest_ = 1 - newest_;
+        return total;
+    }
     
-    // Convert stereo to mono and calculate detection function
-    std::vector<double> detectionFunction;
-    std::vector<double> frame(frameLength);
+private:
+    // Four bins' distances. Leaves this frame's magnitudes and phasors in
+    // place of the last magnitudes and the older phasors.
+    static vec4 bins(const float* reals, const float* imags, float* lastMagnitude, const float* lastRe,
+                     const float* lastIm, float* olderRe, float* olderIm) {
+        vec4 re = vload(reals), im = vload(imags);
+        vec4 magnitude = vsqrt(vadd(vmul(re, re), vmul(im, im)));
+        
+        // A silent bin gets atan2's angle of zero: 1 - M / max(M, tiny) is
+        // 1 there and 0 anywhere else, making its phasor (1, 0)
+        vec4 inverse = vdiv(vset1(1.0f), vmax(magnitude, vset1(1e-30f)));
+        vec4 ur = vadd(vmul(re, inverse), vsub(vset1(1.0f), vmul(magnitude, inverse)));
+        vec4 ui = vmul(im, inverse);
+        
+        // conj(u')^2 u''
+        vec4 lr = vload(lastRe), li = vload(lastIm);
+        vec4 cr = vsub(vmul(lr, lr), vmul(li, li));
+        vec4 ci = vmul(vset1(-2.0f), vmul(lr, li));
+        vec4 vr = vload(olderRe), vi = vload(olderIm);
+        vec4 pr = vsub(vmul(cr, vr), vmul(ci, vi));
+        vec4 pi = vadd(vmul(cr, vi), vmul(ci, vr));
+        vec4 cosine = vsub(vmul(ur, pr), vmul(ui, pi));
+        
+        vec4 last = vload(lastMagnitude);
+        vec4 squared = vsub(vadd(vmul(last, last), vmul(magnitude, magnitude)),
+                            vmul(vset1(2.0f), vmul(vmul(last, magnitude), cosine)));
+        
+        vstore(lastMagnitude, magnitude);
+        vstore(olderRe, ur);
+        vstore(olderIm, ui);
+        return vsqrt(vmax(squared, vset1(0.0f)));
+    }
     
-    // sampleCount = number of stereo sample frames
-    // Buffer has sampleCount * 2 floats (stereo interleaved: L0,R0,L1,R1,...)
-    // We need enough frames to process: (sampleCount - frameLength) / stepSize
-    int64_t numFrames = (sampleCount - frameLength) / stepSize;
-    if (numFrames <= 0) {
-        if (logFile) {
-            fprintf(logFile, "ERROR: Not enough samples for analysis (numFrames=%lld)\n", (long long)numFrames);
-            fclose(logFile);
+    int bins_;
+    std::vector<float> magnitude_;
+    std::vector<float> phasor_re_[2];  // Unit phasors of the last two frames
+    std::vector<float> phasor_im_[2];
+    int newest_;                       // Which of the two is the last frame's
+};
+
+// The detection function over consecutive hops on one backend: the
+// thread's FFT plan, then qm-dsp's DetectionFunction on the reference
+// backend or SpectralDifference on the fast one
+class OnsetDetector {
+public:
+    OnsetDetector(FFTBackend backend, int stepSize, int frameLength)
+        : frameLength_(frameLength)
+        , fft_(getThreadFFT(backend, frameLength))
+        , window_(makeHannWindow(frameLength))
+        , frame_(static_cast<size_t>(frameLength))
+        , reals_(static_cast<size_t>(frameLength / 2 + 1))
+        , imags_(reals_.size())
+        , fastDF_(frameLength / 2 + 1)
+    {
+        if (backend == FFTBackend::Reference) {
+            referenceDF_ = std::make_unique<DetectionFunction>(makeDFConfig(stepSize, frameLength));
+            dfReals_.resize(reals_.size());
+            dfImags_.resize(reals_.size());
         }
-        return 0.0;
     }
     
-    if (logFile) {
-        fprintf(logFile, "Processing %lld frames (step=%d, frameLen=%d)\n", 
-                (long long)numFrames, stepSize, frameLength);
+    // The frame starting at samples. Its spectrum stays in reals() and
+    // imags() until the next.
+    double process(const float* samples) {
+        // Windowed and rotated half a frame, as the detection function's
+        // phase vocoder does in processTimeDomain()
+        const int half = frameLength_ / 2;
+        for (int i = 0; i < half; i++) {
+            frame_[i] = samples[i + half] * window_[i + half];
+            frame_[i + half] = samples[i] * window_[i];
+        }
+        fft_.forward(frame_.data(), reals_.data(), imags_.data());
+        
+        if (!referenceDF_) return fastDF_.process(reals_.data(), imags_.data());
+        std::copy(reals_.begin(), reals_.end(), dfReals_.begin());
+        std::copy(imags_.begin(), imags_.end(), dfImags_.begin());
+        return referenceDF_->processFrequencyDomain(dfReals_.data(), dfImags_.data());
     }
     
-    // Process audio frames
-    for (int64_t f = 0; f < numFrames; f++) {
-        int64_t startFrame = f * stepSize;  // Starting frame index (mono)
-        
-        // Convert stereo to mono for this frame
-        for (int i = 0; i < frameLength; i++) {
-            int64_t frameIdx = startFrame + i;
-            if (frameIdx < sampleCount) {
-                int64_t bufIdx = frameIdx * 2;  // stereo buffer index (L channel)
-                frame[i] = (samples[bufIdx] + samples[bufIdx + 1]) / 2.0;
-            } else {
-                frame[i] = 0.0;
+    const float* reals() const { return reals_.data(); }
+    const float* imags() const { return imags_.data(); }
+    
+private:
+    int frameLength_;
+    AnalysisFFT& fft_;
+    std::vector<float> window_;
+    std::vector<float> frame_;
+    std::vector<float> reals_;
+    std::vector<float> imags_;
+    SpectralDifference fastDF_;
+    std::unique_ptr<DetectionFunction> referenceDF_;
+    std::vector<double> dfReals_;  // The reference takes double spectra
+    std::vector<double> dfImags_;
+};
+
+// A chunk's share of the spectral features, added up in chunk order so the
+// totals don't depend on scheduling
+struct SpectralSums {
+    double chroma[CHROMA_BINS] = {};
+    double bands[ANALYSIS_BANDS] = {};
+};
+
+// The band of every bin of a detection function frame
+static std::vector<int> makeBandBins(int sampleRate, int frameLength) {
+    double binHz = static_cast<double>(sampleRate) / frameLength;
+    std::vector<int> bins(static_cast<size_t>(frameLength / 2 + 1));
+    for (size_t k = 0; k < bins.size(); k++) {
+        double hz = k * binHz;
+        bins[k] = hz < BAND_LOW_SPLIT_HZ ? 0 : (hz < BAND_HIGH_SPLIT_HZ ? 1 : 2);
+    }
+    return bins;
+}
+
+// The pitch class of every bin of a key frame, -1 outside the chroma range
+static std::vector<int> makeChromaBins(int sampleRate, int frameLength) {
+    double binHz = static_cast<double>(sampleRate) / frameLength;
+    double chromaMinHz = binHz / (std::pow(2.0, 1.0 / 12.0) - 1.0);
+    std::vector<int> bins(static_cast<size_t>(frameLength / 2 + 1), -1);
+    for (size_t k = 1; k < bins.size(); k++) {
+        double hz = k * binHz;
+        if (hz >= chromaMinHz && hz <= CHROMA_MAX_HZ) {
+            long note = std::lround(69.0 + 12.0 * std::log2(hz / CHROMA_TUNING_HZ));  // MIDI, C = 0 mod 12
+            bins[k] = static_cast<int>(((note % CHROMA_BINS) + CHROMA_BINS) % CHROMA_BINS);
+        }
+    }
+    return bins;
+}
+
+// Gated mean of the overview blocks' levels, in dBFS
+static double gatedLoudness(const std::vector<double>& meanSquares) {
+    auto gatedMean = [&meanSquares](double gate) {
+        double sum = 0.0;
+        size_t count = 0;
+        for (double ms : meanSquares) {
+            if (ms > gate) {
+                sum += ms;
+                count++;
             }
         }
-        
-        // Calculate detection function value for this frame
-        double dfValue = df.processTimeDomain(frame.data());
-        detectionFunction.push_back(dfValue);
+        return count > 0 ? sum / count : 0.0;
+    };
+    
+    double absoluteGate = std::pow(10.0, LOUDNESS_ABSOLUTE_GATE_DB / 10.0);
+    double ungated = gatedMean(absoluteGate);
+    if (ungated <= 0.0) return LOUDNESS_ABSOLUTE_GATE_DB;  // Silence keeps the floor value
+    
+    double gated = gatedMean(std::max(absoluteGate, ungated * std::pow(10.0, LOUDNESS_RELATIVE_GATE_DB / 10.0)));
+    return 10.0 * std::log10(gated);
+}
+
+// Pearson correlation of the chroma with a profile rooted at tonic
+static double correlateProfile(const double* chroma, const double* profile, int tonic) {
+    double chromaMean = 0.0;
+    double profileMean = 0.0;
+    for (int i = 0; i < CHROMA_BINS; i++) {
+        chromaMean += chroma[i] / CHROMA_BINS;
+        profileMean += profile[i] / CHROMA_BINS;
     }
     
-    if (logFile) {
-        fprintf(logFile, "Detection function: %zu frames computed\n", detectionFunction.size());
+    double cross = 0.0;
+    double chromaSquares = 0.0;
+    double profileSquares = 0.0;
+    for (int i = 0; i < CHROMA_BINS; i++) {
+        double c = chroma[i] - chromaMean;
+        double p = profile[(i - tonic + CHROMA_BINS) % CHROMA_BINS] - profileMean;
+        cross += c * p;
+        chromaSquares += c * c;
+        profileSquares += p * p;
+    }
+    double norm = std::sqrt(chromaSquares * profileSquares);
+    return norm > 0.0 ? cross / norm : 0.0;
+}
+
+// Track key, chroma and band shares from the summed spectra
+static void finishSpectralFeatures(const SpectralSums& sums, AnalysisResult& result) {
+    double bandTotal = std::accumulate(sums.bands, sums.bands + ANALYSIS_BANDS, 0.0);
+    for (int b = 0; bandTotal > 0.0 && b < ANALYSIS_BANDS; b++) {
+        result.band_energy[b] = static_cast<float>(sums.bands[b] / bandTotal);
     }
     
-    if (detectionFunction.size() < 100) {
-        if (logFile) {
-            fprintf(logFile, "ERROR: Not enough frames for tempo tracking\n");
-            fclose(logFile);
+    double chromaPeak = *std::max_element(sums.chroma, sums.chroma + CHROMA_BINS);
+    if (chromaPeak <= 0.0) return;  // Nothing tonal: no key
+    for (int i = 0; i < CHROMA_BINS; i++) {
+        result.chroma[i] = static_cast<float>(sums.chroma[i] / chromaPeak);
+    }
+    
+    double best = -2.0;
+    for (int tonic = 0; tonic < CHROMA_BINS; tonic++) {
+        double major = correlateProfile(sums.chroma, KEY_MAJOR_PROFILE, tonic);
+        double minor = correlateProfile(sums.chroma, KEY_MINOR_PROFILE, tonic);
+        if (major > best) {
+            best = major;
+            result.key = tonic;
+        }
+        if (minor > best) {
+            best = minor;
+            result.key = CHROMA_BINS + tonic;
         }
-        return 0.0;
     }
+    result.key_strength = static_cast<float>(best);
+}
+
+// Every feature from one read of the track. Each chunk converts its PCM
+// once; per overview block it takes the peak, the level and the key
+// detector's FFT, and per hop one windowed FFT that feeds both the onset
+// detection function and the band energies. Chunks run in parallel, each with its own detection function
+// and warm-up overlap, and stitch into the same values a single serial
+// pass produces. The FFTs are the thread's plans of the selected backend.
+// Cancelling drops the chunks not yet started and leaves the detection
+// function empty.
+static void analyzeFrames(const AudioFile& track, AnalysisResult& result, AnalysisControl* control) {
+    const int stepSize = ANALYSIS_STEP_FRAMES;
+    const int frameLength = ANALYSIS_FRAME_LENGTH;
+    const int halfLength = frameLength / 2 + 1;
+    const int64_t chunkSpan = DF_CHUNK_FRAMES * stepSize;
     
-    // Use TempoTrackV2 to find tempo
-    TempoTrackV2 tempoTracker(static_cast<float>(sampleRate), stepSize);
+    // sampleCount = number of stereo sample frames
+    int64_t sampleCount = track.getTotalSamples();
+    int64_t numFrames = std::max<int64_t>(0, (sampleCount - frameLength) / stepSize);
+    int64_t blocks = (sampleCount + OVERVIEW_PEAK_FRAMES - 1) / OVERVIEW_PEAK_FRAMES;
+    
+    result.peak_frames = OVERVIEW_PEAK_FRAMES;
+    result.peaks.assign(static_cast<size_t>(blocks), 0);
+    if (blocks == 0) return;
+    
+    std::vector<double> detectionFunction(static_cast<size_t>(numFrames));
+    std::vector<double> meanSquares(static_cast<size_t>(blocks), 0.0);
+    const std::vector<int> bandBins = makeBandBins(track.getSampleRate(), frameLength);
+    const std::vector<int> chromaBins = makeChromaBins(track.getSampleRate(), OVERVIEW_PEAK_FRAMES);
+    const std::vector<float> keyWindow = makeHannWindow(OVERVIEW_PEAK_FRAMES);
+    const FFTBackend backend = getAnalysisFFTBackend();
+    
+    int chunks = static_cast<int>((sampleCount + chunkSpan - 1) / chunkSpan);
+    std::vector<SpectralSums> chunkSums(static_cast<size_t>(chunks));
+    std::atomic<int> chunksDone(0);
+    
+    parallelFor(chunks, [&](int index) {
+        if (control && control->cancelled.load(std::memory_order_relaxed)) return;
+        
+        int64_t first = index * DF_CHUNK_FRAMES;
+        int64_t end = std::min(numFrames, first + DF_CHUNK_FRAMES);
+        int64_t warmup = std::max<int64_t>(0, first - DF_WARMUP_FRAMES);
+        int64_t blockBegin = first * stepSize;
+        int64_t blockEnd = std::min(sampleCount, blockBegin + chunkSpan);
+        
+        // Every sample the chunk's DF frames and overview blocks cover,
+        // converted to mono once rather than per (half-overlapping) frame
+        int64_t sampleBegin = warmup * stepSize;
+        int64_t sampleEnd = blockEnd;
+        if (end > first) sampleEnd = std::max(sampleEnd, (end - 1) * stepSize + frameLength);
+        int64_t sampleSpan = sampleEnd - sampleBegin;
+        std::vector<float> stereo(static_cast<size_t>(sampleSpan) * 2);
+        std::vector<float> mono(static_cast<size_t>(sampleSpan), 0.0f);
+        
+        int64_t got = track.copyFrames(sampleBegin, stereo.data(), sampleSpan);
+        for (int64_t i = 0; i < got; i++) {
+            mono[i] = (stereo[i * 2] + stereo[i * 2 + 1]) * 0.5f;
+        }
+        
+        SpectralSums& sums = chunkSums[index];
+        AnalysisFFT& keyFFT = getThreadFFT(backend, OVERVIEW_PEAK_FRAMES);
+        std::vector<float> keyFrame(OVERVIEW_PEAK_FRAMES);
+        std::vector<float> reals(OVERVIEW_PEAK_FRAMES / 2 + 1);
+        std::vector<float> imags(OVERVIEW_PEAK_FRAMES / 2 + 1);
+        
+        for (int64_t b = blockBegin / OVERVIEW_PEAK_FRAMES; b * OVERVIEW_PEAK_FRAMES < blockEnd; b++) {
+            int64_t from = b * OVERVIEW_PEAK_FRAMES - sampleBegin;
+            int64_t to = std::min(got, from + OVERVIEW_PEAK_FRAMES);
+            float peak = 0.0f;
+            double sumSquares = 0.0;
+            for (int64_t i = from * 2; i < to * 2; i++) {
+                peak = std::max(peak, std::fabs(stereo[i]));
+                sumSquares += static_cast<double>(stereo[i]) * stereo[i];
+            }
+            result.peaks[b] = static_cast<uint8_t>(std::lround(std::min(peak, 1.0f) * 255.0f));
+            meanSquares[b] = to > from ? sumSquares / ((to - from) * 2) : 0.0;
+            
+            // The last block is short; the rest of its frame stays silent
+            int64_t length = std::max<int64_t>(0, to - from);
+            for (int64_t i = 0; i < length; i++) keyFrame[i] = mono[from + i] * keyWindow[i];
+            std::fill(keyFrame.begin() + length, keyFrame.end(), 0.0f);
+            keyFFT.forward(keyFrame.data(), reals.data(), imags.data());
+            for (size_t k = 1; k < chromaBins.size(); k++) {
+                if (chromaBins[k] >= 0) {
+                    sums.chroma[chromaBins[k]] += std::sqrt(static_cast<double>(reals[k]) * reals[k] +
+                                                            static_cast<double>(imags[k]) * imags[k]);
+                }
+            }
+        }
+        
+        OnsetDetector detector(backend, stepSize, frameLength);
+        const float* dfReals = detector.reals();
+        const float* dfImags = detector.imags();
+        for (int64_t f = warmup; f < end; f++) {
+            double dfValue = detector.process(mono.data() + (f - warmup) * stepSize);
+            if (f < first) continue;
+            detectionFunction[f] = dfValue;
+            
+            for (int k = 1; k < halfLength; k++) {
+                sums.bands[bandBins[k]] += static_cast<double>(dfReals[k]) * dfReals[k] +
+                                           static_cast<double>(dfImags[k]) * dfImags[k];
+            }
+        }
+        
+        if (control) {
+            float fraction = static_cast<float>(chunksDone.fetch_add(1) + 1) / chunks;
+            control->progress.store(fraction * DF_PROGRESS_SHARE, std::memory_order_relaxed);
+        }
+    });
     
-    std::vector<double> beatPeriod;
-    std::vector<double> tempi;
+    if (control && control->cancelled.load()) return;
     
-    // Calculate beat period (tempo)
-    tempoTracker.calculateBeatPeriod(detectionFunction, beatPeriod, tempi, 120.0, false);
+    SpectralSums total;
+    for (const SpectralSums& sums : chunkSums) {
+        for (int i = 0; i < CHROMA_BINS; i++) total.chroma[i] += sums.chroma[i];
+        for (int b = 0; b < ANALYSIS_BANDS; b++) total.bands[b] += sums.bands[b];
+    }
+    finishSpectralFeatures(total, result);
     
-    // Calculate median tempo from the tempi array
+    result.loudness_db = gatedLoudness(meanSquares);
+    result.detection_function = std::move(detectionFunction);
+}
+
+// Median of the plausible tempi, folded into the DJ range
+static double estimateBPM(const std::vector<double>& tempi) {
     double detectedBPM = 0.0;
     if (!tempi.empty()) {
         // Take median of tempi for stability
@@ -161,137 +520,267 @@ double analyzeBPM(const float* samples, int64_t sampleCount, int sampleRate) {
     while (detectedBPM > 0 && detectedBPM < 70) detectedBPM *= 2;
     while (detectedBPM > 160) detectedBPM /= 2;
     
-    if (logFile) {
-        fprintf(logFile, "BPM ANALYSIS RESULT: %.1f BPM (raw tempi count: %zu)\n", 
-                detectedBPM, tempi.size());
-        
-        // Log first few and last few tempi for debugging
-        if (tempi.size() > 10) {
-            fprintf(logFile, "  First 5 tempi: ");
-            for (size_t i = 0; i < 5 && i < tempi.size(); i++) {
-                fprintf(logFile, "%.1f ", tempi[i]);
-            }
-            fprintf(logFile, "\n  Last 5 tempi: ");
-            for (size_t i = tempi.size() - 5; i < tempi.size(); i++) {
-                fprintf(logFile, "%.1f ", tempi[i]);
-            }
-            fprintf(logFile, "\n");
-        }
-        
-        fclose(logFile);
-    }
-    
     return detectedBPM;
-    
-    } catch (const std::exception& e) {
-        FILE* errLog = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-        if (errLog) {
-            fprintf(errLog, "EXCEPTION in analyzeBPM: %s\n", e.what());
-            fclose(errLog);
-        }
-        return 0.0;
-    } catch (...) {
-        FILE* errLog = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-        if (errLog) {
-            fprintf(errLog, "UNKNOWN EXCEPTION in analyzeBPM\n");
-            fclose(errLog);
-        }
-        return 0.0;
-    }
 }
 
-// Detect beat positions using QM DSP
-std::vector<double> detectBeats(const float* samples, int64_t sampleCount, int sampleRate) {
-    std::vector<double> beatTimes;
-    
-    if (!samples || sampleCount == 0) return beatTimes;
+// Full beat analysis using QM DSP TempoTrackV2, the same algorithm Mixxx
+// uses. One pass over the PCM feeds the detection function and every other
+// feature; one tempo track feeds the BPM, the first beat and the grid alike.
+std::shared_ptr<const AnalysisResult> analyzeTrack(const AudioFile& track, AnalysisControl* control) {
+    auto result = std::make_shared<AnalysisResult>();
     
-    const int stepSize = 512;
-    const int frameLength = 1024;
+    int64_t sampleCount = track.getTotalSamples();
+    int sampleRate = track.getSampleRate();
     
-    // Configure detection function
-    DFConfig dfConfig;
-    dfConfig.stepSize = stepSize;
-    dfConfig.frameLength = frameLength;
-    dfConfig.DFType = DF_COMPLEXSD;
-    dfConfig.dbRise = 3.0;
-    dfConfig.adaptiveWhitening = false;
-    dfConfig.whiteningRelaxCoeff = -1;
-    dfConfig.whiteningFloor = -1;
+    DJ_LOG_INFO("=== BPM ANALYSIS START === track=%p, count=%lld, rate=%d",
+                (const void*)&track, (long long)sampleCount, sampleRate);
     
-    DetectionFunction df(dfConfig);
+    const int stepSize = ANALYSIS_STEP_FRAMES;
+    result->step_size = stepSize;
+    result->sample_rate = sampleRate;
     
-    // Calculate detection function
-    std::vector<double> detectionFunction;
-    std::vector<double> frame(frameLength);
+    if (sampleCount == 0 || sampleRate == 0) {
+        DJ_LOG_ERROR("analyzeTrack: Invalid input parameters");
+        return result;
+    }
     
-    // sampleCount = number of stereo sample frames
-    int64_t numFrames = (sampleCount - frameLength) / stepSize;
-    if (numFrames <= 0) return beatTimes;
-    
-    for (int64_t f = 0; f < numFrames; f++) {
-        int64_t startFrame = f * stepSize;
-        
-        for (int i = 0; i < frameLength; i++) {
-            int64_t frameIdx = startFrame + i;
-            if (frameIdx < sampleCount) {
-                int64_t bufIdx = frameIdx * 2;
-                frame[i] = (samples[bufIdx] + samples[bufIdx + 1]) / 2.0;
-            } else {
-                frame[i] = 0.0;
-            }
+    try {
+        DJ_LOG_DEBUG("Input: %lld samples at %d Hz (%.1f seconds)",
+                     (long long)sampleCount, sampleRate, (double)sampleCount / sampleRate);
+        
+        // Overview, loudness, key, bands and the detection function; the
+        // R128 figures came with the decode
+        result->has_loudness = track.getLoudness(&result->loudness);
+        analyzeFrames(track, *result, control);
+        const std::vector<double>& detectionFunction = result->detection_function;
+        
+        // QM DSP can't be interrupted, so cancellation is checked between passes
+        auto cancelled = [control]() { return control && control->cancelled.load(); };
+        if (cancelled()) return nullptr;
+        
+        DJ_LOG_DEBUG("Detection function: %zu frames computed, key %d (%.2f)",
+                     detectionFunction.size(), result->key, result->key_strength);
+        
+        if (detectionFunction.size() < 100) {
+            DJ_LOG_ERROR("analyzeTrack: Not enough frames for tempo tracking");
+            return result;
+        }
+        
+        // Use TempoTrackV2 to find tempo and beat positions
+        TempoTrackV2 tempoTracker(static_cast<float>(sampleRate), stepSize);
+        
+        std::vector<double> beats;
+        tempoTracker.calculateBeatPeriod(detectionFunction, result->beat_period, result->tempi, 120.0, false);
+        if (cancelled()) return nullptr;
+        if (control) control->progress.store(BEAT_PERIOD_PROGRESS);
+        
+        tempoTracker.calculateBeats(detectionFunction, result->beat_period, beats);
+        
+        // Convert beat positions (in df frames) to seconds
+        result->beats.reserve(beats.size());
+        for (double beatFrame : beats) {
+            result->beats.push_back((beatFrame * stepSize) / static_cast<double>(sampleRate));
         }
         
-        double dfValue = df.processTimeDomain(frame.data());
-        detectionFunction.push_back(dfValue);
+        result->bpm = estimateBPM(result->tempi);
+        
+        const std::vector<double>& tempi = result->tempi;
+        DJ_LOG_INFO("BPM ANALYSIS RESULT: %.1f BPM (raw tempi count: %zu, beats: %zu)",
+                    result->bpm, tempi.size(), result->beats.size());
+        
+        // Log first few and last few tempi for debugging
+        if (tempi.size() > 10) {
+            size_t n = tempi.size();
+            DJ_LOG_DEBUG("  First 5 tempi: %.1f %.1f %.1f %.1f %.1f",
+                         tempi[0], tempi[1], tempi[2], tempi[3], tempi[4]);
+            DJ_LOG_DEBUG("  Last 5 tempi: %.1f %.1f %.1f %.1f %.1f",
+                         tempi[n - 5], tempi[n - 4], tempi[n - 3], tempi[n - 2], tempi[n - 1]);
+        }
+        
+        if (control) control->progress.store(1.0f);
+    } catch (const std::exception& e) {
+        DJ_LOG_ERROR("EXCEPTION in analyzeTrack: %s", e.what());
+        return std::make_shared<AnalysisResult>();
+    } catch (...) {
+        DJ_LOG_ERROR("UNKNOWN EXCEPTION in analyzeTrack");
+        return std::make_shared<AnalysisResult>();
     }
     
-    if (detectionFunction.size() < 100) return beatTimes;
-    
-    // Use TempoTrackV2 for beat positions
-    TempoTrackV2 tempoTracker(static_cast<float>(sampleRate), stepSize);
-    
-    std::vector<double> beatPeriod;
-    std::vector<double> tempi;
-    std::vector<double> beats;
-    
-    tempoTracker.calculateBeatPeriod(detectionFunction, beatPeriod, tempi);
-    tempoTracker.calculateBeats(detectionFunction, beatPeriod, beats);
-    
-    // Convert beat positions (in df frames) to seconds
-    for (double beatFrame : beats) {
-        double beatTime = (beatFrame * stepSize) / static_cast<double>(sampleRate);
-        beatTimes.push_back(beatTime);
+    return result;
+}
+
+// Mean square of frames [begin, end), read in blocks
+static double windowEnergy(const AudioFile& track, int64_t begin, int64_t end) {
+    std::vector<float> stereo(static_cast<size_t>(PREVIEW_READ_FRAMES) * 2);
+    double sum = 0.0;
+    for (int64_t pos = begin; pos < end; pos += PREVIEW_READ_FRAMES) {
+        int64_t got = track.copyFrames(pos, stereo.data(), std::min(PREVIEW_READ_FRAMES, end - pos));
+        for (int64_t i = 0; i < got * 2; i++) sum += static_cast<double>(stereo[i]) * stereo[i];
     }
-    
-    return beatTimes;
+    return end > begin ? sum / (end - begin) : 0.0;
 }
 
-// Detect the first beat position
-double detectFirstBeat(const float* samples, int64_t sampleCount, int sampleRate, double bpm) {
-    if (!samples || sampleCount == 0 || bpm <= 0) return 0.0;
-    
-    auto beats = detectBeats(samples, sampleCount, sampleRate);
-    
-    FILE* logFile = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-    if (logFile) {
-        fprintf(logFile, "detectFirstBeat (QM DSP): Found %zu beats\n", beats.size());
+// Frames [begin, end) downmixed and decimated by factor through a
+// Hann-windowed sinc lowpass; samples outside the track count as silence
+static std::vector<float> decimateWindow(const AudioFile& track, int64_t begin, int64_t end, int factor) {
+    const double pi = 3.14159265358979323846;
+    const int taps = PREVIEW_FILTER_TAPS_PER_FACTOR * factor + 1;
+    const int centre = taps / 2;
+    std::vector<float> kernel(static_cast<size_t>(taps));
+    double cutoff = PREVIEW_FILTER_CUTOFF * 0.5 / factor;  // Cycles per input sample
+    double sum = 0.0;
+    for (int t = 0; t < taps; t++) {
+        double x = 2.0 * cutoff * (t - centre);
+        double sinc = t == centre ? 1.0 : std::sin(pi * x) / (pi * x);
+        double value = sinc * (0.5 - 0.5 * std::cos(2.0 * pi * (t + 1) / (taps + 1)));
+        kernel[t] = static_cast<float>(value);
+        sum += value;
     }
-    
-    if (!beats.empty()) {
-        if (logFile) {
-            fprintf(logFile, "detectFirstBeat (QM DSP): First beat at %.3f seconds\n", beats[0]);
-            fclose(logFile);
+    for (float& k : kernel) k = static_cast<float>(k / sum);
+    
+    int64_t first = std::max<int64_t>(0, begin - centre);
+    int64_t span = end + centre - first;
+    std::vector<float> mono(static_cast<size_t>(span) + static_cast<size_t>(taps), 0.0f);
+    std::vector<float> stereo(static_cast<size_t>(PREVIEW_READ_FRAMES) * 2);
+    for (int64_t pos = first; pos < first + span; pos += PREVIEW_READ_FRAMES) {
+        int64_t got = track.copyFrames(pos, stereo.data(), std::min(PREVIEW_READ_FRAMES, first + span - pos));
+        for (int64_t i = 0; i < got; i++) {
+            mono[pos - first + i] = (stereo[i * 2] + stereo[i * 2 + 1]) * 0.5f;
         }
-        return beats[0];
     }
     
-    if (logFile) {
-        fprintf(logFile, "detectFirstBeat (QM DSP): No beats found, returning 0\n");
-        fclose(logFile);
+    // mono[0] is frame first; output j centres on frame begin + j * factor
+    int64_t offset = begin - centre - first;  // Negative at the very start of the track
+    std::vector<float> output(static_cast<size_t>((end - begin) / factor));
+    for (size_t j = 0; j < output.size(); j++) {
+        int64_t at = offset + static_cast<int64_t>(j) * factor;
+        float value = 0.0f;
+        for (int t = std::max<int64_t>(0, -at); t < taps; t++) value += kernel[t] * mono[at + t];
+        output[j] = value;
+    }
+    return output;
+}
+
+// A constant-tempo grid over the whole track, fitted to the window's beats
+// by least squares, and its beat period in seconds. Empty, with a period
+// of 0, if they don't give a plausible tempo.
+static std::vector<double> fitPreviewGrid(const std::vector<double>& beats, double duration, double* fittedPeriod) {
+    std::vector<double> grid;
+    *fittedPeriod = 0.0;
+    if (beats.size() < PREVIEW_MIN_GRID_BEATS) return grid;
+    
+    double n = static_cast<double>(beats.size());
+    double meanIndex = (n - 1.0) / 2.0;
+    double meanTime = std::accumulate(beats.begin(), beats.end(), 0.0) / n;
+    double covariance = 0.0;
+    double variance = 0.0;
+    for (size_t i = 0; i < beats.size(); i++) {
+        covariance += (i - meanIndex) * (beats[i] - meanTime);
+        variance += (i - meanIndex) * (i - meanIndex);
+    }
+    double period = covariance / variance;
+    if (!(period > 60.0 / 300.0 && period < 60.0 / 30.0)) return grid;
+    *fittedPeriod = period;
+    
+    // The fit's beat 0, moved back to the track's first whole beat
+    double phase = std::fmod(meanTime - period * meanIndex, period);
+    if (phase < 0.0) phase += period;
+    for (double beat = phase; beat < duration; beat += period) grid.push_back(beat);
+    return grid;
+}
+
+std::shared_ptr<const AnalysisResult> analyzePreview(const AudioFile& track, AnalysisControl* control) {
+    auto result = std::make_shared<AnalysisResult>();
+    result->tier = AnalysisTier::Preview;
+    
+    int sampleRate = track.getSampleRate();
+    int64_t total = track.getTotalSamples();
+    result->sample_rate = sampleRate;
+    result->has_loudness = track.getLoudness(&result->loudness);
+    if (track.isStreaming() || total == 0 || sampleRate == 0) return result;
+    
+    int factor = 1;
+    while (factor * 2 * PREVIEW_SAMPLE_RATE <= sampleRate) factor *= 2;
+    const int stepSize = ANALYSIS_STEP_FRAMES / factor;
+    const int frameLength = ANALYSIS_FRAME_LENGTH / factor;
+    const double previewRate = static_cast<double>(sampleRate) / factor;
+    result->step_size = ANALYSIS_STEP_FRAMES;
+    
+    try {
+        // The loudest candidate among those decoded, once the first is
+        int64_t windowFrames = std::min(total, static_cast<int64_t>(PREVIEW_WINDOW_SECONDS * sampleRate));
+        auto windowStart = [&](double centre) {
+            return std::max<int64_t>(0, std::min(total - windowFrames,
+                                                 static_cast<int64_t>(centre * total) - windowFrames / 2));
+        };
+        
+        static const std::atomic<bool> never{ false };
+        int64_t firstEnd = windowStart(PREVIEW_WINDOW_CENTRES[0]) + windowFrames;
+        if (!track.waitUntilDecoded(firstEnd, control ? control->cancelled : never)) return nullptr;
+        
+        int64_t begin = windowStart(PREVIEW_WINDOW_CENTRES[0]);
+        double loudest = -1.0;
+        for (double centre : PREVIEW_WINDOW_CENTRES) {
+            int64_t start = windowStart(centre);
+            if (start + windowFrames > track.getDecodedSamples()) continue;
+            double energy = windowEnergy(track, start, start + windowFrames);
+            if (energy > loudest) {
+                loudest = energy;
+                begin = start;
+            }
+        }
+        if (control && control->cancelled.load()) return nullptr;
+        
+        std::vector<float> mono = decimateWindow(track, begin, begin + windowFrames, factor);
+        int64_t frames = std::max<int64_t>(0, (static_cast<int64_t>(mono.size()) - frameLength) / stepSize);
+        std::vector<double> detectionFunction(static_cast<size_t>(frames));
+        OnsetDetector detector(getAnalysisFFTBackend(), stepSize, frameLength);
+        for (int64_t f = 0; f < frames; f++) {
+            detectionFunction[f] = detector.process(mono.data() + f * stepSize);
+        }
+        if (detectionFunction.size() < 100) return result;
+        if (control && control->cancelled.load()) return nullptr;
+        
+        TempoTrackV2 tempoTracker(static_cast<float>(previewRate), stepSize);
+        std::vector<double> beatPeriod;
+        std::vector<double> beats;
+        tempoTracker.calculateBeatPeriod(detectionFunction, beatPeriod, result->tempi, 120.0, false);
+        tempoTracker.calculateBeats(detectionFunction, beatPeriod, beats);
+        
+        double windowSeconds = static_cast<double>(begin) / sampleRate;
+        for (double& beat : beats) beat = windowSeconds + beat * stepSize / previewRate;
+        // The BPM is the grid's own where the fit holds, so the two agree;
+        // the tempo candidates are the fallback
+        double period = 0.0;
+        result->beats = fitPreviewGrid(beats, static_cast<double>(total) / sampleRate, &period);
+        result->bpm = period > 0.0 ? 60.0 / period : estimateBPM(result->tempi);
+        
+        DJ_LOG_INFO("BPM preview: %.1f BPM from %.1f s at %.0f s, %zu grid beats",
+                    result->bpm, static_cast<double>(windowFrames) / sampleRate, windowSeconds, result->beats.size());
+    } catch (const std::exception& e) {
+        DJ_LOG_ERROR("EXCEPTION in analyzePreview: %s", e.what());
+        result = std::make_shared<AnalysisResult>();
+        result->tier = AnalysisTier::Preview;
+    } catch (...) {
+        DJ_LOG_ERROR("UNKNOWN EXCEPTION in analyzePreview");
+        result = std::make_shared<AnalysisResult>();
+        result->tier = AnalysisTier::Preview;
     }
     
-    return 0.0;
+    return result;
+}
+
+void copyAnalysisFeatures(const AnalysisResult& result, analysis_features_t* features) {
+    features->bpm = result.bpm;
+    features->first_beat_seconds = result.beats.empty() ? 0.0 : result.beats[0];
+    features->loudness_db = result.loudness_db;
+    features->key = result.key;
+    features->key_strength = result.key_strength;
+    std::copy(result.chroma, result.chroma + CHROMA_BINS, features->chroma);
+    std::copy(result.band_energy, result.band_energy + ANALYSIS_BANDS, features->band_energy);
+    features->has_loudness = result.has_loudness ? 1 : 0;
+    features->integrated_lufs = result.loudness.integrated_lufs;
+    features->true_peak_db = result.loudness.true_peak_db;
 }
 
 } // namespace dj
@@ -299,38 +788,52 @@ double detectFirstBeat(const float* samples, int64_t sampleCount, int sampleRate
 // C API for BPM analysis
 extern "C" {
 
-// Analyze a loaded track for BPM
-DJ_API double audio_analyze_bpm(int deck_id) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1) return 0.0;
-    
+// Analysis of a deck's track, run on first use; also hands the deck its
+// beat grid. nullptr if nothing is loaded.
+static std::shared_ptr<const dj::AnalysisResult> analyzeDeck(int deck_id) {
     auto& deck = dj::g_engine->decks[deck_id];
-    if (!deck || !deck->isLoaded()) return 0.0;
+    if (!deck || !deck->isLoaded()) return nullptr;
     
-    auto* audioFile = deck->getAudioFile();
-    if (!audioFile) return 0.0;
+    auto audioFile = deck->getAudioFile();
+    if (!audioFile) return nullptr;
     
-    const float* data = audioFile->getData();
-    int64_t totalSamples = audioFile->getTotalSamples();
-    int sampleRate = audioFile->getSampleRate();
+    // Analyzed once per track (waiting out a progressive decode); the
+    // beat-offset query that usually follows is a lookup
+    auto analysis = audioFile->getAnalysis();
+    deck->setBeatGrid(dj::BeatGrid::fromAnalysis(*analysis), audioFile.get());
+    return analysis;
+}
+
+// Analyze a loaded track for BPM
+DJ_API double audio_analyze_bpm(int deck_id) {
+    if (!dj::isValidDeck(deck_id)) return 0.0;
     
-    return dj::analyzeBPM(data, totalSamples, sampleRate);
+    auto analysis = analyzeDeck(deck_id);
+    return analysis ? analysis->bpm : 0.0;
 }
 
 // Analyze a loaded track for first beat position
 DJ_API double audio_analyze_beat_offset(int deck_id, double bpm) {
-    if (!dj::g_engine || deck_id < 0 || deck_id > 1 || bpm <= 0) return 0.0;
-    
-    auto& deck = dj::g_engine->decks[deck_id];
-    if (!deck || !deck->isLoaded()) return 0.0;
+    if (!dj::isValidDeck(deck_id) || bpm <= 0) return 0.0;
     
-    auto* audioFile = deck->getAudioFile();
-    if (!audioFile) return 0.0;
-    
-    const float* data = audioFile->getData();
-    int64_t totalSamples = audioFile->getTotalSamples();
-    int sampleRate = audioFile->getSampleRate();
+    auto analysis = analyzeDeck(deck_id);
+    if (!analysis || analysis->beats.empty()) {
+        DJ_LOG_INFO("detectFirstBeat (QM DSP): No beats found, returning 0");
+        return 0.0;
+    }
     
-    return dj::detectFirstBeat(data, totalSamples, sampleRate, bpm);
+    DJ_LOG_INFO("detectFirstBeat (QM DSP): First beat at %.3f seconds of %zu", analysis->beats[0], analysis->beats.size());
+    return analysis->beats[0];
+}
+
+// Analyze a loaded track for key, loudness and band energies
+DJ_API int audio_analyze_features(int deck_id, analysis_features_t* features) {
+    if (!dj::isValidDeck(deck_id) || !features) return -1;
+    
+    auto analysis = analyzeDeck(deck_id);
+    if (!analysis) return -1;
+    dj::copyAnalysisFeatures(*analysis, features);
+    return 0;
 }
 
 } // extern "C"
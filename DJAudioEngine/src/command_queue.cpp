@@ -0,0 +1,42 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+
+namespace dj {
+
+static size_t roundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+CommandQueue::CommandQueue(size_t capacity)
+    : slots_(roundUpToPowerOfTwo(std::max<size_t>(capacity, 2)))
+    , mask_(slots_.size() - 1)
+    , head_(0)
+    , tail_(0)
+{
+}
+
+bool CommandQueue::push(const Command& command) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+        return false;
+    }
+
+    slots_[tail & mask_] = command;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool CommandQueue::pop(Command* command) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    *command = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+} // namespace dj
@@ -0,0 +1,65 @@
+#include "dj_audio_internal.h"
+#include <chrono>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#endif
+
+namespace dj {
+
+// How often the primer looks for cues gone stale. Tempo changes come from
+// the render thread, which mustn't wake anyone, so they wait for this.
+static const int CUE_PRIME_POLL_MS = 50;
+
+// Priming only gets ahead of the jumps; it mustn't slow the audio threads
+static void demoteCuePrimerThread() {
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+}
+
+CuePrimer::CuePrimer(const std::vector<std::unique_ptr<Deck>>& decks)
+    : running_(true)
+    , woken_(false)
+{
+    for (const auto& deck : decks) {
+        decks_.push_back(deck.get());
+    }
+    thread_ = std::thread(&CuePrimer::threadMain, this);
+}
+
+CuePrimer::~CuePrimer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void CuePrimer::wake() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        woken_ = true;
+    }
+    wake_.notify_all();
+}
+
+void CuePrimer::threadMain() {
+    demoteCuePrimerThread();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        woken_ = false;
+        lock.unlock();
+        for (Deck* deck : decks_) {
+            deck->primeHotCues();
+        }
+        lock.lock();
+
+        wake_.wait_for(lock, std::chrono::milliseconds(CUE_PRIME_POLL_MS), [this] { return !running_ || woken_; });
+    }
+}
+
+} // namespace dj
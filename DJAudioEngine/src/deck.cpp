@@ -1,19 +1,88 @@
 #include "dj_audio_internal.h"
-#include <SoundTouch.h>
 #include <algorithm>
 #include <cmath>
 #include <cstdio>
-#include <map>
+#include <cstring>
+#include <thread>
 
 namespace dj {
 
+// Source frames handed to the stretcher per putSamples call
+static const int FEED_CHUNK_FRAMES = 4096;
+
+// Source frames the stretcher is restarted ahead of a seek target. Its
+// output fades in from silence (SoundTouch's first overlap window, the
+// resampler's filter); this much of it is thrown away so what plays from
+// the target is already steady.
+static const int64_t STRETCH_PREROLL_FRAMES = 1024;
+
+// Output frames over which the deck crossfades when it switches between
+// reading the track directly and stretching it
+static const int STRETCH_CROSSFADE_FRAMES = 256;
+
+// Output frames a primed hot cue holds ready: a whole block, however large
+// the host's, plays before the stretcher needs feeding
+static const int CUE_PRIMED_FRAMES = 4096;
+
+// How far the tempo may have moved from a primed cue's before it's stale.
+// Sync nudges a slave by up to 1%; the taken stretcher is retuned on the
+// spot, so only the primed frames play at the old tempo, and the play
+// position counts those at the tempo they were made at.
+static const double CUE_TEMPO_TOLERANCE = 0.01;
+static const double CUE_PITCH_TOLERANCE = 0.01;  // Semitones
+
+// Source frames before a loop's end faded into those before its start, so
+// the wrap has no click. Shorter when the loop or its lead-in is.
+static const int64_t LOOP_CROSSFADE_FRAMES = 128;
+
+// Shortest loop, about a 1/32 beat at 175 BPM
+static const int64_t LOOP_MIN_FRAMES = 256;
+
+// Auto-gain limits: never more than this either way, and boosts never
+// take the true peak above the ceiling
+static const double AUTO_GAIN_MAX_DB = 12.0;
+static const double AUTO_GAIN_PEAK_CEILING_DB = -1.0;
+
+// Whether tempo and pitch take the stretcher. Bypassed at tempo 1.0, which
+// eliminates the stretcher's latency for perfect sync, unless sync holds the
+// deck stretched (see holdStretch). Vinyl can't shift pitch on its own, so
+// pitch alone doesn't engage it.
+static bool needsStretch(double tempo, double pitch_semitones, bool can_shift_pitch, bool held) {
+    return held || std::abs(tempo - 1.0) >= 0.001 || (std::abs(pitch_semitones) >= 0.1 && can_shift_pitch);
+}
+
+// Marks a span on the render thread during which track_ may be dereferenced
+namespace {
+struct RenderEpochScope {
+    explicit RenderEpochScope(std::atomic<uint32_t>& epoch) : epoch_(epoch) { epoch_.fetch_add(1); }
+    ~RenderEpochScope() { epoch_.fetch_add(1); }
+    std::atomic<uint32_t>& epoch_;
+};
+}
+
 Deck::Deck(int sample_rate)
     : sample_rate_(sample_rate)
-    , audio_file_(std::make_unique<AudioFile>())
-    , soundtouch_(std::make_unique<soundtouch::SoundTouch>())
+    , track_(nullptr)
+    , render_epoch_(0)
+    , grid_(nullptr)
+    , stretcher_(nullptr)
+    , previous_stretcher_(nullptr)
     , is_playing_(false)
     , sample_position_(0)
+    , play_position_(0.0)
+    , reset_pending_(false)
+    , stretching_(false)
+    , restart_stretch_(true)
+    , preroll_discard_(0)
+    , primed_frames_(0)
+    , primed_tempo_(1.0)
     , volume_(1.0f)
+    , applied_volume_(1.0f)
+    , auto_gain_enabled_(false)
+    , auto_gain_target_lufs_(-14.0)
+    , auto_gain_pending_(false)
+    , auto_gain_(1.0f)
+    , applied_auto_gain_(1.0f)
     , tempo_(1.0)
     , pitch_semitones_(0.0)
     , bpm_(120.0)
@@ -21,45 +90,180 @@ Deck::Deck(int sample_rate)
     , eq_low_(1.0f)
     , eq_mid_(1.0f)
     , eq_high_(1.0f)
+    , eq_(sample_rate)
+    , feed_buffer_(FEED_CHUNK_FRAMES * 2)
+    , crossfade_buffer_(STRETCH_CROSSFADE_FRAMES * 2)
+    , rendered_duration_(0.0)
+    , peak_{ 0.0f, 0.0f }
+    , end_count_(0)
+    , log_counter_(0)
+    , timings_({ 0, 0, 0 })
+    , cue_tempo_(1.0)
+    , cue_pitch_(0.0)
+    , cue_mode_(static_cast<int>(StretchMode::SoundTouch))
+    , stretch_held_(false)
+    , prime_buffer_(FEED_CHUNK_FRAMES * 2)
+    , loop_in_(-1)
+    , loop_start_(0)
+    , loop_end_(0)
+    , loop_enabled_(false)
+    , pending_jump_(-1)
+    , seam_head_(0)
+    , seam_count_(0)
+    , seam_buffer_(LOOP_CROSSFADE_FRAMES * 2)
+    , rolling_(false)
+    , slip_position_(0.0)
+    , rolled_start_(0)
+    , rolled_end_(0)
+    , rolled_enabled_(false)
 {
-    soundtouch_->setSampleRate(sample_rate);
-    soundtouch_->setChannels(2);
-    soundtouch_->setTempo(1.0);
-    soundtouch_->setPitch(1.0);
+    for (int mode = 0; mode < STRETCH_MODE_COUNT; mode++) {
+        stretchers_[mode] = createTimeStretcher(static_cast<StretchMode>(mode), sample_rate);
+        can_shift_pitch_[mode] = stretchers_[mode] && stretchers_[mode]->canShiftPitch();
+    }
+    for (auto& cue : hot_cues_) {
+        cue = -1;
+    }
+    
+    // Key lock by default, as before the engines were selectable
+    stretcher_ = stretchers_[static_cast<int>(StretchMode::SoundTouch)].get();
+    stretcher_->setTempo(1.0);
 }
 
 Deck::~Deck() {
 }
 
-bool Deck::loadTrack(const char* filepath) {
-    std::lock_guard<std::mutex> lock(deck_mutex_);
+bool Deck::loadTrack(const char* filepath, const LoadOptions& options) {
+    // Decode into a private buffer first - the audio thread keeps playing
+    // the current track while this runs. In progressive mode only the
+    // preroll is decoded here and the rest follows in the background.
+    // Converted to the engine rate while loading, so every position below
+    // is in engine-rate frames and the audio thread never resamples
+    LoadOptions track_options = options;
+    track_options.target_sample_rate = sample_rate_;
     
-    if (!audio_file_->load(filepath)) {
-        return false;
+    // A preloaded track is taken as it is, with its analysis if that's done
+    std::shared_ptr<AudioFile> track;
+    if (options.track_cache) track = options.track_cache->find(filepath, track_options);
+    if (!track) {
+        track = std::make_shared<AudioFile>();
+        if (!track->load(filepath, track_options)) {
+            return false;
+        }
     }
     
-    // Reset playback state
-    sample_position_ = 0;
-    is_playing_ = false;
+    publishTrack(std::move(track));
+    return true;
+}
+
+bool Deck::loadTrackMemory(std::shared_ptr<const EncodedBuffer> buffer, const char* format_hint,
+                           const LoadOptions& options) {
+    LoadOptions track_options = options;
+    track_options.target_sample_rate = sample_rate_;
     
-    // Clear SoundTouch buffer
-    soundtouch_->clear();
+    auto track = std::make_shared<AudioFile>();
+    if (!track->loadMemory(std::move(buffer), format_hint, track_options)) {
+        return false;
+    }
     
+    publishTrack(std::move(track));
     return true;
 }
 
 void Deck::unloadTrack() {
-    std::lock_guard<std::mutex> lock(deck_mutex_);
-    stop();
-    audio_file_->unload();
-    soundtouch_->clear();
+    publishTrack(nullptr);
+}
+
+bool Deck::isLoaded() const {
+    AudioFile* track = track_.load();
+    return track != nullptr && track->getTotalSamples() > 0;
+}
+
+std::shared_ptr<AudioFile> Deck::getAudioFile() const {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    return track_ref_;
+}
+
+void Deck::publishTrack(std::shared_ptr<AudioFile> track) {
+    std::shared_ptr<AudioFile> old_track;
+    
+    {
+        std::lock_guard<std::mutex> load_lock(load_mutex_);
+        
+        is_playing_ = false;
+        
+        old_track = std::move(track_ref_);
+        track_ref_ = std::move(track);
+        track_.store(track_ref_.get());
+        
+        // Tracks that come with an analysis (already run, or from the
+        // database) bring their grid; others get one once analyzed
+        std::shared_ptr<const AnalysisResult> analysis = track_ref_ ? track_ref_->peekAnalysis() : nullptr;
+        publishGridLocked(analysis ? BeatGrid::fromAnalysis(*analysis) : nullptr);
+    }
+    
+    // Deferred free: the callback may still hold the old raw pointer for
+    // the rest of its current block
+    waitForRenderQuiescence();
+    
+    // Reset the position only once that block can no longer advance it.
+    // The stretcher belongs to the render thread, so it restarts itself when
+    // it sees reset_pending_.
+    sample_position_ = 0;
+    play_position_ = 0.0;
+    reset_pending_ = true;
+    
+    // Cues belong to the track; primed slots see the new one and drop theirs
+    for (auto& cue : hot_cues_) {
+        cue = -1;
+    }
+    old_track.reset();
+}
+
+void Deck::setBeatGrid(std::shared_ptr<const BeatGrid> grid, const AudioFile* track) {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    if (track_ref_.get() != track) return;  // Analysis of a track since replaced
+    publishGridLocked(std::move(grid));
+}
+
+std::shared_ptr<const BeatGrid> Deck::acquireBeatGrid() const {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    return grid_ref_;
+}
+
+void Deck::publishGridLocked(std::shared_ptr<const BeatGrid> grid) {
+    // The render thread reads grid_ outside render() too (sync runs ahead
+    // of the mix), so a replaced grid lives until the epoch has moved on by
+    // two: past the end of the render() in progress or about to start, and
+    // with it the callback that may still hold the old pointer. While the
+    // stream is stopped the epoch stands still and retired grids just wait.
+    uint32_t epoch = render_epoch_.load();
+    retired_grids_.erase(std::remove_if(retired_grids_.begin(), retired_grids_.end(),
+                                        [epoch](const std::pair<uint32_t, std::shared_ptr<const BeatGrid>>& retired) {
+                                            return epoch - retired.first >= 2;
+                                        }),
+                         retired_grids_.end());
+    
+    if (grid_ref_) retired_grids_.emplace_back(epoch, std::move(grid_ref_));
+    grid_ref_ = std::move(grid);
+    grid_.store(grid_ref_.get(), std::memory_order_release);
+}
+
+void Deck::waitForRenderQuiescence() const {
+    uint32_t epoch = render_epoch_.load();
+    if ((epoch & 1) == 0) {
+        // Not inside render() - the next callback will see the new pointer
+        return;
+    }
+    
+    while (render_epoch_.load() == epoch) {
+        std::this_thread::yield();
+    }
 }
 
 void Deck::play(int64_t startPosition) {
     if (startPosition >= 0) {
-        // Set position and clear buffer BEFORE starting playback
-        sample_position_ = startPosition;
-        soundtouch_->clear();
+        seek(startPosition);
     }
     is_playing_ = true;
 }
@@ -70,63 +274,418 @@ void Deck::pause() {
 
 void Deck::stop() {
     is_playing_ = false;
-    sample_position_ = 0;
-    soundtouch_->clear();
+    seek(0);
+}
+
+void Deck::seek(int64_t pos) {
+    // Render thread (or stopped stream). The next stretched block restarts
+    // the stretcher ahead of pos, so the target plays without a gap.
+    // Seeking past the end of the loop leaves it.
+    sample_position_ = pos;
+    play_position_ = static_cast<double>(pos);
+    restart_stretch_ = true;
+    clearSeams();
+    if (pos >= loop_end_) loop_enabled_ = false;
 }
 
 void Deck::setPosition(double seconds) {
-    std::lock_guard<std::mutex> lock(deck_mutex_);
+    // Runs from the command queue, outside render()
+    RenderEpochScope epoch_scope(render_epoch_);
+    AudioFile* track = track_.load();
+    int64_t total = track ? track->getTotalSamples() : 0;
     
     int64_t new_pos = static_cast<int64_t>(seconds * sample_rate_);
-    new_pos = std::max<int64_t>(0, std::min(new_pos, audio_file_->getTotalSamples()));
-    sample_position_ = new_pos;
-    
-    // Clear SoundTouch buffer when seeking
-    soundtouch_->clear();
+    new_pos = std::max<int64_t>(0, std::min(new_pos, total));
+    seek(new_pos);
 }
 
 double Deck::getPosition() const {
-    return static_cast<double>(sample_position_) / sample_rate_;
+    return play_position_.load() / sample_rate_;
 }
 
 double Deck::getDuration() const {
-    return audio_file_->getDurationSeconds();
+    auto track = getAudioFile();
+    return track ? track->getDurationSeconds() : 0.0;
+}
+
+double Deck::getDecodedDuration() const {
+    auto track = getAudioFile();
+    return track ? track->getDecodedSeconds() : 0.0;
+}
+
+double Deck::getLoadProgress() const {
+    auto track = getAudioFile();
+    return track ? track->getDecodeProgress() : 0.0;
 }
 
 void Deck::setTempo(double tempo) {
-    tempo_ = std::max(0.5, std::min(tempo, 2.0));
-    soundtouch_->setTempo(tempo_);
+    // Reconfiguring the stretcher isn't free; sync calls this every block
+    tempo = std::max(0.5, std::min(tempo, 2.0));
+    if (tempo == tempo_) return;
     
-    // Log tempo change
-    FILE* logFile = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-    if (logFile) {
-        fprintf(logFile, "Deck::setTempo: tempo=%.3f (%.1f%% speed)\\n", tempo_, tempo_ * 100);
-        fclose(logFile);
-    }
+    tempo_ = tempo;
+    stretcher_->setTempo(tempo_);
+    cue_tempo_ = tempo_;
+    
+    DJ_LOG_DEBUG("Deck::setTempo: tempo=%.3f (%.1f%% speed)", tempo_, tempo_ * 100);
 }
 
 void Deck::setPitch(double semitones) {
     pitch_semitones_ = std::max(-12.0, std::min(semitones, 12.0));
-    soundtouch_->setPitchSemiTones(pitch_semitones_);
+    stretcher_->setPitchSemitones(pitch_semitones_);
+    cue_pitch_ = pitch_semitones_;
 }
 
-void Deck::setSamplePosition(int64_t pos, bool forceSync) {
-    int64_t old_pos = sample_position_;
-    sample_position_ = pos;
+void Deck::setStretchMode(StretchMode mode) {
+    TimeStretcher* stretcher = stretchers_[static_cast<int>(mode)].get();
+    if (!stretcher || stretcher == stretcher_) return;
     
-    // For sync operations, ALWAYS clear the buffer to ensure new samples
-    // For normal seeks, only clear on large jumps to avoid clicks
-    if (forceSync) {
-        soundtouch_->clear();
-    } else {
-        int64_t jump_size = std::abs(pos - old_pos);
-        if (jump_size > sample_rate_) { // More than 1 second jump
-            soundtouch_->clear();
+    // The next block fades from the old engine into the new one, restarted
+    // at the play position
+    stretcher->setTempo(tempo_);
+    stretcher->setPitchSemitones(pitch_semitones_);
+    if (!previous_stretcher_) previous_stretcher_ = stretcher_;
+    stretcher_ = stretcher;
+    cue_mode_ = static_cast<int>(mode);
+}
+
+bool Deck::isStretchNeeded() const {
+    return needsStretch(tempo_, pitch_semitones_, stretcher_->canShiftPitch(), stretch_held_);
+}
+
+void Deck::setHotCue(int index, int64_t frame) {
+    if (index < 0 || index >= HOT_CUE_COUNT) return;
+    hot_cues_[index] = frame < 0 ? -1 : frame;
+}
+
+int64_t Deck::getHotCue(int index) const {
+    return (index >= 0 && index < HOT_CUE_COUNT) ? hot_cues_[index].load() : -1;
+}
+
+void Deck::triggerHotCue(int index) {
+    // Runs from the command queue or the scheduler, outside render()
+    if (index < 0 || index >= HOT_CUE_COUNT) return;
+    RenderEpochScope epoch_scope(render_epoch_);
+    AudioFile* track = track_.load();
+    int64_t cue = hot_cues_[index].load();
+    if (!track || cue < 0) return;
+    
+    cue = std::min(cue, track->getTotalSamples());
+    if (!isStretchNeeded() || !takePrimedCue(index, track, cue)) {
+        // Direct reads have nothing to refill; a stretcher with no primed
+        // slot restarts at the cue like any seek
+        seek(cue);
+    }
+    is_playing_ = true;
+}
+
+bool Deck::takePrimedCue(int index, const AudioFile* track, int64_t cue) {
+    HotCueSlot& slot = cue_slots_[index];
+    int ready = HotCueSlot::Ready;
+    if (!slot.state.compare_exchange_strong(ready, HotCueSlot::Claimed, std::memory_order_acquire)) return false;
+    
+    StretchMode mode = static_cast<StretchMode>(cue_mode_.load());
+    bool matches = slot.track.get() == track && slot.cue_frame == cue && slot.mode == mode &&
+                   std::abs(slot.tempo - tempo_) <= CUE_TEMPO_TOLERANCE &&
+                   std::abs(slot.pitch - pitch_semitones_) <= CUE_PITCH_TOLERANCE;
+    
+    // Primed straight through an active loop's end, which should have wrapped
+    if (loop_enabled_ && cue < loop_end_ && slot.feed_position > loop_end_) matches = false;
+    if (matches) {
+        // The primed stretcher becomes the deck's, and the one that was
+        // playing goes back to the primer for re-priming. Whatever fade a
+        // mode switch had pending is moot: this is a jump.
+        std::unique_ptr<TimeStretcher>& owned = stretchers_[static_cast<int>(mode)];
+        owned.swap(slot.stretcher);
+        stretcher_ = owned.get();
+        previous_stretcher_ = nullptr;
+        if (slot.tempo != tempo_) stretcher_->setTempo(tempo_);
+        if (slot.pitch != pitch_semitones_) stretcher_->setPitchSemitones(pitch_semitones_);
+        
+        sample_position_ = slot.feed_position;
+        play_position_ = static_cast<double>(cue);
+        restart_stretch_ = false;
+        preroll_discard_ = 0;
+        primed_frames_ = stretcher_->numSamples();
+        primed_tempo_ = slot.tempo;
+        stretching_ = true;
+        clearSeams();
+        if (cue >= loop_end_) loop_enabled_ = false;
+    }
+    
+    // Stale or used, it's the primer's to bring up to date
+    slot.state.store(HotCueSlot::Spent, std::memory_order_release);
+    return matches;
+}
+
+void Deck::primeHotCues() {
+    std::shared_ptr<AudioFile> track = getAudioFile();
+    double tempo = cue_tempo_.load();
+    double pitch = cue_pitch_.load();
+    StretchMode mode = static_cast<StretchMode>(cue_mode_.load());
+    
+    // Unstretched decks jump straight to the cue anyway, and streaming
+    // tracks have nothing in memory to prime from
+    bool usable = track && !track->isStreaming() &&
+                  needsStretch(tempo, pitch, can_shift_pitch_[static_cast<int>(mode)], stretch_held_.load());
+    
+    for (int i = 0; i < HOT_CUE_COUNT; i++) {
+        HotCueSlot& slot = cue_slots_[i];
+        int64_t cue = hot_cues_[i].load();
+        bool wanted = usable && cue >= 0;
+        
+        int state = slot.state.load(std::memory_order_acquire);
+        if (state == HotCueSlot::Claimed) continue;
+        if (state == HotCueSlot::Ready) {
+            bool current = wanted && slot.track == track && slot.cue_frame == cue && slot.mode == mode &&
+                           std::abs(slot.tempo - tempo) <= CUE_TEMPO_TOLERANCE &&
+                           std::abs(slot.pitch - pitch) <= CUE_PITCH_TOLERANCE;
+            if (current) continue;
+            
+            // Lost to the render thread: come back once it's done
+            if (!slot.state.compare_exchange_strong(state, HotCueSlot::Priming, std::memory_order_acquire)) continue;
+        }
+        
+        slot.state.store(HotCueSlot::Priming, std::memory_order_relaxed);
+        bool primed = wanted && primeSlot(slot, track, cue);
+        if (!primed) {
+            slot.track.reset();
+            slot.cue_frame = -1;
         }
+        slot.state.store(primed ? HotCueSlot::Ready : HotCueSlot::Empty, std::memory_order_release);
+    }
+}
+
+bool Deck::primeSlot(HotCueSlot& slot, const std::shared_ptr<AudioFile>& track, int64_t cue) {
+    StretchMode mode = static_cast<StretchMode>(cue_mode_.load());
+    if (!slot.stretcher || slot.mode != mode) {
+        slot.stretcher = createTimeStretcher(mode, sample_rate_);
+        slot.mode = mode;
+        if (!slot.stretcher) return false;
     }
+    
+    slot.tempo = cue_tempo_.load();
+    slot.pitch = cue_pitch_.load();
+    TimeStretcher* stretcher = slot.stretcher.get();
+    stretcher->clear();
+    stretcher->setTempo(slot.tempo);
+    stretcher->setPitchSemitones(slot.pitch);
+    
+    // As renderStretched() restarts after a seek: fed from a little ahead
+    // of the cue, with the output that stands for the pre-roll dropped
+    int64_t preroll = std::min(STRETCH_PREROLL_FRAMES, cue);
+    int discard = static_cast<int>(std::llround(preroll / slot.tempo));
+    int64_t feed = cue - preroll;
+    while (stretcher->numSamples() < CUE_PRIMED_FRAMES + discard) {
+        int64_t got = track->copyFrames(feed, prime_buffer_.data(), FEED_CHUNK_FRAMES);
+        if (got <= 0) break;  // End of track, or not decoded this far yet
+        stretcher->putSamples(prime_buffer_.data(), static_cast<int>(got));
+        feed += got;
+    }
+    
+    // Until the decoder gets far enough there's no telling where the cue
+    // starts in the output; the next pass tries again
+    if (stretcher->receiveSamples(nullptr, std::min(discard, stretcher->numSamples())) < discard) return false;
+    
+    slot.track = track;
+    slot.cue_frame = cue;
+    slot.feed_position = feed;
+    return true;
 }
 
-double Deck::getPhase() const {
+void Deck::loopIn() {
+    loop_in_ = getSamplePosition();
+    
+    // With a loop playing, moves its start
+    if (loop_enabled_ && loop_in_ < loop_end_) setLoop(loop_in_, loop_end_);
+}
+
+void Deck::loopOut() {
+    if (loop_in_ < 0) return;
+    setLoop(loop_in_, getSamplePosition());
+}
+
+void Deck::setLoop(int64_t start, int64_t end) {
+    // Runs from the command queue or the scheduler, outside render()
+    RenderEpochScope epoch_scope(render_epoch_);
+    AudioFile* track = track_.load();
+    if (!track) return;
+    
+    start = std::max<int64_t>(0, start);
+    end = std::min(end, track->getTotalSamples());
+    if (end - start < LOOP_MIN_FRAMES) return;
+    
+    loop_start_ = start;
+    loop_end_ = end;
+    loop_enabled_ = true;
+    
+    // Heard past the end, it carries on where it would be had it looped
+    // all along; only read past it, it goes back for what was read wrong
+    double position = play_position_.load();
+    if (position >= end) {
+        pending_jump_ = start + static_cast<int64_t>(std::fmod(position - start, static_cast<double>(end - start)));
+    } else if (sample_position_ > end) {
+        pending_jump_ = static_cast<int64_t>(std::llround(position));
+    }
+}
+
+void Deck::setBeatLoop(double beats) {
+    if (beats <= 0.0) return;
+    
+    // Starts on the beat, or the fraction of one, being played
+    double quantum = std::min(beats, 1.0);
+    double first = std::floor(getBeatNumber() / quantum + 1e-6) * quantum;
+    setLoop(getBeatFrame(first), getBeatFrame(first + beats));
+}
+
+void Deck::exitLoop() {
+    if (rolling_) {
+        endLoopRoll();
+        return;
+    }
+    loop_enabled_ = false;
+}
+
+void Deck::startLoopRoll(double beats) {
+    if (beats <= 0.0) return;
+    if (!rolling_) {
+        rolled_start_ = loop_start_;
+        rolled_end_ = loop_end_;
+        rolled_enabled_ = loop_enabled_;
+        slip_position_ = play_position_.load();
+        rolling_ = true;
+    }
+    setBeatLoop(beats);
+}
+
+void Deck::endLoopRoll() {
+    if (!rolling_) return;
+    rolling_ = false;
+    loop_start_ = rolled_start_;
+    loop_end_ = rolled_end_;
+    loop_enabled_ = rolled_enabled_;
+    
+    // Playback went on underneath, around the loop from before the roll
+    double target = slip_position_;
+    if (loop_enabled_ && target >= loop_end_) {
+        target = loop_start_ + std::fmod(target - loop_start_, static_cast<double>(loop_end_ - loop_start_));
+    }
+    pending_jump_ = static_cast<int64_t>(std::llround(target));
+}
+
+int64_t Deck::getBeatFrame(double beat_number) const {
+    return static_cast<int64_t>(std::llround(getBeatTime(beat_number) * sample_rate_));
+}
+
+int64_t Deck::getLoopCrossfadeFrames() const {
+    // The fade reads as far back before the start as it is long; before the
+    // track's first frame that is silence (see readSource)
+    return std::min(LOOP_CROSSFADE_FRAMES, (loop_end_ - loop_start_) / 2);
+}
+
+int64_t Deck::readSource(AudioFile* track, float* output, int64_t frames) {
+    int64_t done = 0;
+    for (;;) {
+        if (loop_enabled_ && sample_position_ == loop_end_) {
+            // The stretcher is fed across the wrap; its output reaches it
+            // some frames later
+            sample_position_ = loop_start_;
+            if (stretching_) {
+                if (seam_count_ == LOOP_SEAM_CAPACITY) {
+                    // Tiny loops fed far ahead: only the reported position
+                    // wraps early
+                    seam_head_ = (seam_head_ + 1) % LOOP_SEAM_CAPACITY;
+                    seam_count_--;
+                }
+                seams_[(seam_head_ + seam_count_) % LOOP_SEAM_CAPACITY] = { loop_end_, loop_start_ };
+                seam_count_++;
+            }
+        }
+        if (done == frames) break;
+        
+        int64_t pos = sample_position_;
+        float* out = output + done * 2;
+        int64_t fade = getLoopCrossfadeFrames();
+        int64_t fade_start = loop_end_ - fade;
+        
+        if (!loop_enabled_ || pos > loop_end_ || pos < fade_start) {
+            int64_t want = (!loop_enabled_ || pos > loop_end_) ? frames - done : std::min(frames - done, fade_start - pos);
+            int64_t got = track->readFrames(pos, out, want);
+            sample_position_ = pos + got;
+            done += got;
+            if (got < want) break;
+            continue;
+        }
+        
+        // Fading into the frames before the start leaves the wrap landing
+        // on audio continuous with what just played. Equal power: the two
+        // are only as alike as the loop is well placed. A loop too close
+        // to the track's start fades into silence for the frames it lacks,
+        // so after the wrap the start comes in as it does from a cold play.
+        int64_t want = std::min(frames - done, loop_end_ - pos);
+        int64_t lead = loop_start_ - (loop_end_ - pos);
+        int64_t silent = std::min(want, std::max<int64_t>(0, -lead));
+        memset(seam_buffer_.data(), 0, static_cast<size_t>(silent) * 2 * sizeof(float));
+        int64_t got = silent + track->readFrames(lead + silent, seam_buffer_.data() + silent * 2, want - silent);
+        got = track->readFrames(pos, out, got);
+        for (int64_t i = 0; i < got; i++) {
+            double t = (pos + i - fade_start + 0.5) / fade * 1.57079632679489661923;
+            float a = static_cast<float>(std::cos(t));
+            float b = static_cast<float>(std::sin(t));
+            out[i * 2] = a * out[i * 2] + b * seam_buffer_[i * 2];
+            out[i * 2 + 1] = a * out[i * 2 + 1] + b * seam_buffer_[i * 2 + 1];
+        }
+        sample_position_ = pos + got;
+        done += got;
+        if (got < want) break;
+    }
+    return done;
+}
+
+void Deck::setSamplePosition(int64_t pos) {
+    seek(pos);
+}
+
+void Deck::setAutoGain(bool enabled, double target_lufs) {
+    auto_gain_enabled_ = enabled;
+    auto_gain_target_lufs_ = target_lufs;
+    
+    // Asked for, so it applies now, ramped over the next block
+    auto_gain_pending_ = true;
+    updateAutoGain(track_.load());
+}
+
+float Deck::getAutoGainDb() const {
+    return 20.0f * std::log10(auto_gain_);
+}
+
+void Deck::updateAutoGain(const AudioFile* track) {
+    if (!auto_gain_enabled_) {
+        auto_gain_ = 1.0f;
+        auto_gain_pending_ = false;
+        return;
+    }
+    
+    TrackLoudness loudness;
+    if (!track || !track->getLoudness(&loudness)) return;  // Still pending
+    auto_gain_pending_ = false;
+    
+    // Nothing to match in silence
+    double gain_db = 0.0;
+    if (loudness.integrated_lufs > LOUDNESS_SILENCE_LUFS) {
+        gain_db = auto_gain_target_lufs_ - loudness.integrated_lufs;
+        if (gain_db > 0.0) gain_db = std::max(0.0, std::min(gain_db, AUTO_GAIN_PEAK_CEILING_DB - loudness.true_peak_db));
+        gain_db = std::max(-AUTO_GAIN_MAX_DB, std::min(AUTO_GAIN_MAX_DB, gain_db));
+    }
+    auto_gain_ = static_cast<float>(std::pow(10.0, gain_db / 20.0));
+}
+
+double Deck::getPhase(const BeatGrid* grid) const {
+    if (grid) {
+        return grid->getPhase(getPosition());
+    }
+    
+    // Not analyzed: constant grid from the BPM and first beat
     if (bpm_ <= 0.0) return 0.0;
     
     // Calculate samples per beat
@@ -137,7 +696,7 @@ double Deck::getPhase() const {
     
     // Apply beat offset
     int64_t offset_samples = static_cast<int64_t>(beat_offset_ * sample_rate_);
-    int64_t adjusted_position = sample_position_ - offset_samples;
+    int64_t adjusted_position = getSamplePosition() - offset_samples;
     
     // Calculate phase (0.0 to 1.0)
     int64_t samples_into_beat = adjusted_position % samples_per_beat;
@@ -146,102 +705,266 @@ double Deck::getPhase() const {
     return static_cast<double>(samples_into_beat) / samples_per_beat;
 }
 
-int Deck::readSamples(float* output, int frames) {
-    // Always zero-initialize output to prevent noise from uninitialized data
-    memset(output, 0, frames * 2 * sizeof(float));
+double Deck::getBeatNumber(const BeatGrid* grid) const {
+    double position = getPosition();
+    if (grid) return grid->getBeatNumber(position);
+    return (position - beat_offset_) * bpm_ / 60.0;
+}
+
+double Deck::getBeatTime(const BeatGrid* grid, double beat_number) const {
+    if (grid) return grid->getBeatTime(beat_number);
+    double bpm = bpm_;
+    return bpm > 0.0 ? beat_offset_ + beat_number * 60.0 / bpm : beat_offset_.load();
+}
+
+DeckBlock Deck::render(float* scratch, int frames) {
+    ScopedTimer timer(&timings_.render_ns);
+    DeckBlock block = { nullptr, 0, 0.0f, 0.0f, 0.0f, 0.0f };
     
-    if (!is_playing_ || audio_file_->getTotalSamples() == 0) {
-        // Already zeroed, just return
-        return frames;
+    // A new track was published since the last block
+    bool new_track = reset_pending_.exchange(false);
+    if (new_track) {
+        restart_stretch_ = true;
+        loop_in_ = -1;
+        loop_enabled_ = false;
+        rolling_ = false;
+        pending_jump_ = -1;
+        clearSeams();
+        auto_gain_ = 1.0f;
+        auto_gain_pending_ = true;
     }
     
-    std::lock_guard<std::mutex> lock(deck_mutex_);
+    // Closed by endRender(), once the mixer is done with the block
+    render_epoch_.fetch_add(1);
+    AudioFile* track = track_.load();
+    rendered_duration_ = track ? track->getDurationSeconds() : 0.0;
+    peak_[0] = 0.0f;
+    peak_[1] = 0.0f;
+    
+    // A new track takes its gain before its first block; a measurement
+    // that lands mid-play waits for the next pause
+    if (auto_gain_pending_ && (new_track || !is_playing_)) updateAutoGain(track);
+    if (new_track) applied_auto_gain_ = auto_gain_;
+    
+    if (!is_playing_ || !track || track->getTotalSamples() == 0) {
+        applied_volume_ = volume_;
+        applied_auto_gain_ = auto_gain_;
+        return block;
+    }
     
     // Log tempo check - use this pointer address as deck identifier
     // Log every ~second (at 44100 sample rate, 512 frame buffer = ~86 calls/sec)
-    static std::map<void*, int> log_counters;
-    if (log_counters[this]++ % 100 == 0) {
-        FILE* logFile = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-        if (logFile) {
-            fprintf(logFile, "readSamples[%p]: tempo_=%.3f, bypass=%s, playing=%d\n", 
-                    (void*)this, tempo_, (std::abs(tempo_ - 1.0) < 0.001) ? "YES" : "NO", is_playing_.load());
-            fclose(logFile);
-        }
+    if (log_counter_++ % 100 == 0) {
+        DJ_LOG_DEBUG("render[%p]: tempo_=%.3f, bypass=%s, playing=%d",
+                     (void*)this, tempo_, isStretchNeeded() ? "NO" : "YES", is_playing_.load());
     }
     
-    // Bypass SoundTouch when tempo is 1.0 - read directly from audio file
-    // This eliminates SoundTouch's internal latency for perfect sync
-    if (std::abs(tempo_ - 1.0) < 0.001 && std::abs(pitch_semitones_) < 0.1) {
-        int64_t remaining = audio_file_->getTotalSamples() - sample_position_;
-        if (remaining <= 0) {
-            is_playing_ = false;
-            return frames;
+    eq_.setGains(eq_low_, eq_mid_, eq_high_);
+    bool eq_flat = eq_.isFlat();
+    
+    // Bypass the stretcher when tempo is 1.0 - read directly from audio file
+    bool stretch = isStretchNeeded();
+    
+    // Crossing between the two paths, or between two stretchers, the first
+    // frames of the block fade from the one just left, which renders them
+    // into crossfade_buffer_. A stretcher switched away from still holds
+    // what was due next, unless a seek has made it stale.
+    TimeStretcher* fade_from = previous_stretcher_;
+    previous_stretcher_ = nullptr;
+    int crossfade = 0;
+    
+    // A loop jump fades from what was due next the same way. Crossing paths
+    // as well, the crossing's fade covers it.
+    if (pending_jump_ >= 0) {
+        if (stretch == stretching_) {
+            crossfade = std::min(frames, STRETCH_CROSSFADE_FRAMES);
+            if (stretch) {
+                crossfade = renderFadeOut(fade_from ? fade_from : stretcher_, track, crossfade_buffer_.data(), crossfade);
+                fade_from = nullptr;
+            } else {
+                int64_t position = sample_position_;
+                crossfade = static_cast<int>(readSource(track, crossfade_buffer_.data(), crossfade));
+                sample_position_ = position;
+            }
         }
-        
-        int to_read = std::min<int>(frames, static_cast<int>(remaining));
-        const float* source = audio_file_->getData() + (sample_position_ * 2);
-        
-        // Copy directly to output
-        memcpy(output, source, to_read * 2 * sizeof(float));
-        sample_position_ += to_read;
-        
-        // Apply volume and EQ
-        applyEQ(output, to_read);
-        for (int i = 0; i < to_read * 2; ++i) {
-            output[i] *= volume_;
+        int64_t target = pending_jump_;
+        pending_jump_ = -1;
+        bool looping = loop_enabled_;
+        seek(target);
+        loop_enabled_ = looping;
+    }
+    
+    if (stretch != stretching_) {
+        crossfade = std::min(frames, STRETCH_CROSSFADE_FRAMES);
+        stretching_ = stretch;
+        if (stretch) {
+            // Direct frames from where the stretcher is about to restart
+            int64_t position = sample_position_;
+            crossfade = static_cast<int>(readSource(track, crossfade_buffer_.data(), crossfade));
+            sample_position_ = position;
+            restart_stretch_ = true;
+        } else {
+            // What the stretcher still holds is exactly what was due next;
+            // the direct read then covers the same frames
+            crossfade = renderFadeOut(fade_from ? fade_from : stretcher_, track, crossfade_buffer_.data(), crossfade);
+            sample_position_ = static_cast<int64_t>(std::llround(play_position_.load()));
         }
-        
-        return frames;
+    } else if (stretch && fade_from && !restart_stretch_) {
+        // New stretch mode, same position: restart the new engine there
+        crossfade = renderFadeOut(fade_from, track, crossfade_buffer_.data(), std::min(frames, STRETCH_CROSSFADE_FRAMES));
+        restart_stretch_ = true;
     }
     
-    // Feed SoundTouch with source samples
-    const int CHUNK_SIZE = 4096;
-    while (soundtouch_->numSamples() < static_cast<unsigned int>(frames)) {
-        int64_t remaining = audio_file_->getTotalSamples() - sample_position_;
-        if (remaining <= 0) {
-            // End of track
+    if (!stretch) {
+        if (track->isEndOfTrack(sample_position_)) {
             is_playing_ = false;
-            break;
+            end_count_++;
+            applied_volume_ = volume_;
+            applied_auto_gain_ = auto_gain_;
+            return block;
         }
         
-        int to_read = std::min<int>(CHUNK_SIZE, static_cast<int>(remaining));
-        const float* source = audio_file_->getData() + (sample_position_ * 2);
-        
-        soundtouch_->putSamples(source, to_read);
-        sample_position_ += to_read;
+        // With nothing to filter a Float32 track is mixed straight from its
+        // own buffer, unless the block reaches a loop's seam. Comes up short
+        // while a progressive decode or a streaming refill catches up; the
+        // rest of the block stays silent.
+        int64_t available = 0;
+        bool clear_of_loop = !loop_enabled_ || sample_position_ + frames <= loop_end_ - getLoopCrossfadeFrames();
+        const float* direct = (eq_flat && crossfade == 0 && clear_of_loop)
+                                  ? track->peekFrames(sample_position_, frames, &available) : nullptr;
+        if (direct) {
+            block.samples = direct;
+            block.frames = static_cast<int>(available);
+            sample_position_ += block.frames;
+        } else {
+            block.samples = scratch;
+            block.frames = static_cast<int>(readSource(track, scratch, frames));
+        }
+        play_position_ = static_cast<double>(sample_position_);
+        clearSeams();
+    } else {
+        block.samples = scratch;
+        block.frames = renderStretched(track, scratch, frames);
     }
     
-    // Read processed samples from SoundTouch
-    int received = soundtouch_->receiveSamples(output, frames);
+    if (rolling_) {
+        slip_position_ += block.frames * (stretch ? tempo_ : 1.0);
+    }
     
-    // Apply volume and EQ only to received samples
-    if (received > 0) {
-        applyEQ(output, received);
-        for (int i = 0; i < received * 2; i++) {
-            output[i] *= volume_;
+    if (crossfade > 0) {
+        // Linear is enough: both paths carry the same audio at nearly the
+        // same rate, so they are strongly correlated
+        crossfade = std::min(crossfade, block.frames);
+        float step = 1.0f / (crossfade + 1);
+        for (int i = 0; i < crossfade; i++) {
+            float w = (i + 1) * step;
+            scratch[i * 2] = crossfade_buffer_[i * 2] + w * (scratch[i * 2] - crossfade_buffer_[i * 2]);
+            scratch[i * 2 + 1] = crossfade_buffer_[i * 2 + 1] + w * (scratch[i * 2 + 1] - crossfade_buffer_[i * 2 + 1]);
         }
     }
     
-    // Remainder is already zeroed from memset above
+    // A flat EQ folds into the gain ramp; otherwise it filters the scratch
+    // copy (the direct path is only taken when flat)
+    float eq_start = 1.0f;
+    float eq_end = 1.0f;
+    if (block.frames > 0 && !eq_.takeFlatGain(block.frames, &eq_start, &eq_end)) {
+        ScopedTimer eq_timer(&timings_.eq_ns);
+        eq_.process(scratch, block.frames);
+    }
+    
+    // Auto-gain is pre-fader, so the cue bus hears it too
+    block.gain_start = applied_volume_ * applied_auto_gain_ * eq_start;
+    block.gain_end = volume_ * auto_gain_ * eq_end;
+    block.cue_gain_start = applied_auto_gain_ * eq_start;
+    block.cue_gain_end = auto_gain_ * eq_end;
+    applied_volume_ = volume_;
+    applied_auto_gain_ = auto_gain_;
     
-    return frames;
+    if (block.frames == 0) {
+        block.samples = nullptr;
+    } else {
+        measurePeaks(block.samples, block.frames, auto_gain_ * eq_end, &peak_[0], &peak_[1]);
+    }
+    return block;
 }
 
-void Deck::applyEQ(float* buffer, int frames) {
-    // Simple 3-band EQ using biquad filters
-    // For now, just apply gain to approximate frequency bands
-    // TODO: Implement proper biquad filters
+int Deck::renderStretched(AudioFile* track, float* output, int frames) {
+    ScopedTimer timer(&timings_.stretch_ns);
+    if (restart_stretch_) {
+        // Restart a little ahead of the play position and drop the output
+        // that stands for the pre-roll
+        restart_stretch_ = false;
+        stretcher_->clear();
+        int64_t target = static_cast<int64_t>(std::llround(play_position_.load()));
+        int64_t preroll = std::min(STRETCH_PREROLL_FRAMES, target);
+        sample_position_ = target - preroll;
+        preroll_discard_ = static_cast<int>(std::llround(preroll / tempo_));
+        primed_frames_ = 0;
+        clearSeams();
+    }
     
-    // This is a simplified version - in production you'd want proper filters
-    for (int i = 0; i < frames * 2; i += 2) {
-        float left = buffer[i];
-        float right = buffer[i + 1];
+    // Feed the stretcher with source samples
+    while (stretcher_->numSamples() < frames + preroll_discard_) {
+        if (track->isEndOfTrack(sample_position_)) {
+            // End of track
+            is_playing_ = false;
+            end_count_++;
+            break;
+        }
+        
+        int to_read = static_cast<int>(readSource(track, feed_buffer_.data(), FEED_CHUNK_FRAMES));
+        if (to_read == 0) {
+            // The decoder hasn't got here yet
+            break;
+        }
         
-        // Apply EQ gains (simplified - not frequency-specific yet)
-        float avg_gain = (eq_low_ + eq_mid_ + eq_high_) / 3.0f;
-        buffer[i] = left * avg_gain;
-        buffer[i + 1] = right * avg_gain;
+        stretcher_->putSamples(feed_buffer_.data(), to_read);
+    }
+    
+    if (preroll_discard_ > 0) {
+        preroll_discard_ -= stretcher_->receiveSamples(nullptr, std::min(preroll_discard_, stretcher_->numSamples()));
+    }
+    
+    // The position is what has been heard, not what has been fed: every
+    // output frame stands for tempo_ source frames (a primed cue's first
+    // frames for the tempo they were primed at), and a loop's wrap counts
+    // once the output gets to it
+    int received = stretcher_->receiveSamples(output, frames);
+    int primed = std::min(received, primed_frames_);
+    primed_frames_ -= primed;
+    double position = play_position_.load() + primed * primed_tempo_ + (received - primed) * tempo_;
+    while (seam_count_ > 0 && position >= seams_[seam_head_].end) {
+        position -= seams_[seam_head_].end - seams_[seam_head_].start;
+        seam_head_ = (seam_head_ + 1) % LOOP_SEAM_CAPACITY;
+        seam_count_--;
     }
+    play_position_ = position;
+    return received;
+}
+
+int Deck::renderFadeOut(TimeStretcher* stretcher, AudioFile* track, float* output, int frames) {
+    // Output due next from stretcher, to fade out of; the play position
+    // stays where it was
+    TimeStretcher* current = stretcher_;
+    double position = play_position_.load();
+    int primed = primed_frames_;
+    stretcher_ = stretcher;
+    primed_frames_ = stretcher == current ? primed : 0;
+    int rendered = renderStretched(track, output, frames);
+    stretcher_ = current;
+    play_position_ = position;
+    primed_frames_ = primed;
+    return rendered;
+}
+
+void Deck::endRender() {
+    render_epoch_.fetch_add(1);
+}
+
+DeckTimings Deck::takeTimings() {
+    DeckTimings timings = timings_;
+    timings_ = { 0, 0, 0 };
+    return timings;
 }
 
 } // namespace dj
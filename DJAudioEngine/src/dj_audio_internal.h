@@ -2,48 +2,1155 @@
 #define DJ_AUDIO_INTERNAL_H
 
 #include <cstdint>
+#include <cmath>
 #include <vector>
 #include <mutex>
 #include <atomic>
 #include <memory>
+#include <string>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <type_traits>
+#include <deque>
+#include <unordered_map>
 
 // Forward declarations
-namespace soundtouch {
-    class SoundTouch;
-}
+struct SRC_STATE_tag;  // libsamplerate's SRC_STATE
+struct engine_status_t;  // dj_audio_engine.h
+struct engine_perf_t;    // dj_audio_engine.h
+struct analysis_features_t;  // dj_audio_engine.h
 
 namespace dj {
 
+// ----------------------------------------------------------------------------
+// Logging
+// ----------------------------------------------------------------------------
+
+enum class LogLevel : int {
+    Debug = 0,
+    Info = 1,
+    Warning = 2,
+    Error = 3,
+    Off = 4
+};
+
+// Calls below this level compile away entirely (Release builds set 1)
+#ifndef DJ_LOG_MIN_LEVEL
+#define DJ_LOG_MIN_LEVEL 0
+#endif
+
+// One log call. The format string must be a literal - only its pointer is
+// kept; arguments are captured by value and %s strings are copied into text.
+struct LogRecord {
+    static const int MAX_ARGS = 8;
+    static const int TEXT_BYTES = 96;
+    
+    enum class ArgType : uint8_t { Int, UInt, Double, String, Pointer };
+    struct Arg {
+        ArgType type;
+        union {
+            int64_t i;
+            uint64_t u;
+            double d;
+            const void* p;
+            uint32_t text_offset;
+        };
+    };
+    
+    LogLevel level;
+    int64_t time_ns;  // steady_clock
+    const char* format;
+    int arg_count;
+    uint32_t text_used;
+    Arg args[MAX_ARGS];
+    char text[TEXT_BYTES];
+};
+
+// Real-time safe logger. Any thread, the audio callback included, packs a
+// LogRecord and pushes it into a bounded lock-free MPMC ring; nothing is
+// formatted, allocated or written on the caller's thread. A writer thread
+// formats and appends records to the log file. When the ring is full the
+// record is dropped and counted instead of waiting.
+class Logger {
+public:
+    static Logger& instance();
+    
+    void start(const char* path);  // Starts the writer; records queue up until then
+    void stop();                   // Drains what's queued, then joins the writer
+    
+    void setLevel(LogLevel level) { level_.store(static_cast<int>(level), std::memory_order_relaxed); }
+    bool isEnabled(LogLevel level) const {
+        return static_cast<int>(level) >= level_.load(std::memory_order_relaxed);
+    }
+    uint64_t getDroppedCount() const { return dropped_.load(std::memory_order_relaxed); }
+    
+    template <typename... Args>
+    void log(LogLevel level, const char* format, const Args&... args) {
+        static_assert(sizeof...(Args) <= LogRecord::MAX_ARGS, "too many log arguments");
+        LogRecord record;
+        begin(&record, level, format);
+        int unused[] = { 0, (pack(&record, args), 0)... };
+        (void)unused;
+        push(record);
+    }
+    
+private:
+    Logger();
+    ~Logger();
+    
+    static void begin(LogRecord* record, LogLevel level, const char* format);
+    static void pack(LogRecord* record, const char* value);
+    static void pack(LogRecord* record, char* value) { pack(record, static_cast<const char*>(value)); }
+    static void pack(LogRecord* record, const std::string& value) { pack(record, value.c_str()); }
+    static void pack(LogRecord* record, double value) { addArg(record, LogRecord::ArgType::Double)->d = value; }
+    static void pack(LogRecord* record, float value) { pack(record, static_cast<double>(value)); }
+    static void pack(LogRecord* record, bool value) { addArg(record, LogRecord::ArgType::Int)->i = value ? 1 : 0; }
+    template <typename T>
+    static void pack(LogRecord* record, T* value) { addArg(record, LogRecord::ArgType::Pointer)->p = value; }
+    template <typename T>
+    static void pack(LogRecord* record, const T& value) {
+        static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "unsupported log argument");
+        if (std::is_signed<T>::value || std::is_enum<T>::value) {
+            addArg(record, LogRecord::ArgType::Int)->i = static_cast<int64_t>(value);
+        } else {
+            addArg(record, LogRecord::ArgType::UInt)->u = static_cast<uint64_t>(value);
+        }
+    }
+    static LogRecord::Arg* addArg(LogRecord* record, LogRecord::ArgType type);
+    
+    void push(const LogRecord& record);
+    bool pop(LogRecord* record);
+    void writerMain();
+    
+    // Vyukov bounded MPMC queue: each cell's sequence number says whether
+    // it is free for the producer at that position or full for the consumer
+    struct Cell {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;
+    alignas(64) std::atomic<size_t> dequeue_pos_;
+    
+    std::atomic<int> level_;
+    std::atomic<uint64_t> dropped_;
+    
+    std::mutex writer_mutex_;  // start/stop only
+    std::thread writer_thread_;
+    std::atomic<bool> writer_running_;
+    std::string path_;
+    int64_t epoch_ns_;  // Timestamps are written relative to this
+};
+
+#define DJ_LOG(level, ...) \
+    do { \
+        if (static_cast<int>(level) >= DJ_LOG_MIN_LEVEL && ::dj::Logger::instance().isEnabled(level)) \
+            ::dj::Logger::instance().log(level, __VA_ARGS__); \
+    } while (0)
+
+#define DJ_LOG_DEBUG(...) DJ_LOG(::dj::LogLevel::Debug, __VA_ARGS__)
+#define DJ_LOG_INFO(...)  DJ_LOG(::dj::LogLevel::Info, __VA_ARGS__)
+#define DJ_LOG_WARN(...)  DJ_LOG(::dj::LogLevel::Warning, __VA_ARGS__)
+#define DJ_LOG_ERROR(...) DJ_LOG(::dj::LogLevel::Error, __VA_ARGS__)
+
+// ----------------------------------------------------------------------------
+// Render memory
+// ----------------------------------------------------------------------------
+
+// Bump allocator over one block reserved up front. The render thread resets
+// it at the start of every block and carves per-deck and per-bus scratch out
+// of it, so rendering never touches the heap.
+class RenderArena {
+public:
+    RenderArena();
+    
+    void reserve(size_t bytes);  // Allocates; call before the stream starts
+    void reset() { used_ = 0; }
+    
+    // 64-byte aligned and uninitialized. nullptr once the reservation is
+    // used up - callers render silence rather than allocate.
+    float* allocateFloats(size_t count);
+    
+    size_t getCapacity() const { return capacity_; }
+    size_t getHighWater() const { return high_water_; }
+    
+private:
+    std::vector<uint8_t> storage_;
+    uint8_t* base_;
+    size_t capacity_;
+    size_t used_;
+    size_t high_water_;
+};
+
+// Marks the current thread as real-time while in scope. Built with
+// DJ_DEBUG_RT_ALLOC, any operator new or delete on a marked thread is
+// logged and asserts; otherwise this is an empty object.
+class RealtimeScope {
+public:
+#ifdef DJ_DEBUG_RT_ALLOC
+    RealtimeScope();
+    ~RealtimeScope();
+    
+private:
+    bool previous_;
+#else
+    RealtimeScope() {}
+#endif
+};
+
+// Steady-clock nanoseconds, for timing render stages
+int64_t nowNanoseconds();
+
+// Adds the nanoseconds it was in scope to *total. Two clock reads; cheap
+// enough to leave on in the render path.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(int64_t* total) : total_(total), start_(nowNanoseconds()) {}
+    ~ScopedTimer() { *total_ += nowNanoseconds() - start_; }
+    
+private:
+    int64_t* total_;
+    int64_t start_;
+};
+
+// Runs fn(0) ... fn(count - 1) across the hardware threads and returns once
+// every call has finished. Calls may run in any order.
+void parallelFor(int count, const std::function<void(int)>& fn);
+
+// 64-bit FNV-1a, used for cache keys
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    
+    bool open(const char* filepath);
+    void close();
+    
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    
+private:
+    const uint8_t* data_;
+    size_t size_;
+#ifdef _WIN32
+    void* file_handle_;     // HANDLE
+    void* mapping_handle_;  // HANDLE
+#endif
+};
+
+// In-memory PCM representation. Int16/Float16 halve resident memory and the
+// bandwidth of the bypass copy; samples are widened to float in blocks on read.
+enum class SampleFormat {
+    Float32,
+    Int16,
+    Float16
+};
+
+inline size_t bytesPerSample(SampleFormat format) {
+    return format == SampleFormat::Float32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+// EBU R128 figures of a whole track
+struct TrackLoudness {
+    double integrated_lufs = 0.0;  // LOUDNESS_SILENCE_LUFS when every block is gated out
+    double true_peak_db = 0.0;     // dBTP
+};
+
+// Integrated loudness of a track with nothing above the absolute gate
+static const double LOUDNESS_SILENCE_LUFS = -70.0;
+
+// ITU-R BS.1770 (EBU R128) integrated loudness and true peak, fed the
+// decoded frames in order as a streaming stage of the decode. K-weighted
+// 400 ms gating blocks overlapping by 75%; true peak from 4x oversampling
+// below 96 kHz, 2x below 192 kHz.
+class LoudnessMeter {
+public:
+    explicit LoudnessMeter(int sample_rate);
+    
+    void process(const float* stereo, int64_t frames);
+    TrackLoudness getLoudness() const;
+    
+private:
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+    };
+    
+    double filter(int channel, double x);
+    void measurePeaks(int channel, float x);
+    
+    Biquad shelf_;                  // K-weighting stage 1
+    Biquad highpass_;               // Stage 2, the revised low-frequency B curve
+    double state_[2][4];            // Per channel, both stages' transposed direct form II states
+    
+    int step_frames_;               // 100 ms: a quarter of a gating block
+    int64_t step_count_;            // Frames in the current step
+    double step_energy_;
+    double steps_[4];               // Energy of the last four whole steps
+    int64_t steps_done_;
+    std::vector<double> blocks_;    // Mean square of every gating block
+    
+    int oversample_;
+    int taps_;                      // Per phase
+    std::vector<float> phases_;     // oversample_ x taps_ interpolation filter
+    std::vector<float> history_[2]; // 2 x taps_, each sample written twice
+    int history_pos_;
+    float peak_;
+};
+
+// What a cached PCM file holds, checked against the request on lookup
+struct PcmCacheInfo {
+    SampleFormat format;
+    int sample_rate;
+    int64_t frames;
+    bool has_loudness = false;      // Measured while decoding
+    TrackLoudness loudness;
+};
+
+// On-disk cache of decoded PCM, one file per track, memory-mapped on hit so
+// the OS page cache shares it between processes. Keyed by source path,
+// modification time, size and storage format; evicted least-recently-used
+// once the directory grows past the size cap.
+class PcmCache {
+public:
+    PcmCache();
+    
+    void configure(const char* directory, uint64_t max_bytes);
+    bool isEnabled() const;
+    
+    // Returns the mapping on a hit. *pcm points at the first sample.
+    // target_rate is the rate the track was converted to (0 = native).
+    std::unique_ptr<MappedFile> open(const char* source_path, SampleFormat format, int target_rate,
+                                     PcmCacheInfo* info, const uint8_t** pcm);
+    void store(const char* source_path, int target_rate, const PcmCacheInfo& info,
+               const uint8_t* pcm, size_t pcm_bytes);
+    
+private:
+    bool cacheFilePath(const char* source_path, SampleFormat format, int target_rate,
+                       std::string* cache_path, uint64_t* key) const;
+    void evict();
+    
+    mutable std::mutex mutex_;
+    std::string directory_;
+    uint64_t max_bytes_;
+};
+
+// An encoded file in memory, for tracks that never were on disk as one.
+// Either a copy the engine owns, or the caller's bytes read in place, which
+// go back through release once the last decoder is done with them - from
+// whichever thread that is, and also if the load fails.
+class EncodedBuffer {
+public:
+    typedef void (*ReleaseCallback)(void* user_data);
+    
+    EncodedBuffer(const void* data, size_t size, ReleaseCallback release, void* user_data);  // Borrows
+    explicit EncodedBuffer(std::vector<uint8_t> bytes);                                      // Owns
+    ~EncodedBuffer();
+    
+    EncodedBuffer(const EncodedBuffer&) = delete;
+    EncodedBuffer& operator=(const EncodedBuffer&) = delete;
+    
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    
+private:
+    std::vector<uint8_t> owned_;
+    const uint8_t* data_;
+    size_t size_;
+    ReleaseCallback release_;
+    void* user_data_;
+};
+
+// Streaming decoder over dr_libs. Always delivers interleaved stereo float;
+// mono sources are duplicated to both channels.
+class AudioDecoder {
+public:
+    AudioDecoder();
+    ~AudioDecoder();
+    
+    bool open(const char* filepath);  // Format from the extension
+    
+    // Format from the magic bytes, or from format_hint ("mp3", ".flac", a
+    // file name) when they don't tell. Holds buffer until closed.
+    bool openMemory(std::shared_ptr<const EncodedBuffer> buffer, const char* format_hint);
+    void close();
+    bool isOpen() const { return handle_ != nullptr; }
+    
+    // 0 if the container doesn't tell us up front
+    int64_t getTotalFrames() const { return total_frames_; }
+    int getSampleRate() const { return sample_rate_; }
+    
+    // Returns the number of stereo frames written (< frames at end of stream)
+    int64_t read(float* output, int64_t frames);
+    bool seek(int64_t frame);
+    
+    // MP3 only: scan the file once so later seeks jump straight to the
+    // nearest frame instead of decoding from the start
+    void buildSeekTable();
+    
+private:
+    enum class Format { None, Mp3, Wav, Flac };
+    
+    static Format formatFromName(const char* name);
+    static Format formatFromBytes(const uint8_t* data, size_t size);
+    bool openAs(Format format, const char* filepath);  // From memory_ if filepath is null
+    
+    Format format_;
+    void* handle_;  // drmp3*, drwav* or drflac*
+    std::shared_ptr<const EncodedBuffer> memory_;
+    int64_t total_frames_;
+    int sample_rate_;
+    int source_channels_;
+    std::vector<float> mono_scratch_;
+    std::vector<uint8_t> seek_table_;  // drmp3_seek_point[], bound to handle_
+};
+
+// libsamplerate converter for interleaved stereo float. Tracks are
+// converted to the engine rate while loading; vinyl decks open a fast one
+// and vary its ratio on the audio thread, which process() allows since it
+// never allocates.
+class Resampler {
+public:
+    Resampler();
+    ~Resampler();
+    
+    bool open(int source_rate, int target_rate, bool fast = false);
+    void close();
+    void reset();
+    bool isActive() const { return state_ != nullptr; }
+    void setRatio(double ratio) { ratio_ = ratio; }  // Output / input; glides over the next process()
+    
+    // Converts as much of input as fits in output. *used receives the input
+    // frames consumed; returns the frames written. With end_of_input set,
+    // keep calling with no input until it returns 0 to drain the filter.
+    int64_t process(const float* input, int64_t input_frames, float* output, int64_t output_frames,
+                    bool end_of_input, int64_t* used);
+    
+    // Frame count of a track of source_frames after conversion
+    static int64_t convertedLength(int64_t source_frames, int source_rate, int target_rate);
+    
+    // Converts a whole in-memory track in independent, overlapping chunks
+    // on worker threads. sink(pos, frames, count) receives each finished
+    // span of output, possibly concurrently; spans never overlap and
+    // together cover [0, convertedLength()).
+    static void convertParallel(const float* input, int64_t input_frames, int source_rate, int target_rate,
+                                const std::function<void(int64_t, const float*, int64_t)>& sink);
+    
+private:
+    SRC_STATE_tag* state_;
+    double ratio_;
+};
+
+class AnalysisDatabase;
+class TrackCache;
+
+// How AudioFile::load gets PCM into memory
+enum class LoadMode {
+    Full,         // Decode the whole file before load() returns
+    Progressive   // Decode a short preroll, then finish on a background thread
+};
+
+struct LoadOptions {
+    LoadMode mode = LoadMode::Full;
+    SampleFormat storage_format = SampleFormat::Float32;
+    double preroll_seconds = 5.0;  // Progressive: decoded before load() returns
+    
+    // Tracks longer than this are never held in memory; they play through a
+    // read-ahead ring instead (0 disables streaming)
+    double streaming_threshold_seconds = 1800.0;
+    double streaming_buffer_seconds = 10.0;
+    
+    PcmCache* pcm_cache = nullptr;  // Map previously decoded PCM instead of decoding
+    AnalysisDatabase* analysis_db = nullptr;  // Analyses found here come with the track
+    bool build_waveform = true;  // WaveformPyramid for the UI; scans that never draw skip it
+    TrackCache* track_cache = nullptr;  // Deck loads take preloaded tracks from here
+    
+    // Convert to this rate while loading (0 keeps the file's own rate).
+    // Deck always sets the engine rate so positions are engine-rate frames.
+    int target_sample_rate = 0;
+};
+
+class AudioFile;
+
+// FFT implementations for the analysis pass. Reference is qm-dsp's kissfft
+// in double precision, kept to check the fast one against; Fast is a
+// single-precision radix-4 transform on the vec4 layer.
+enum class FFTBackend {
+    Reference,
+    Fast
+};
+
+// A planned real forward FFT of one size: size() real inputs in,
+// size() / 2 + 1 bins out, unnormalized. Owns its working buffers.
+class AnalysisFFT {
+public:
+    virtual ~AnalysisFFT() {}
+
+    virtual FFTBackend getBackend() const = 0;
+    virtual int size() const = 0;
+    virtual void forward(const float* input, float* reals, float* imags) = 0;
+};
+
+// Fast needs a power of two of at least 32; other sizes get Reference
+std::unique_ptr<AnalysisFFT> makeAnalysisFFT(FFTBackend backend, int size);
+
+// The calling thread's plan of that backend and size, made on first use
+// and kept for the thread's lifetime
+AnalysisFFT& getThreadFFT(FFTBackend backend, int size);
+
+// Backend the analysis pass uses (Reference unless set otherwise)
+void setAnalysisFFTBackend(FFTBackend backend);
+FFTBackend getAnalysisFFTBackend();
+
+// Pitch classes in a chroma vector, from C
+static const int CHROMA_BINS = 12;
+
+// Spectral bands the analysis measures: low, mid and high
+static const int ANALYSIS_BANDS = 3;
+
+// How thoroughly a result was analyzed. Preview is a quick BPM and a
+// tentative constant-tempo grid from one window of the track, to stand in
+// until the full analysis replaces it.
+enum class AnalysisTier : uint8_t { Full = 0, Preview = 1 };
+
+// Everything the analysis derives from a track, all from one pass over its
+// PCM. Computed once per track and kept on its AudioFile, so BPM,
+// first-beat and grid queries after the first are lookups.
+struct AnalysisResult {
+    AnalysisTier tier = AnalysisTier::Full;
+    int step_size = 0;     // Detection function hop, in frames
+    int sample_rate = 0;
+    std::vector<double> detection_function;
+    std::vector<double> beat_period;  // Per DF frame, in DF frames
+    std::vector<double> tempi;
+    std::vector<double> beats;        // Beat positions in seconds
+    double bpm = 0.0;                 // 0 when the track couldn't be analyzed
+    
+    // Waveform overview: the peak magnitude of every peak_frames frames,
+    // scaled to 0 - 255
+    int peak_frames = 0;
+    std::vector<uint8_t> peaks;
+    double loudness_db = -70.0;       // Gated RMS level in dBFS
+    
+    // From the same spectra as the detection function
+    int key = -1;                     // 0 - 11 major from C, 12 - 23 minor from C; -1 if none
+    float key_strength = 0.0f;        // Correlation of the chroma with the key's profile
+    float chroma[CHROMA_BINS] = {};   // Mean pitch class magnitudes, peak 1
+    float band_energy[ANALYSIS_BANDS] = {};  // Shares of the spectral energy, summing to 1
+    
+    // Measured while decoding, not by the analysis pass
+    bool has_loudness = false;
+    TrackLoudness loudness;
+};
+
+// Analyses persisted by content hash, so a track analyzed once (on a deck
+// or by a library scan) is never analyzed again. One append-only file; the
+// index lives in memory and records are read on lookup. Results read back
+// carry the BPM, beats, overview, loudness, key and band energies, not the
+// detection function. A file from an older format starts over empty.
+class AnalysisDatabase {
+public:
+    AnalysisDatabase();
+    
+    bool open(const char* filepath);  // Created if missing; nullptr closes
+    void close();
+    bool isOpen() const;
+    size_t getTrackCount() const;
+    
+    std::shared_ptr<const AnalysisResult> lookup(uint64_t key) const;
+    void store(uint64_t key, const AnalysisResult& result);
+    
+private:
+    struct Location {
+        uint64_t offset;  // Of the payload
+        uint32_t bytes;
+        uint64_t checksum;
+    };
+    
+    bool readIndex();
+    
+    mutable std::mutex mutex_;
+    std::string path_;
+    std::unordered_map<uint64_t, Location> index_;  // Later records win
+};
+
+// Identifies a file by what's in it rather than where it is: the size plus
+// a few windows of its bytes. 0 if the file can't be read.
+uint64_t hashFileContent(const char* filepath);
+uint64_t hashContent(const uint8_t* data, size_t size);  // The same for a file in memory
+
+// Progress reporting and cooperative cancellation for a running analysis
+struct AnalysisControl {
+    std::atomic<bool> cancelled{ false };
+    std::atomic<float> progress{ 0.0f };  // 0.0 - 1.0
+};
+
+// Runs the full analysis on an in-memory, fully decoded track. Failures
+// come back as an empty result; nullptr only if control was cancelled.
+std::shared_ptr<const AnalysisResult> analyzeTrack(const AudioFile& track, AnalysisControl* control = nullptr);
+
+// The preview tier: BPM and a tentative grid over the whole track from the
+// loudest of a few windows, downmixed and decimated to ~11 kHz. Only the
+// beat fields are filled in. Waits for the first window of a progressive
+// decode; nullptr if control is cancelled first.
+std::shared_ptr<const AnalysisResult> analyzePreview(const AudioFile& track, AnalysisControl* control = nullptr);
+
+// The C API's view of a result
+void copyAnalysisFeatures(const AnalysisResult& result, analysis_features_t* features);
+
+// One column of the UI waveform. min and max are the sample extremes over
+// both channels (-127 - 127); the rest are RMS levels (0 - 255) of the whole
+// signal and of its low (< 250 Hz), mid and high (> 2.5 kHz) bands.
+struct WaveformBin {
+    int8_t min;
+    int8_t max;
+    uint8_t rms;
+    uint8_t low;
+    uint8_t mid;
+    uint8_t high;
+    uint8_t reserved[2];
+};
+
+// Mipmapped waveform summary, so the UI draws the overview and every zoom
+// from bins computed once at load. Level l has getFramesPerBin(l) frames
+// per bin. Every level is allocated up front and filled in track order:
+// bins [0, getBinCount(level)) are final and can be read in place while a
+// progressive decode is still adding to the end.
+class WaveformPyramid {
+public:
+    static const int LEVEL_COUNT = 4;  // 64, 256, 1024 and 4096 frames per bin
+    
+    WaveformPyramid(int sample_rate, int64_t total_frames);
+    
+    static int getFramesPerBin(int level) { return 64 << (2 * level); }
+    const WaveformBin* getBins(int level) const { return levels_[level].data(); }
+    int64_t getBinCount(int level) const { return ready_[level].load(std::memory_order_acquire); }
+    
+    // Summarizes the track's frames up to available, which must be
+    // decoded. Until final, only whole regions are built, so each range is
+    // read once. Called by one thread at a time.
+    void update(const AudioFile& track, int64_t available, bool final);
+    
+private:
+    void buildRegion(const AudioFile& track, int64_t region, int64_t end);
+    
+    std::vector<WaveformBin> levels_[LEVEL_COUNT];
+    std::atomic<int64_t> ready_[LEVEL_COUNT];
+    int64_t total_frames_;
+    int64_t built_regions_;
+    float low_coeff_;   // One-pole lowpass coefficients of the band splits
+    float high_coeff_;
+};
+
 // Audio file loader
 class AudioFile {
 public:
     AudioFile();
     ~AudioFile();
     
-    bool load(const char* filepath);
+    bool load(const char* filepath, const LoadOptions& options = LoadOptions());
+    
+    // The same from an encoded file in memory. Never PCM-cached, since that
+    // is keyed by path; a full decode lets go of buffer before returning.
+    bool loadMemory(std::shared_ptr<const EncodedBuffer> buffer, const char* format_hint,
+                    const LoadOptions& options = LoadOptions());
     void unload();
     
-    int64_t getTotalSamples() const { return total_samples_; }
-    int getSampleRate() const { return sample_rate_; }
+    int64_t getTotalSamples() const { return total_samples_.load(std::memory_order_acquire); }
+    int getSampleRate() const { return sample_rate_; }  // Rate of the stored frames
+    int getSourceSampleRate() const { return source_sample_rate_; }
     int getChannels() const { return channels_; }
     double getDurationSeconds() const;
     
-    const float* getData() const { return audio_data_.data(); }
+    // Progressive decode watermark: frames [0, getDecodedSamples()) are
+    // valid. Equal to getTotalSamples() once decoding has finished.
+    int64_t getDecodedSamples() const { return decoded_samples_.load(std::memory_order_acquire); }
+    bool isFullyDecoded() const { return decode_complete_.load(std::memory_order_acquire); }
+    double getDecodedSeconds() const;
+    double getDecodeProgress() const;  // 0.0 - 1.0
+    void waitUntilDecoded() const;
+    bool waitUntilDecoded(const std::atomic<bool>& cancel) const;  // false if cancel was set first
+    bool waitUntilDecoded(int64_t frames, const std::atomic<bool>& cancel) const;  // Just the first frames
+    
+    SampleFormat getStorageFormat() const { return storage_format_; }
+    uint64_t getMemoryBytes() const;  // PCM held: the whole track, or a streaming ring
+    
+    // Streaming tracks keep only a window around the play position, so
+    // copyFrames() can't reach them; readFrames() is the only way in
+    bool isStreaming() const { return streaming_; }
+    
+    // Copy stereo frames starting at pos. Returns how many were available,
+    // which is short (or 0) while a progressive decode or a streaming refill
+    // hasn't reached pos yet. Safe to call from the audio thread.
+    int64_t readFrames(int64_t pos, float* output, int64_t frames);
+    
+    // True once pos is past the last frame that will ever be decoded
+    bool isEndOfTrack(int64_t pos) const;
+    
+    // Random access to in-memory tracks as float, from any thread (analysis)
+    int64_t copyFrames(int64_t pos, float* output, int64_t frames) const;
+    
+    // Zero-copy view of in-memory Float32 tracks: up to frames decoded
+    // frames at pos, their count in *available. nullptr for streaming or
+    // packed storage, which have to go through readFrames().
+    const float* peekFrames(int64_t pos, int64_t frames, int64_t* available) const;
+    
+    // Beat analysis of this track. The first caller waits for the decode
+    // and runs analyzeTrack(); everyone after, concurrent callers included,
+    // gets the same cached result. Empty for streaming tracks. nullptr if
+    // control is cancelled first, in which case nothing is cached.
+    std::shared_ptr<const AnalysisResult> getAnalysis(AnalysisControl* control = nullptr) const;
+    std::shared_ptr<const AnalysisResult> peekAnalysis() const;  // Never runs or waits for one
+    
+    // EBU R128 figures, measured as the track decodes. False until then;
+    // a streaming track is measured by a second read in the streaming
+    // thread's idle time.
+    bool getLoudness(TrackLoudness* loudness) const;
+    
+    // UI waveform, complete on return from load() or growing with a
+    // progressive decode. nullptr for streaming tracks and when the load
+    // options didn't ask for one.
+    std::shared_ptr<const WaveformPyramid> getWaveform() const { return waveform_; }
     
 private:
-    std::vector<float> audio_data_;  // Interleaved stereo
-    int64_t total_samples_;          // Total sample frames
+    bool loadOpened(const LoadOptions& options);  // Once decoder_ has the source
+    void attachStoredAnalysis(uint64_t content_key, AnalysisDatabase* db);
+    bool decodeRange(int64_t frames);
+    void decodeThreadMain();
+    void buildWaveform();
+    void finishDecode();
+    
+    int64_t decodeNative(int64_t total);
+    int64_t decodeResampled(int64_t source_total);
+    int64_t readSource(float* output, int64_t frames);
+    int64_t readConverted(float* output, int64_t frames);
+    bool seekConverted(int64_t pos);
+    
+    bool loadFromCache(const char* filepath, const LoadOptions& options);
+    void storeInCache();
+    void setLoudness(const TrackLoudness& loudness);
+    void finishLoudness();
+    
+    bool startStreaming(const LoadOptions& options);
+    void streamThreadMain();
+    bool meterStreamChunk();
+    int64_t readStreamFrames(int64_t pos, float* output, int64_t frames);
+    void requestSeek(int64_t pos);
+    
+    // Interleaved stereo in storage_format_. pcm_data_ points either into
+    // pcm_ or into a mapped cache file.
+    const uint8_t* pcm_data_;
+    std::vector<uint8_t> pcm_;
+    std::unique_ptr<MappedFile> pcm_mapping_;
+    std::vector<float> decode_buffer_;  // Float chunk on its way into pcm_
+    
+    // Sample-rate conversion. Source frames are pulled into source_buffer_
+    // and drained through resampler_ by readConverted().
+    Resampler resampler_;
+    std::vector<float> source_buffer_;
+    int64_t source_offset_;
+    int64_t source_pending_;
+    bool source_eof_;
+    int source_sample_rate_;
+    int target_sample_rate_;  // As requested; 0 = native
+    
+    std::string source_path_;
+    std::shared_ptr<const EncodedBuffer> source_memory_;  // Memory loads, while decoders may reopen it
+    PcmCache* pcm_cache_;
+    std::atomic<int64_t> total_samples_;    // Total sample frames
+    std::atomic<int64_t> decoded_samples_;  // Frames published to readers
     int sample_rate_;
     int channels_;
+    SampleFormat storage_format_;
+    
+    // Streaming ring. Frames live at slot (frame % ring_frames_), valid for
+    // [stream_start_, stream_end_) minus whatever the decoder may be
+    // overwriting. stream_read_ is owned by the reader and bounds how far
+    // ahead the decoder may fill.
+    bool streaming_;
+    std::vector<float> ring_;
+    int64_t ring_frames_;
+    std::atomic<int64_t> stream_start_;
+    std::atomic<int64_t> stream_end_;
+    std::atomic<int64_t> stream_read_;
+    std::atomic<int64_t> seek_target_;
+    std::atomic<uint32_t> seek_serial_;  // Bumped by the reader per seek
+    std::atomic<uint32_t> seek_ack_;     // Set by the decoder once refilling from it
+    
+    AudioDecoder decoder_;
+    std::thread decode_thread_;
+    std::atomic<bool> decode_complete_;
+    std::atomic<bool> cancel_decode_;
+    mutable std::mutex decode_mutex_;
+    mutable std::condition_variable decode_cv_;
+    
+    mutable std::mutex analysis_mutex_;  // Held for the whole analysis run
+    mutable std::shared_ptr<const AnalysisResult> analysis_;
+    AnalysisDatabase* analysis_db_;
+    uint64_t content_key_;               // 0 when there's no database
+    
+    // Fed by readSource() as the decoder produces frames, at the source
+    // rate. Streaming tracks feed it from meter_decoder_ instead, since
+    // the stream itself seeks. loudness_ is written once, before
+    // has_loudness_ is set.
+    std::unique_ptr<LoudnessMeter> meter_;
+    AudioDecoder meter_decoder_;
+    std::vector<float> meter_buffer_;
+    TrackLoudness loudness_;
+    std::atomic<bool> has_loudness_;
+    
+    // Set while loading, before the track is shared; a progressive decode
+    // extends it from the decoder thread
+    bool build_waveform_;
+    std::shared_ptr<WaveformPyramid> waveform_;
+};
+
+// Decoded tracks held in memory for decks to take without decoding, such
+// as the next entries of a playlist preloaded in the background. Keyed by
+// path, and only a hit if the file's size and modification time and the
+// load's rate and storage format still match. Over the budget the least
+// recently used go first; a deck playing an evicted track keeps it.
+class TrackCache {
+public:
+    explicit TrackCache(uint64_t max_bytes);
+    
+    void setBudget(uint64_t max_bytes);  // 0 empties and disables it
+    uint64_t getBudget() const;
+    uint64_t getBytes() const;
+    
+    // options as the deck loads with, so with its target rate set
+    std::shared_ptr<AudioFile> find(const char* filepath, const LoadOptions& options);
+    bool contains(const char* filepath, const LoadOptions& options) const;
+    
+    // Fully decoded, in-memory tracks only; streaming ones can't be shared
+    void insert(const char* filepath, const LoadOptions& options, std::shared_ptr<AudioFile> track);
+    
+private:
+    struct Entry {
+        std::shared_ptr<AudioFile> track;
+        SampleFormat format;
+        int target_rate;
+        uint64_t file_size;
+        int64_t file_mtime;
+        uint64_t bytes;
+        uint64_t last_used;  // use_clock_ at the last insert or hit
+    };
+    
+    const Entry* findLocked(const std::string& path, const LoadOptions& options) const;
+    void evictLocked();
+    
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    uint64_t max_bytes_;
+    uint64_t bytes_;
+    uint64_t use_clock_;
+};
+
+// Parameter and transport changes on their way from the API threads to the
+// render thread. Plain data so it can sit in a preallocated ring.
+struct Command {
+    enum class Type : uint8_t {
+        DeckPlay,            // position >= 0 starts from that frame
+        DeckPlaySynced,      // other = master deck
+        DeckPause,
+        DeckStop,
+        DeckSetPosition,     // value = seconds
+        DeckSetVolume,
+        DeckSetTempo,
+        DeckSetPitch,
+        DeckSetStretchMode,  // value = StretchMode
+        DeckSetEQLow,
+        DeckSetEQMid,
+        DeckSetEQHigh,
+        MixerSetCrossfader,
+        MixerSetAssign,      // value = CrossfaderSide
+        MixerSetPFL,         // value = 0 or 1
+        MixerSetCueMix,
+        MixerSetCueVolume,
+        SyncEnable,          // deck = slave, other = master
+        SyncDisable,
+        SyncAlignNow,        // deck = slave, other = master
+        ScheduleCancel,      // deck, or -1 for every deck
+        AutomationRamp,      // other = AutomationTarget, value = end value, position = start frame (-1 = now)
+        AutomationCancel,    // other = AutomationTarget, or -1 for all of deck's
+        PerfReset,
+        DeckHotCue,          // other = cue index
+        DeckLoopIn,
+        DeckLoopOut,
+        DeckSetLoop,         // value = start frame, position = end frame
+        DeckLoopBeats,       // value = beats
+        DeckLoopExit,
+        DeckLoopRoll,        // value = beats, <= 0 to release
+        DeckSetAutoGain      // value = target LUFS, other = enabled
+    };
+    
+    Type type;
+    int deck;
+    int other;
+    double value;
+    int64_t position;
+    
+    // Scheduled commands wait in the EventScheduler until due_frame, or
+    // until quantize_deck reaches its next multiple of quantize_beats
+    int64_t due_frame;   // Stream frame; -1 when not at a fixed frame
+    int quantize_deck;   // -1 when not quantized
+    int quantize_beats;  // 1 = next beat, 4 = next bar
+    
+    bool isScheduled() const { return due_frame >= 0 || quantize_deck >= 0; }
+    
+    // AutomationRamp only
+    double ramp_seconds;
+    uint8_t ramp_shape;  // AutomationShape
+};
+
+// Lock-free single-producer/single-consumer ring. The render thread is the
+// only consumer; producers are serialized by EngineState::command_mutex.
+class CommandQueue {
+public:
+    explicit CommandQueue(size_t capacity);  // Rounded up to a power of two
+    
+    bool push(const Command& command);  // False when full
+    bool pop(Command* command);         // False when empty
+    
+private:
+    std::vector<Command> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_;  // Next slot to read, owned by the consumer
+    alignas(64) std::atomic<size_t> tail_;  // Next slot to write, owned by the producer
+};
+
+class Deck;
+
+// Commands held back until a stream frame, or until a deck reaches a beat.
+// The callback renders in spans that end where the next one is due, so
+// each lands on its exact frame. Render thread only (or any thread while
+// the stream is stopped, like the deck setters) but for reserve() and
+// release(); never allocates once made.
+class EventScheduler {
+public:
+    EventScheduler(size_t capacity, int sample_rate);
+    
+    // Any thread: claims a place for a command before it is sent, so a full
+    // scheduler is refused to the caller instead of dropped on arrival.
+    // release() hands back the place of one that never arrived.
+    bool reserve();
+    void release() { reserved_.fetch_sub(1); }
+    
+    // Into a place reserve() claimed; quantized commands get their target
+    // beat here, from where quantize_deck is now. False when full anyway,
+    // and the place is released.
+    bool add(const Command& command, const Deck* quantize_deck);
+    void cancel(int deck_id);  // -1 for every deck
+    
+    // Frames from stream_frame until the next command is due, 1 to frames
+    int framesUntilNext(Deck* const* decks, int count, int64_t stream_frame, int frames) const;
+    
+    // Takes the first command due at stream_frame, in the order they were
+    // added, with its timing cleared
+    bool popDue(Deck* const* decks, int count, int64_t stream_frame, Command* command);
+    
+private:
+    struct Event {
+        Command command;
+        double target_beat;  // Quantized events, on quantize_deck's grid
+    };
+    
+    // 0 when due now
+    int64_t framesUntil(const Event& event, Deck* const* decks, int count, int64_t stream_frame) const;
+    
+    std::vector<Event> events_;  // Reserved to capacity_
+    size_t capacity_;
+    int sample_rate_;
+    std::atomic<size_t> reserved_;  // Events held plus commands on their way
+};
+
+// DJ-style three-band isolator. Linkwitz-Riley 4th-order crossovers split
+// the signal into low, mid and high; at equal gains the bands sum to an
+// allpass, so a flat EQ doesn't colour the sound. Both channels and two
+// filter paths run side by side in 4-lane vectors (see eq.cpp).
+// Gains are linear: 0 = kill, 1 = unity, 2 = +6 dB.
+class ThreeBandEQ {
+public:
+    explicit ThreeBandEQ(int sample_rate);
+    
+    // Gains glide toward new values over a few milliseconds of processing
+    void setGains(float low, float mid, float high);
+    
+    // Stereo interleaved, in place
+    void process(float* buffer, int frames);
+    
+    // While all gains match and the filters are switched out, the EQ is a
+    // plain gain. takeFlatGain() then advances the glide by frames and
+    // hands the ramp to the caller to fold into its own pass, leaving
+    // the samples alone; otherwise it returns false and process() is due.
+    bool isFlat() const;
+    bool takeFlatGain(int frames, float* gain_start, float* gain_end);
+    
+    void reset();
+    
+private:
+    void advanceGains(int frames, float* start, float* end);
+    
+    // One biquad per lane, transposed direct form II
+    struct Section {
+        alignas(16) float b0[4];
+        alignas(16) float b1[4];
+        alignas(16) float b2[4];
+        alignas(16) float a1[4];
+        alignas(16) float a2[4];
+    };
+    
+    enum { SECTIONS = 4 };
+    
+    // Lanes are (L, R, L, R). Sections 0-1: low-pass | high-pass at the low
+    // crossover. Sections 2-3: low-pass at the high crossover | allpass.
+    Section sections_[SECTIONS];
+    alignas(16) float z1_[SECTIONS][4];
+    alignas(16) float z2_[SECTIONS][4];
+    
+    float target_[3];        // low, mid, high
+    float current_[3];
+    double smoothing_frames_;
+    bool active_;            // Filters running; bypassed while all gains match
+};
+
+// A track's beats as analyzed, for phase and tempo that follow the music
+// rather than a constant-BPM grid. Immutable once built, so any thread may
+// read it. Lookups are binary searches; before the first and after the last
+// beat the grid continues at the first and last beat intervals.
+class BeatGrid {
+public:
+    explicit BeatGrid(std::vector<double> beats);  // Seconds, ascending, at least two
+    
+    // nullptr when the analysis found fewer than two beats
+    static std::shared_ptr<const BeatGrid> fromAnalysis(const AnalysisResult& result);
+    
+    int getBeatCount() const { return static_cast<int>(beats_.size()); }
+    const double* getBeats() const { return beats_.data(); }
+    double getFirstBeat() const { return beats_.front(); }
+    
+    // Continuous beat number at a time: 2.5 is halfway from beat 2 to 3.
+    // getBeatTime() is its inverse.
+    double getBeatNumber(double seconds) const;
+    double getBeatTime(double beat_number) const;
+    
+    double getPhase(double seconds) const;      // 0.0 to 1.0 within the beat
+    double getNearestBeat(double seconds) const;
+    double getLocalBPM(double seconds) const;   // Averaged over a few beats either side
+    double getAverageBPM() const;
+    
+private:
+    std::vector<double> beats_;
+};
+
+// ----------------------------------------------------------------------------
+// Time stretching
+// ----------------------------------------------------------------------------
+
+enum class StretchMode : uint8_t {
+    Vinyl = 0,       // Pitch follows tempo; a resampler, the cheapest by far
+    SoundTouch = 1,  // Key lock (WSOLA)
+    Custom = 2       // Whatever registerTimeStretcher() installed
+};
+static const int STRETCH_MODE_COUNT = 3;
+
+// Tempo (and pitch) engine behind a deck, fed source frames and drained of
+// output frames, SoundTouch style. Render thread only; nothing may
+// allocate after construction. Output must line up with the input, so a
+// deck can count output frames times the tempo as source frames heard.
+class TimeStretcher {
+public:
+    virtual ~TimeStretcher() {}
+    
+    virtual void setTempo(double tempo) = 0;
+    virtual void setPitchSemitones(double semitones) = 0;
+    virtual bool canShiftPitch() const = 0;  // Without changing the tempo
+    
+    virtual void clear() = 0;
+    virtual void putSamples(const float* input, int frames) = 0;  // At most 4096 frames
+    virtual int receiveSamples(float* output, int frames) = 0;   // output may be null to drop frames
+    virtual int numSamples() const = 0;                          // Output frames ready
+};
+
+typedef std::unique_ptr<TimeStretcher> (*TimeStretcherFactory)(int sample_rate);
+
+// The Custom slot, for a stretcher built outside the engine. Takes effect
+// for decks created afterwards, so call it before engine_init.
+void registerTimeStretcher(TimeStretcherFactory factory);
+
+// nullptr for Custom when nothing is registered
+std::unique_ptr<TimeStretcher> createTimeStretcher(StretchMode mode, int sample_rate);
+std::unique_ptr<TimeStretcher> createSoundTouchStretcher(int sample_rate);  // soundtouch_wrap.cpp
+
+// One deck's contribution to a mixer block
+struct DeckBlock {
+    const float* samples;  // Stereo interleaved; nullptr when silent
+    int frames;            // Valid frames - the rest of the block is silence
+    float gain_start;      // Volume (and a flat EQ's gain) to apply, ramped
+    float gain_end;        // linearly across the whole block
+    float cue_gain_start;  // The same without the volume, for the cue bus
+    float cue_gain_end;
+};
+
+// Hot cue points per deck
+static const int HOT_CUE_COUNT = 8;
+
+// A stretcher primed at a hot cue by the CuePrimer thread - fed from ahead
+// of the cue, pre-roll dropped and the first frames rendered - so a jump
+// plays from it at once instead of refilling. The state says who has the
+// rest: the primer while Empty, Priming or Spent; the render thread while
+// Claimed, after which it hands the slot back Spent, holding the deck's
+// old stretcher. Ready slots are up for either to claim.
+struct HotCueSlot {
+    enum State : int { Empty, Priming, Ready, Claimed, Spent };
+    
+    std::atomic<int> state{ Empty };
+    std::unique_ptr<TimeStretcher> stretcher;
+    std::shared_ptr<AudioFile> track;  // Primed from; kept alive while referenced
+    StretchMode mode = StretchMode::SoundTouch;
+    double tempo = 1.0;
+    double pitch = 0.0;
+    int64_t cue_frame = -1;
+    int64_t feed_position = 0;  // Next source frame to feed the stretcher
+};
+
+// A loop wrap the stretcher has been fed but the output hasn't reached:
+// once the play position gets to end it carries on from start
+struct LoopSeam {
+    int64_t end;
+    int64_t start;
+};
+
+// Wraps in flight at once; with the shortest loop a stretcher's latency
+// covers far fewer
+static const int LOOP_SEAM_CAPACITY = 64;
+
+// Where a deck's last block went, in nanoseconds of CPU time. Stretch and
+// EQ are part of render.
+struct DeckTimings {
+    int64_t render_ns;
+    int64_t stretch_ns;
+    int64_t eq_ns;
 };
 
-// Deck class
+// Deck class. Transport, tempo/pitch, volume and EQ setters belong to the
+// render thread - the C API reaches them through the command queue, or
+// calls them directly while the stream is stopped.
 class Deck {
 public:
     Deck(int sample_rate);
     ~Deck();
     
-    bool loadTrack(const char* filepath);
+    // Decodes with no lock held, then publishes the finished track with an
+    // atomic pointer swap. The previous track is freed on the calling thread
+    // once the audio callback has stopped using it.
+    bool loadTrack(const char* filepath, const LoadOptions& options = LoadOptions());
+    bool loadTrackMemory(std::shared_ptr<const EncodedBuffer> buffer, const char* format_hint,
+                         const LoadOptions& options = LoadOptions());
     void unloadTrack();
     
     void play(int64_t startPosition = -1);
@@ -54,55 +1161,311 @@ public:
     void setPosition(double seconds);
     double getPosition() const;
     double getDuration() const;
+    double getDecodedDuration() const;  // Progressive loads: playable so far
+    double getLoadProgress() const;     // 0.0 - 1.0
     
     void setVolume(float volume) { volume_ = volume; }
+    float getVolume() const { return volume_; }
+    
+    // Auto-gain, render thread: a pre-fader gain taking the track's
+    // integrated loudness to target_lufs, folded into the volume ramp.
+    // Boosts stop short of pushing the true peak over a ceiling. A track
+    // still being measured plays at unity until the deck is next paused,
+    // so the level never jumps mid-play.
+    void setAutoGain(bool enabled, double target_lufs);
+    float getAutoGainDb() const;  // As applied, for the status block
     void setTempo(double tempo);
     void setPitch(double semitones);
+    void setStretchMode(StretchMode mode);  // Ignored for an empty Custom slot
+    
+    // Render thread: keeps the deck on the stretcher even at tempo 1.0. A
+    // phase-locked slave's nudges sit either side of unity; bypassing
+    // there would drop them, and each way back restarts the stretcher.
+    void holdStretch(bool held) { stretch_held_ = held; }
+    // Beat grid values are atomics instead of commands: sync math on the
+    // API threads must see a value the moment it was set
     void setBPM(double bpm) { bpm_ = bpm; }
     double getBPM() const { return bpm_; }
     void setBeatOffset(double offset) { beat_offset_ = offset; }
     double getBeatOffset() const { return beat_offset_; }
     
+    // Analyzed beat grid of the loaded track, replacing the constant grid
+    // from BPM and beat offset in phase math. Ignored unless track is still
+    // the one loaded. getBeatGrid() is for the render thread: the pointer
+    // stays valid until the callback after it was read has rendered.
+    void setBeatGrid(std::shared_ptr<const BeatGrid> grid, const AudioFile* track);
+    const BeatGrid* getBeatGrid() const { return grid_.load(std::memory_order_acquire); }
+    std::shared_ptr<const BeatGrid> acquireBeatGrid() const;
+    
     void setEQLow(float gain) { eq_low_ = gain; }
     void setEQMid(float gain) { eq_mid_ = gain; }
     void setEQHigh(float gain) { eq_high_ = gain; }
+    float getEQLow() const { return eq_low_; }
+    float getEQMid() const { return eq_mid_; }
+    float getEQHigh() const { return eq_high_; }
+    
+    // Audio processing. render() produces the deck's next block for the
+    // mixer, using scratch (2 * frames floats) when the samples can't be
+    // read in place. The block may point straight into the track, so it
+    // stays valid only until endRender(), which must follow every render().
+    DeckBlock render(float* scratch, int frames);
+    void endRender();
+    
+    // Access to loaded audio data (for BPM analysis). The returned reference
+    // keeps the track alive even if the deck is reloaded meanwhile.
+    bool isLoaded() const;
+    std::shared_ptr<AudioFile> getAudioFile() const;
+    
+    // Sync support. Positions are output-side - the frame being heard, not
+    // the frame the stretcher was last fed - so phase math is sample-accurate.
+    int64_t getSamplePosition() const { return static_cast<int64_t>(std::llround(play_position_.load())); }
+    void setSamplePosition(int64_t pos);
+    double getPhase() const { return getPhase(getBeatGrid()); }  // 0.0 to 1.0 within beat
+    
+    // Beats since the first beat at the current position, and where a
+    // beat number falls in seconds: on the analyzed grid if there is one,
+    // else on the constant grid from BPM and beat offset
+    double getBeatNumber() const { return getBeatNumber(getBeatGrid()); }
+    double getBeatTime(double beat_number) const { return getBeatTime(getBeatGrid(), beat_number); }
     
-    // Audio processing
-    int readSamples(float* output, int frames);
+    // The same against a grid the caller holds: API threads pass
+    // acquireBeatGrid(), since the forms above read the render thread's
+    // pointer. A null grid is the constant grid.
+    double getPhase(const BeatGrid* grid) const;
+    double getBeatNumber(const BeatGrid* grid) const;
+    double getBeatTime(const BeatGrid* grid, double beat_number) const;
     
-    // Access to loaded audio data (for BPM analysis)
-    bool isLoaded() const { return audio_file_ != nullptr && audio_file_->getTotalSamples() > 0; }
-    AudioFile* getAudioFile() const { return audio_file_.get(); }
+    // Render thread: what the last block saw, for the status block
+    double getTempo() const { return tempo_; }
+    double getRenderedDuration() const { return rendered_duration_; }
+    float getPeak(int channel) const { return peak_[channel]; }  // Post EQ and auto-gain, pre volume
+    uint32_t getEndCount() const { return end_count_; }  // Times playback ran off the end
+    DeckTimings takeTimings();  // Since the last call, then starts over
     
-    // Sync support
-    int64_t getSamplePosition() const { return sample_position_; }
-    void setSamplePosition(int64_t pos, bool forceSync = false);
-    double getPhase() const;  // 0.0 to 1.0 within beat
+    // Hot cues, in frames (-1 = unset), set from any thread and cleared by
+    // a new track. triggerHotCue() belongs to the render thread: it plays
+    // from the cue, straight out of the primed stretcher when it matches
+    // the current tempo, pitch and engine, else restarting like a seek.
+    void setHotCue(int index, int64_t frame);
+    int64_t getHotCue(int index) const;
+    void triggerHotCue(int index);
+    
+    // CuePrimer thread: primes each set cue for the current stretch
+    // settings, re-priming those that have gone stale or been used
+    void primeHotCues();
+    
+    // Loops, render thread. The wrap happens where the source is read, so
+    // it lands on the exact frame and the stretcher is fed straight across
+    // it, the frames before the end crossfaded into those before the start.
+    // A loop that ends behind where the deck has already read is joined
+    // with a crossfaded jump instead.
+    void loopIn();   // Marks the start at the play position
+    void loopOut();  // Ends the marked loop at the play position and loops it
+    void setLoop(int64_t start, int64_t end);
+    void setBeatLoop(double beats);  // From the beat (or fraction) at or before the play position
+    void exitLoop();
+    
+    // Loop roll: a beat loop while held, then playback picks up where it
+    // would have been had the loop never started, with the loop before
+    // the roll back in place
+    void startLoopRoll(double beats);
+    void endLoopRoll();
+    
+    bool isLooping() const { return loop_enabled_; }
+    bool isRolling() const { return rolling_; }
+    int64_t getLoopStart() const { return loop_start_; }
+    int64_t getLoopEnd() const { return loop_end_; }
     
 private:
-    void applyEQ(float* buffer, int frames);
+    // Swap in a new track (or nullptr) and release the old one after the
+    // render thread has left the current render()/endRender() span
+    void publishTrack(std::shared_ptr<AudioFile> track);
+    void waitForRenderQuiescence() const;
+    
+    // Under load_mutex_. Grids are swapped without waiting for the render
+    // thread; replaced ones are freed once it has rendered twice since.
+    void publishGridLocked(std::shared_ptr<const BeatGrid> grid);
+    
+    // Render thread. seek() moves both positions and has the stretcher
+    // restart there; renderStretched() produces frames of stretched output
+    // and renderFadeOut() the frames another stretcher would have, leaving
+    // the position alone.
+    void seek(int64_t pos);
+    int renderStretched(AudioFile* track, float* output, int frames);
+    int renderFadeOut(TimeStretcher* stretcher, AudioFile* track, float* output, int frames);
+    bool isStretchNeeded() const;  // Render thread: tempo or pitch need the stretcher
+    
+    // Render thread. readSource() reads from sample_position_ on, through
+    // the loop; a jump to pending_jump_ is crossfaded by the next render().
+    int64_t readSource(AudioFile* track, float* output, int64_t frames);
+    int64_t getLoopCrossfadeFrames() const;
+    int64_t getBeatFrame(double beat_number) const;
+    void clearSeams() { seam_count_ = 0; }
+    
+    // Render thread: takes auto_gain_ from the track's loudness, if known
+    void updateAutoGain(const AudioFile* track);
+    
+    // Hot cue slots, render thread and primer thread respectively
+    bool takePrimedCue(int index, const AudioFile* track, int64_t cue);
+    bool primeSlot(HotCueSlot& slot, const std::shared_ptr<AudioFile>& track, int64_t cue);
     
     int sample_rate_;
-    std::unique_ptr<AudioFile> audio_file_;
-    std::unique_ptr<soundtouch::SoundTouch> soundtouch_;
+    
+    // RCU-style track ownership: track_ref_ owns the buffer (guarded by
+    // load_mutex_), track_ is the raw pointer the audio thread reads.
+    // render_epoch_ is odd from render() to endRender().
+    std::shared_ptr<AudioFile> track_ref_;
+    std::atomic<AudioFile*> track_;
+    std::atomic<uint32_t> render_epoch_;
+    mutable std::mutex load_mutex_;
+    
+    std::shared_ptr<const BeatGrid> grid_ref_;  // Guarded by load_mutex_, like track_ref_
+    std::atomic<const BeatGrid*> grid_;
+    std::vector<std::pair<uint32_t, std::shared_ptr<const BeatGrid>>> retired_grids_;  // With the epoch they left at
+    
+    // One of each engine, made up front so switching never allocates
+    std::unique_ptr<TimeStretcher> stretchers_[STRETCH_MODE_COUNT];
+    TimeStretcher* stretcher_;
+    TimeStretcher* previous_stretcher_;  // Faded out of by the next stretched block
     
     std::atomic<bool> is_playing_;
-    std::atomic<int64_t> sample_position_;  // In source samples
+    std::atomic<int64_t> sample_position_;  // Next source frame to read (or feed the stretcher)
+    std::atomic<double> play_position_;     // Source frame being output, fractional while stretching
+    std::atomic<bool> reset_pending_;       // Track swapped; render thread restarts the stretcher
+    
+    bool stretching_;       // Render thread: the last block went through the stretcher
+    bool restart_stretch_;  // The stretcher holds audio from before a seek
+    int preroll_discard_;   // Output frames still owed to the pre-roll
+    int primed_frames_;     // Output frames a taken cue's stretcher made at primed_tempo_
+    double primed_tempo_;
     
     float volume_;
+    float applied_volume_;  // Where the last block's volume ramp ended
+    bool auto_gain_enabled_;
+    double auto_gain_target_lufs_;
+    bool auto_gain_pending_;   // The track's loudness isn't applied yet
+    float auto_gain_;          // Linear, in front of the volume
+    float applied_auto_gain_;
     double tempo_;
     double pitch_semitones_;
-    double bpm_;
-    double beat_offset_;  // In seconds
+    std::atomic<double> bpm_;
+    std::atomic<double> beat_offset_;  // In seconds
     
     float eq_low_;
     float eq_mid_;
     float eq_high_;
+    ThreeBandEQ eq_;
+    
+    std::vector<float> feed_buffer_;  // Source frames on their way into the stretcher
+    std::vector<float> crossfade_buffer_;  // The path being left, while switching
+    
+    double rendered_duration_;  // Render thread, like the peaks and end count
+    float peak_[2];
+    uint32_t end_count_;
+    
+    int log_counter_;  // Render thread; throttles the per-block debug trace
+    DeckTimings timings_;  // Whichever thread renders the deck, taken after the mix
+    
+    std::atomic<int64_t> hot_cues_[HOT_CUE_COUNT];
+    HotCueSlot cue_slots_[HOT_CUE_COUNT];
+    bool can_shift_pitch_[STRETCH_MODE_COUNT];  // Per engine, fixed at construction
+    
+    // Stretch settings as last set on the render thread, for the primer
+    std::atomic<double> cue_tempo_;
+    std::atomic<double> cue_pitch_;
+    std::atomic<int> cue_mode_;
+    std::atomic<bool> stretch_held_;  // Read by the primer too
+    std::vector<float> prime_buffer_;  // Primer thread's feed chunk
+    
+    // Loop state, render thread. Frames are source frames.
+    int64_t loop_in_;        // Marked by loopIn(); -1 until then
+    int64_t loop_start_;
+    int64_t loop_end_;
+    bool loop_enabled_;
+    int64_t pending_jump_;   // -1 = none
+    LoopSeam seams_[LOOP_SEAM_CAPACITY];  // Circular, oldest at seam_head_
+    int seam_head_;
+    int seam_count_;
+    std::vector<float> seam_buffer_;  // Frames before the loop start, faded in at its end
+    
+    bool rolling_;
+    double slip_position_;    // Where playback would be without the roll
+    int64_t rolled_start_;    // The loop the roll replaced
+    int64_t rolled_end_;
+    bool rolled_enabled_;
+};
+
+// Worker threads that render decks in parallel. run() is called from the
+// audio callback: it wakes just enough workers, takes jobs itself too and
+// returns once every job is done - the barrier before the mix. Workers are
+// pinned to their own cores and run at real-time priority.
+// Kernel semaphore: posting it never takes a lock the callback could block
+// on, as a condition variable's notify may. In render_pool.cpp.
+struct Semaphore;
+
+class RenderPool {
+public:
+    typedef void (*Job)(void* context, int index);
+    
+    explicit RenderPool(int workers);
+    ~RenderPool();
+    
+    int getWorkerCount() const { return static_cast<int>(threads_.size()); }
+    
+    // Runs job(context, 0) ... job(context, count - 1). Real-time safe
+    void run(int count, Job job, void* context);
     
-    std::mutex deck_mutex_;
+private:
+    void workerMain(int index);
+    void takeJobs();
+    
+    std::vector<std::thread> threads_;
+    std::unique_ptr<Semaphore> wake_;
+    std::atomic<bool> running_;
+    
+    // Current batch, published before the workers are woken
+    Job job_;
+    void* context_;
+    int count_;
+    std::atomic<int> next_;         // Next job index to claim
+    std::atomic<int> done_;         // Jobs finished
+    std::atomic<int> outstanding_;  // Woken workers that haven't checked out
 };
 
+struct EngineState;
+
+// Decks the engine can be configured with
+static const int MAX_DECKS = 8;
+
+// Keeps the decks' hot cues primed on a low-priority thread of its own. It
+// looks at every deck a few times a second, and at once after wake().
+class CuePrimer {
+public:
+    CuePrimer(const std::vector<std::unique_ptr<Deck>>& decks);
+    ~CuePrimer();
+    
+    void wake();  // A cue was set; not from the render thread
+    
+private:
+    void threadMain();
+    
+    std::vector<Deck*> decks_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_;
+    bool woken_;
+};
+
+// Which side of the crossfader a deck is on. Through ignores the fader.
+enum class CrossfaderSide : uint8_t { A = 0, B = 1, Through = 2 };
+
+// Per-channel peak magnitude of frames of interleaved stereo, times gain
+void measurePeaks(const float* stereo, int frames, float gain, float* left, float* right);
+
 // Mixer class
+struct MixSource;
+
 class Mixer {
 public:
     Mixer();
@@ -110,13 +1473,274 @@ public:
     void setCrossfader(float position) { crossfader_position_ = position; }
     float getCrossfader() const { return crossfader_position_; }
     
-    void mix(Deck* deck_a, Deck* deck_b, float* output, int frames);
+    // Even decks default to A and odd ones to B, as on 4-deck controllers
+    void setAssign(int deck_id, CrossfaderSide side);
+    CrossfaderSide getAssign(int deck_id) const { return assign_[deck_id]; }
+    
+    // Cue bus, for headphones: the decks with PFL on, post EQ and before
+    // volume and crossfader, blended with the master. Cue mix 0.0 is the
+    // cue alone, 1.0 the master alone.
+    void setPFL(int deck_id, bool enabled);
+    bool getPFL(int deck_id) const { return deck_id >= 0 && deck_id < MAX_DECKS && pfl_[deck_id]; }
+    void setCueMix(float mix) { cue_mix_ = std::max(0.0f, std::min(mix, 1.0f)); }
+    float getCueMix() const { return cue_mix_; }
+    void setCueVolume(float volume) { cue_volume_ = std::max(0.0f, volume); }
+    float getCueVolume() const { return cue_volume_; }
+    
+    // Renders count decks - on pool when more than one is playing - and
+    // mixes them. Deck buffers come from arena; frames must fit its
+    // reservation. The cue bus is mixed into cue_output from the same deck
+    // buffers, unless it's null. Unless stems is null, each deck's signal
+    // as the cue bus takes it (before volume and crossfader) also goes to
+    // stems[i], silence included.
+    void mix(Deck* const* decks, int count, float* output, float* cue_output, int frames, RenderArena& arena,
+             RenderPool* pool, float* const* stems = nullptr);
+    
+    // The mix alone, of decks rendered already: RenderAhead's stems, each
+    // with frames samples (or none, for silence)
+    void mixBlocks(const DeckBlock* blocks, int count, float* output, float* cue_output, int frames);
+    
+    // Nanoseconds spent mixing, past the deck renders, since the last call
+    int64_t takeMixTime();
+    
+private:
+    void mixCue(const MixSource* sources, int count, const float* master, float* cue_output, int frames);
+    
+    float crossfader_position_;           // 0.0 = A, 1.0 = B
+    CrossfaderSide assign_[MAX_DECKS];
+    float applied_fader_gain_[MAX_DECKS]; // Crossfader gains reached by the last block
+    bool clipping_;                       // Last block needed the soft clipper
+    int64_t mix_ns_;
+    
+    bool pfl_[MAX_DECKS];
+    float applied_pfl_gain_[MAX_DECKS];   // 0 or 1, as the last block left it
+    float cue_mix_;
+    float cue_volume_;
+    float applied_cue_gain_;              // Cue and master gains in the headphones
+    float applied_cue_master_gain_;       // as the last block left them
+};
+
+// A master-stage control as the API last set it. change goes up with every
+// set and rides on its command, so the render thread can say which it has
+// applied.
+struct LiveControl {
+    LiveControl() : value(0.0f), change(0) {}
+    
+    std::atomic<float> value;
+    std::atomic<uint32_t> change;  // Stored after value
+};
+
+// API threads -> RenderAhead::pull, which applies these over the ring
+struct LiveControls {
+    LiveControl crossfader;
+    LiveControl cue_mix;
+    LiveControl volume[MAX_DECKS];
+};
+
+// The last change of each live control the render thread has applied
+struct ControlChanges {
+    uint32_t crossfader;
+    uint32_t cue_mix;
+    uint32_t volume[MAX_DECKS];
+};
+
+// The master stage a block in the ring was rendered for
+struct MasterStage {
+    float crossfader;
+    float cue_mix;
+    float cue_volume;
+    float volume[MAX_DECKS];
+    CrossfaderSide assign[MAX_DECKS];
+    bool pfl[MAX_DECKS];
+    ControlChanges applied;
+};
+
+// Pipeline mode: a thread of its own, at MMCSS Pro Audio priority on
+// Windows, renders the decks a few blocks ahead into a ring - each one up
+// to its volume, as the cue bus takes it - and the device callback mixes
+// them out of it. Commands apply to the next block rendered, so most
+// controls answer a ring's depth late, the price of riding out a slow
+// block that would otherwise be an xrun; the crossfader, deck volumes and
+// cue mix are applied in the callback, and answer in its next buffer. The
+// render thread of everything else in the engine is then this one.
+class RenderAhead {
+public:
+    // In the device's layout (renderDeviceBlock); returns once the ring is full
+    RenderAhead(EngineState* engine, int block_frames, int blocks);
+    ~RenderAhead();
+    
+    // Device callback: the next frames. False if the ring ran dry, with
+    // the rest of output silent.
+    bool pull(float* output, int frames);
+    
+    int getLatencyFrames() const { return static_cast<int>(capacity_); }
     
 private:
-    float crossfader_position_;  // 0.0 = A, 1.0 = B
+    void threadMain();
+    float* stem(int64_t block, int deck) { return ring_.data() + (block * deck_count_ + deck) * block_frames_ * 2; }
+    
+    // Frames of one block from offset, through the master stage
+    void mixPiece(int64_t block, int offset, float* output, int frames);
+    
+    EngineState* engine_;
+    int channels_;
+    int deck_count_;
+    int block_frames_;
+    int64_t blocks_;
+    int64_t capacity_;                // Frames
+    std::vector<float> ring_;         // Per block, each deck's stereo stem
+    std::vector<MasterStage> stages_; // Per block
+    std::vector<float> block_;        // The render thread's own master, for the meters
+    alignas(64) std::atomic<int64_t> written_;  // Frames rendered, owned by the render thread
+    alignas(64) std::atomic<int64_t> read_;     // Frames played, owned by the callback
+    std::unique_ptr<Semaphore> wake_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+    
+    // Callback's
+    Mixer mixer_;
+    float applied_volume_[MAX_DECKS];  // Where the last piece's volume ramp ended
+    std::vector<float> master_;        // A four-channel device's buses, a
+    std::vector<float> cue_;           // block each, interleaved after
+};
+
+// Blocks RenderAhead may run ahead by
+static const int MAX_RENDER_AHEAD_BLOCKS = 8;
+
+// Parameters the render thread can automate
+enum class AutomationTarget : uint8_t {
+    Crossfader = 0,  // Deck ignored
+    DeckVolume = 1,
+    DeckEQLow = 2,
+    DeckEQMid = 3,
+    DeckEQHigh = 4,
+    DeckTempo = 5
+};
+static const int AUTOMATION_TARGET_COUNT = 6;
+
+enum class AutomationShape : uint8_t {
+    Linear = 0,
+    SCurve = 1,   // Smoothstep: eases in and out
+    EaseIn = 2,   // Slow start
+    EaseOut = 3   // Slow finish
+};
+static const int AUTOMATION_SHAPE_COUNT = 4;
+
+// Parameter ramps run by the render thread. The callback evaluates them at
+// the end of each span it mixes, in spans of a few milliseconds while any
+// ramp runs; deck and crossfader gains already ramp per sample across a
+// block, so fades come out as fine piecewise-linear curves. Render thread
+// only (or any thread while the stream is stopped); never allocates once
+// made.
+class Automation {
+public:
+    Automation(size_t capacity, int sample_rate);
+    
+    // Moves from the value at start_frame to value over seconds. Replaces
+    // a ramp already on the same parameter. False when full.
+    bool add(AutomationTarget target, int deck, double value, int64_t start_frame, double seconds,
+             AutomationShape shape);
+    void cancel(int target, int deck);  // target < 0 for all of deck's (and the crossfader's for deck < 0)
+    
+    // Frames from stream_frame the next span may run for, 1 to frames
+    int framesUntilNext(int64_t stream_frame, int frames) const;
+    
+    // Sets every running parameter to its value at span_end, for the span
+    // starting at span_start
+    void apply(Deck* const* decks, int count, Mixer* mixer, int64_t span_start, int64_t span_end);
+    
+private:
+    struct Ramp {
+        AutomationTarget target;
+        AutomationShape shape;
+        bool started;
+        int deck;
+        double from;  // Read from the parameter once the ramp starts
+        double to;
+        int64_t start_frame;
+        int64_t duration_frames;
+    };
+    
+    std::vector<Ramp> ramps_;  // Reserved to capacity_
+    size_t capacity_;
+    int sample_rate_;
+};
+
+// ----------------------------------------------------------------------------
+// Background analysis
+// ----------------------------------------------------------------------------
+
+class Deck;
+
+// Deck jobs (tracks about to be played) always run ahead of Background
+// jobs (library scans)
+enum class AnalysisPriority : uint8_t { Deck = 0, Background = 1 };
+static const int ANALYSIS_PRIORITY_COUNT = 2;
+
+enum class AnalysisStatus : int {
+    Queued = 0,
+    Running = 1,
+    Done = 2,
+    Failed = 3,      // Not loadable, or no tempo found
+    Cancelled = 4,
+    Preview = 5      // Running, with the preview tier's result out
+};
+
+// Bounded pool running analyses off the API threads. Jobs are handles
+// polled for progress or waited on through the completion callback, which
+// runs on the analysis thread that finished the job.
+class AnalysisQueue {
+public:
+    typedef void (*Callback)(int job_id, int status);
+    
+    explicit AnalysisQueue(int workers);
+    ~AnalysisQueue();  // Cancels whatever is left and joins
+    
+    // Job handles are > 0. A deck job analyzes the track loaded when it was
+    // submitted, fills that track's analysis cache and, if the deck still
+    // has the track, gives the deck its beat grid. A Preview job publishes
+    // the preview tier first (status Preview, and the deck's grid until
+    // then), and the full result replaces it when done.
+    int submitTrack(std::shared_ptr<AudioFile> track, Deck* deck, int deck_id, AnalysisPriority priority,
+                    AnalysisTier tier = AnalysisTier::Full);
+    int submitFile(const char* filepath, const LoadOptions& options, AnalysisPriority priority,
+                   AnalysisTier tier = AnalysisTier::Full);
+    
+    // Decodes the file as a deck would with options, puts it in cache and
+    // analyzes it there, at background priority
+    int submitPreload(const char* filepath, const LoadOptions& options, TrackCache* cache);
+    
+    // False for unknown (or released) handles
+    bool getStatus(int job_id, AnalysisStatus* status, double* progress) const;
+    std::shared_ptr<const AnalysisResult> getResult(int job_id) const;  // Done and Preview jobs only
+    
+    void cancel(int job_id);
+    void cancelDeck(int deck_id);  // The deck is being reloaded
+    void release(int job_id);      // Forget the handle; a running job still finishes
+    
+    void setCallback(Callback callback) { callback_.store(callback); }
+    
+private:
+    struct Job;
+    
+    int enqueue(std::shared_ptr<Job> job);
+    void workerMain();
+    void runJob(Job& job);
+    void finish(Job& job, AnalysisStatus status, std::shared_ptr<const AnalysisResult> result = nullptr);
+    bool cancelLocked(Job& job);  // True if it ended a queued job
+    void notifyCancelled(const std::vector<int>& job_ids);
+    
+    std::vector<std::thread> threads_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::shared_ptr<Job>> pending_[ANALYSIS_PRIORITY_COUNT];
+    std::unordered_map<int, std::shared_ptr<Job>> jobs_;
+    int next_id_;
+    bool running_;
+    std::atomic<Callback> callback_;
 };
 
-// Sync manager
+// Sync manager. Render thread only, like the deck setters.
 class SyncManager {
 public:
     SyncManager();
@@ -125,37 +1749,272 @@ public:
     void disable(int deck_id);
     void alignNow(Deck* slave, Deck* master);  // Immediate one-time alignment
     
-    void update(Deck* decks[2]);
+    // Tempo-matches slave and returns the frame to cue it at, its first
+    // kick, for starting on master's next beat; -1 without BPMs to match
+    int64_t cueSynced(Deck* slave, Deck* master, int sample_rate);
+    
+    // Once per callback, before rendering block_seconds of audio: keeps
+    // every playing slave tempo-matched and phase-locked to its master
+    void update(Deck* const* decks, int count, double block_seconds);
     
 private:
-    struct SyncState {
-        bool enabled;
-        int master_deck_id;
-        int slave_deck_id;
+    // Phase-locked loop state, per slave deck
+    struct Lock {
+        bool active = false;      // Both decks played through the last update
+        double error = 0.0;       // Filtered phase error, beats
+        double integral = 0.0;    // Phase error integrated over time, beat-seconds
     };
     
-    SyncState sync_state_;
-    std::mutex sync_mutex_;
+    int master_of_[MAX_DECKS];  // Per slave deck; -1 when not synced
+    Lock lock_[MAX_DECKS];
+    int log_counter_;
+};
+
+// ----------------------------------------------------------------------------
+// Status
+// ----------------------------------------------------------------------------
+
+// Parts of the render graph the performance counters time separately
+enum class PerfStage : uint8_t {
+    DeckRender = 0,  // Every deck, stretch and EQ included
+    Stretch = 1,
+    EQ = 2,
+    Mix = 3,
+    Sync = 4
+};
+static const int PERF_STAGE_COUNT = 5;
+
+// Callback durations are binned in eighths of the deadline; the last
+// bucket takes everything slower
+static const int PERF_HISTOGRAM_BUCKETS = 16;
+
+// Device status flags, as PortAudio's PaStreamCallbackFlags
+static const unsigned PERF_INPUT_UNDERFLOW = 0x1;
+static const unsigned PERF_INPUT_OVERFLOW = 0x2;
+static const unsigned PERF_OUTPUT_UNDERFLOW = 0x4;
+static const unsigned PERF_OUTPUT_OVERFLOW = 0x8;
+
+// Timing and xrun counters, in two halves with a writer each: the render
+// thread's block and stage times, and the device callback's own figures.
+// Without a pipeline both are the callback thread; with one they run side
+// by side. Each half goes out under a sequence lock of its own, like the
+// status block's, so readers never hold either writer up.
+class PerfCounters {
+public:
+    PerfCounters(int sample_rate);
+    ~PerfCounters();
+    
+    // Render thread, while rendering a block
+    void addStage(PerfStage stage, int64_t ns) { block_stages_[static_cast<int>(stage)] += ns; }
+    void addDeck(int deck, const DeckTimings& timings);
+    void endBlock();  // Folds the block's stage times in and publishes
+    
+    // Audio callback, once its block is rendered or pulled: when it started
+    // (nowNanoseconds) and how long it took, the device's status flags and
+    // estimates, and how far ahead of the DAC the buffer went (0 = unknown)
+    void endCallback(int frames, int64_t start_ns, int64_t elapsed_ns, unsigned flags, double cpu_load,
+                     double output_latency_seconds);
+    void restartClock();  // No stream running: the next callback has no predecessor
+    
+    // Render thread. The callback's half is cleared by the callback itself,
+    // at its next call; until then read() reports it as zero.
+    void reset();
+    
+    // Any thread: the callback's latest figures, for the status block
+    double getCpuLoad() const { return cpu_load_.load(std::memory_order_relaxed); }
+    double getCallbackLoad() const { return callback_load_.load(std::memory_order_relaxed); }
+    uint64_t getXruns() const { return xruns_.load(std::memory_order_relaxed); }
+    uint64_t getDeadlineMisses() const { return deadline_misses_.load(std::memory_order_relaxed); }
+    
+    // Any thread
+    void read(engine_perf_t* perf) const;
+    void addDroppedCommand() { dropped_commands_.fetch_add(1, std::memory_order_relaxed); }
+    
+private:
+    struct RenderTotals {
+        uint64_t blocks;
+        int64_t stage_sum_ns[PERF_STAGE_COUNT];
+        int64_t stage_max_ns[PERF_STAGE_COUNT];
+        int64_t deck_sum_ns[MAX_DECKS];
+        int64_t deck_max_ns[MAX_DECKS];
+    };
+    
+    struct CallbackTotals {
+        uint64_t callbacks;
+        uint64_t xruns[4];  // Input underflow, input overflow, output underflow, output overflow
+        uint64_t deadline_misses;
+        double deadline_ns;
+        int64_t last_callback_ns;
+        int64_t callback_sum_ns;
+        int64_t callback_max_ns;
+        double max_lateness_ns;
+        double cpu_load;
+        double output_latency_ns;
+        uint64_t histogram[PERF_HISTOGRAM_BUCKETS];
+    };
+    
+    // A copy of one half for readers. write() only from that half's writer.
+    template <typename T>
+    class Published {
+    public:
+        Published() : sequence_(0), value_() {}
+        void write(const T& value);
+        void read(T* value) const;
+        
+    private:
+        std::atomic<uint32_t> sequence_;  // Odd while write() is copying
+        T value_;
+    };
+    
+    void resetCallbackTotals();
+    
+    int sample_rate_;
+    
+    // Render thread's half
+    RenderTotals render_;
+    int64_t block_stages_[PERF_STAGE_COUNT];  // The block being rendered
+    int64_t block_decks_[MAX_DECKS];
+    Published<RenderTotals> published_render_;
+    
+    // Callback's half
+    CallbackTotals callback_;
+    int64_t expected_start_;  // When the next callback should start, in ns; < 0 for unknown
+    Published<CallbackTotals> published_callback_;
+    std::atomic<bool> callback_reset_;  // reset() asked; the callback clears its half
+    std::atomic<double> cpu_load_;
+    std::atomic<double> callback_load_;  // Last callback's share of its deadline
+    std::atomic<uint64_t> xruns_;
+    std::atomic<uint64_t> deadline_misses_;
+    
+    std::atomic<uint64_t> dropped_commands_;  // Never reached the callback
+};
+
+// Engine status for the UI, rewritten by the audio callback after every
+// block under a sequence lock: the callback never waits, and readers retry
+// in the rare case they overlap a write.
+class StatusBlock {
+public:
+    StatusBlock(int sample_rate);
+    ~StatusBlock();
+    
+    // Render thread, after the mix; output is the finished block
+    void publish(Deck* const* decks, int count, float crossfader, const PerfCounters& perf,
+                 const float* output, int frames);
+    
+    // Any thread
+    void read(engine_status_t* status) const;
+    
+private:
+    std::atomic<uint32_t> sequence_;  // Odd while publish() is writing
+    std::unique_ptr<engine_status_t> status_;
+    int sample_rate_;
+};
+
+// Runs the position and track-ended callbacks on a thread of its own, from
+// what the status block shows, so managed code never runs on the audio
+// thread. Idle until a callback is set.
+class StatusNotifier {
+public:
+    typedef void (*PositionCallback)(int deck_id, double position);
+    typedef void (*TrackEndedCallback)(int deck_id);
+    
+    StatusNotifier(const StatusBlock& status);
+    ~StatusNotifier();
+    
+    void setPositionCallback(PositionCallback callback);
+    void setTrackEndedCallback(TrackEndedCallback callback);
+    
+private:
+    void threadMain();
+    
+    const StatusBlock& status_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_;
+    PositionCallback position_callback_;
+    TrackEndedCallback track_ended_callback_;
 };
 
 // Global engine state - shared across all source files
 struct EngineState {
-    std::unique_ptr<Deck> decks[2];
+    // Declared first so they outlive the tracks that write into them
+    std::unique_ptr<PcmCache> pcm_cache;
+    std::unique_ptr<AnalysisDatabase> analysis_db;
+    std::unique_ptr<TrackCache> track_cache;  // Outlives the analysis queue's preloads
+    
+    std::vector<std::unique_ptr<Deck>> decks;  // Fixed at engine_init
     std::unique_ptr<Mixer> mixer;
     std::unique_ptr<SyncManager> sync_manager;
+    std::unique_ptr<AnalysisQueue> analysis_queue;
+    std::unique_ptr<CuePrimer> cue_primer;  // Reaches into the decks, so is torn down before them
     
     void* stream;  // PaStream*, using void* to avoid PortAudio include in header
     int sample_rate;
     int buffer_size;
+    int output_channels;  // Of the open stream: 2, or 4 with the cue bus
+    
+    // The notifier reads the status block, so it goes first on shutdown
+    std::unique_ptr<StatusBlock> status;
+    std::unique_ptr<StatusNotifier> status_notifier;
+    std::unique_ptr<PerfCounters> perf;
+    
+    // Render scratch, reserved in engine_init for max_block_frames. Larger
+    // host blocks are rendered in max_block_frames pieces.
+    RenderArena arena;
+    int max_block_frames;
+    std::vector<float> device_master;  // A four-channel device's two buses,
+    std::vector<float> device_cue;     // max_block_frames each, interleaved after
+    
+    // Null renders every deck on the callback thread
+    std::unique_ptr<RenderPool> render_pool;
+    
+    // Pipeline mode, while a stream with render_ahead_blocks > 0 is open.
+    // Null renders in the callback.
+    std::unique_ptr<RenderAhead> render_ahead;
+    int render_ahead_blocks;
+    LiveControls live_controls;
+    ControlChanges applied_controls;  // Render thread, like the mixer
     
-    void* position_callback;  // Callbacks stored as void*
-    void* track_ended_callback;
+    LoadOptions load_options;
     
-    int callback_counter;
+    // API threads -> render thread. The mutex only orders producers (and
+    // engine start/stop against them); the callback never takes it.
+    std::unique_ptr<CommandQueue> commands;
+    std::mutex command_mutex;
+    
+    // Render thread, like the command targets. stream_frame counts every
+    // frame rendered since engine_init and is the clock scheduled commands
+    // run on.
+    std::unique_ptr<EventScheduler> scheduler;
+    std::unique_ptr<Automation> automation;
+    std::atomic<int64_t> stream_frame;
 };
 
 extern EngineState* g_engine;
 
+// One block of the whole graph: queued and scheduled commands, sync,
+// automation, the mix and the status block, with the cue bus into
+// cue_output unless it's null, and the decks' stems (Mixer::mix) into
+// stems unless that is. The audio callback, RenderAhead's thread, or the
+// offline renderer while no stream runs. In audio_engine.cpp.
+void renderEngineBlock(EngineState* engine, float* output, int frames, float* cue_output = nullptr,
+                       float* const* stems = nullptr);
+
+// The same for the device, in its channel layout: the stereo master, or
+// with output_channels 4 the master on 1/2 and the cue bus on 3/4
+void renderDeviceBlock(EngineState* engine, float* output, int frames);
+void drainCommands(EngineState* engine);  // Applies everything queued
+
+// The output device: PortAudio in audio_device.cpp, or nothing at all in
+// audio_device_null.cpp for builds that only render offline (the bench)
+bool initializeAudioDevice();
+void terminateAudioDevice();
+
+inline bool isValidDeck(int deck_id) {
+    return g_engine && deck_id >= 0 && deck_id < static_cast<int>(g_engine->decks.size());
+}
+
 } // namespace dj
 
 #endif // DJ_AUDIO_INTERNAL_H
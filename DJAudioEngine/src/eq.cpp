@@ -0,0 +1,292 @@
+#include "dj_audio_internal.h"
+#include "simd.h"
+#include <cmath>
+#include <cstring>
+
+namespace dj {
+
+// Crossover points, close to what hardware DJ isolators use
+static const double EQ_LOW_CROSSOVER_HZ = 250.0;
+static const double EQ_HIGH_CROSSOVER_HZ = 2500.0;
+
+// Time constant of the gain glide
+static const double EQ_SMOOTHING_MS = 10.0;
+
+// Closer than this to the target and the glide snaps to it
+static const float EQ_GAIN_EPSILON = 1e-4f;
+
+// How the bands are assembled. With LR4 crossovers, LP4 + HP4 at a
+// frequency is the second-order allpass AP2 at that frequency, so
+//
+//   low  = LP4(x, f1)            rest = HP4(x, f1)
+//   mid  = LP4(rest, f2)         high = AP2(rest, f2) - mid
+//
+// and the output gL*AP2(low, f2) + gM*mid + gH*high, which keeps the low
+// band phase-aligned with the other two, collapses to
+//
+//   AP2(gL*low + gH*rest, f2) + (gM - gH) * mid
+//
+// Stage A computes (low | rest) for both channels in one vector, stage B
+// (mid | allpass). Four vector biquads per stereo frame for the whole EQ.
+
+struct BiquadCoefficients {
+    double b0, b1, b2, a1, a2;
+};
+
+enum class BiquadType { LowPass, HighPass, AllPass, Identity };
+
+// RBJ cookbook forms, normalized by a0
+static BiquadCoefficients designBiquad(BiquadType type, double frequency, int sample_rate) {
+    if (type == BiquadType::Identity) {
+        return { 1.0, 0.0, 0.0, 0.0, 0.0 };
+    }
+
+    const double q = 0.70710678118654752;  // Butterworth; two in series make LR4
+    double w0 = 2.0 * M_PI * frequency / sample_rate;
+    double cosw = std::cos(w0);
+    double alpha = std::sin(w0) / (2.0 * q);
+    double a0 = 1.0 + alpha;
+
+    BiquadCoefficients c;
+    switch (type) {
+        case BiquadType::LowPass:
+            c.b0 = (1.0 - cosw) / 2.0;
+            c.b1 = 1.0 - cosw;
+            c.b2 = (1.0 - cosw) / 2.0;
+            break;
+        case BiquadType::HighPass:
+            c.b0 = (1.0 + cosw) / 2.0;
+            c.b1 = -(1.0 + cosw);
+            c.b2 = (1.0 + cosw) / 2.0;
+            break;
+        default:  // AllPass
+            c.b0 = 1.0 - alpha;
+            c.b1 = -2.0 * cosw;
+            c.b2 = 1.0 + alpha;
+            break;
+    }
+    c.b0 /= a0;
+    c.b1 /= a0;
+    c.b2 /= a0;
+    c.a1 = -2.0 * cosw / a0;
+    c.a2 = (1.0 - alpha) / a0;
+    return c;
+}
+
+ThreeBandEQ::ThreeBandEQ(int sample_rate)
+    : smoothing_frames_(EQ_SMOOTHING_MS * 0.001 * sample_rate)
+    , active_(false)
+{
+    // Per section: the filter in lanes 0-1 and the one in lanes 2-3
+    const struct {
+        BiquadType low_lanes, high_lanes;
+        double frequency;
+    } layout[SECTIONS] = {
+        { BiquadType::LowPass, BiquadType::HighPass, EQ_LOW_CROSSOVER_HZ },
+        { BiquadType::LowPass, BiquadType::HighPass, EQ_LOW_CROSSOVER_HZ },
+        { BiquadType::LowPass, BiquadType::AllPass,  EQ_HIGH_CROSSOVER_HZ },
+        { BiquadType::LowPass, BiquadType::Identity, EQ_HIGH_CROSSOVER_HZ },
+    };
+
+    for (int s = 0; s < SECTIONS; s++) {
+        BiquadCoefficients pair[2] = {
+            designBiquad(layout[s].low_lanes, layout[s].frequency, sample_rate),
+            designBiquad(layout[s].high_lanes, layout[s].frequency, sample_rate),
+        };
+        for (int lane = 0; lane < 4; lane++) {
+            const BiquadCoefficients& c = pair[lane / 2];
+            sections_[s].b0[lane] = static_cast<float>(c.b0);
+            sections_[s].b1[lane] = static_cast<float>(c.b1);
+            sections_[s].b2[lane] = static_cast<float>(c.b2);
+            sections_[s].a1[lane] = static_cast<float>(c.a1);
+            sections_[s].a2[lane] = static_cast<float>(c.a2);
+        }
+    }
+
+    for (int band = 0; band < 3; band++) {
+        target_[band] = 1.0f;
+        current_[band] = 1.0f;
+    }
+    reset();
+}
+
+void ThreeBandEQ::setGains(float low, float mid, float high) {
+    target_[0] = low;
+    target_[1] = mid;
+    target_[2] = high;
+}
+
+void ThreeBandEQ::reset() {
+    memset(z1_, 0, sizeof(z1_));
+    memset(z2_, 0, sizeof(z2_));
+}
+
+namespace {
+
+struct SectionRegs {
+    vec4 b0, b1, b2, a1, a2;
+};
+
+inline vec4 runSection(const SectionRegs& c, vec4& z1, vec4& z2, vec4 x) {
+    vec4 y = vmadd(c.b0, x, z1);
+    z1 = vsub(vmadd(c.b1, x, z2), vmul(c.a1, y));
+    z2 = vsub(vmul(c.b2, x), vmul(c.a2, y));
+    return y;
+}
+
+// Per-frame gain vectors and their increments across the block
+struct GainRamp {
+    vec4 stage_a;      // (0, 0, gH, gH): rest stays as is, rest * gH feeds the allpass
+    vec4 stage_a_swap; // (1, 1, gL, gL): rest for the mid filter, low * gL for the allpass
+    vec4 stage_b;      // (gM - gH, gM - gH, 1, 1)
+};
+
+} // namespace
+
+// Crossfade blends the filtered signal with the dry one scaled by the mid
+// gain, for switching the filters in and out without a step
+template <bool Crossfade>
+static void runEQKernel(float* buffer, int frames, SectionRegs (&c)[4], vec4 (&z1)[4], vec4 (&z2)[4],
+                        GainRamp gains, const GainRamp& step,
+                        float wet, float wet_step, float dry_gain, float dry_step) {
+    for (int i = 0; i < frames; i++) {
+        float* frame = buffer + i * 2;
+        vec4 x = vloadframe2(frame);
+
+        vec4 a = runSection(c[0], z1[0], z2[0], x);
+        a = runSection(c[1], z1[1], z2[1], a);
+
+        vec4 b = vmadd(a, gains.stage_a, vmul(vswaphalves(a), gains.stage_a_swap));
+        b = runSection(c[2], z1[2], z2[2], b);
+        b = runSection(c[3], z1[3], z2[3], b);
+
+        vec4 t = vmul(b, gains.stage_b);
+        vec4 y = vadd(t, vswaphalves(t));
+
+        if (Crossfade) {
+            y = vmadd(y, vset1(wet), vmul(x, vset1(dry_gain * (1.0f - wet))));
+            wet += wet_step;
+            dry_gain += dry_step;
+        }
+
+        vstoreframe(frame, y);
+
+        gains.stage_a = vadd(gains.stage_a, step.stage_a);
+        gains.stage_a_swap = vadd(gains.stage_a_swap, step.stage_a_swap);
+        gains.stage_b = vadd(gains.stage_b, step.stage_b);
+    }
+}
+
+static GainRamp makeGainVectors(const float* g) {
+    GainRamp r;
+    r.stage_a = vset(0.0f, 0.0f, g[2], g[2]);
+    r.stage_a_swap = vset(1.0f, 1.0f, g[0], g[0]);
+    r.stage_b = vset(g[1] - g[2], g[1] - g[2], 1.0f, 1.0f);
+    return r;
+}
+
+static bool gainsMatch(const float* g) {
+    return g[0] == g[1] && g[1] == g[2];
+}
+
+// One-pole glide evaluated once per block, linear inside it
+void ThreeBandEQ::advanceGains(int frames, float* start, float* end) {
+    double decay = std::exp(-frames / smoothing_frames_);
+    for (int band = 0; band < 3; band++) {
+        start[band] = current_[band];
+        end[band] = static_cast<float>(target_[band] + (current_[band] - target_[band]) * decay);
+        if (std::abs(end[band] - target_[band]) < EQ_GAIN_EPSILON) {
+            end[band] = target_[band];
+        }
+        current_[band] = end[band];
+    }
+}
+
+bool ThreeBandEQ::isFlat() const {
+    // Matching current and target gains stay matched through the glide
+    return !active_ && gainsMatch(current_) && gainsMatch(target_);
+}
+
+bool ThreeBandEQ::takeFlatGain(int frames, float* gain_start, float* gain_end) {
+    if (!isFlat()) return false;
+
+    float start[3];
+    float end[3];
+    advanceGains(frames, start, end);
+    *gain_start = start[1];
+    *gain_end = end[1];
+    return true;
+}
+
+void ThreeBandEQ::process(float* buffer, int frames) {
+    if (frames <= 0) return;
+
+    float gain = 1.0f;
+    float gain_end = 1.0f;
+    if (takeFlatGain(frames, &gain, &gain_end)) {
+        // Fast path: all bands equal is just a gain
+        float gain_step = (gain_end - gain) / frames;
+        if (gain == 1.0f && gain_step == 0.0f) return;
+        for (int i = 0; i < frames; i++) {
+            buffer[i * 2] *= gain;
+            buffer[i * 2 + 1] *= gain;
+            gain += gain_step;
+        }
+        return;
+    }
+
+    float start[3];
+    float end[3];
+    advanceGains(frames, start, end);
+    bool flat = gainsMatch(start) && gainsMatch(end);
+    float inv_frames = 1.0f / frames;
+
+    // Fade the filters in from silence state, or out once the gains have
+    // settled flat, across this block
+    float wet_start = 1.0f;
+    float wet_end = 1.0f;
+    if (!active_) {
+        reset();
+        active_ = true;
+        wet_start = 0.0f;
+    } else if (flat && start[1] == end[1]) {
+        active_ = false;
+        wet_end = 0.0f;
+    }
+
+    SectionRegs c[SECTIONS];
+    vec4 z1[SECTIONS];
+    vec4 z2[SECTIONS];
+    for (int s = 0; s < SECTIONS; s++) {
+        c[s].b0 = vload(sections_[s].b0);
+        c[s].b1 = vload(sections_[s].b1);
+        c[s].b2 = vload(sections_[s].b2);
+        c[s].a1 = vload(sections_[s].a1);
+        c[s].a2 = vload(sections_[s].a2);
+        z1[s] = vload(z1_[s]);
+        z2[s] = vload(z2_[s]);
+    }
+
+    GainRamp gains = makeGainVectors(start);
+    GainRamp goal = makeGainVectors(end);
+    vec4 scale = vset1(inv_frames);
+    GainRamp step;
+    step.stage_a = vmul(vsub(goal.stage_a, gains.stage_a), scale);
+    step.stage_a_swap = vmul(vsub(goal.stage_a_swap, gains.stage_a_swap), scale);
+    step.stage_b = vmul(vsub(goal.stage_b, gains.stage_b), scale);
+
+    if (wet_start == 1.0f && wet_end == 1.0f) {
+        runEQKernel<false>(buffer, frames, c, z1, z2, gains, step, 1.0f, 0.0f, 0.0f, 0.0f);
+    } else {
+        runEQKernel<true>(buffer, frames, c, z1, z2, gains, step,
+                          wet_start, (wet_end - wet_start) * inv_frames,
+                          start[1], (end[1] - start[1]) * inv_frames);
+    }
+
+    for (int s = 0; s < SECTIONS; s++) {
+        vstore(z1_[s], z1[s]);
+        vstore(z2_[s], z2[s]);
+    }
+}
+
+} // namespace dj
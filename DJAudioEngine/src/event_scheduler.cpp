@@ -0,0 +1,98 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cmath>
+
+namespace dj {
+
+// A deck this close before a boundary counts as past it, so a command
+// issued right on a beat waits for the next one rather than firing now
+static const double QUANTIZE_EPSILON_BEATS = 1e-6;
+
+// Fraction of a frame a beat may fall past a frame and still land on it
+static const double FRAME_SLACK = 1e-6;
+
+EventScheduler::EventScheduler(size_t capacity, int sample_rate)
+    : capacity_(capacity)
+    , sample_rate_(sample_rate)
+    , reserved_(0)
+{
+    events_.reserve(capacity_);
+}
+
+bool EventScheduler::reserve() {
+    size_t reserved = reserved_.load();
+    do {
+        if (reserved >= capacity_) return false;
+    } while (!reserved_.compare_exchange_weak(reserved, reserved + 1));
+    return true;
+}
+
+bool EventScheduler::add(const Command& command, const Deck* quantize_deck) {
+    if (events_.size() >= capacity_) {
+        release();
+        return false;
+    }
+
+    Event event;
+    event.command = command;
+    event.target_beat = 0.0;
+    if (command.due_frame < 0 && quantize_deck) {
+        double quantum = std::max(1, command.quantize_beats);
+        double beat = quantize_deck->getBeatNumber();
+        event.target_beat = (std::floor(beat / quantum + QUANTIZE_EPSILON_BEATS) + 1.0) * quantum;
+    }
+    events_.push_back(event);
+    return true;
+}
+
+void EventScheduler::cancel(int deck_id) {
+    auto kept = std::remove_if(events_.begin(), events_.end(), [deck_id](const Event& event) {
+        return deck_id < 0 || event.command.deck == deck_id;
+    });
+    reserved_.fetch_sub(static_cast<size_t>(events_.end() - kept));
+    events_.erase(kept, events_.end());
+}
+
+int64_t EventScheduler::framesUntil(const Event& event, Deck* const* decks, int count, int64_t stream_frame) const {
+    const Command& command = event.command;
+    if (command.due_frame >= 0) {
+        return std::max<int64_t>(0, command.due_frame - stream_frame);
+    }
+
+    // A deck that isn't moving never reaches the beat, so the command
+    // goes ahead at once - quantizing to a stopped deck is just playing
+    int id = command.quantize_deck;
+    const Deck* deck = (id >= 0 && id < count) ? decks[id] : nullptr;
+    if (!deck || !deck->isPlaying() || deck->getTempo() <= 0.0) return 0;
+    if (!deck->getBeatGrid() && deck->getBPM() <= 0.0) return 0;
+
+    // Output frames to the beat: source frames to go, heard at tempo. The
+    // slack keeps rounding in the seconds-to-frames trip from adding one.
+    double remaining = (deck->getBeatTime(event.target_beat) - deck->getPosition()) * sample_rate_ / deck->getTempo();
+    if (remaining <= FRAME_SLACK) return 0;
+    return static_cast<int64_t>(std::ceil(remaining - FRAME_SLACK));
+}
+
+int EventScheduler::framesUntilNext(Deck* const* decks, int count, int64_t stream_frame, int frames) const {
+    int64_t next = frames;
+    for (const Event& event : events_) {
+        next = std::min(next, framesUntil(event, decks, count, stream_frame));
+    }
+    return static_cast<int>(std::max<int64_t>(1, next));
+}
+
+bool EventScheduler::popDue(Deck* const* decks, int count, int64_t stream_frame, Command* command) {
+    for (auto it = events_.begin(); it != events_.end(); ++it) {
+        if (framesUntil(*it, decks, count, stream_frame) > 0) continue;
+
+        *command = it->command;
+        command->due_frame = -1;
+        command->quantize_deck = -1;
+        events_.erase(it);
+        release();
+        return true;
+    }
+    return false;
+}
+
+} // namespace dj
@@ -0,0 +1,291 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+namespace dj {
+
+// Records in flight between producers and the writer thread
+static const size_t LOG_QUEUE_CAPACITY = 2048;
+
+// How often the writer wakes up to drain the ring
+static const int LOG_WRITER_INTERVAL_MS = 20;
+
+// Log file until engine_set_log_file names one, in the temp folder
+static const char* DEFAULT_LOG_NAME = "cpp_debug.log";
+
+static std::string defaultLogPath() {
+    std::error_code ec;
+    std::filesystem::path folder = std::filesystem::temp_directory_path(ec);
+    return ec ? std::string(DEFAULT_LOG_NAME) : (folder / DEFAULT_LOG_NAME).string();
+}
+
+int64_t nowNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const char* levelName(LogLevel level) {
+    switch (level) {
+        case LogLevel::Debug:   return "DEBUG";
+        case LogLevel::Info:    return "INFO";
+        case LogLevel::Warning: return "WARN";
+        case LogLevel::Error:   return "ERROR";
+        case LogLevel::Off:     break;
+    }
+    return "?";
+}
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : cells_(new Cell[LOG_QUEUE_CAPACITY])
+    , mask_(LOG_QUEUE_CAPACITY - 1)
+    , enqueue_pos_(0)
+    , dequeue_pos_(0)
+    , level_(static_cast<int>(LogLevel::Info))
+    , dropped_(0)
+    , writer_running_(false)
+    , path_(defaultLogPath())
+    , epoch_ns_(nowNanoseconds())
+{
+    static_assert((LOG_QUEUE_CAPACITY & (LOG_QUEUE_CAPACITY - 1)) == 0, "capacity must be a power of two");
+    for (size_t i = 0; i < LOG_QUEUE_CAPACITY; i++) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+Logger::~Logger() {
+    stop();
+}
+
+void Logger::start(const char* path) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    if (writer_running_) return;
+
+    if (path && *path) path_ = path;
+    writer_running_ = true;
+    writer_thread_ = std::thread(&Logger::writerMain, this);
+}
+
+void Logger::stop() {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    if (!writer_running_) return;
+
+    writer_running_ = false;
+    if (writer_thread_.joinable()) {
+        writer_thread_.join();
+    }
+}
+
+void Logger::begin(LogRecord* record, LogLevel level, const char* format) {
+    record->level = level;
+    record->time_ns = nowNanoseconds();
+    record->format = format;
+    record->arg_count = 0;
+    record->text_used = 0;
+}
+
+LogRecord::Arg* Logger::addArg(LogRecord* record, LogRecord::ArgType type) {
+    LogRecord::Arg* arg = &record->args[record->arg_count++];
+    arg->type = type;
+    return arg;
+}
+
+void Logger::pack(LogRecord* record, const char* value) {
+    LogRecord::Arg* arg = addArg(record, LogRecord::ArgType::String);
+    arg->text_offset = record->text_used;
+
+    // Copied, since the caller's string may be gone by the time it's written.
+    // Truncated to whatever room is left in the record.
+    if (!value) value = "(null)";
+    size_t room = LogRecord::TEXT_BYTES - record->text_used;
+    size_t length = 0;
+    while (value[length] && length + 1 < room) {
+        record->text[record->text_used + length] = value[length];
+        length++;
+    }
+    if (room == 0) {
+        arg->text_offset = LogRecord::TEXT_BYTES - 1;  // Previous string's terminator
+        return;
+    }
+    record->text[record->text_used + length] = '\0';
+    record->text_used += static_cast<uint32_t>(length + 1);
+}
+
+void Logger::push(const LogRecord& record) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell* cell = &cells_[pos & mask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+        if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell->record = record;
+                cell->sequence.store(pos + 1, std::memory_order_release);
+                return;
+            }
+        } else if (diff < 0) {
+            // Full - never make the caller wait
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Logger::pop(LogRecord* record) {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell* cell = &cells_[pos & mask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+
+        if (diff == 0) {
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                *record = cell->record;
+                cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;  // Empty
+        } else {
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Formats a record on the writer thread. Each conversion is handed to
+// snprintf on its own with the length modifier rewritten to match how the
+// argument was captured, so %d, %ld and %lld all work for any integer.
+static void formatRecord(const LogRecord& record, char* out, size_t out_size) {
+    size_t used = 0;
+    int next_arg = 0;
+    const char* f = record.format;
+
+    auto append = [&](const char* text, size_t length) {
+        length = std::min(length, out_size - 1 - used);
+        memcpy(out + used, text, length);
+        used += length;
+    };
+
+    while (*f && used + 1 < out_size) {
+        if (*f != '%') {
+            const char* literal = f;
+            while (*f && *f != '%') f++;
+            append(literal, f - literal);
+            continue;
+        }
+
+        if (f[1] == '%') {
+            append("%", 1);
+            f += 2;
+            continue;
+        }
+
+        // Flags, width and precision are kept; length modifiers are dropped
+        char spec[32];
+        size_t spec_length = 0;
+        spec[spec_length++] = *f++;
+        while (*f && strchr("-+ #0123456789.", *f) && spec_length < sizeof(spec) - 4) {
+            spec[spec_length++] = *f++;
+        }
+        while (*f && strchr("hlLqjzt", *f)) f++;
+        char conversion = *f ? *f++ : 's';
+
+        if (next_arg >= record.arg_count) {
+            append("<?>", 3);
+            continue;
+        }
+        const LogRecord::Arg& arg = record.args[next_arg++];
+
+        char piece[128];
+        int written = 0;
+        if (strchr("diouxXc", conversion)) {
+            if (conversion != 'c') {
+                spec[spec_length++] = 'l';
+                spec[spec_length++] = 'l';
+            }
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            long long value = (arg.type == LogRecord::ArgType::Double) ? static_cast<long long>(arg.d)
+                            : static_cast<long long>(arg.i);
+            written = (conversion == 'c') ? snprintf(piece, sizeof(piece), spec, static_cast<int>(value))
+                                          : snprintf(piece, sizeof(piece), spec, value);
+        } else if (strchr("eEfFgGaA", conversion)) {
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            double value = (arg.type == LogRecord::ArgType::Double) ? arg.d
+                         : (arg.type == LogRecord::ArgType::UInt) ? static_cast<double>(arg.u)
+                         : static_cast<double>(arg.i);
+            written = snprintf(piece, sizeof(piece), spec, value);
+        } else if (conversion == 's') {
+            spec[spec_length++] = 's';
+            spec[spec_length] = '\0';
+            const char* value = (arg.type == LogRecord::ArgType::String) ? record.text + arg.text_offset : "<?>";
+            written = snprintf(piece, sizeof(piece), spec, value);
+        } else if (conversion == 'p') {
+            spec[spec_length++] = 'p';
+            spec[spec_length] = '\0';
+            written = snprintf(piece, sizeof(piece), spec, const_cast<void*>(arg.p));
+        } else {
+            written = snprintf(piece, sizeof(piece), "<%%%c?>", conversion);
+        }
+
+        if (written > 0) {
+            append(piece, std::min<size_t>(written, sizeof(piece) - 1));
+        }
+    }
+
+    out[used] = '\0';
+}
+
+void Logger::writerMain() {
+    uint64_t reported_drops = 0;
+    LogRecord record;
+    char line[1024];
+
+    for (;;) {
+        bool running = writer_running_.load();
+
+        // Opened per batch so the file can be read or deleted while running
+        FILE* file = nullptr;
+        bool open_failed = false;
+        while (pop(&record)) {
+            if (!file && !open_failed) {
+                file = fopen(path_.c_str(), "a");
+                open_failed = !file;
+            }
+            if (!file) continue;  // Keep draining so producers never see a full ring
+            
+            formatRecord(record, line, sizeof(line));
+            double seconds = (record.time_ns - epoch_ns_) / 1e9;
+            fprintf(file, "[%10.4f] %-5s %s\n", seconds, levelName(record.level), line);
+        }
+
+        uint64_t drops = dropped_.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            if (!file && !open_failed) file = fopen(path_.c_str(), "a");
+            if (file) {
+                fprintf(file, "[logger] %llu records dropped (ring full)\n",
+                        static_cast<unsigned long long>(drops - reported_drops));
+            }
+            reported_drops = drops;
+        }
+
+        if (file) fclose(file);
+        if (!running) break;  // Final drain done
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOG_WRITER_INTERVAL_MS));
+    }
+}
+
+} // namespace dj
@@ -0,0 +1,155 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace dj {
+
+// Gating block length in 100 ms steps, and the block gates
+static const int LOUDNESS_BLOCK_STEPS = 4;
+static const double LOUDNESS_ABSOLUTE_GATE_LUFS = -70.0;
+static const double LOUDNESS_RELATIVE_GATE_LU = -10.0;
+
+// Offset in the BS.1770 loudness of a mean square
+static const double LOUDNESS_OFFSET_DB = -0.691;
+
+// Interpolation filter length per phase for the true peak, as in the
+// BS.1770-4 example filter (48 taps at 4x)
+static const int TRUE_PEAK_TAPS = 12;
+
+// Reported for a track of digital silence
+static const double TRUE_PEAK_FLOOR_DB = -100.0;
+
+static double blockLoudness(double mean_square) {
+    return LOUDNESS_OFFSET_DB + 10.0 * std::log10(mean_square);
+}
+
+LoudnessMeter::LoudnessMeter(int sample_rate)
+    : step_frames_(std::max(1, static_cast<int>(std::lround(sample_rate * 0.1))))
+    , step_count_(0)
+    , step_energy_(0.0)
+    , steps_done_(0)
+    , oversample_(sample_rate < 96000 ? 4 : (sample_rate < 192000 ? 2 : 1))
+    , taps_(oversample_ > 1 ? TRUE_PEAK_TAPS : 1)
+    , history_pos_(0)
+    , peak_(0.0f)
+{
+    // K-weighting for any rate, by the bilinear transform of the analog
+    // prototypes behind the 48 kHz coefficients in BS.1770
+    const double pi = 3.14159265358979323846;
+    double fs = static_cast<double>(std::max(1, sample_rate));
+
+    double k = std::tan(pi * 1681.974450955533 / fs);
+    double q = 0.7071752369554196;
+    double vh = std::pow(10.0, 3.999843853973347 / 20.0);
+    double vb = std::pow(vh, 0.4996667741545416);
+    double a0 = 1.0 + k / q + k * k;
+    shelf_ = { (vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+               2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+
+    k = std::tan(pi * 38.13547087602444 / fs);
+    q = 0.5003270373238773;
+    a0 = 1.0 + k / q + k * k;
+    highpass_ = { 1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0 };
+
+    std::fill(&state_[0][0], &state_[0][0] + 8, 0.0);
+    std::fill(steps_, steps_ + LOUDNESS_BLOCK_STEPS, 0.0);
+
+    // Hann-windowed sinc, split into one unity-gain filter per phase
+    int length = oversample_ * taps_;
+    std::vector<double> prototype(static_cast<size_t>(length));
+    for (int n = 0; n < length; n++) {
+        double x = (n - (length - 1) / 2.0) / oversample_;
+        double sinc = std::fabs(x) < 1e-12 ? 1.0 : std::sin(pi * x) / (pi * x);
+        prototype[n] = sinc * (0.5 - 0.5 * std::cos(2.0 * pi * (n + 1) / (length + 1)));
+    }
+    phases_.resize(static_cast<size_t>(length));
+    for (int p = 0; p < oversample_; p++) {
+        double sum = 0.0;
+        for (int t = 0; t < taps_; t++) sum += prototype[t * oversample_ + p];
+        for (int t = 0; t < taps_; t++) {
+            phases_[p * taps_ + t] = static_cast<float>(prototype[t * oversample_ + p] / sum);
+        }
+    }
+    history_[0].assign(static_cast<size_t>(taps_) * 2, 0.0f);
+    history_[1].assign(static_cast<size_t>(taps_) * 2, 0.0f);
+}
+
+double LoudnessMeter::filter(int channel, double x) {
+    // Both stages in transposed direct form II
+    double* s = state_[channel];
+    double y = shelf_.b0 * x + s[0];
+    s[0] = shelf_.b1 * x - shelf_.a1 * y + s[1];
+    s[1] = shelf_.b2 * x - shelf_.a2 * y;
+
+    double z = highpass_.b0 * y + s[2];
+    s[2] = highpass_.b1 * y - highpass_.a1 * z + s[3];
+    s[3] = highpass_.b2 * y - highpass_.a2 * z;
+    return z;
+}
+
+void LoudnessMeter::measurePeaks(int channel, float x) {
+    // Newest first, so history[pos + t] is the sample t back
+    float* history = history_[channel].data() + history_pos_;
+    history[0] = x;
+    history[taps_] = x;
+
+    float peak = std::fabs(x);
+    for (int p = 0; p < oversample_; p++) {
+        const float* phase = phases_.data() + p * taps_;
+        float y = 0.0f;
+        for (int t = 0; t < taps_; t++) y += phase[t] * history[t];
+        peak = std::max(peak, std::fabs(y));
+    }
+    peak_ = std::max(peak_, peak);
+}
+
+void LoudnessMeter::process(const float* stereo, int64_t frames) {
+    for (int64_t i = 0; i < frames; i++) {
+        history_pos_ = (history_pos_ + taps_ - 1) % taps_;
+        measurePeaks(0, stereo[i * 2]);
+        measurePeaks(1, stereo[i * 2 + 1]);
+
+        double left = filter(0, stereo[i * 2]);
+        double right = filter(1, stereo[i * 2 + 1]);
+        step_energy_ += left * left + right * right;
+        if (++step_count_ < step_frames_) continue;
+
+        // Every step completes a block overlapping the last by three steps
+        steps_[steps_done_ % LOUDNESS_BLOCK_STEPS] = step_energy_;
+        steps_done_++;
+        step_count_ = 0;
+        step_energy_ = 0.0;
+        if (steps_done_ >= LOUDNESS_BLOCK_STEPS) {
+            double energy = std::accumulate(steps_, steps_ + LOUDNESS_BLOCK_STEPS, 0.0);
+            blocks_.push_back(energy / (static_cast<double>(step_frames_) * LOUDNESS_BLOCK_STEPS));
+        }
+    }
+}
+
+TrackLoudness LoudnessMeter::getLoudness() const {
+    auto gatedMean = [this](double gate_lufs) {
+        double sum = 0.0;
+        size_t count = 0;
+        for (double mean_square : blocks_) {
+            if (mean_square > 0.0 && blockLoudness(mean_square) > gate_lufs) {
+                sum += mean_square;
+                count++;
+            }
+        }
+        return count > 0 ? sum / count : 0.0;
+    };
+
+    TrackLoudness loudness;
+    loudness.integrated_lufs = LOUDNESS_SILENCE_LUFS;
+    loudness.true_peak_db = peak_ > 0.0f ? 20.0 * std::log10(peak_) : TRUE_PEAK_FLOOR_DB;
+
+    double ungated = gatedMean(LOUDNESS_ABSOLUTE_GATE_LUFS);
+    if (ungated <= 0.0) return loudness;
+
+    double gated = gatedMean(std::max(LOUDNESS_ABSOLUTE_GATE_LUFS, blockLoudness(ungated) + LOUDNESS_RELATIVE_GATE_LU));
+    if (gated > 0.0) loudness.integrated_lufs = blockLoudness(gated);
+    return loudness;
+}
+
+} // namespace dj
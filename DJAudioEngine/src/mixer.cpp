@@ -1,40 +1,317 @@
 #include "dj_audio_internal.h"
+#include "simd.h"
+#include <algorithm>
 #include <cstring>
 #include <cmath>
 
 namespace dj {
 
+// The soft clipper is unity up to the knee, then bends with a rational
+// tanh approximation that meets full scale with zero slope at
+// knee + 3 * (1 - knee). Smooth everywhere and never past 1.0.
+static const float SOFT_CLIP_KNEE = 0.9f;
+
 Mixer::Mixer()
     : crossfader_position_(0.5f)
+    , clipping_(false)
+    , mix_ns_(0)
+    , cue_mix_(0.0f)
+    , cue_volume_(1.0f)
+    , applied_cue_gain_(1.0f)
+    , applied_cue_master_gain_(0.0f)
 {
+    for (int i = 0; i < MAX_DECKS; i++) {
+        assign_[i] = (i % 2 == 0) ? CrossfaderSide::A : CrossfaderSide::B;
+        applied_fader_gain_[i] = 0.70710678f;  // Centre of the power curve
+        pfl_[i] = false;
+        applied_pfl_gain_[i] = 0.0f;
+    }
+}
+
+void Mixer::setAssign(int deck_id, CrossfaderSide side) {
+    if (deck_id < 0 || deck_id >= MAX_DECKS) return;
+    assign_[deck_id] = side;
+}
+
+void Mixer::setPFL(int deck_id, bool enabled) {
+    if (deck_id < 0 || deck_id >= MAX_DECKS) return;
+    pfl_[deck_id] = enabled;
+}
+
+static inline vec4 softClip(vec4 x) {
+    const vec4 knee = vset1(SOFT_CLIP_KNEE);
+    const vec4 range = vset1(1.0f - SOFT_CLIP_KNEE);
+    const vec4 twenty_seven = vset1(27.0f);
+
+    vec4 magnitude = vabs(x);
+    vec4 over = vmul(vmax(vsub(magnitude, knee), vset1(0.0f)), vset1(1.0f / (1.0f - SOFT_CLIP_KNEE)));
+    over = vmin(over, vset1(3.0f));
+    vec4 over2 = vmul(over, over);
+    vec4 shaped = vdiv(vmul(over, vadd(twenty_seven, over2)), vmadd(vset1(9.0f), over2, twenty_seven));
+    return vcopysign(vmadd(shaped, range, vmin(magnitude, knee)), x);
+}
+
+// The whole per-sample mix in one pass, two decks at a time: deck gains
+// (volume, flat EQ and crossfader, all ramped), the sum and, on the last
+// pair when the previous block ran hot, the soft clipper. Two stereo
+// frames per vector. Returns the peak before clipping so the caller can
+// tell whether the clipper is needed.
+template <bool HasB, bool Accumulate, bool Clip>
+static float mixKernel(float* output, const float* a, const float* b, int frames,
+                       float gain_a, float step_a, float gain_b, float step_b) {
+    vec4 ga = vset(gain_a, gain_a, gain_a + step_a, gain_a + step_a);
+    vec4 gb = vset(gain_b, gain_b, gain_b + step_b, gain_b + step_b);
+    vec4 ga_step = vset1(2.0f * step_a);
+    vec4 gb_step = vset1(2.0f * step_b);
+    vec4 peak = vset1(0.0f);
+
+    int i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        vec4 y = vmul(vload(a + i * 2), ga);
+        if (HasB) y = vmadd(vload(b + i * 2), gb, y);
+        if (Accumulate) y = vadd(y, vload(output + i * 2));
+
+        peak = vmax(peak, vabs(y));
+        if (Clip) y = softClip(y);
+        vstore(output + i * 2, y);
+
+        ga = vadd(ga, ga_step);
+        gb = vadd(gb, gb_step);
+    }
+
+    if (i < frames) {
+        // Odd last frame, through the same lanes
+        float tail_a[4] = { a[i * 2], a[i * 2 + 1], 0.0f, 0.0f };
+        float tail_b[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float tail_out[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        if (HasB) memcpy(tail_b, b + i * 2, 2 * sizeof(float));
+        if (Accumulate) memcpy(tail_out, output + i * 2, 2 * sizeof(float));
+
+        vec4 y = vadd(vmadd(vload(tail_b), gb, vmul(vload(tail_a), ga)), vload(tail_out));
+        peak = vmax(peak, vabs(y));
+        if (Clip) y = softClip(y);
+        vstoreframe(output + i * 2, y);
+    }
+
+    return vmaxlane(peak);
 }
 
-void Mixer::mix(Deck* deck_a, Deck* deck_b, float* output, int frames) {
-    // Read from both decks
-    std::vector<float> buffer_a(frames * 2);
-    std::vector<float> buffer_b(frames * 2);
+// Decks that need no mix work are dropped before this, so every source
+// here has a full block of samples
+struct MixSource {
+    const float* samples;
+    float gain;
+    float step;
+};
+
+template <bool Clip>
+static float mixPair(float* output, const MixSource& a, const MixSource* b, bool accumulate, int frames) {
+    if (b) {
+        return accumulate ? mixKernel<true, true, Clip>(output, a.samples, b->samples, frames, a.gain, a.step, b->gain, b->step)
+                          : mixKernel<true, false, Clip>(output, a.samples, b->samples, frames, a.gain, a.step, b->gain, b->step);
+    }
+    return accumulate ? mixKernel<false, true, Clip>(output, a.samples, nullptr, frames, a.gain, a.step, 0.0f, 0.0f)
+                      : mixKernel<false, false, Clip>(output, a.samples, nullptr, frames, a.gain, a.step, 0.0f, 0.0f);
+}
+
+static void softClipInPlace(float* buffer, int frames) {
+    int i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        vstore(buffer + i * 2, softClip(vload(buffer + i * 2)));
+    }
+    if (i < frames) {
+        float tail[4] = { buffer[i * 2], buffer[i * 2 + 1], 0.0f, 0.0f };
+        vstoreframe(buffer + i * 2, softClip(vload(tail)));
+    }
+}
+
+void measurePeaks(const float* stereo, int frames, float gain, float* left, float* right) {
+    vec4 peak = vset1(0.0f);
+    int i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        peak = vmax(peak, vabs(vload(stereo + i * 2)));
+    }
     
-    deck_a->readSamples(buffer_a.data(), frames);
-    deck_b->readSamples(buffer_b.data(), frames);
+    float lanes[4];
+    vstore(lanes, peak);
+    float l = std::max(lanes[0], lanes[2]);
+    float r = std::max(lanes[1], lanes[3]);
+    if (i < frames) {
+        l = std::max(l, std::fabs(stereo[i * 2]));
+        r = std::max(r, std::fabs(stereo[i * 2 + 1]));
+    }
+    *left = l * gain;
+    *right = r * gain;
+}
+
+namespace {
+struct RenderJobs {
+    Deck* const* decks;
+    float* const* scratch;
+    DeckBlock* blocks;
+    int frames;
+};
+}
+
+static void renderDeckJob(void* context, int index) {
+    RenderJobs* jobs = static_cast<RenderJobs*>(context);
+    jobs->blocks[index] = jobs->decks[index]->render(jobs->scratch[index], jobs->frames);
+}
+
+void Mixer::mix(Deck* const* decks, int count, float* output, float* cue_output, int frames, RenderArena& arena,
+                RenderPool* pool, float* const* stems) {
+    count = std::min(count, MAX_DECKS);
     
+    // Decks render into scratch reserved up front, or hand back a pointer
+    // into the track itself when there's nothing to process
+    float* scratch[MAX_DECKS];
+    for (int i = 0; i < count; i++) {
+        scratch[i] = arena.allocateFloats(frames * 2);
+        if (!scratch[i]) {
+            memset(output, 0, frames * 2 * sizeof(float));
+            for (int j = 0; stems && j < count; j++) memset(stems[j], 0, frames * 2 * sizeof(float));
+            return;
+        }
+    }
+    
+    // Stretching decks in parallel; one playing deck isn't worth waking
+    // anyone for
+    DeckBlock blocks[MAX_DECKS];
+    RenderJobs jobs = { decks, scratch, blocks, frames };
+    int playing = 0;
+    for (int i = 0; i < count; i++) {
+        if (decks[i]->isPlaying()) playing++;
+    }
+    if (pool && playing > 1) {
+        pool->run(count, renderDeckJob, &jobs);
+    } else {
+        for (int i = 0; i < count; i++) renderDeckJob(&jobs, i);
+    }
+    
+    // From here on it's the mix proper, for the performance counters
+    ScopedTimer timer(&mix_ns_);
+    
+    // A deck that came up short (end of track, decoder catching up) is
+    // silent for the rest of the block
+    for (int i = 0; i < count; i++) {
+        DeckBlock& block = blocks[i];
+        if (!block.samples || block.frames >= frames) continue;
+        if (block.samples != scratch[i]) memcpy(scratch[i], block.samples, block.frames * 2 * sizeof(float));
+        memset(scratch[i] + block.frames * 2, 0, (frames - block.frames) * 2 * sizeof(float));
+        block.samples = scratch[i];
+        block.frames = frames;
+    }
+    
+    if (stems) {
+        float inv_frames = 1.0f / frames;
+        for (int i = 0; i < count; i++) {
+            const DeckBlock& block = blocks[i];
+            if (!block.samples) {
+                memset(stems[i], 0, frames * 2 * sizeof(float));
+                continue;
+            }
+            float step = (block.cue_gain_end - block.cue_gain_start) * inv_frames;
+            mixKernel<false, false, false>(stems[i], block.samples, nullptr, frames, block.cue_gain_start, step, 0.0f, 0.0f);
+        }
+    }
+    
+    mixBlocks(blocks, count, output, cue_output, frames);
+    
+    for (int i = 0; i < count; i++) {
+        decks[i]->endRender();
+    }
+}
+
+void Mixer::mixBlocks(const DeckBlock* blocks, int count, float* output, float* cue_output, int frames) {
     // Apply crossfader with power curve
     // Power curve ensures constant power during transition
     float angle = crossfader_position_ * 1.5707963f;  // 0 to π/2
-    float gain_a = std::cos(angle);
-    float gain_b = std::sin(angle);
+    float fader_gain[3] = { std::cos(angle), std::sin(angle), 1.0f };  // A, B, Through
     
-    // Mix the buffers
-    for (int i = 0; i < frames * 2; i++) {
-        output[i] = buffer_a[i] * gain_a + buffer_b[i] * gain_b;
+    // Deck gain times crossfader gain, ramped from where the last block ended
+    float inv_frames = 1.0f / frames;
+    MixSource sources[MAX_DECKS];
+    MixSource cue_sources[MAX_DECKS];
+    int source_count = 0;
+    int cue_count = 0;
+    for (int i = 0; i < count; i++) {
+        const DeckBlock& block = blocks[i];
+        float fader = fader_gain[static_cast<int>(assign_[i])];
+        float gain = block.gain_start * applied_fader_gain_[i];
+        float step = (block.gain_end * fader - gain) * inv_frames;
+        applied_fader_gain_[i] = fader;
         
-        // Soft clipping to prevent harsh distortion
-        if (output[i] > 1.0f) {
-            output[i] = 1.0f - std::exp(1.0f - output[i]);
-        }
-        else if (output[i] < -1.0f) {
-            output[i] = -1.0f + std::exp(1.0f + output[i]);
+        // PFL switches with a block-long ramp rather than a click
+        float pfl = (cue_output && pfl_[i]) ? 1.0f : 0.0f;
+        float cue_gain = block.cue_gain_start * applied_pfl_gain_[i];
+        float cue_step = (block.cue_gain_end * pfl - cue_gain) * inv_frames;
+        applied_pfl_gain_[i] = pfl;
+        
+        bool to_master = gain != 0.0f || step != 0.0f;
+        bool to_cue = cue_gain != 0.0f || cue_step != 0.0f;
+        if (!block.samples || (!to_master && !to_cue)) continue;
+        
+        if (to_master) sources[source_count++] = { block.samples, gain, step };
+        if (to_cue) cue_sources[cue_count++] = { block.samples, cue_gain, cue_step };
+    }
+    
+    // Material that needed clipping usually still does, so the clipper runs
+    // inside the last pass then; otherwise a block that unexpectedly peaks
+    // over the knee gets a second pass
+    float peak = 0.0f;
+    if (source_count == 0) {
+        memset(output, 0, frames * 2 * sizeof(float));
+    }
+    for (int i = 0; i < source_count; i += 2) {
+        const MixSource* second = (i + 1 < source_count) ? &sources[i + 1] : nullptr;
+        bool accumulate = i > 0;
+        bool last = i + 2 >= source_count;
+        if (last && clipping_) {
+            peak = mixPair<true>(output, sources[i], second, accumulate, frames);
+        } else {
+            peak = mixPair<false>(output, sources[i], second, accumulate, frames);
         }
     }
+    if (!clipping_ && peak > SOFT_CLIP_KNEE) {
+        softClipInPlace(output, frames);
+    }
+    clipping_ = peak > SOFT_CLIP_KNEE;
+    
+    if (cue_output) {
+        mixCue(cue_sources, cue_count, output, cue_output, frames);
+    }
+}
+
+void Mixer::mixCue(const MixSource* sources, int count, const float* master, float* cue_output, int frames) {
+    // The same power curve as the crossfader, then the headphone volume
+    float angle = cue_mix_ * 1.5707963f;
+    float cue_gain = std::cos(angle) * cue_volume_;
+    float master_gain = std::sin(angle) * cue_volume_;
+    float inv_frames = 1.0f / frames;
+    float cue_step = (cue_gain - applied_cue_gain_) * inv_frames;
+    float master_step = (master_gain - applied_cue_master_gain_) * inv_frames;
+    
+    // The PFL decks, then the blend in one more pass through the clipper -
+    // headphones get hot, and this bus has no block-to-block state for it
+    for (int i = 0; i < count; i += 2) {
+        const MixSource* second = (i + 1 < count) ? &sources[i + 1] : nullptr;
+        mixPair<false>(cue_output, sources[i], second, i > 0, frames);
+    }
+    if (count > 0) {
+        mixKernel<true, false, true>(cue_output, cue_output, master, frames,
+                                     applied_cue_gain_, cue_step, applied_cue_master_gain_, master_step);
+    } else {
+        mixKernel<false, false, true>(cue_output, master, nullptr, frames,
+                                      applied_cue_master_gain_, master_step, 0.0f, 0.0f);
+    }
+    applied_cue_gain_ = cue_gain;
+    applied_cue_master_gain_ = master_gain;
+}
+
+int64_t Mixer::takeMixTime() {
+    int64_t ns = mix_ns_;
+    mix_ns_ = 0;
+    return ns;
 }
 
 } // namespace dj
@@ -0,0 +1,81 @@
+#include "dj_audio_engine.h"
+#include "dj_audio_internal.h"
+#include "dr_wav.h"
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+namespace dj {
+
+// Blocks written to the file per drwav call
+static const int OFFLINE_WRITE_BLOCKS = 16;
+
+// Renders frames of the graph into wav, buffer_size frames per block - the
+// blocks the device would have asked for, so the output matches a live run
+static bool renderOffline(EngineState* engine, drwav* wav, int64_t frames) {
+    int block = std::max(1, std::min(engine->buffer_size, engine->max_block_frames));
+    std::vector<float> buffer(static_cast<size_t>(block) * OFFLINE_WRITE_BLOCKS * 2);
+    
+    for (int64_t done = 0; done < frames;) {
+        int64_t batch = 0;
+        for (int i = 0; i < OFFLINE_WRITE_BLOCKS && done + batch < frames; i++) {
+            int count = static_cast<int>(std::min<int64_t>(block, frames - done - batch));
+            renderEngineBlock(engine, buffer.data() + batch * 2, count);
+            batch += count;
+        }
+        
+        if (drwav_write_pcm_frames(wav, static_cast<drwav_uint64>(batch), buffer.data()) != static_cast<drwav_uint64>(batch)) {
+            return false;
+        }
+        done += batch;
+    }
+    return true;
+}
+
+} // namespace dj
+
+// C API for offline rendering
+extern "C" {
+
+DJ_API int engine_render_offline(const char* wav_path, double seconds) {
+    if (!dj::g_engine || !wav_path || seconds <= 0.0) return -1;
+    dj::EngineState* engine = dj::g_engine;
+    
+    // The graph has one clock: no stream may run meanwhile, and commands
+    // from other threads wait until the render is done
+    std::lock_guard<std::mutex> lock(engine->command_mutex);
+    if (engine->stream) return -1;
+    
+    // Rendering outruns any decoder, so progressive loads finish first
+    for (auto& deck : engine->decks) {
+        auto track = deck->getAudioFile();
+        if (track && !track->isStreaming()) track->waitUntilDecoded();
+    }
+    
+    drwav_data_format format;
+    format.container = drwav_container_riff;
+    format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+    format.channels = 2;
+    format.sampleRate = static_cast<drwav_uint32>(engine->sample_rate);
+    format.bitsPerSample = 32;
+    
+    drwav wav;
+    if (!drwav_init_file_write(&wav, wav_path, &format, nullptr)) {
+        DJ_LOG_WARN("engine_render_offline: could not create %s", wav_path);
+        return -1;
+    }
+    
+    // On a thread of its own, as if it were the device's: the graph runs
+    // with denormals flushed, which mustn't leak into the caller's thread
+    int64_t frames = static_cast<int64_t>(seconds * engine->sample_rate + 0.5);
+    bool ok = false;
+    std::thread render([&] { ok = dj::renderOffline(engine, &wav, frames); });
+    render.join();
+    
+    drwav_uninit(&wav);
+    DJ_LOG_INFO("engine_render_offline: %lld frames to %s%s", static_cast<long long>(frames), wav_path,
+                ok ? "" : " (write failed)");
+    return ok ? 0 : -1;
+}
+
+} // extern "C"
@@ -0,0 +1,35 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+
+namespace dj {
+
+void parallelFor(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) return;
+
+    int workers = std::min<int>(count, std::max(1u, std::thread::hardware_concurrency()));
+    if (workers == 1) {
+        for (int i = 0; i < count; i++) fn(i);
+        return;
+    }
+
+    // Work stealing from a shared counter keeps uneven items balanced
+    std::atomic<int> next(0);
+    auto run = [&]() {
+        for (int i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            fn(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (int t = 1; t < workers; t++) {
+        threads.emplace_back(run);
+    }
+    run();  // The calling thread takes its share
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+} // namespace dj
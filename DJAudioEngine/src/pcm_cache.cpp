@@ -0,0 +1,323 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace dj {
+
+// Cache file layout: PcmCacheHeader, then frames * 2 samples in `format`
+static const uint32_t PCM_CACHE_MAGIC = 0x4350444A;  // "DJPC"
+static const uint32_t PCM_CACHE_VERSION = 2;  // 2: loudness
+static const char* PCM_CACHE_EXTENSION = ".djpcm";
+
+struct PcmCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;            // Same hash as the file name, guards against renames
+    uint32_t format;         // SampleFormat
+    uint32_t sample_rate;
+    int64_t frames;
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint64_t header_bytes;   // Offset of the PCM data, rounded up for alignment
+    float integrated_lufs;   // NaN if the decode wasn't measured
+    float true_peak_db;
+};
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// ----------------------------------------------------------------------------
+// MappedFile
+// ----------------------------------------------------------------------------
+
+MappedFile::MappedFile()
+    : data_(nullptr)
+    , size_(0)
+#ifdef _WIN32
+    , file_handle_(nullptr)
+    , mapping_handle_(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const char* filepath) {
+    close();
+
+#ifdef _WIN32
+    // FILE_SHARE_DELETE lets eviction remove a file another deck still maps
+    HANDLE file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle_ = file;
+    mapping_handle_ = mapping;
+    data_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(filepath, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // The mapping keeps its own reference
+    if (view == MAP_FAILED) return false;
+
+    data_ = static_cast<const uint8_t*>(view);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (!data_) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(static_cast<HANDLE>(mapping_handle_));
+    CloseHandle(static_cast<HANDLE>(file_handle_));
+    mapping_handle_ = nullptr;
+    file_handle_ = nullptr;
+#else
+    munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+
+    data_ = nullptr;
+    size_ = 0;
+}
+
+// ----------------------------------------------------------------------------
+// PcmCache
+// ----------------------------------------------------------------------------
+
+PcmCache::PcmCache()
+    : max_bytes_(0)
+{
+}
+
+void PcmCache::configure(const char* directory, uint64_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    directory_ = directory ? directory : "";
+    max_bytes_ = max_bytes;
+
+    if (!directory_.empty()) {
+        std::error_code ec;
+        fs::create_directories(directory_, ec);
+    }
+}
+
+bool PcmCache::isEnabled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !directory_.empty() && max_bytes_ > 0;
+}
+
+bool PcmCache::cacheFilePath(const char* source_path, SampleFormat format, int target_rate,
+                             std::string* cache_path, uint64_t* key) const {
+    std::error_code ec;
+    uint64_t size = fs::file_size(source_path, ec);
+    if (ec) return false;
+    int64_t mtime = static_cast<int64_t>(fs::last_write_time(source_path, ec).time_since_epoch().count());
+    if (ec) return false;
+
+    // Path + size + mtime identifies the source; format and target rate are
+    // part of the key because each is its own decoded representation
+    uint64_t hash = hashBytes(source_path, strlen(source_path));
+    hash = hashBytes(&size, sizeof(size), hash);
+    hash = hashBytes(&mtime, sizeof(mtime), hash);
+    uint32_t fmt = static_cast<uint32_t>(format);
+    hash = hashBytes(&fmt, sizeof(fmt), hash);
+    hash = hashBytes(&target_rate, sizeof(target_rate), hash);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    *cache_path = (fs::path(directory_) / (std::string(name) + PCM_CACHE_EXTENSION)).string();
+    *key = hash;
+    return true;
+}
+
+std::unique_ptr<MappedFile> PcmCache::open(const char* source_path, SampleFormat format, int target_rate,
+                                           PcmCacheInfo* info, const uint8_t** pcm) {
+    if (!isEnabled()) return nullptr;
+
+    std::string path;
+    uint64_t key = 0;
+    if (!cacheFilePath(source_path, format, target_rate, &path, &key)) return nullptr;
+
+    auto mapping = std::make_unique<MappedFile>();
+    if (!mapping->open(path.c_str())) return nullptr;
+
+    if (mapping->size() < sizeof(PcmCacheHeader)) return nullptr;
+    PcmCacheHeader header;
+    memcpy(&header, mapping->data(), sizeof(header));
+
+    if (header.magic != PCM_CACHE_MAGIC || header.version != PCM_CACHE_VERSION ||
+        header.key != key || header.format != static_cast<uint32_t>(format) ||
+        header.frames <= 0 || (target_rate > 0 && header.sample_rate != static_cast<uint32_t>(target_rate))) {
+        return nullptr;
+    }
+
+    uint64_t pcm_bytes = static_cast<uint64_t>(header.frames) * 2 * bytesPerSample(format);
+    if (header.header_bytes + pcm_bytes > mapping->size()) return nullptr;  // Truncated
+
+    // Touch the file so eviction sees it as recently used
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+    info->format = format;
+    info->sample_rate = static_cast<int>(header.sample_rate);
+    info->frames = header.frames;
+    info->has_loudness = !std::isnan(header.integrated_lufs);
+    info->loudness.integrated_lufs = header.integrated_lufs;
+    info->loudness.true_peak_db = header.true_peak_db;
+    *pcm = mapping->data() + header.header_bytes;
+    return mapping;
+}
+
+void PcmCache::store(const char* source_path, int target_rate, const PcmCacheInfo& info,
+                     const uint8_t* pcm, size_t pcm_bytes) {
+    if (!isEnabled() || !pcm || pcm_bytes == 0) return;
+
+    std::string path;
+    uint64_t key = 0;
+    if (!cacheFilePath(source_path, info.format, target_rate, &path, &key)) return;
+
+    std::error_code ec;
+    PcmCacheHeader header = {};
+    header.magic = PCM_CACHE_MAGIC;
+    header.version = PCM_CACHE_VERSION;
+    header.key = key;
+    header.format = static_cast<uint32_t>(info.format);
+    header.sample_rate = static_cast<uint32_t>(info.sample_rate);
+    header.frames = info.frames;
+    header.source_size = fs::file_size(source_path, ec);
+    header.source_mtime = static_cast<int64_t>(fs::last_write_time(source_path, ec).time_since_epoch().count());
+    header.header_bytes = 64;
+    header.integrated_lufs = info.has_loudness ? static_cast<float>(info.loudness.integrated_lufs) : NAN;
+    header.true_peak_db = info.has_loudness ? static_cast<float>(info.loudness.true_peak_db) : NAN;
+    static_assert(sizeof(PcmCacheHeader) <= 64, "cache header must fit the reserved space");
+
+    // Write under a temporary name so readers never map a partial file
+    std::string temp_path = path + ".tmp";
+    FILE* file = fopen(temp_path.c_str(), "wb");
+    if (!file) return;
+
+    uint8_t header_block[64] = {0};
+    memcpy(header_block, &header, sizeof(header));
+    bool ok = fwrite(header_block, 1, sizeof(header_block), file) == sizeof(header_block) &&
+              fwrite(pcm, 1, pcm_bytes, file) == pcm_bytes;
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok) {
+        fs::remove(temp_path, ec);
+        return;
+    }
+
+    fs::rename(temp_path, path, ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        return;
+    }
+
+    evict();
+}
+
+void PcmCache::evict() {
+    std::string directory;
+    uint64_t max_bytes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        directory = directory_;
+        max_bytes = max_bytes_;
+    }
+
+    struct Entry {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type last_used;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+
+    std::error_code ec;
+    for (const auto& item : fs::directory_iterator(directory, ec)) {
+        if (item.path().extension() != PCM_CACHE_EXTENSION) continue;
+        std::error_code item_ec;
+        Entry entry{item.path(), item.file_size(item_ec), item.last_write_time(item_ec)};
+        if (item_ec) continue;
+        total += entry.size;
+        entries.push_back(entry);
+    }
+
+    if (total <= max_bytes) return;
+
+    // Oldest first
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.last_used < b.last_used;
+    });
+
+    for (const auto& entry : entries) {
+        if (total <= max_bytes) break;
+        std::error_code remove_ec;
+        if (fs::remove(entry.path, remove_ec)) {
+            total -= entry.size;
+        }
+    }
+}
+
+} // namespace dj
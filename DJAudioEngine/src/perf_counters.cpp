@@ -0,0 +1,189 @@
+#include "dj_audio_engine.h"
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cstring>
+
+static_assert(DJ_PERF_HISTOGRAM_BUCKETS == dj::PERF_HISTOGRAM_BUCKETS, "histogram sizes must match");
+static_assert(DJ_PERF_STAGE_COUNT == dj::PERF_STAGE_COUNT, "stage counts must match");
+
+namespace dj {
+
+// Histogram buckets per deadline
+static const int PERF_BUCKETS_PER_DEADLINE = 8;
+
+template <typename T>
+void PerfCounters::Published<T>::write(const T& value) {
+    // Odd from here until the release store at the end
+    uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&value_, &value, sizeof(T));
+    sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+template <typename T>
+void PerfCounters::Published<T>::read(T* value) const {
+    for (;;) {
+        uint32_t before = sequence_.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        memcpy(value, &value_, sizeof(T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == before) return;
+    }
+}
+
+PerfCounters::PerfCounters(int sample_rate)
+    : sample_rate_(sample_rate)
+    , expected_start_(-1)
+    , callback_reset_(false)
+    , cpu_load_(0.0)
+    , callback_load_(0.0)
+    , xruns_(0)
+    , deadline_misses_(0)
+    , dropped_commands_(0)
+{
+    reset();
+}
+
+PerfCounters::~PerfCounters() {
+}
+
+void PerfCounters::addDeck(int deck, const DeckTimings& timings) {
+    if (deck < 0 || deck >= MAX_DECKS) return;
+    block_decks_[deck] += timings.render_ns;
+    addStage(PerfStage::DeckRender, timings.render_ns);
+    addStage(PerfStage::Stretch, timings.stretch_ns);
+    addStage(PerfStage::EQ, timings.eq_ns);
+}
+
+void PerfCounters::endBlock() {
+    render_.blocks++;
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        render_.stage_sum_ns[i] += block_stages_[i];
+        render_.stage_max_ns[i] = std::max(render_.stage_max_ns[i], block_stages_[i]);
+        block_stages_[i] = 0;
+    }
+    for (int i = 0; i < MAX_DECKS; i++) {
+        render_.deck_sum_ns[i] += block_decks_[i];
+        render_.deck_max_ns[i] = std::max(render_.deck_max_ns[i], block_decks_[i]);
+        block_decks_[i] = 0;
+    }
+    published_render_.write(render_);
+}
+
+void PerfCounters::endCallback(int frames, int64_t start_ns, int64_t elapsed_ns, unsigned flags, double cpu_load,
+                               double output_latency_seconds) {
+    if (callback_reset_.exchange(false, std::memory_order_acquire)) resetCallbackTotals();
+
+    CallbackTotals& totals = callback_;
+    double deadline_ns = 1e9 * frames / sample_rate_;
+    double load = deadline_ns > 0.0 ? elapsed_ns / deadline_ns : 0.0;
+
+    totals.callbacks++;
+    totals.deadline_ns = deadline_ns;
+    totals.last_callback_ns = elapsed_ns;
+    totals.callback_sum_ns += elapsed_ns;
+    totals.callback_max_ns = std::max(totals.callback_max_ns, elapsed_ns);
+    totals.cpu_load = cpu_load;
+    totals.output_latency_ns = output_latency_seconds * 1e9;
+    if (elapsed_ns > deadline_ns) totals.deadline_misses++;
+
+    int bucket = static_cast<int>(load * PERF_BUCKETS_PER_DEADLINE);
+    totals.histogram[std::max(0, std::min(bucket, PERF_HISTOGRAM_BUCKETS - 1))]++;
+
+    if (flags & PERF_INPUT_UNDERFLOW) totals.xruns[0]++;
+    if (flags & PERF_INPUT_OVERFLOW) totals.xruns[1]++;
+    if (flags & PERF_OUTPUT_UNDERFLOW) totals.xruns[2]++;
+    if (flags & PERF_OUTPUT_OVERFLOW) totals.xruns[3]++;
+
+    // Against the previous callback only, so the device clock drifting
+    // from the sample rate never adds up
+    if (expected_start_ >= 0) {
+        totals.max_lateness_ns = std::max(totals.max_lateness_ns, static_cast<double>(start_ns - expected_start_));
+    }
+    expected_start_ = start_ns + static_cast<int64_t>(deadline_ns);
+
+    published_callback_.write(totals);
+    cpu_load_.store(cpu_load, std::memory_order_relaxed);
+    callback_load_.store(load, std::memory_order_relaxed);
+    xruns_.store(totals.xruns[0] + totals.xruns[1] + totals.xruns[2] + totals.xruns[3], std::memory_order_relaxed);
+    deadline_misses_.store(totals.deadline_misses, std::memory_order_relaxed);
+}
+
+void PerfCounters::restartClock() {
+    expected_start_ = -1;
+}
+
+void PerfCounters::reset() {
+    memset(&render_, 0, sizeof(render_));
+    memset(block_stages_, 0, sizeof(block_stages_));
+    memset(block_decks_, 0, sizeof(block_decks_));
+    published_render_.write(render_);
+    dropped_commands_.store(0, std::memory_order_relaxed);
+
+    // The callback's half isn't this thread's to touch
+    callback_reset_.store(true, std::memory_order_release);
+    cpu_load_.store(0.0, std::memory_order_relaxed);
+    callback_load_.store(0.0, std::memory_order_relaxed);
+    xruns_.store(0, std::memory_order_relaxed);
+    deadline_misses_.store(0, std::memory_order_relaxed);
+}
+
+void PerfCounters::resetCallbackTotals() {
+    memset(&callback_, 0, sizeof(callback_));
+    expected_start_ = -1;
+}
+
+void PerfCounters::read(engine_perf_t* perf) const {
+    RenderTotals render;
+    CallbackTotals callback;
+    published_render_.read(&render);
+    published_callback_.read(&callback);
+    if (callback_reset_.load(std::memory_order_acquire)) memset(&callback, 0, sizeof(callback));
+
+    perf->callbacks = callback.callbacks;
+    perf->blocks = render.blocks;
+    perf->input_underflows = callback.xruns[0];
+    perf->input_overflows = callback.xruns[1];
+    perf->output_underflows = callback.xruns[2];
+    perf->output_overflows = callback.xruns[3];
+    perf->deadline_misses = callback.deadline_misses;
+    perf->deadline_us = callback.deadline_ns / 1000.0;
+    perf->last_callback_us = callback.last_callback_ns / 1000.0;
+    perf->mean_callback_us = callback.callbacks ? callback.callback_sum_ns / 1000.0 / callback.callbacks : 0.0;
+    perf->max_callback_us = callback.callback_max_ns / 1000.0;
+    perf->max_lateness_us = callback.max_lateness_ns / 1000.0;
+    perf->cpu_load = callback.cpu_load;
+    perf->output_latency_us = callback.output_latency_ns / 1000.0;
+    memcpy(perf->histogram, callback.histogram, sizeof(perf->histogram));
+
+    double blocks = static_cast<double>(std::max<uint64_t>(1, render.blocks));
+    for (int i = 0; i < PERF_STAGE_COUNT; i++) {
+        perf->stages[i].mean_us = render.stage_sum_ns[i] / 1000.0 / blocks;
+        perf->stages[i].max_us = render.stage_max_ns[i] / 1000.0;
+    }
+    for (int i = 0; i < MAX_DECKS; i++) {
+        perf->decks[i].mean_us = render.deck_sum_ns[i] / 1000.0 / blocks;
+        perf->decks[i].max_us = render.deck_max_ns[i] / 1000.0;
+    }
+
+    // Counted by API threads, and current even while the callback has stalled
+    perf->dropped_commands = dropped_commands_.load(std::memory_order_relaxed);
+}
+
+} // namespace dj
+
+// C API for the performance counters
+extern "C" {
+
+DJ_API int engine_get_perf(engine_perf_t* perf) {
+    if (!dj::g_engine || !perf) return -1;
+    dj::g_engine->perf->read(perf);
+    return 0;
+}
+
+} // extern "C"
@@ -0,0 +1,124 @@
+#include "dj_audio_internal.h"
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+namespace dj {
+
+static const size_t ARENA_ALIGNMENT = 64;
+
+// ----------------------------------------------------------------------------
+// RenderArena
+// ----------------------------------------------------------------------------
+
+RenderArena::RenderArena()
+    : base_(nullptr)
+    , capacity_(0)
+    , used_(0)
+    , high_water_(0)
+{
+}
+
+void RenderArena::reserve(size_t bytes) {
+    storage_.assign(bytes + ARENA_ALIGNMENT, 0);
+    
+    uintptr_t address = reinterpret_cast<uintptr_t>(storage_.data());
+    uintptr_t aligned = (address + ARENA_ALIGNMENT - 1) & ~static_cast<uintptr_t>(ARENA_ALIGNMENT - 1);
+    base_ = storage_.data() + (aligned - address);
+    capacity_ = bytes;
+    used_ = 0;
+    high_water_ = 0;
+}
+
+float* RenderArena::allocateFloats(size_t count) {
+    size_t bytes = (count * sizeof(float) + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+    if (used_ + bytes > capacity_) {
+        return nullptr;
+    }
+    
+    float* block = reinterpret_cast<float*>(base_ + used_);
+    used_ += bytes;
+    if (used_ > high_water_) high_water_ = used_;
+    return block;
+}
+
+// ----------------------------------------------------------------------------
+// Audio-thread allocation check (DJ_DEBUG_RT_ALLOC builds only)
+// ----------------------------------------------------------------------------
+
+#ifdef DJ_DEBUG_RT_ALLOC
+
+static thread_local bool t_realtime = false;
+
+RealtimeScope::RealtimeScope()
+    : previous_(t_realtime)
+{
+    t_realtime = true;
+}
+
+RealtimeScope::~RealtimeScope() {
+    t_realtime = previous_;
+}
+
+static void reportRealtimeHeapUse(const char* what, size_t size) {
+    // Logging doesn't allocate, but stay clear of recursion regardless
+    t_realtime = false;
+    DJ_LOG_ERROR("Heap %s of %zu bytes on the audio thread", what, size);
+    assert(!"heap use on the audio thread");
+    t_realtime = true;
+}
+
+#endif // DJ_DEBUG_RT_ALLOC
+
+} // namespace dj
+
+#ifdef DJ_DEBUG_RT_ALLOC
+
+// Replacements for the global allocation functions. Aligned variants keep
+// their defaults; nothing in the render path uses over-aligned types.
+void* operator new(size_t size) {
+    if (dj::t_realtime) dj::reportRealtimeHeapUse("allocation", size);
+    void* block = std::malloc(size ? size : 1);
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    if (dj::t_realtime) dj::reportRealtimeHeapUse("allocation", size);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return ::operator new(size, tag);
+}
+
+void operator delete(void* block) noexcept {
+    if (block && dj::t_realtime) dj::reportRealtimeHeapUse("free", 0);
+    std::free(block);
+}
+
+void operator delete[](void* block) noexcept {
+    ::operator delete(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    ::operator delete(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    ::operator delete(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+    ::operator delete(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+    ::operator delete(block);
+}
+
+#endif // DJ_DEBUG_RT_ALLOC
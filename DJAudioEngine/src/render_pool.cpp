@@ -0,0 +1,292 @@
+#include "dj_audio_internal.h"
+#include "simd.h"
+#include <algorithm>
+
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#include <avrt.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#endif
+
+namespace dj {
+
+// Waking a worker must not take a lock the callback could block on, so
+// this is a kernel semaphore rather than a condition variable
+struct Semaphore {
+#ifdef _WIN32
+    Semaphore() : handle(CreateSemaphoreA(nullptr, 0, MAXLONG, nullptr)) {}
+    ~Semaphore() { CloseHandle(handle); }
+    void post(int count) { ReleaseSemaphore(handle, count, nullptr); }
+    void wait() { WaitForSingleObject(handle, INFINITE); }
+    HANDLE handle;
+#else
+    Semaphore() { sem_init(&handle, 0, 0); }
+    ~Semaphore() { sem_destroy(&handle); }
+    void post(int count) { for (int i = 0; i < count; i++) sem_post(&handle); }
+    void wait() { while (sem_wait(&handle) != 0) {} }
+    sem_t handle;
+#endif
+};
+
+static inline void cpuRelax() {
+#if defined(DJ_SIMD_SSE2)
+    _mm_pause();
+#elif defined(DJ_SIMD_NEON)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Core 0 is left to the OS and the audio callback; worker n gets core n + 1
+static void promoteWorkerThread(int index) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    int core = static_cast<int>((index + 1) % cores);
+
+#ifdef _WIN32
+    SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core);
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    // Needs rtprio rights; workers stay at normal priority otherwise
+    sched_param param;
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+}
+
+// The render-ahead thread stands in for the device's own callback thread,
+// so it asks for the same class of priority
+static void promoteRenderAheadThread() {
+#ifdef _WIN32
+    DWORD task = 0;
+    HANDLE handle = AvSetMmThreadCharacteristicsW(L"Pro Audio", &task);
+    if (handle) {
+        AvSetMmThreadPriority(handle, AVRT_PRIORITY_HIGH);
+    } else {
+        SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+    }
+#else
+    sched_param param;
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+#endif
+}
+
+RenderPool::RenderPool(int workers)
+    : wake_(std::make_unique<Semaphore>())
+    , running_(true)
+    , job_(nullptr)
+    , context_(nullptr)
+    , count_(0)
+    , next_(0)
+    , done_(0)
+    , outstanding_(0)
+{
+    for (int i = 0; i < workers; i++) {
+        threads_.emplace_back(&RenderPool::workerMain, this, i);
+    }
+}
+
+RenderPool::~RenderPool() {
+    running_ = false;
+    wake_->post(static_cast<int>(threads_.size()));
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+void RenderPool::takeJobs() {
+    for (int i = next_.fetch_add(1); i < count_; i = next_.fetch_add(1)) {
+        job_(context_, i);
+        done_.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void RenderPool::run(int count, Job job, void* context) {
+    if (count <= 0) return;
+
+    int helpers = std::min(count - 1, getWorkerCount());
+    if (helpers <= 0) {
+        for (int i = 0; i < count; i++) job(context, i);
+        return;
+    }
+
+    job_ = job;
+    context_ = context;
+    count_ = count;
+    next_.store(0);
+    done_.store(0);
+    outstanding_.store(helpers);
+    wake_->post(helpers);
+
+    takeJobs();
+
+    // Barrier. Also waits for helpers that woke too late to find work, so
+    // none of them can still be reading this batch when the next one starts.
+    while (done_.load(std::memory_order_acquire) < count || outstanding_.load(std::memory_order_acquire) > 0) {
+        cpuRelax();
+    }
+}
+
+void RenderPool::workerMain(int index) {
+    promoteWorkerThread(index);
+    enableFlushToZero();
+    RealtimeScope realtime;
+
+    for (;;) {
+        wake_->wait();
+        if (!running_) break;
+
+        takeJobs();
+        outstanding_.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+RenderAhead::RenderAhead(EngineState* engine, int block_frames, int blocks)
+    : engine_(engine)
+    , channels_(engine->output_channels)
+    , deck_count_(static_cast<int>(engine->decks.size()))
+    , block_frames_(std::max(1, block_frames))
+    , blocks_(std::max(1, std::min(blocks, MAX_RENDER_AHEAD_BLOCKS)))
+    , capacity_(block_frames_ * blocks_)
+    , ring_(static_cast<size_t>(capacity_) * deck_count_ * 2, 0.0f)
+    , stages_(static_cast<size_t>(blocks_))
+    , block_(static_cast<size_t>(block_frames_) * 2, 0.0f)
+    , written_(0)
+    , read_(0)
+    , wake_(std::make_unique<Semaphore>())
+    , running_(true)
+    , master_(static_cast<size_t>(block_frames_) * 2, 0.0f)
+    , cue_(static_cast<size_t>(block_frames_) * 2, 0.0f)
+{
+    for (int i = 0; i < deck_count_; i++) {
+        applied_volume_[i] = engine->decks[i]->getVolume();
+    }
+    thread_ = std::thread(&RenderAhead::threadMain, this);
+    
+    // The stream's first callback finds a full ring
+    while (written_.load(std::memory_order_acquire) < capacity_) {
+        std::this_thread::yield();
+    }
+}
+
+RenderAhead::~RenderAhead() {
+    running_ = false;
+    wake_->post(1);
+    thread_.join();
+}
+
+bool RenderAhead::pull(float* output, int frames) {
+    RealtimeScope realtime;
+    enableFlushToZero();
+    
+    int64_t read = read_.load(std::memory_order_relaxed);
+    int64_t available = written_.load(std::memory_order_acquire) - read;
+    int count = static_cast<int>(std::min<int64_t>(frames, available));
+    
+    // A piece per block, as each has a master stage of its own
+    for (int done = 0; done < count;) {
+        int64_t position = read + done;
+        int offset = static_cast<int>(position % block_frames_);
+        int piece = std::min(count - done, block_frames_ - offset);
+        mixPiece((position / block_frames_) % blocks_, offset, output + done * channels_, piece);
+        done += piece;
+    }
+    if (count < frames) {
+        memset(output + count * channels_, 0, (frames - count) * channels_ * sizeof(float));
+    }
+    
+    read_.store(read + count, std::memory_order_release);
+    wake_->post(1);
+    return count == frames;
+}
+
+// The API's value when it was set after the block was rendered, otherwise
+// the render thread's, which may be automation's
+static float liveValue(const LiveControl& control, uint32_t applied, float rendered) {
+    if (control.change.load(std::memory_order_acquire) == applied) return rendered;
+    return control.value.load(std::memory_order_relaxed);
+}
+
+void RenderAhead::mixPiece(int64_t block, int offset, float* output, int frames) {
+    const MasterStage& stage = stages_[block];
+    const LiveControls& live = engine_->live_controls;
+    mixer_.setCrossfader(liveValue(live.crossfader, stage.applied.crossfader, stage.crossfader));
+    mixer_.setCueMix(liveValue(live.cue_mix, stage.applied.cue_mix, stage.cue_mix));
+    mixer_.setCueVolume(stage.cue_volume);
+    
+    // The stems are past the deck's own gains but for the volume, which
+    // ramps here instead
+    DeckBlock blocks[MAX_DECKS];
+    for (int i = 0; i < deck_count_; i++) {
+        float volume = liveValue(live.volume[i], stage.applied.volume[i], stage.volume[i]);
+        mixer_.setAssign(i, stage.assign[i]);
+        mixer_.setPFL(i, stage.pfl[i]);
+        blocks[i] = { stem(block, i) + offset * 2, frames, applied_volume_[i], volume, 1.0f, 1.0f };
+        applied_volume_[i] = volume;
+    }
+    
+    if (channels_ != 4) {
+        mixer_.mixBlocks(blocks, deck_count_, output, nullptr, frames);
+        return;
+    }
+    
+    float* master = master_.data();
+    float* cue = cue_.data();
+    mixer_.mixBlocks(blocks, deck_count_, master, cue, frames);
+    for (int i = 0; i < frames; i++) {
+        output[i * 4] = master[i * 2];
+        output[i * 4 + 1] = master[i * 2 + 1];
+        output[i * 4 + 2] = cue[i * 2];
+        output[i * 4 + 3] = cue[i * 2 + 1];
+    }
+}
+
+void RenderAhead::threadMain() {
+    promoteRenderAheadThread();
+    RealtimeScope realtime;
+    
+    while (running_) {
+        // A whole block's room or nothing, so every block is rendered at
+        // the size it was opened with
+        int64_t written = written_.load(std::memory_order_relaxed);
+        if (written + block_frames_ - read_.load(std::memory_order_acquire) > capacity_) {
+            wake_->wait();
+            continue;
+        }
+        
+        // Blocks fill the ring exactly, so one never wraps
+        int64_t block = (written / block_frames_) % blocks_;
+        float* stems[MAX_DECKS];
+        for (int i = 0; i < deck_count_; i++) {
+            stems[i] = stem(block, i);
+        }
+        renderEngineBlock(engine_, block_.data(), block_frames_, nullptr, stems);
+        
+        // What the block was rendered for, to weigh against what the API
+        // has set by the time it plays
+        const Mixer& mixer = *engine_->mixer;
+        MasterStage& stage = stages_[block];
+        stage.crossfader = mixer.getCrossfader();
+        stage.cue_mix = mixer.getCueMix();
+        stage.cue_volume = mixer.getCueVolume();
+        for (int i = 0; i < deck_count_; i++) {
+            stage.volume[i] = engine_->decks[i]->getVolume();
+            stage.assign[i] = mixer.getAssign(i);
+            stage.pfl[i] = mixer.getPFL(i);
+        }
+        stage.applied = engine_->applied_controls;
+        written_.store(written + block_frames_, std::memory_order_release);
+    }
+}
+
+} // namespace dj
@@ -0,0 +1,132 @@
+#include "dj_audio_internal.h"
+#include <samplerate.h>
+#include <algorithm>
+#include <numeric>
+
+namespace dj {
+
+// Transparent for playback and several times faster than the best sinc
+static const int RESAMPLE_QUALITY = SRC_SINC_MEDIUM_QUALITY;
+
+// Real-time converters (vinyl decks) trade a little stopband for speed
+static const int RESAMPLE_FAST_QUALITY = SRC_SINC_FASTEST;
+
+// Source frames per parallel chunk, and the extra context each chunk
+// converts on either side so the filter has settled at the seams
+static const int64_t RESAMPLE_CHUNK_FRAMES = 1 << 19;
+static const int64_t RESAMPLE_OVERLAP_FRAMES = 8192;
+
+Resampler::Resampler()
+    : state_(nullptr)
+    , ratio_(1.0)
+{
+}
+
+Resampler::~Resampler() {
+    close();
+}
+
+bool Resampler::open(int source_rate, int target_rate, bool fast) {
+    close();
+    if (source_rate <= 0 || target_rate <= 0) return false;
+
+    int error = 0;
+    state_ = src_new(fast ? RESAMPLE_FAST_QUALITY : RESAMPLE_QUALITY, 2, &error);
+    if (!state_) return false;
+
+    ratio_ = static_cast<double>(target_rate) / source_rate;
+    return true;
+}
+
+void Resampler::close() {
+    if (state_) {
+        src_delete(state_);
+        state_ = nullptr;
+    }
+    ratio_ = 1.0;
+}
+
+void Resampler::reset() {
+    if (state_) src_reset(state_);
+}
+
+int64_t Resampler::process(const float* input, int64_t input_frames, float* output, int64_t output_frames,
+                           bool end_of_input, int64_t* used) {
+    *used = 0;
+    if (!state_ || output_frames <= 0) return 0;
+
+    SRC_DATA data;
+    data.data_in = input;
+    data.data_out = output;
+    data.input_frames = static_cast<long>(input_frames);
+    data.output_frames = static_cast<long>(output_frames);
+    data.input_frames_used = 0;
+    data.output_frames_gen = 0;
+    data.end_of_input = end_of_input ? 1 : 0;
+    data.src_ratio = ratio_;
+
+    if (src_process(state_, &data) != 0) return 0;
+
+    *used = data.input_frames_used;
+    return data.output_frames_gen;
+}
+
+int64_t Resampler::convertedLength(int64_t source_frames, int source_rate, int target_rate) {
+    if (source_rate <= 0) return 0;
+    return (source_frames * target_rate + source_rate / 2) / source_rate;
+}
+
+void Resampler::convertParallel(const float* input, int64_t input_frames, int source_rate, int target_rate,
+                                const std::function<void(int64_t, const float*, int64_t)>& sink) {
+    int64_t total_out = convertedLength(input_frames, source_rate, target_rate);
+    if (total_out <= 0) return;
+
+    // Chunk boundaries sit on whole periods of the rate ratio, so every
+    // chunk starts on an exact output frame and the pieces tile seamlessly
+    int64_t divisor = std::gcd(source_rate, target_rate);
+    int64_t unit_in = source_rate / divisor;
+    int64_t unit_out = target_rate / divisor;
+
+    auto roundUp = [unit_in](int64_t frames) { return (frames + unit_in - 1) / unit_in * unit_in; };
+    int64_t chunk = roundUp(RESAMPLE_CHUNK_FRAMES);
+    int64_t overlap = roundUp(RESAMPLE_OVERLAP_FRAMES);
+    int chunks = static_cast<int>((input_frames + chunk - 1) / chunk);
+
+    auto toOutput = [unit_in, unit_out](int64_t source_frame) { return source_frame / unit_in * unit_out; };
+
+    parallelFor(chunks, [&](int index) {
+        int64_t begin = index * chunk;
+        int64_t feed_begin = std::max<int64_t>(0, begin - overlap);
+        int64_t feed_end = std::min(input_frames, begin + chunk + overlap);
+
+        int64_t out_begin = toOutput(begin);
+        int64_t out_end = (index == chunks - 1) ? total_out : toOutput(begin + chunk);
+        int64_t skip = out_begin - toOutput(feed_begin);
+
+        Resampler resampler;
+        if (!resampler.open(source_rate, target_rate)) return;
+
+        std::vector<float> output(static_cast<size_t>(skip + (out_end - out_begin) + 256) * 2);
+        int64_t fed = feed_begin;
+        int64_t produced = 0;
+        int64_t wanted = skip + (out_end - out_begin);
+
+        while (produced < wanted) {
+            int64_t used = 0;
+            int64_t got = resampler.process(input + fed * 2, feed_end - fed,
+                                            output.data() + produced * 2, wanted - produced,
+                                            true, &used);
+            fed += used;
+            produced += got;
+            if (got == 0 && used == 0) break;  // Drained
+        }
+
+        // Anything the filter didn't deliver at the very end stays silent
+        int64_t count = std::max<int64_t>(0, std::min(produced, wanted) - skip);
+        if (count > 0) {
+            sink(out_begin, output.data() + skip * 2, count);
+        }
+    });
+}
+
+} // namespace dj
@@ -0,0 +1,197 @@
+#pragma once
+
+// Minimal 4-lane float vector layer for the render and analysis kernels.
+// SSE2 on x86, NEON on 64-bit ARM, plain structs elsewhere - every helper
+// is available on all three, so kernels are written once against vec4.
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DJ_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define DJ_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#include <cmath>
+#endif
+
+namespace dj {
+
+#if defined(DJ_SIMD_SSE2)
+
+typedef __m128 vec4;
+
+inline vec4 vset1(float value) { return _mm_set1_ps(value); }
+inline vec4 vset(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+inline vec4 vload(const float* p) { return _mm_loadu_ps(p); }
+inline void vstore(float* p, vec4 v) { _mm_storeu_ps(p, v); }
+inline vec4 vadd(vec4 a, vec4 b) { return _mm_add_ps(a, b); }
+inline vec4 vsub(vec4 a, vec4 b) { return _mm_sub_ps(a, b); }
+inline vec4 vmul(vec4 a, vec4 b) { return _mm_mul_ps(a, b); }
+inline vec4 vmin(vec4 a, vec4 b) { return _mm_min_ps(a, b); }
+inline vec4 vmax(vec4 a, vec4 b) { return _mm_max_ps(a, b); }
+inline vec4 vdiv(vec4 a, vec4 b) { return _mm_div_ps(a, b); }
+inline vec4 vabs(vec4 v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+
+// magnitude with the sign of sign; magnitude must be non-negative
+inline vec4 vcopysign(vec4 magnitude, vec4 sign) {
+    return _mm_or_ps(magnitude, _mm_and_ps(_mm_set1_ps(-0.0f), sign));
+}
+
+inline float vmaxlane(vec4 v) {
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+// One stereo frame in both halves: (L, R, L, R)
+inline vec4 vloadframe2(const float* p) {
+    return _mm_castpd_ps(_mm_load1_pd(reinterpret_cast<const double*>(p)));
+}
+
+// Stores lanes 0 and 1 (one stereo frame)
+inline void vstoreframe(float* p, vec4 v) { _mm_storel_pi(reinterpret_cast<__m64*>(p), v); }
+
+// (a, b, c, d) -> (c, d, a, b)
+inline vec4 vswaphalves(vec4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)); }
+
+inline vec4 vsqrt(vec4 v) { return _mm_sqrt_ps(v); }
+
+// (a, b, c, d) -> (d, c, b, a)
+inline vec4 vreverse(vec4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)); }
+
+// (a0, a1, a2, a3), (b0, b1, b2, b3) -> (a0, a2, b0, b2), (a1, a3, b1, b3)
+inline void vdeinterleave(vec4 a, vec4 b, vec4* even, vec4* odd) {
+    *even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+    *odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+// Rows to columns, in place
+inline void vtranspose4(vec4& a, vec4& b, vec4& c, vec4& d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+
+#elif defined(DJ_SIMD_NEON)
+
+typedef float32x4_t vec4;
+
+inline vec4 vset1(float value) { return vdupq_n_f32(value); }
+inline vec4 vset(float a, float b, float c, float d) {
+    const float lanes[4] = { a, b, c, d };
+    return vld1q_f32(lanes);
+}
+inline vec4 vload(const float* p) { return vld1q_f32(p); }
+inline void vstore(float* p, vec4 v) { vst1q_f32(p, v); }
+inline vec4 vadd(vec4 a, vec4 b) { return vaddq_f32(a, b); }
+inline vec4 vsub(vec4 a, vec4 b) { return vsubq_f32(a, b); }
+inline vec4 vmul(vec4 a, vec4 b) { return vmulq_f32(a, b); }
+inline vec4 vmin(vec4 a, vec4 b) { return vminq_f32(a, b); }
+inline vec4 vmax(vec4 a, vec4 b) { return vmaxq_f32(a, b); }
+inline vec4 vdiv(vec4 a, vec4 b) { return vdivq_f32(a, b); }
+inline vec4 vabs(vec4 v) { return vabsq_f32(v); }
+
+inline vec4 vcopysign(vec4 magnitude, vec4 sign) {
+    return vbslq_f32(vdupq_n_u32(0x80000000u), sign, magnitude);
+}
+
+inline float vmaxlane(vec4 v) { return vmaxvq_f32(v); }
+
+inline vec4 vloadframe2(const float* p) {
+    float32x2_t frame = vld1_f32(p);
+    return vcombine_f32(frame, frame);
+}
+
+inline void vstoreframe(float* p, vec4 v) { vst1_f32(p, vget_low_f32(v)); }
+
+inline vec4 vswaphalves(vec4 v) { return vextq_f32(v, v, 2); }
+
+inline vec4 vsqrt(vec4 v) { return vsqrtq_f32(v); }
+
+inline vec4 vreverse(vec4 v) {
+    float32x4_t pairs = vrev64q_f32(v);
+    return vextq_f32(pairs, pairs, 2);
+}
+
+inline void vdeinterleave(vec4 a, vec4 b, vec4* even, vec4* odd) {
+    float32x4x2_t split = vuzpq_f32(a, b);
+    *even = split.val[0];
+    *odd = split.val[1];
+}
+
+inline void vtranspose4(vec4& a, vec4& b, vec4& c, vec4& d) {
+    float32x4x2_t ab = vtrnq_f32(a, b);
+    float32x4x2_t cd = vtrnq_f32(c, d);
+    a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+    b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+    c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+    d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+#else
+
+struct vec4 { float v[4]; };
+
+inline vec4 vset(float a, float b, float c, float d) { return vec4{ { a, b, c, d } }; }
+inline vec4 vset1(float value) { return vset(value, value, value, value); }
+inline vec4 vload(const float* p) { return vset(p[0], p[1], p[2], p[3]); }
+inline void vstore(float* p, vec4 v) { for (int i = 0; i < 4; i++) p[i] = v.v[i]; }
+
+#define DJ_VEC4_LANEWISE(name, expr) \
+    inline vec4 name(vec4 a, vec4 b) { \
+        vec4 r; \
+        for (int i = 0; i < 4; i++) r.v[i] = (expr); \
+        return r; \
+    }
+DJ_VEC4_LANEWISE(vadd, a.v[i] + b.v[i])
+DJ_VEC4_LANEWISE(vsub, a.v[i] - b.v[i])
+DJ_VEC4_LANEWISE(vmul, a.v[i] * b.v[i])
+DJ_VEC4_LANEWISE(vmin, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+DJ_VEC4_LANEWISE(vmax, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+DJ_VEC4_LANEWISE(vdiv, a.v[i] / b.v[i])
+DJ_VEC4_LANEWISE(vcopysign, std::signbit(b.v[i]) ? -a.v[i] : a.v[i])
+#undef DJ_VEC4_LANEWISE
+
+inline vec4 vabs(vec4 v) {
+    return vset(std::fabs(v.v[0]), std::fabs(v.v[1]), std::fabs(v.v[2]), std::fabs(v.v[3]));
+}
+
+inline float vmaxlane(vec4 v) {
+    float m = v.v[0];
+    for (int i = 1; i < 4; i++) m = v.v[i] > m ? v.v[i] : m;
+    return m;
+}
+
+inline vec4 vloadframe2(const float* p) { return vset(p[0], p[1], p[0], p[1]); }
+inline void vstoreframe(float* p, vec4 v) { p[0] = v.v[0]; p[1] = v.v[1]; }
+inline vec4 vswaphalves(vec4 v) { return vset(v.v[2], v.v[3], v.v[0], v.v[1]); }
+
+inline vec4 vsqrt(vec4 v) {
+    return vset(std::sqrt(v.v[0]), std::sqrt(v.v[1]), std::sqrt(v.v[2]), std::sqrt(v.v[3]));
+}
+
+inline vec4 vreverse(vec4 v) { return vset(v.v[3], v.v[2], v.v[1], v.v[0]); }
+
+inline void vdeinterleave(vec4 a, vec4 b, vec4* even, vec4* odd) {
+    *even = vset(a.v[0], a.v[2], b.v[0], b.v[2]);
+    *odd = vset(a.v[1], a.v[3], b.v[1], b.v[3]);
+}
+
+inline void vtranspose4(vec4& a, vec4& b, vec4& c, vec4& d) {
+    vec4 rows[4] = { a, b, c, d };
+    a = vset(rows[0].v[0], rows[1].v[0], rows[2].v[0], rows[3].v[0]);
+    b = vset(rows[0].v[1], rows[1].v[1], rows[2].v[1], rows[3].v[1]);
+    c = vset(rows[0].v[2], rows[1].v[2], rows[2].v[2], rows[3].v[2]);
+    d = vset(rows[0].v[3], rows[1].v[3], rows[2].v[3], rows[3].v[3]);
+}
+
+#endif
+
+// a * b + c
+inline vec4 vmadd(vec4 a, vec4 b, vec4 c) { return vadd(vmul(a, b), c); }
+
+// Denormals from decaying filter tails cost hundreds of cycles each on x86.
+// Called at the top of every audio callback; ARM flushes by default.
+inline void enableFlushToZero() {
+#if defined(DJ_SIMD_SSE2)
+    _mm_setcsr(_mm_getcsr() | 0x8040);  // FTZ | DAZ
+#endif
+}
+
+} // namespace dj
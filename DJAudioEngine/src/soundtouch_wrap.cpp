@@ -1,13 +1,58 @@
 #include "dj_audio_internal.h"
 #include <SoundTouch.h>
-
-// This file is a minimal wrapper if needed
-// SoundTouch is header-only or comes as a library from vcpkg
-// No additional wrapper implementation needed
+#include <vector>
 
 namespace dj {
 
-// Placeholder for any SoundTouch-specific utilities
-// Currently not needed as SoundTouch is used directly in deck.cpp
+// Frames of silence run through at construction, in chunks of the deck's
+// largest putSamples()
+static const int WARMUP_CHUNK_FRAMES = 4096;
+static const int WARMUP_CHUNKS = 4;
+
+namespace {
+
+// Key-locked tempo and independent pitch, WSOLA style
+class SoundTouchStretcher : public TimeStretcher {
+public:
+    explicit SoundTouchStretcher(int sample_rate) {
+        soundtouch_.setSampleRate(sample_rate);
+        soundtouch_.setChannels(2);
+        soundtouch_.setTempo(1.0);
+        soundtouch_.setPitch(1.0);
+        
+        // Run a few chunks of silence through so SoundTouch grows its internal
+        // buffers now rather than on the audio thread; clear() keeps capacity
+        std::vector<float> silence(WARMUP_CHUNK_FRAMES * 2, 0.0f);
+        for (int i = 0; i < WARMUP_CHUNKS; i++) {
+            soundtouch_.putSamples(silence.data(), WARMUP_CHUNK_FRAMES);
+            while (soundtouch_.receiveSamples(silence.data(), WARMUP_CHUNK_FRAMES) > 0) {
+            }
+        }
+        soundtouch_.clear();
+    }
+    
+    void setTempo(double tempo) override { soundtouch_.setTempo(tempo); }
+    void setPitchSemitones(double semitones) override { soundtouch_.setPitchSemiTones(semitones); }
+    bool canShiftPitch() const override { return true; }
+    
+    void clear() override { soundtouch_.clear(); }
+    void putSamples(const float* input, int frames) override { soundtouch_.putSamples(input, frames); }
+    
+    int receiveSamples(float* output, int frames) override {
+        if (!output) return static_cast<int>(soundtouch_.receiveSamples(frames));
+        return static_cast<int>(soundtouch_.receiveSamples(output, frames));
+    }
+    
+    int numSamples() const override { return static_cast<int>(soundtouch_.numSamples()); }
+    
+private:
+    soundtouch::SoundTouch soundtouch_;
+};
+
+} // namespace
+
+std::unique_ptr<TimeStretcher> createSoundTouchStretcher(int sample_rate) {
+    return std::make_unique<SoundTouchStretcher>(sample_rate);
+}
 
 } // namespace dj
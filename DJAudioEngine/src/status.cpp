@@ -0,0 +1,189 @@
+#include "dj_audio_engine.h"
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+static_assert(DJ_STATUS_MAX_DECKS == dj::MAX_DECKS, "status block must have room for every deck");
+
+namespace dj {
+
+// Peak meter release, applied by the audio thread so a reader polling at
+// UI rate still sees every peak
+static const float METER_FALL_DB_PER_SECOND = 20.0f;
+
+// How often the notifier looks at the status block, which bounds how late
+// a track-ended callback can be
+static const int NOTIFY_POLL_MS = 10;
+
+// Position callback interval, as with the old every-10-callbacks throttle
+static const int POSITION_CALLBACK_MS = 100;
+
+StatusBlock::StatusBlock(int sample_rate)
+    : sequence_(0)
+    , status_(std::make_unique<engine_status_t>())
+    , sample_rate_(sample_rate)
+{
+    memset(status_.get(), 0, sizeof(engine_status_t));
+}
+
+StatusBlock::~StatusBlock() {
+}
+
+void StatusBlock::publish(Deck* const* decks, int count, float crossfader, const PerfCounters& perf,
+                          const float* output, int frames) {
+    engine_status_t& status = *status_;
+    count = std::min(count, MAX_DECKS);
+
+    // Odd from here until the release store at the end
+    uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    float fall = std::pow(10.0f, -METER_FALL_DB_PER_SECOND / 20.0f * frames / sample_rate_);
+
+    status.blocks++;
+    status.deck_count = count;
+    status.crossfader = crossfader;
+    status.cpu_load = static_cast<float>(perf.getCpuLoad());
+    status.callback_load = static_cast<float>(perf.getCallbackLoad());
+    status.xruns = static_cast<unsigned int>(perf.getXruns());
+    status.deadline_misses = static_cast<unsigned int>(perf.getDeadlineMisses());
+    for (int i = 0; i < count; i++) {
+        const Deck* deck = decks[i];
+        deck_status_t& out = status.decks[i];
+        out.position_seconds = deck->getPosition();
+        out.duration_seconds = deck->getRenderedDuration();
+        out.phase = deck->getPhase();
+        out.tempo = deck->getTempo();
+        out.bpm = deck->getBPM();
+        out.peak_left = std::max(deck->getPeak(0), out.peak_left * fall);
+        out.peak_right = std::max(deck->getPeak(1), out.peak_right * fall);
+        out.playing = deck->isPlaying() ? 1 : 0;
+        out.end_count = deck->getEndCount();
+        out.loop_start_seconds = static_cast<double>(deck->getLoopStart()) / sample_rate_;
+        out.loop_end_seconds = static_cast<double>(deck->getLoopEnd()) / sample_rate_;
+        out.looping = deck->isLooping() ? 1 : 0;
+        out.rolling = deck->isRolling() ? 1 : 0;
+        out.auto_gain_db = deck->getAutoGainDb();
+    }
+
+    float left = 0.0f;
+    float right = 0.0f;
+    measurePeaks(output, frames, 1.0f, &left, &right);
+    status.master_peak_left = std::max(left, status.master_peak_left * fall);
+    status.master_peak_right = std::max(right, status.master_peak_right * fall);
+
+    sequence_.store(sequence + 2, std::memory_order_release);
+}
+
+void StatusBlock::read(engine_status_t* status) const {
+    for (;;) {
+        uint32_t before = sequence_.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();  // A publish takes microseconds
+            continue;
+        }
+
+        memcpy(status, status_.get(), sizeof(engine_status_t));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) == before) return;
+    }
+}
+
+StatusNotifier::StatusNotifier(const StatusBlock& status)
+    : status_(status)
+    , running_(true)
+    , position_callback_(nullptr)
+    , track_ended_callback_(nullptr)
+{
+    thread_ = std::thread(&StatusNotifier::threadMain, this);
+}
+
+StatusNotifier::~StatusNotifier() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void StatusNotifier::setPositionCallback(PositionCallback callback) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        position_callback_ = callback;
+    }
+    wake_.notify_all();
+}
+
+void StatusNotifier::setTrackEndedCallback(TrackEndedCallback callback) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        track_ended_callback_ = callback;
+    }
+    wake_.notify_all();
+}
+
+void StatusNotifier::threadMain() {
+    engine_status_t status;
+    uint32_t end_counts[MAX_DECKS] = {};
+    bool have_baseline = false;
+    unsigned long long position_blocks = 0;
+    auto next_position = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        if (!position_callback_ && !track_ended_callback_) {
+            // Ends that happened while nobody listened aren't reported later
+            have_baseline = false;
+            wake_.wait(lock);
+            continue;
+        }
+
+        wake_.wait_for(lock, std::chrono::milliseconds(NOTIFY_POLL_MS));
+        if (!running_) break;
+        PositionCallback position_callback = position_callback_;
+        TrackEndedCallback track_ended_callback = track_ended_callback_;
+
+        // Callbacks run unlocked, so they may set callbacks themselves
+        lock.unlock();
+        status_.read(&status);
+        int count = std::min(status.deck_count, MAX_DECKS);
+
+        for (int i = 0; i < count; i++) {
+            uint32_t ended = status.decks[i].end_count;
+            if (have_baseline && ended != end_counts[i] && track_ended_callback) {
+                track_ended_callback(i);
+            }
+            end_counts[i] = ended;
+        }
+        have_baseline = true;
+
+        // Only while blocks are being rendered - a stopped stream has
+        // nothing new to report
+        auto now = std::chrono::steady_clock::now();
+        if (position_callback && now >= next_position && status.blocks != position_blocks) {
+            position_blocks = status.blocks;
+            next_position = now + std::chrono::milliseconds(POSITION_CALLBACK_MS);
+            for (int i = 0; i < count; i++) {
+                position_callback(i, status.decks[i].position_seconds);
+            }
+        }
+        lock.lock();
+    }
+}
+
+} // namespace dj
+
+// C API for the status block
+extern "C" {
+
+DJ_API int engine_read_status(engine_status_t* status) {
+    if (!dj::g_engine || !status) return -1;
+    dj::g_engine->status->read(status);
+    return 0;
+}
+
+} // extern "C"
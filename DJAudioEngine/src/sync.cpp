@@ -1,49 +1,69 @@
 #include "dj_audio_internal.h"
+#include <algorithm>
 #include <cmath>
-#include <cstdio>
 #ifdef _WIN32
 #include <Windows.h>
 #endif
 
 namespace dj {
 
-SyncManager::SyncManager() {
-    sync_state_.enabled = false;
-    sync_state_.master_deck_id = -1;
-    sync_state_.slave_deck_id = -1;
+// Phase-locked loop gains. The proportional term pulls a phase error (in
+// beats) in; the integral term soaks up what's left of a BPM estimate that
+// is slightly off, so the error settles at zero. Around 0.7 damping at
+// 120 BPM, so the lock settles without ringing.
+static const double SYNC_PHASE_GAIN = 0.2;      // Tempo change per beat of error
+static const double SYNC_INTEGRAL_GAIN = 0.04;  // Per beat-second
+
+// Largest tempo nudge the loop applies on top of the BPM ratio. Small
+// enough to go unheard as a pitch wobble on the stretcher.
+static const double SYNC_MAX_NUDGE = 0.01;
+
+// Loop filter on the measured phase error. Stretched decks advance their
+// position a feed chunk at a time; this averages that out.
+static const double SYNC_ERROR_SMOOTHING_SECONDS = 1.0;
+
+// SoundTouch is only retuned once the wanted ratio has moved this far
+static const double SYNC_RETUNE_THRESHOLD = 0.0005;
+
+// A deck's BPM where it is playing: the nominal BPM, bent by how far the
+// analyzed grid there runs from its own average. Keeps the BPM the app set
+// (and its octave) while following the drift of live-played tracks.
+static double currentBPM(const Deck* deck) {
+    double bpm = deck->getBPM();
+    const BeatGrid* grid = deck->getBeatGrid();
+    if (!grid || bpm <= 0.0) return bpm;
+    return bpm * grid->getLocalBPM(deck->getPosition()) / grid->getAverageBPM();
+}
+
+SyncManager::SyncManager()
+    : log_counter_(0)
+{
+    for (int i = 0; i < MAX_DECKS; i++) {
+        master_of_[i] = -1;
+    }
 }
 
 void SyncManager::enable(int slave_deck_id, int master_deck_id) {
-    std::lock_guard<std::mutex> lock(sync_mutex_);
-    sync_state_.enabled = true;
-    sync_state_.master_deck_id = master_deck_id;
-    sync_state_.slave_deck_id = slave_deck_id;
+    if (slave_deck_id < 0 || slave_deck_id >= MAX_DECKS || master_deck_id < 0 ||
+        master_deck_id >= MAX_DECKS || slave_deck_id == master_deck_id) return;
+    master_of_[slave_deck_id] = master_deck_id;
+    lock_[slave_deck_id] = Lock();
 }
 
 void SyncManager::disable(int deck_id) {
-    std::lock_guard<std::mutex> lock(sync_mutex_);
-    if (sync_state_.slave_deck_id == deck_id) {
-        sync_state_.enabled = false;
-        sync_state_.master_deck_id = -1;
-        sync_state_.slave_deck_id = -1;
-    }
+    if (deck_id < 0 || deck_id >= MAX_DECKS) return;
+    master_of_[deck_id] = -1;
+    lock_[deck_id] = Lock();
 }
 
 void SyncManager::alignNow(Deck* slave, Deck* master) {
-    FILE* logFile = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-    
-    if (!slave || !master) {
-        if (logFile) { fprintf(logFile, "alignNow: null deck\n"); fclose(logFile); }
-        return;
-    }
+    // Runs on the render thread (SyncAlignNow command) - no file logging here
+    if (!slave || !master) return;
     
     double master_bpm = master->getBPM();
     double slave_bpm = slave->getBPM();
     
-    if (master_bpm <= 0.0 || slave_bpm <= 0.0) {
-        if (logFile) { fprintf(logFile, "alignNow: Invalid BPM m=%.1f s=%.1f\n", master_bpm, slave_bpm); fclose(logFile); }
-        return;
-    }
+    if (master_bpm <= 0.0 || slave_bpm <= 0.0) return;
     
     // Match tempo
     double tempo_ratio = master_bpm / slave_bpm;
@@ -52,55 +72,87 @@ void SyncManager::alignNow(Deck* slave, Deck* master) {
     // Simple: set slave to same position as master (for same song testing)
     int64_t master_pos = master->getSamplePosition();
     
-    if (logFile) {
-        fprintf(logFile, "alignNow: master_pos=%lld, setting slave with forceSync=true\n", (long long)master_pos);
-        fflush(logFile);
-    }
-    
-    // Use forceSync=true to clear SoundTouch buffer!
-    slave->setSamplePosition(master_pos, true);
-    
-    if (logFile) {
-        fprintf(logFile, "alignNow: Done, slave now at %lld\n", (long long)slave->getSamplePosition());
-        fclose(logFile);
-    }
+    // Restarts the stretcher there, with pre-roll
+    slave->setSamplePosition(master_pos);
 }
 
-void SyncManager::update(Deck* decks[2]) {
-    std::lock_guard<std::mutex> lock(sync_mutex_);
-    
-    if (!sync_state_.enabled) return;
-    
-    int master_id = sync_state_.master_deck_id;
-    int slave_id = sync_state_.slave_deck_id;
-    
-    if (master_id < 0 || master_id > 1 || slave_id < 0 || slave_id > 1) return;
-    
-    Deck* master = decks[master_id];
-    Deck* slave = decks[slave_id];
-    
-    if (!master || !slave) return;
-    if (!master->isPlaying() || !slave->isPlaying()) return;
-    
-    double master_bpm = master->getBPM();
-    double slave_bpm = slave->getBPM();
-    
-    if (master_bpm <= 0.0 || slave_bpm <= 0.0) return;
-    
-    // SIMPLE TEMPO MATCH ONLY - no phase correction
-    // This tests if BPM detection and tempo adjustment work correctly
-    double tempo_ratio = master_bpm / slave_bpm;
-    slave->setTempo(tempo_ratio);
-    
-    // Log occasionally to verify values
-    static int log_counter = 0;
-    if (++log_counter >= 500) {
-        log_counter = 0;
-        FILE* logFile = fopen("c:\\Apps\\DJApp\\cpp_debug.log", "a");
-        if (logFile) {
-            fprintf(logFile, "TEMPO MATCH: master=%.1f BPM, slave=%.1f BPM, ratio=%.3f (%.1f%%)\n",
-                    master_bpm, slave_bpm, tempo_ratio, tempo_ratio * 100);
-            fclose(logFile);
+int64_t SyncManager::cueSynced(Deck* slave, Deck* master, int sample_rate) {
+    // Runs on the render thread (DeckPlaySynced command)
+    double master_bpm = currentBPM(master);
+    double slave_bpm = currentBPM(slave);
+    if (master_bpm <= 0 || slave_bpm <= 0) return -1;
+    
+    // Match tempo; the phase lock takes it from there if sync is on
+    slave->setTempo(master_bpm / slave_bpm);
+    
+    // A DJ cues the incoming track at its first kick and lets go on the
+    // master's kick. The kick is the analyzed grid's first beat where there
+    // is one, else the beat offset.
+    double first_kick = slave->getBeatTime(0.0);
+    return static_cast<int64_t>(std::max(0.0, first_kick) * sample_rate);
+}
+
+void SyncManager::update(Deck* const* decks, int count, double block_seconds) {
+    for (int slave_id = 0; slave_id < count && slave_id < MAX_DECKS; slave_id++) {
+        Lock& lock = lock_[slave_id];
+        int master_id = master_of_[slave_id];
+        Deck* slave = decks[slave_id];
+        if (!slave) continue;
+        
+        // Only a running lock holds the slave on the stretcher
+        slave->holdStretch(false);
+        if (master_id < 0 || master_id >= count) continue;
+        
+        Deck* master = decks[master_id];
+        
+        if (!master || !master->isPlaying() || !slave->isPlaying()) {
+            lock.active = false;
+            continue;
+        }
+        
+        double master_bpm = currentBPM(master);
+        double slave_bpm = currentBPM(slave);
+        
+        if (master_bpm <= 0.0 || slave_bpm <= 0.0) continue;
+        slave->holdStretch(true);
+        
+        // Phase error in beats, wrapped to the nearest beat: positive when
+        // the slave is ahead
+        double measured = slave->getBeatNumber() - master->getBeatNumber();
+        measured -= std::round(measured);
+        
+        // A fresh lock (either deck just started, or was cued) starts
+        // without history
+        if (!lock.active) {
+            lock.active = true;
+            lock.integral = 0.0;
+            lock.error = measured;
+        }
+        
+        // Filtered along the shortest way round, so it never jumps a beat
+        double delta = measured - lock.error;
+        delta -= std::round(delta);
+        lock.error += delta * (1.0 - std::exp(-block_seconds / SYNC_ERROR_SMOOTHING_SECONDS));
+        lock.error -= std::round(lock.error);
+        double error = lock.error;
+        
+        // Anti-windup: nothing is integrated while the nudge is pinned at
+        // its limit by an error the integral would only push further
+        double demand = SYNC_PHASE_GAIN * error + SYNC_INTEGRAL_GAIN * lock.integral;
+        if (std::abs(demand) < SYNC_MAX_NUDGE || (demand > 0.0) != (error > 0.0)) {
+            lock.integral += error * block_seconds;
+        }
+        double nudge = std::max(-SYNC_MAX_NUDGE, std::min(-demand, SYNC_MAX_NUDGE));
+        
+        double tempo_ratio = master_bpm / slave_bpm * (1.0 + nudge);
+        if (std::abs(tempo_ratio - slave->getTempo()) >= SYNC_RETUNE_THRESHOLD) {
+            slave->setTempo(tempo_ratio);
+        }
+        
+        if (++log_counter_ >= 500) {
+            log_counter_ = 0;
+            DJ_LOG_DEBUG("Sync: deck %d -> %d, master=%.2f BPM, slave=%.2f BPM, phase error=%+.3f beats, tempo=%.4f",
+                         slave_id, master_id, master_bpm, slave_bpm, error, slave->getTempo());
         }
     }
 }
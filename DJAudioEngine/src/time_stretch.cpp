@@ -0,0 +1,104 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace dj {
+
+// Source frames a vinyl stretcher holds back while its output is full,
+// and output frames it can hold: a 4096-frame feed at the slowest tempo
+// (0.5) with room to spare
+static const int VINYL_INPUT_FRAMES = 8192;
+static const int VINYL_OUTPUT_FRAMES = 32768;
+
+namespace {
+
+// Varispeed: resamples the track by the tempo, so pitch moves with it the
+// way it does on a turntable. Much cheaper than SoundTouch and free of its
+// phasing, at the cost of key lock.
+class VinylStretcher : public TimeStretcher {
+public:
+    explicit VinylStretcher(int sample_rate)
+        : input_(VINYL_INPUT_FRAMES * 2)
+        , output_(VINYL_OUTPUT_FRAMES * 2)
+        , input_frames_(0)
+        , output_frames_(0)
+    {
+        resampler_.open(sample_rate, sample_rate, true);
+    }
+    
+    void setTempo(double tempo) override { resampler_.setRatio(1.0 / tempo); }
+    void setPitchSemitones(double) override {}
+    bool canShiftPitch() const override { return false; }
+    
+    void clear() override {
+        resampler_.reset();
+        input_frames_ = 0;
+        output_frames_ = 0;
+    }
+    
+    void putSamples(const float* input, int frames) override {
+        frames = std::min(frames, VINYL_INPUT_FRAMES - input_frames_);
+        memcpy(input_.data() + input_frames_ * 2, input, sizeof(float) * 2 * frames);
+        input_frames_ += frames;
+        convert();
+    }
+    
+    int receiveSamples(float* output, int frames) override {
+        int count = std::min(frames, output_frames_);
+        if (output) memcpy(output, output_.data(), sizeof(float) * 2 * count);
+        output_frames_ -= count;
+        memmove(output_.data(), output_.data() + count * 2, sizeof(float) * 2 * output_frames_);
+        convert();
+        return count;
+    }
+    
+    int numSamples() const override { return output_frames_; }
+    
+private:
+    // Converts whatever input the output has room for
+    void convert() {
+        if (input_frames_ == 0 || !resampler_.isActive()) return;
+        
+        int64_t used = 0;
+        int64_t written = resampler_.process(input_.data(), input_frames_,
+                                             output_.data() + output_frames_ * 2,
+                                             VINYL_OUTPUT_FRAMES - output_frames_, false, &used);
+        output_frames_ += static_cast<int>(written);
+        input_frames_ -= static_cast<int>(used);
+        memmove(input_.data(), input_.data() + used * 2, sizeof(float) * 2 * input_frames_);
+    }
+    
+    Resampler resampler_;
+    std::vector<float> input_;   // Stereo interleaved, unconverted
+    std::vector<float> output_;  // Stereo interleaved, ready
+    int input_frames_;
+    int output_frames_;
+};
+
+std::unique_ptr<TimeStretcher> createVinylStretcher(int sample_rate) {
+    return std::make_unique<VinylStretcher>(sample_rate);
+}
+
+// Set before engine_init; decks are only created there
+TimeStretcherFactory g_custom_factory = nullptr;
+
+} // namespace
+
+void registerTimeStretcher(TimeStretcherFactory factory) {
+    g_custom_factory = factory;
+}
+
+std::unique_ptr<TimeStretcher> createTimeStretcher(StretchMode mode, int sample_rate) {
+    switch (mode) {
+    case StretchMode::Vinyl:
+        return createVinylStretcher(sample_rate);
+    case StretchMode::SoundTouch:
+        return createSoundTouchStretcher(sample_rate);
+    case StretchMode::Custom:
+        return g_custom_factory ? g_custom_factory(sample_rate) : nullptr;
+    }
+    return nullptr;
+}
+
+} // namespace dj
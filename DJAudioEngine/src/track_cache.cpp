@@ -0,0 +1,115 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace dj {
+
+// What the file on disk is now, to tell a cached decode from a stale one
+static bool sourceStamp(const std::string& path, uint64_t* size, int64_t* mtime) {
+    std::error_code ec;
+    *size = fs::file_size(path, ec);
+    if (ec) return false;
+    *mtime = static_cast<int64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+    return !ec;
+}
+
+TrackCache::TrackCache(uint64_t max_bytes)
+    : max_bytes_(max_bytes)
+    , bytes_(0)
+    , use_clock_(0)
+{
+}
+
+void TrackCache::setBudget(uint64_t max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_bytes_ = max_bytes;
+    evictLocked();
+}
+
+uint64_t TrackCache::getBudget() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_bytes_;
+}
+
+uint64_t TrackCache::getBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_;
+}
+
+const TrackCache::Entry* TrackCache::findLocked(const std::string& path, const LoadOptions& options) const {
+    auto it = entries_.find(path);
+    if (it == entries_.end()) return nullptr;
+
+    const Entry& entry = it->second;
+    if (entry.format != options.storage_format || entry.target_rate != options.target_sample_rate) return nullptr;
+
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    if (!sourceStamp(path, &size, &mtime) || size != entry.file_size || mtime != entry.file_mtime) return nullptr;
+    return &entry;
+}
+
+std::shared_ptr<AudioFile> TrackCache::find(const char* filepath, const LoadOptions& options) {
+    if (!filepath) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Entry* entry = findLocked(filepath, options);
+    if (!entry) return nullptr;
+
+    Entry& hit = entries_.find(filepath)->second;
+    hit.last_used = ++use_clock_;
+    DJ_LOG_DEBUG("Track cache hit: %s", filepath);
+    return hit.track;
+}
+
+bool TrackCache::contains(const char* filepath, const LoadOptions& options) const {
+    if (!filepath) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return findLocked(filepath, options) != nullptr;
+}
+
+void TrackCache::insert(const char* filepath, const LoadOptions& options, std::shared_ptr<AudioFile> track) {
+    if (!filepath || !track || track->isStreaming() || !track->isFullyDecoded()) return;
+
+    Entry entry;
+    entry.format = options.storage_format;
+    entry.target_rate = options.target_sample_rate;
+    if (!sourceStamp(filepath, &entry.file_size, &entry.file_mtime)) return;
+    entry.bytes = track->getMemoryBytes();
+    entry.track = std::move(track);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (max_bytes_ == 0) return;
+
+    // Replaces a stale decode of the same file
+    auto it = entries_.find(filepath);
+    if (it != entries_.end()) {
+        bytes_ -= it->second.bytes;
+        entries_.erase(it);
+    }
+
+    entry.last_used = ++use_clock_;
+    bytes_ += entry.bytes;
+    entries_.emplace(filepath, std::move(entry));
+    evictLocked();
+}
+
+void TrackCache::evictLocked() {
+    // A handful of tracks at most, so a scan for the oldest will do
+    while (bytes_ > max_bytes_ && !entries_.empty()) {
+        auto oldest = std::min_element(entries_.begin(), entries_.end(),
+                                       [](const std::pair<const std::string, Entry>& a,
+                                          const std::pair<const std::string, Entry>& b) {
+                                           return a.second.last_used < b.second.last_used;
+                                       });
+        DJ_LOG_DEBUG("Track cache evicting %s", oldest->first.c_str());
+        bytes_ -= oldest->second.bytes;
+        entries_.erase(oldest);
+    }
+}
+
+} // namespace dj
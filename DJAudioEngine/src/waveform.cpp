@@ -0,0 +1,154 @@
+#include "dj_audio_internal.h"
+#include <algorithm>
+#include <cmath>
+
+namespace dj {
+
+// Frames built together in one pass. A multiple of the coarsest bin, so
+// every bin of every level falls inside one region, and of the decode
+// chunk, so a progressive decode completes one region per chunk.
+static const int64_t WAVEFORM_REGION_FRAMES = 65536;
+
+// Frames a region runs the band filters over before its first bin, so
+// regions built in parallel match a serial pass
+static const int64_t WAVEFORM_FILTER_WARMUP_FRAMES = 1024;
+
+// Band split frequencies
+static const double WAVEFORM_LOW_SPLIT_HZ = 250.0;
+static const double WAVEFORM_HIGH_SPLIT_HZ = 2500.0;
+
+// Running sums of one finest-level bin, merged for the coarser levels
+struct BinSums {
+    float min = 0.0f;
+    float max = 0.0f;
+    double squares = 0.0;  // Over both channels
+    double low = 0.0;      // Band squares, mono
+    double mid = 0.0;
+    double high = 0.0;
+    int64_t frames = 0;
+};
+
+static float onePoleCoeff(double hz, int sample_rate) {
+    return static_cast<float>(1.0 - std::exp(-2.0 * 3.14159265358979323846 * hz / sample_rate));
+}
+
+static int8_t quantizeSigned(float value) {
+    return static_cast<int8_t>(std::lround(std::max(-1.0f, std::min(1.0f, value)) * 127.0f));
+}
+
+static uint8_t quantizeRMS(double squares, double count) {
+    double rms = count > 0.0 ? std::sqrt(squares / count) : 0.0;
+    return static_cast<uint8_t>(std::lround(std::min(1.0, rms) * 255.0));
+}
+
+WaveformPyramid::WaveformPyramid(int sample_rate, int64_t total_frames)
+    : total_frames_(std::max<int64_t>(0, total_frames))
+    , built_regions_(0)
+    , low_coeff_(onePoleCoeff(WAVEFORM_LOW_SPLIT_HZ, sample_rate))
+    , high_coeff_(onePoleCoeff(WAVEFORM_HIGH_SPLIT_HZ, sample_rate))
+{
+    for (int level = 0; level < LEVEL_COUNT; level++) {
+        int64_t frames = getFramesPerBin(level);
+        levels_[level].assign(static_cast<size_t>((total_frames_ + frames - 1) / frames), WaveformBin());
+        ready_[level].store(0, std::memory_order_relaxed);
+    }
+}
+
+void WaveformPyramid::update(const AudioFile& track, int64_t available, bool final) {
+    int64_t end = std::min(available, total_frames_);
+    int64_t regions = final ? (end + WAVEFORM_REGION_FRAMES - 1) / WAVEFORM_REGION_FRAMES
+                            : end / WAVEFORM_REGION_FRAMES;
+    if (regions <= built_regions_) return;
+
+    int64_t first = built_regions_;
+    parallelFor(static_cast<int>(regions - first), [&](int index) {
+        buildRegion(track, first + index, end);
+    });
+    built_regions_ = regions;
+
+    // Publish once every new bin is written, so readers never see a gap
+    int64_t covered = std::min(end, regions * WAVEFORM_REGION_FRAMES);
+    for (int level = 0; level < LEVEL_COUNT; level++) {
+        int64_t frames = getFramesPerBin(level);
+        ready_[level].store((covered + frames - 1) / frames, std::memory_order_release);
+    }
+}
+
+void WaveformPyramid::buildRegion(const AudioFile& track, int64_t region, int64_t end) {
+    int64_t start = region * WAVEFORM_REGION_FRAMES;
+    int64_t stop = std::min(end, start + WAVEFORM_REGION_FRAMES);
+    int64_t warmup = std::min(start, WAVEFORM_FILTER_WARMUP_FRAMES);
+
+    std::vector<float> stereo(static_cast<size_t>(warmup + WAVEFORM_REGION_FRAMES) * 2);
+    int64_t got = track.copyFrames(start - warmup, stereo.data(), warmup + (stop - start));
+    int64_t frames = std::max<int64_t>(0, got - warmup);
+
+    // Lows below the first split, highs above the second, mids between
+    float low_state = 0.0f;
+    float split_state = 0.0f;
+    for (int64_t i = 0; i < std::min(warmup, got); i++) {
+        float mono = 0.5f * (stereo[i * 2] + stereo[i * 2 + 1]);
+        low_state += low_coeff_ * (mono - low_state);
+        split_state += high_coeff_ * (mono - split_state);
+    }
+
+    const int64_t base_frames = getFramesPerBin(0);
+    std::vector<BinSums> sums(static_cast<size_t>((frames + base_frames - 1) / base_frames));
+    const float* samples = stereo.data() + warmup * 2;
+    for (int64_t i = 0; i < frames; i++) {
+        BinSums& bin = sums[static_cast<size_t>(i / base_frames)];
+        float left = samples[i * 2];
+        float right = samples[i * 2 + 1];
+        float mono = 0.5f * (left + right);
+        low_state += low_coeff_ * (mono - low_state);
+        split_state += high_coeff_ * (mono - split_state);
+        float high = mono - split_state;
+        float mid = split_state - low_state;
+
+        if (bin.frames == 0) {
+            bin.min = std::min(left, right);
+            bin.max = std::max(left, right);
+        } else {
+            bin.min = std::min(bin.min, std::min(left, right));
+            bin.max = std::max(bin.max, std::max(left, right));
+        }
+        bin.squares += static_cast<double>(left) * left + static_cast<double>(right) * right;
+        bin.low += static_cast<double>(low_state) * low_state;
+        bin.mid += static_cast<double>(mid) * mid;
+        bin.high += static_cast<double>(high) * high;
+        bin.frames++;
+    }
+
+    // Coarser bins merge the sums rather than the quantized finer bins
+    for (int level = 0; level < LEVEL_COUNT; level++) {
+        int64_t group = getFramesPerBin(level) / base_frames;
+        int64_t offset = start / getFramesPerBin(level);
+        std::vector<WaveformBin>& bins = levels_[level];
+
+        for (size_t first = 0; first < sums.size(); first += static_cast<size_t>(group)) {
+            BinSums merged = sums[first];
+            size_t last = std::min(sums.size(), first + static_cast<size_t>(group));
+            for (size_t i = first + 1; i < last; i++) {
+                merged.min = std::min(merged.min, sums[i].min);
+                merged.max = std::max(merged.max, sums[i].max);
+                merged.squares += sums[i].squares;
+                merged.low += sums[i].low;
+                merged.mid += sums[i].mid;
+                merged.high += sums[i].high;
+                merged.frames += sums[i].frames;
+            }
+
+            size_t index = static_cast<size_t>(offset) + first / static_cast<size_t>(group);
+            if (index >= bins.size()) break;
+            WaveformBin& out = bins[index];
+            out.min = quantizeSigned(merged.min);
+            out.max = quantizeSigned(merged.max);
+            out.rms = quantizeRMS(merged.squares, 2.0 * merged.frames);
+            out.low = quantizeRMS(merged.low, static_cast<double>(merged.frames));
+            out.mid = quantizeRMS(merged.mid, static_cast<double>(merged.frames));
+            out.high = quantizeRMS(merged.high, static_cast<double>(merged.frames));
+        }
+    }
+}
+
+} // namespace dj